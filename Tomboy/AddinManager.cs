@@ -29,6 +29,22 @@ namespace Tomboy
 		/// </summary>
 		Dictionary<string, List<NoteAddinInfo>> note_addin_infos;
 
+		/// <summary>
+		/// Enabled NoteAddin types, shared by all notes.
+		/// Key = TypeExtensionNode.Id
+		/// </summary>
+		Dictionary<string, NoteAddinType> note_addin_types;
+
+		/// <summary>
+		/// Notes that have had their lazy NoteAddins created
+		/// </summary>
+		Dictionary<Note, bool> materialized_notes;
+
+		/// <summary>
+		/// NoteManagers whose NoteDeleted event we're connected to
+		/// </summary>
+		List<NoteManager> watched_managers;
+
 		public event System.EventHandler ApplicationAddinListChanged;
 
 		public AddinManager (string tomboy_conf_dir) : this (tomboy_conf_dir, null)
@@ -41,6 +57,9 @@ namespace Tomboy
 			app_addins = new Dictionary<string, ApplicationAddin> ();
 			note_addins = new Dictionary<Note, List<NoteAddinInfo>> ();
 			note_addin_infos = new Dictionary<string, List<NoteAddinInfo>> ();
+			note_addin_types = new Dictionary<string, NoteAddinType> ();
+			materialized_notes = new Dictionary<Note, bool> ();
+			watched_managers = new List<NoteManager> ();
 
 			InitializeMonoAddins (old_tomboy_conf_dir);
 		}
@@ -183,24 +202,22 @@ namespace Tomboy
 
 		void OnNoteAddinEnabled (Mono.Addins.ExtensionNodeEventArgs args)
 		{
+			Mono.Addins.TypeExtensionNode type_node =
+			        args.ExtensionNode as Mono.Addins.TypeExtensionNode;
+			NoteAddinType addin_type = RegisterNoteAddinType (type_node);
+			if (addin_type == null)
+				return;
+
 			// Load NoteAddins
 			if (Tomboy.DefaultNoteManager == null) {
 				return; // too early -- YUCK!  Bad hack
 			}
 
+			// Only notes that already have their addins need the new one
+			// right away; the rest will pick it up when they're opened.
 			foreach (Note note in Tomboy.DefaultNoteManager.Notes) {
-				// Create a new NoteAddin
-				Mono.Addins.TypeExtensionNode type_node =
-				        args.ExtensionNode as Mono.Addins.TypeExtensionNode;
-
-				try {
-					NoteAddin n_addin = type_node.CreateInstance () as NoteAddin;
-
-					// Keep track of the addins added to each note
-					AttachAddin (type_node.Id, note, n_addin);
-				} catch (Exception e) {
-					Logger.Debug ("Couldn't create a NoteAddin instance: {0}", e.Message);
-				}
+				if (addin_type.IsEager || materialized_notes.ContainsKey (note))
+					CreateAndAttachAddin (addin_type, note);
 			}
 		}
 
@@ -209,6 +226,8 @@ namespace Tomboy
 			Mono.Addins.TypeExtensionNode type_node =
 			        args.ExtensionNode as Mono.Addins.TypeExtensionNode;
 
+			note_addin_types.Remove (type_node.Id);
+
 			try {
 				OnDisabledAddin (type_node.Id);
 			} catch (Exception e) {
@@ -216,25 +235,129 @@ namespace Tomboy
 			}
 		}
 
+		NoteAddinType RegisterNoteAddinType (Mono.Addins.TypeExtensionNode type_node)
+		{
+			if (type_node == null)
+				return null;
+
+			NoteAddinType addin_type;
+			if (note_addin_types.TryGetValue (type_node.Id, out addin_type))
+				return addin_type;
+
+			bool eager = false;
+			try {
+				eager = type_node.Type.IsDefined (typeof (EagerNoteAddinAttribute), true);
+			} catch (Exception e) {
+				Logger.Warn ("Couldn't load NoteAddin type {0}: {1}",
+				             type_node.Id, e.Message);
+			}
+
+			addin_type = new NoteAddinType (type_node, eager);
+			note_addin_types [type_node.Id] = addin_type;
+			return addin_type;
+		}
+
+		void CreateAndAttachAddin (NoteAddinType addin_type, Note note)
+		{
+			try {
+				NoteAddin n_addin = addin_type.Node.CreateInstance () as NoteAddin;
+
+				// Keep track of the addins added to each note
+				AttachAddin (addin_type.Node.Id, note, n_addin);
+			} catch (Exception e) {
+				Logger.Warn ("Couldn't create a NoteAddin instance: {0}", e.Message);
+			}
+		}
+
+		/// <summary>
+		/// Attach the NoteAddins that have asked to be attached eagerly
+		/// (see EagerNoteAddinAttribute).  All other addins are created
+		/// by EnsureAddinsForNote the first time the note's buffer or
+		/// window is created.
+		/// </summary>
 		public void LoadAddinsForNote (Note note)
 		{
-			Mono.Addins.ExtensionNodeList list = Mono.Addins.AddinManager.GetExtensionNodes ("/Tomboy/NoteAddins");
-			foreach (Mono.Addins.ExtensionNode node in list) {
-				Mono.Addins.TypeExtensionNode type_node =
-				        node as Mono.Addins.TypeExtensionNode;
+			foreach (NoteAddinType addin_type in note_addin_types.Values) {
+				if (addin_type.IsEager)
+					CreateAndAttachAddin (addin_type, note);
+			}
 
-				try {
-					NoteAddin n_addin = type_node.CreateInstance () as NoteAddin;
+			// Make sure we remove addins when a note is deleted
+			if (!watched_managers.Contains (note.Manager)) {
+				note.Manager.NoteDeleted += OnNoteDeleted;
+				watched_managers.Add (note.Manager);
+			}
+		}
+
+		/// <summary>
+		/// Create the remaining (non-eager) NoteAddins for a note.  Called
+		/// by Note right before its buffer or window is created.  Does
+		/// nothing if the addins have already been created.
+		/// </summary>
+		public void EnsureAddinsForNote (Note note)
+		{
+			if (materialized_notes.ContainsKey (note))
+				return;
+
+			// Mark first: addins may touch note.Buffer while initializing
+			materialized_notes [note] = true;
 
-					// Keep track of the addins added to each note
-					AttachAddin (type_node.Id, note, n_addin);
+			// Iterate a copy, an addin may enable/disable others
+			List<NoteAddinType> addin_types =
+			        new List<NoteAddinType> (note_addin_types.Values);
+			foreach (NoteAddinType addin_type in addin_types) {
+				if (!addin_type.IsEager)
+					CreateAndAttachAddin (addin_type, note);
+			}
+		}
+
+		/// <summary>
+		/// Shut down and drop the lazily created NoteAddins of a note whose
+		/// buffer is being released.  Eager addins stay attached.  The next
+		/// EnsureAddinsForNote call recreates the others.
+		/// </summary>
+		public void ReleaseAddinsForNote (Note note)
+		{
+			materialized_notes.Remove (note);
+
+			List<NoteAddinInfo> note_addin_list;
+			if (!note_addins.TryGetValue (note, out note_addin_list))
+				return;
+
+			foreach (NoteAddinInfo info in new List<NoteAddinInfo> (note_addin_list)) {
+				NoteAddinType addin_type;
+				if (note_addin_types.TryGetValue (info.ExtensionNodeId, out addin_type) &&
+				    addin_type.IsEager)
+					continue;
+
+				try {
+					info.Addin.Shutdown ();
 				} catch (Exception e) {
-					Logger.Warn ("Couldn't create a NoteAddin instance: {0}", e.Message);
+					Logger.Warn ("Error shutting down addin: {0} - {1}",
+					             info.Addin.GetType ().ToString (), e.Message);
+				}
+
+				try {
+					info.Addin.Dispose ();
+				} catch (Exception e1) {
+					Logger.Warn ("Error disposing addin: {0} - {1}",
+					             info.Addin.GetType ().ToString (), e1.Message);
 				}
+
+				note_addin_list.Remove (info);
+				if (note_addin_infos.ContainsKey (info.ExtensionNodeId))
+					note_addin_infos [info.ExtensionNodeId].Remove (info);
 			}
+		}
 
-			// Make sure we remove addins when a note is deleted
-			note.Manager.NoteDeleted += OnNoteDeleted;
+		/// <summary>
+		/// Number of notes that currently have all their addins created.
+		/// </summary>
+		public int MaterializedNoteCount
+		{
+			get {
+				return materialized_notes.Count;
+			}
 		}
 
 		/// <summary>
@@ -350,6 +473,8 @@ namespace Tomboy
 		/// </summary>
 		void OnNoteDeleted (object sender, Note deleted)
 		{
+			materialized_notes.Remove (deleted);
+
 			if (note_addins.ContainsKey (deleted) == false)
 				return;
 
@@ -403,10 +528,10 @@ namespace Tomboy
 
 			Logger.Debug ("OnDisabledAddin: {0}", ext_node_id);
 
-			// Remove and shut down all the addins
+			// Remove and shut down all the addins.  With lazy attachment
+			// it's fine for no note to have an instance yet.
 			if (note_addin_infos.ContainsKey (ext_node_id) == false)
-				throw new ArgumentException (
-				        "Cannot call OnDisabledAddin with an invalid Mono.Addins.ExtensionNode.Id");
+				return;
 
 			List<NoteAddinInfo> addin_info_list = note_addin_infos [ext_node_id];
 			foreach (NoteAddinInfo info in addin_info_list) {
@@ -577,6 +702,32 @@ public AddinReference (object addin, string description) :
 		}
 	}
 
+	class NoteAddinType
+	{
+		readonly Mono.Addins.TypeExtensionNode node;
+		readonly bool eager;
+
+		public NoteAddinType (Mono.Addins.TypeExtensionNode node, bool eager)
+		{
+			this.node = node;
+			this.eager = eager;
+		}
+
+		public Mono.Addins.TypeExtensionNode Node
+		{
+			get {
+				return node;
+			}
+		}
+
+		public bool IsEager
+		{
+			get {
+				return eager;
+			}
+		}
+	}
+
 	class NoteAddinInfo
 	{
 		readonly string extension_node_id;
@@ -1,9 +1,6 @@
 using System;
+using System.Collections.Generic;
 using System.IO;
-using System.Reflection;
-using System.Xml;
-using System.Xml.XPath;
-using System.Xml.Xsl;
 using Tomboy;
 using Mono.Unix;
 
@@ -14,42 +11,8 @@ namespace Tomboy.ExportToHtml
 	/// </summary>
 	public class ExportToHtmlApplicationAddin : ExportAllApplicationAddin
 	{
-
-		const string stylesheet_name = "ExportToHtml.xsl";
-		static XslTransform xsl;
-
 		Gtk.ImageMenuItem item;
 
-		static XslTransform NoteXsl
-		{
-			get {
-				if (xsl == null) {
-					Assembly asm = Assembly.GetExecutingAssembly ();
-					string asm_dir = System.IO.Path.GetDirectoryName (asm.Location);
-					string stylesheet_file = Path.Combine (asm_dir, stylesheet_name);
-
-					xsl = new XslTransform ();
-
-					if (File.Exists (stylesheet_file)) {
-						Logger.Info ("ExportToHTML: Using user-custom {0} file.",
-						            stylesheet_name);
-						xsl.Load (stylesheet_file);
-					} else {
-						Stream resource = asm.GetManifestResourceStream (stylesheet_name);
-						if (resource != null) {
-							XmlTextReader reader = new XmlTextReader (resource);
-							xsl.Load (reader, null, null);
-							resource.Close ();
-						} else {
-							Logger.Error ("Unable to find HTML export template '{0}'.",
-							            stylesheet_name);
-						}
-					}
-				}
-				return xsl;
-			}
-		}
-
 		/// <summary>
 		/// Sets the names of the export type.
 		/// </summary>
@@ -59,82 +22,90 @@ namespace Tomboy.ExportToHtml
 			export_type_pretty_name = Catalog.GetString ("HTML");
 		}
 
+		// index is null for a job exported on the GTK thread
+		HtmlExportJob MakeJob (Note note, string output_folder, ExportIndex index)
+		{
+			string output_path = output_folder + SanitizeNoteTitle (note.Title)
+				+ "." + export_file_suffix;
+			return new HtmlExportJob (note.Data.Clone (), output_path,
+			                          new ExportAllTransformExtension (note.Title, this, index));
+		}
+
+		/// <summary>
+		/// Jobs for HtmlExporter, for each note with the folder paired
+		/// with it.  Their links are resolved with an index of where
+		/// every note goes, made now, so they can be exported on any
+		/// thread.  Call on the GTK thread.
+		/// </summary>
+		public List<HtmlExportJob> MakeJobs (List<KeyValuePair<Note, string>> exports)
+		{
+			ExportIndex index = MakeExportIndex ();
+			List<HtmlExportJob> jobs = new List<HtmlExportJob> (exports.Count);
+			foreach (KeyValuePair<Note, string> export in exports)
+				jobs.Add (MakeJob (export.Key, export.Value, index));
+			return jobs;
+		}
+
 		/// <summary>
 		/// Exports a single Note to HTML in a specified location.
 		/// </summary>
 		public override void ExportSingleNote (Note note,
 		                                string output_folder)
 		{
-			string output_path = output_folder + SanitizeNoteTitle (note.Title)
-				+ "." + export_file_suffix;
-
-			Logger.Debug ("Exporting Note '{0}' to '{1}'...", note.Title, output_path);
-
-			StreamWriter writer = null;
-
-			try {
-				// FIXME: Warn about file existing.  Allow overwrite.
-				File.Delete (output_path);
-			} catch {
-			}
-
-			writer = new StreamWriter (output_path);
-
-			WriteHTMLForNote (writer, note);
-
-			if (writer != null)
-				writer.Close ();
+			new HtmlExporter (true).Export (MakeJob (note, output_folder, null));
+		}
 
-			return;
+		/// <summary>
+		/// Exports the notes on worker threads while the GTK main loop
+		/// runs, showing progress in an ExportProgressDialog.
+		/// </summary>
+		protected override void ExportNotes (List<KeyValuePair<Note, string>> exports,
+		                                     ExportFinishedHandler finished)
+		{
+			List<HtmlExportJob> jobs = MakeJobs (exports);
+
+			ExportProgressDialog dialog = new ExportProgressDialog (export_type_pretty_name);
+			dialog.SetProgress (0, jobs.Count);
+			dialog.Show ();
+
+			new HtmlExporter (true).BeginExport (jobs, dialog.SetProgress, delegate (Exception error) {
+				dialog.Destroy ();
+				if (error == null)
+					Logger.Info ("Exported {0} notes to HTML", jobs.Count);
+				finished (error);
+			});
 		}
 
 		public void WriteHTMLForNote (TextWriter writer,
 		                              Note note)
 		{
-			// NOTE: Don't use the XmlDocument version, which strips
-			// whitespace between elements for some reason.  Also,
-			// XPathDocument is faster.
-			StringWriter s_writer = new StringWriter ();
-			NoteArchiver.Write (s_writer, note.Data);
-			StringReader reader = new StringReader (s_writer.ToString ());
-			s_writer.Close ();
-			XPathDocument doc = new XPathDocument (reader);
-			reader.Close ();
-
-			XsltArgumentList args = new XsltArgumentList ();
-			args.AddParam ("exporting-multiple", "", true);
-			args.AddParam ("export-linked", "", false);
-			args.AddParam ("export-linked-all", "", false);
-			args.AddParam ("root-note", "", note.Title);
-			args.AddExtensionObject ("http://beatniksoftware.com/tomboy",
-				new ExportAllTransformExtension (note, this));
-
-			if ((bool) Preferences.Get (Preferences.ENABLE_CUSTOM_FONT)) {
-				string font_face = (string) Preferences.Get (Preferences.CUSTOM_FONT_FACE);
-				Pango.FontDescription font_desc =
-				        Pango.FontDescription.FromString (font_face);
-				string font = String.Format ("font-family:'{0}';", font_desc.Family);
-
-				args.AddParam ("font", "", font);
-			}
-
-			NoteXsl.Transform (doc, args, writer);
+			new HtmlExporter (true).WriteHTMLForNote (writer, note.Data,
+				new ExportAllTransformExtension (note.Title, this));
 		}
 	}
 
-		/// <summary>
+	/// <summary>
 	/// Makes <see cref="System.String.ToLower"/> available in the
-	/// XSL stylesheet and resolves relative paths between notes.
+	/// XSL stylesheet and resolves relative paths between notes.  Called
+	/// from the export worker threads when it has an index.
 	/// </summary>
 	public class ExportAllTransformExtension
 	{
-		private Note note;
-		private ExportToHtmlApplicationAddin parent;
+		private string title;
+		private ExportAllApplicationAddin parent;
+		private ExportAllApplicationAddin.ExportIndex index;
+
+		public ExportAllTransformExtension (string title, ExportAllApplicationAddin parent)
+			: this (title, parent, null)
+		{
+		}
 
-		public ExportAllTransformExtension (Note note, ExportToHtmlApplicationAddin parent)
+		public ExportAllTransformExtension (string title, ExportAllApplicationAddin parent,
+		                                    ExportAllApplicationAddin.ExportIndex index)
 		{
-			this.note = note;
+			this.title = title;
 			this.parent = parent;
+			this.index = index;
 		}
 
 		public String ToLower (string s)
@@ -149,7 +120,9 @@ namespace Tomboy.ExportToHtml
 
 			//Get the the value from the exportAll superclass, changing from platform
 			//dependent to URL drectory seperators since we're making HTML.
-			string system_relative_path = parent.ResolveRelativePath (note, title_to);
+			string system_relative_path = index != null ?
+				parent.ResolveRelativePath (index, title, title_to) :
+				parent.ResolveRelativePath (title, title_to);
 			return system_relative_path.Replace (System.IO.Path.DirectorySeparatorChar, '/');
 		}
 	}
@@ -197,7 +197,7 @@ namespace Tomboy.ExportToHtml
 				args.AddParam ("font", "", font);
 			}
 
-			NoteXsl.Transform (doc, args, writer);
+			NoteXsl.Transform (doc, args, writer, new NoteStoreResolver (note.Manager.Store));
 		}
 	}
 
@@ -232,7 +232,37 @@ namespace Tomboy.ExportToHtml
 				return string.Empty;
 
 			resolved_notes.Add (title.ToLower());
-			return manager.Find (title).FilePath;
+			Note note = manager.Find (title);
+			if (note == null)
+				return string.Empty;
+			return note.FilePath;
+		}
+	}
+
+	/// <summary>
+	/// Reads the notes that TransformExtension.GetPath names through
+	/// the NoteStore, which may not keep a file per note, when the
+	/// stylesheet loads them with document ().
+	/// </summary>
+	public class NoteStoreResolver : XmlUrlResolver
+	{
+		NoteStore store;
+		string notes_dir;
+
+		public NoteStoreResolver (NoteStore store)
+		{
+			this.store = store;
+			this.notes_dir = Path.GetFullPath (store.NotesDirectory)
+				.TrimEnd (Path.DirectorySeparatorChar);
+		}
+
+		public override object GetEntity (Uri absoluteUri, string role, Type ofObjectToReturn)
+		{
+			if (absoluteUri.IsFile &&
+			    Path.GetExtension (absoluteUri.LocalPath) == ".note" &&
+			    Path.GetDirectoryName (absoluteUri.LocalPath) == notes_dir)
+				return new MemoryStream (store.ReadBytes (absoluteUri.LocalPath));
+			return base.GetEntity (absoluteUri, role, ofObjectToReturn);
 		}
 	}
 }
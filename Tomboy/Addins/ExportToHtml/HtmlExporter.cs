@@ -0,0 +1,327 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Reflection;
+using System.Threading;
+using System.Xml;
+using System.Xml.Xsl;
+using Tomboy;
+
+namespace Tomboy.ExportToHtml
+{
+	public delegate void ExportProgressHandler (int exported, int total);
+
+	/// <summary>
+	/// One note to export: everything needed to write its HTML file,
+	/// copied on the GTK thread so that it can be written on any other.
+	/// </summary>
+	public class HtmlExportJob
+	{
+		public HtmlExportJob (NoteData data, string output_path, object extension)
+		{
+			Data = data;
+			OutputPath = output_path;
+			Extension = extension;
+		}
+
+		/// <summary>
+		/// A copy of the note's data, which nothing else changes.
+		/// </summary>
+		public NoteData Data { get; private set; }
+
+		public string OutputPath { get; private set; }
+
+		/// <summary>
+		/// The object behind the tomboy: functions of the stylesheet.
+		/// </summary>
+		public object Extension { get; private set; }
+	}
+
+	/// <summary>
+	/// Exports notes to HTML files with ExportToHtml.xsl, for "export
+	/// all".  The stylesheet is compiled once per process and shared, and
+	/// the font is looked up once per exporter.  Each note's XSLT input
+	/// is built straight from its NoteData.  Export and BeginExport
+	/// spread the notes over one worker thread per processor.
+	///
+	/// The output is the same, byte for byte, as transforming the
+	/// note's complete XML with XslTransform.
+	/// </summary>
+	public class HtmlExporter
+	{
+		const string stylesheet_name = "ExportToHtml.xsl";
+		const string note_namespace = "http://beatniksoftware.com/tomboy";
+		const string xmlns_namespace = "http://www.w3.org/2000/xmlns/";
+		const string xml_namespace = "http://www.w3.org/XML/1998/namespace";
+
+		static XslCompiledTransform xsl;
+		static readonly object xsl_lock = new object ();
+
+		readonly bool exporting_multiple;
+		readonly string font;
+
+		/// <summary>
+		/// Call on the GTK thread, which reads the font preference.
+		/// </summary>
+		public HtmlExporter (bool exporting_multiple)
+			: this (exporting_multiple, GetFont ())
+		{
+		}
+
+		/// <summary>
+		/// An exporter with the given CSS font, or none if font is null.
+		/// </summary>
+		public HtmlExporter (bool exporting_multiple, string font)
+		{
+			this.exporting_multiple = exporting_multiple;
+			this.font = font;
+		}
+
+		/// <summary>
+		/// The compiled stylesheet.  Transforms with it may run on
+		/// several threads at once.
+		/// </summary>
+		public static XslCompiledTransform NoteXsl
+		{
+			get {
+				lock (xsl_lock) {
+					if (xsl == null)
+						xsl = LoadStylesheet ();
+					return xsl;
+				}
+			}
+		}
+
+		static XslCompiledTransform LoadStylesheet ()
+		{
+			Assembly asm = Assembly.GetExecutingAssembly ();
+			string asm_dir = System.IO.Path.GetDirectoryName (asm.Location);
+			string stylesheet_file = Path.Combine (asm_dir, stylesheet_name);
+
+			XslCompiledTransform transform = new XslCompiledTransform ();
+
+			if (File.Exists (stylesheet_file)) {
+				Logger.Info ("ExportToHTML: Using user-custom {0} file.",
+				            stylesheet_name);
+				transform.Load (stylesheet_file);
+			} else {
+				Stream resource = asm.GetManifestResourceStream (stylesheet_name);
+				if (resource != null) {
+					XmlTextReader reader = new XmlTextReader (resource);
+					transform.Load (reader);
+					resource.Close ();
+				} else {
+					Logger.Error ("Unable to find HTML export template '{0}'.",
+					            stylesheet_name);
+				}
+			}
+			return transform;
+		}
+
+		static string GetFont ()
+		{
+			if (!(bool) Preferences.Get (Preferences.ENABLE_CUSTOM_FONT))
+				return null;
+
+			string font_face = (string) Preferences.Get (Preferences.CUSTOM_FONT_FACE);
+			Pango.FontDescription font_desc =
+			        Pango.FontDescription.FromString (font_face);
+			return String.Format ("font-family:'{0}';", font_desc.Family);
+		}
+
+		/// <summary>
+		/// The parts of a note's XML that the stylesheet reads, built
+		/// without serializing and parsing the whole note.
+		/// </summary>
+		public static XmlDocument GetNoteDocument (NoteData data)
+		{
+			XmlDocument doc = new XmlDocument ();
+			// Whitespace in the note content is output
+			doc.PreserveWhitespace = true;
+
+			XmlElement note = doc.CreateElement ("note", note_namespace);
+			AddAttribute (note, "xmlns", "link", xmlns_namespace,
+			              "http://beatniksoftware.com/tomboy/link");
+			AddAttribute (note, "xmlns", "size", xmlns_namespace,
+			              "http://beatniksoftware.com/tomboy/size");
+			doc.AppendChild (note);
+
+			XmlElement title = doc.CreateElement ("title", note_namespace);
+			title.AppendChild (doc.CreateTextNode (data.Title));
+			note.AppendChild (title);
+
+			XmlElement text = doc.CreateElement ("text", note_namespace);
+			AddAttribute (text, "xml", "space", xml_namespace, "preserve");
+			note.AppendChild (text);
+			// Parsed in place, so the link: and size: prefixes resolve
+			text.InnerXml = data.Text;
+
+			return doc;
+		}
+
+		static void AddAttribute (XmlElement element, string prefix, string name,
+		                          string ns, string value)
+		{
+			XmlAttribute attribute = element.OwnerDocument.CreateAttribute (prefix, name, ns);
+			attribute.Value = value;
+			element.Attributes.Append (attribute);
+		}
+
+		public void WriteHTMLForNote (TextWriter writer, NoteData data, object extension)
+		{
+			XsltArgumentList args = new XsltArgumentList ();
+			args.AddParam ("exporting-multiple", "", exporting_multiple);
+			args.AddParam ("export-linked", "", false);
+			args.AddParam ("export-linked-all", "", false);
+			args.AddParam ("root-note", "", data.Title);
+			args.AddExtensionObject (note_namespace, extension);
+			if (font != null)
+				args.AddParam ("font", "", font);
+
+			NoteXsl.Transform (GetNoteDocument (data), args, writer);
+		}
+
+		public void Export (HtmlExportJob job)
+		{
+			Logger.Debug ("Exporting Note '{0}' to '{1}'...", job.Data.Title, job.OutputPath);
+
+			try {
+				// FIXME: Warn about file existing.  Allow overwrite.
+				File.Delete (job.OutputPath);
+			} catch {
+			}
+
+			using (StreamWriter writer = new StreamWriter (job.OutputPath))
+				WriteHTMLForNote (writer, job.Data, job.Extension);
+		}
+
+		/// <summary>
+		/// Export all the jobs, on worker threads, and wait for them to
+		/// finish.  If a note can't be exported, the rest are skipped and
+		/// the exception is thrown from here as the InnerException of a
+		/// TargetInvocationException.  Not for the GTK thread, so make
+		/// the jobs with ExportToHtmlApplicationAddin.MakeJobs, whose
+		/// links don't need it.
+		/// </summary>
+		public void Export (IList<HtmlExportJob> jobs)
+		{
+			ExportRun run = new ExportRun (this, jobs);
+			run.Start ();
+			foreach (Thread worker in run.Workers)
+				worker.Join ();
+
+			if (run.Error != null)
+				throw new TargetInvocationException (run.Error.Message, run.Error);
+		}
+
+		/// <summary>
+		/// Start exporting the jobs on worker threads, and return.  Call
+		/// on the GTK thread, whose main loop must keep running: progress,
+		/// if not null, is called on it every so often, and finished once
+		/// the last job is done, with the exception that stopped the
+		/// export or null.  If a note can't be exported, the rest are
+		/// skipped.
+		/// </summary>
+		public void BeginExport (IList<HtmlExportJob> jobs, ExportProgressHandler progress,
+		                         ExportFinishedHandler finished)
+		{
+			ExportRun run = new ExportRun (this, jobs);
+			run.Start ();
+
+			GLib.Timeout.Add (PROGRESS_INTERVAL, delegate {
+				bool done = run.IsDone;
+				if (progress != null)
+					progress (run.Exported, run.Total);
+				if (!done)
+					return true;
+
+				finished (run.Error);
+				return false;
+			});
+		}
+
+		const uint PROGRESS_INTERVAL = 100;
+
+		// The state shared by the workers of one export
+		class ExportRun
+		{
+			readonly HtmlExporter exporter;
+			readonly IList<HtmlExportJob> jobs;
+			int next = -1;
+			int exported;
+			int running;
+			Exception error;
+
+			public ExportRun (HtmlExporter exporter, IList<HtmlExportJob> jobs)
+			{
+				this.exporter = exporter;
+				this.jobs = jobs;
+			}
+
+			public Thread [] Workers { get; private set; }
+
+			public int Total
+			{
+				get {
+					return jobs.Count;
+				}
+			}
+
+			public int Exported
+			{
+				get {
+					return Thread.VolatileRead (ref exported);
+				}
+			}
+
+			/// <summary>
+			/// Whether every worker has finished, after which Error and
+			/// Exported don't change.
+			/// </summary>
+			public bool IsDone
+			{
+				get {
+					return Thread.VolatileRead (ref running) == 0;
+				}
+			}
+
+			public Exception Error
+			{
+				get {
+					return error;
+				}
+			}
+
+			public void Start ()
+			{
+				int worker_count = Math.Max (1, Math.Min (Environment.ProcessorCount, jobs.Count));
+				running = worker_count;
+				Workers = new Thread [worker_count];
+				for (int i = 0; i < Workers.Length; i++) {
+					Workers [i] = new Thread (Work);
+					Workers [i].Name = "HtmlExport";
+					Workers [i].IsBackground = true;
+					Workers [i].Start ();
+				}
+			}
+
+			void Work ()
+			{
+				try {
+					int i;
+					while (error == null && (i = Interlocked.Increment (ref next)) < jobs.Count) {
+						try {
+							exporter.Export (jobs [i]);
+						} catch (Exception e) {
+							Interlocked.CompareExchange (ref error, e, null);
+							return;
+						}
+						Interlocked.Increment (ref exported);
+					}
+				} finally {
+					Interlocked.Decrement (ref running);
+				}
+			}
+		}
+	}
+}
@@ -73,6 +73,16 @@ namespace Tomboy.Sync
 			// Nothing to do
 		}
 
+		public override string WatchablePath
+		{
+			get {
+				string syncPath;
+				if (GetConfigSettings (out syncPath))
+					return syncPath;
+				return null;
+			}
+		}
+
 		/// <summary>
 		/// Creates a Gtk.Widget that's used to configure the service.  This
 		/// will be used in the Synchronization Preferences.  Preferences should
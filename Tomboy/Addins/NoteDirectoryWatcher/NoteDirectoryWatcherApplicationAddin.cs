@@ -2,7 +2,6 @@
 using System;
 using System.Collections.Generic;
 using System.IO;
-using System.Text.RegularExpressions;
 
 using Tomboy;
 
@@ -15,23 +14,59 @@ namespace Tomboy.NoteDirectoryWatcher
 		public bool changed;
 	}
 
+	/// <summary>
+	/// Modification time and size of a note file right after Tomboy
+	/// wrote it, to recognize the file system events of our own saves.
+	/// </summary>
+	struct NoteFileStamp
+	{
+		public DateTime write_time;
+		public long length;
+
+		public static bool TryGet (string path, out NoteFileStamp stamp)
+		{
+			stamp = new NoteFileStamp ();
+			try {
+				FileInfo info = new FileInfo (path);
+				if (!info.Exists)
+					return false;
+				stamp.write_time = info.LastWriteTimeUtc;
+				stamp.length = info.Length;
+				return true;
+			} catch (Exception) {
+				return false;
+			}
+		}
+	}
+
 	public class NoteDirectoryWatcherApplicationAddin : ApplicationAddin
 	{
 		private static bool VERBOSE_LOGGING = false;
 
+		// Changes are handled in one batch once the directory has
+		// been quiet this long, or at the latest after max_delay.
+		private static readonly TimeSpan quiet_period = TimeSpan.FromSeconds (2);
+		private static readonly TimeSpan max_delay = TimeSpan.FromSeconds (10);
+		private const uint poll_interval_ms = 1000;
+
 		private FileSystemWatcher file_system_watcher;
 		private bool initialized;
 
+		private readonly object records_lock = new object ();
 		private Dictionary<string, NoteFileChangeRecord> file_change_records;
-		private Dictionary<string, DateTime> note_save_times;
+		private Dictionary<string, NoteFileStamp> note_save_stamps;
+		private uint timeout_id;
+		private DateTime first_pending_change;
+		private DateTime last_pending_change;
 
 		public override void Initialize ()
 		{
 			string note_path = Tomboy.DefaultNoteManager.NoteDirectoryPath;
 			Tomboy.DefaultNoteManager.NoteSaved += HandleNoteSaved;
+			Tomboy.DefaultNoteManager.NotesImported += HandleNotesImported;
 
 			file_change_records = new Dictionary<string, NoteFileChangeRecord> ();
-			note_save_times = new Dictionary<string, DateTime> ();
+			note_save_stamps = new Dictionary<string, NoteFileStamp> ();
 
 			file_system_watcher = new FileSystemWatcher (note_path, "*.note");
 
@@ -51,6 +86,15 @@ namespace Tomboy.NoteDirectoryWatcher
 		public override void Shutdown ()
 		{
 			file_system_watcher.EnableRaisingEvents = false;
+			Tomboy.DefaultNoteManager.NoteSaved -= HandleNoteSaved;
+			Tomboy.DefaultNoteManager.NotesImported -= HandleNotesImported;
+			lock (records_lock) {
+				if (timeout_id != 0) {
+					GLib.Source.Remove (timeout_id);
+					timeout_id = 0;
+				}
+				file_change_records.Clear ();
+			}
 			initialized = false;
 		}
 
@@ -61,7 +105,19 @@ namespace Tomboy.NoteDirectoryWatcher
 
 		private void HandleNoteSaved (Note note)
 		{
-			note_save_times [note.Id] = DateTime.Now;
+			NoteFileStamp stamp;
+			lock (note_save_stamps) {
+				if (NoteFileStamp.TryGet (note.FilePath, out stamp))
+					note_save_stamps [note.Id] = stamp;
+				else
+					note_save_stamps.Remove (note.Id);
+			}
+		}
+
+		private void HandleNotesImported (object sender, List<Note> imported)
+		{
+			foreach (Note note in imported)
+				HandleNoteSaved (note);
 		}
 
 		private void HandleFileSystemErrorEvent (Object sender, ErrorEventArgs arg) 
@@ -78,7 +134,7 @@ namespace Tomboy.NoteDirectoryWatcher
 			
 			// Record that the file has been added/changed/deleted.  Adds/changes trump
 			// deletes.  Record the date.
-			lock (file_change_records) {
+			lock (records_lock) {
 				NoteFileChangeRecord record = null;
 
 				if (file_change_records.ContainsKey (note_id)) {
@@ -107,45 +163,84 @@ namespace Tomboy.NoteDirectoryWatcher
 				}
 
 				record.last_change = DateTime.Now;
-			}
+				last_pending_change = record.last_change;
 
-			GLib.Timeout.Add (5000, new GLib.TimeoutHandler (HandleTimeout));
+				// One timer for the whole batch, however many events
+				if (timeout_id == 0) {
+					first_pending_change = record.last_change;
+					timeout_id = GLib.Timeout.Add (poll_interval_ms, new GLib.TimeoutHandler (HandleTimeout));
+				}
+			}
 		}
 
 		private bool HandleTimeout () 
 		{
-			lock (file_change_records) {
-				List<string> keysToRemove = new List<string> (file_change_records.Count);
+			Dictionary<string, NoteFileChangeRecord> batch;
+
+			lock (records_lock) {
+				DateTime now = DateTime.Now;
+				if (now - last_pending_change < quiet_period &&
+				    now - first_pending_change < max_delay)
+					return true; // Still busy, keep waiting
+
+				batch = file_change_records;
+				file_change_records = new Dictionary<string, NoteFileChangeRecord> ();
+				timeout_id = 0;
+			}
+
+			ProcessBatch (batch);
+			return false;
+		}
+
+		private void ProcessBatch (Dictionary<string, NoteFileChangeRecord> batch)
+		{
+			Logger.Debug ("NoteDirectoryWatcher: Handling {0} changed note files", batch.Count);
+
+			// New notes are added together at the end, so listeners get
+			// one NotesImported instead of a NoteAdded per note
+			List<string> new_ids = new List<string> ();
+			List<string> new_xmls = new List<string> ();
 
-				foreach (KeyValuePair<string, NoteFileChangeRecord> pair in file_change_records)  {
+			NoteManager manager = Tomboy.DefaultNoteManager;
+			manager.BeginBulkUpdate ();
+			try {
+				foreach (KeyValuePair<string, NoteFileChangeRecord> pair in batch)  {
 					if (VERBOSE_LOGGING)
 						Logger.Debug ("NoteDirectoryWatcher: Handling (timeout) {0}", pair.Key);
 
-					// Check that Note.Saved event didn't occur within 3 seconds of last write
-					if (note_save_times.ContainsKey (pair.Key) &&
-					    Math.Abs (note_save_times [pair.Key].Ticks - pair.Value.last_change.Ticks) <= 3000*10000) {
-						if (VERBOSE_LOGGING)
-							Logger.Debug ("NoteDirectoryWatcher: Ignoring (timeout) because it was probably a Tomboy write");
-						keysToRemove.Add (pair.Key);
-						continue;
-					}
-					// TODO: Take some actions to clear note_save_times? Not a large structure...
-
-					if (DateTime.Now > pair.Value.last_change.Add (new TimeSpan (4000)) ) {
+					try {
 						if (pair.Value.deleted)
 							DeleteNote (pair.Key);
 						else
-							AddOrUpdateNote (pair.Key);
-
-						keysToRemove.Add (pair.Key);
+							AddOrUpdateNote (pair.Key, new_ids, new_xmls);
+					} catch (Exception e) {
+						Logger.Error ("NoteDirectoryWatcher: Error handling change to {0}: {1}", pair.Key, e);
 					}
 				}
 
-				foreach (string note_id in keysToRemove)
-					file_change_records.Remove (note_id);
+				if (new_ids.Count > 0) {
+					Logger.Debug ("NoteDirectoryWatcher: Adding {0} notes because files appeared", new_ids.Count);
+					manager.AddForeignNotes (new_ids, new_xmls);
+				}
+			} finally {
+				manager.EndBulkUpdate ();
 			}
-			
-			return false;
+		}
+
+		/// <summary>
+		/// Whether the note file is exactly as Tomboy last saved it.
+		/// </summary>
+		private bool IsOwnWrite (string note_id, string note_path)
+		{
+			NoteFileStamp saved;
+			NoteFileStamp current;
+			lock (note_save_stamps) {
+				if (!note_save_stamps.TryGetValue (note_id, out saved))
+					return false;
+			}
+			return NoteFileStamp.TryGet (note_path, out current) &&
+				current.write_time == saved.write_time &&
+				current.length == saved.length;
 		}
 
 		private static void DeleteNote (string note_id)
@@ -161,7 +256,11 @@ namespace Tomboy.NoteDirectoryWatcher
 				Logger.Debug ("NoteDirectoryWatcher: Did not delete {0} because note not found.", note_id);
 		}
 
-		private void AddOrUpdateNote (string note_id)
+		/// <summary>
+		/// Reload a changed note, or add the id and contents of a note
+		/// file that isn't a note yet to new_ids and new_xmls.
+		/// </summary>
+		private void AddOrUpdateNote (string note_id, List<string> new_ids, List<string> new_xmls)
 		{
 			string note_path = Tomboy.DefaultNoteManager.NoteDirectoryPath +
 						Path.DirectorySeparatorChar + note_id + ".note";
@@ -170,6 +269,17 @@ namespace Tomboy.NoteDirectoryWatcher
 					Logger.Debug ("NoteDirectoryWatcher: Not processing update of {0} because file does not exist.", note_path);
 				return;
 			}
+
+			if (IsOwnWrite (note_id, note_path)) {
+				if (VERBOSE_LOGGING)
+					Logger.Debug ("NoteDirectoryWatcher: Ignoring {0} because Tomboy wrote it", note_id);
+				return;
+			}
+
+			// Taken before reading, so a write that lands after the read
+			// doesn't match it
+			NoteFileStamp read_stamp;
+			bool have_read_stamp = NoteFileStamp.TryGet (note_path, out read_stamp);
 			
 			string noteXml = null;
 			try {
@@ -191,42 +301,41 @@ namespace Tomboy.NoteDirectoryWatcher
 
 			Note note = Tomboy.DefaultNoteManager.FindByUri (note_uri);
 
-			bool is_new_note = false;
-
-			if (note == null) {
-				is_new_note = true;
-				Logger.Debug ("NoteDirectoryWatcher: Adding {0} because file changed.", note_id);
-				
-				string title = null;
-				const string title_group_name = "title";
-				Match match = Regex.Match (noteXml, "<title>(?<" + title_group_name + ">[^<]+)</title>");
-				if (match.Success)
-					title = match.Groups [title_group_name].Value;
-				else {
-					Logger.Error ("NoteDirectoryWatcher: Error reading note title from {0}", note_path);
-					return;
-				}
-				
+			// Rewritten with the same title, tags and text, e.g. by a
+			// checkout or a sync that only touched dates
+			if (note != null) {
 				try {
-					note = Tomboy.DefaultNoteManager.CreateWithGuid (title, note_id);
-					if (note == null) {
-						Logger.Error ("NoteDirectoryWatcher: Unknown error creating note from {0}", note_path);
+					if (NoteContentHash.Compute (noteXml, note_uri) == note.ContentHash) {
+						if (VERBOSE_LOGGING)
+							Logger.Debug ("NoteDirectoryWatcher: Ignoring {0} because its content is unchanged", note_id);
 						return;
 					}
-				} catch (Exception e) {
-					Logger.Error ("NoteDirectoryWatcher: Error creating note from {0}: {1}", note_path, e);
-					return;
+				} catch (Exception) {
+					// Let LoadForeignNoteXml report the parse error
 				}
 			}
 
-			if (is_new_note)
-				Logger.Debug ("NoteDirectoryWatcher: Updating {0} because file changed.", note_id);
+			if (note == null) {
+				if (VERBOSE_LOGGING)
+					Logger.Debug ("NoteDirectoryWatcher: Adding {0} because file changed.", note_id);
+				// AddForeignNotes writes the note again.  Until
+				// NotesImported gives the stamp of that write, the file
+				// as read counts as handled, and if the note isn't
+				// added it isn't retried until the file changes again.
+				if (have_read_stamp) {
+					lock (note_save_stamps)
+						note_save_stamps [note_id] = read_stamp;
+				}
+				new_ids.Add (note_id);
+				new_xmls.Add (noteXml);
+				return;
+			}
+
+			Logger.Debug ("NoteDirectoryWatcher: Updating {0} because file changed.", note_id);
 			try {
 				note.LoadForeignNoteXml (noteXml, ChangeType.ContentChanged);
 			} catch (Exception e) {
 				Logger.Error ("NoteDirectoryWatcher: Update aborted, error parsing {0}: {1}", note_path, e);
-				if (is_new_note)
-					Tomboy.DefaultNoteManager.Delete (note);
 			}
 		}
 
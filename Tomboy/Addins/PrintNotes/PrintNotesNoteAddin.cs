@@ -28,6 +28,20 @@ namespace Tomboy.PrintNotes
 	
 	public class PrintNotesNoteAddin : NoteAddin
 	{		
+		// A paragraph laid out for the page, kept from pagination until
+		// the end of the print job
+		private class ParagraphLayout
+		{
+			public readonly Pango.Layout Layout;
+			public readonly int Indentation;
+
+			public ParagraphLayout (Pango.Layout layout, int indentation)
+			{
+				Layout = layout;
+				Indentation = indentation;
+			}
+		}
+
 		private Gtk.ImageMenuItem item;
 		private int margin_top;
 		private int margin_left;
@@ -36,6 +50,9 @@ namespace Tomboy.PrintNotes
 
 		private Pango.Layout timestamp_footer;
 		private IList<PageBreak> page_breaks;
+		// One per buffer line, in order
+		private List<ParagraphLayout> paragraphs;
+		private IntPtr paragraphs_context;
 
 		public override void Initialize ()
 		{
@@ -62,7 +79,8 @@ namespace Tomboy.PrintNotes
 		private void PrintButtonClicked (object sender, EventArgs args)
 		{
 			try {
-				page_breaks = new List<PageBreak> ();				
+				page_breaks = new List<PageBreak> ();
+				paragraphs = new List<ParagraphLayout> ();
 				
 				using (Gtk.PrintOperation print_op = new Gtk.PrintOperation ()) {
 					print_op.JobName = Note.Title;
@@ -272,45 +290,67 @@ namespace Tomboy.PrintNotes
 			double max_height = Pango.Units.FromPixels ((int) context.Height - 
 						margin_top - margin_bottom - ComputeFooterHeight (context));
 			
+			LayOutParagraphs (context);
+
+			page_breaks.Clear ();
+			double page_height = 0;
+			for (int paragraph_number = 0; paragraph_number < paragraphs.Count;
+			     paragraph_number++) {
+				Pango.Layout layout = paragraphs [paragraph_number].Layout;
+
+				Pango.Rectangle ink_rect = Pango.Rectangle.Zero;
+				Pango.Rectangle logical_rect = Pango.Rectangle.Zero;
+				for (int line_in_paragraph = 0; line_in_paragraph < layout.LineCount;
+				     line_in_paragraph++) {
+					Pango.LayoutLine line = layout.GetLine (line_in_paragraph);
+					line.GetExtents (ref ink_rect, ref logical_rect);
+
+					if (page_height + logical_rect.Height >= max_height) {
+						PageBreak page_break = new PageBreak (
+							paragraph_number, line_in_paragraph);
+						page_breaks.Add (page_break);
+
+						page_height = 0;
+					}
+					page_height += logical_rect.Height;
+				}
+			}
+
+			op.NPages = page_breaks.Count + 1;
+		}
+
+		// Lay out every paragraph of the note once, for pagination and
+		// for drawing all the pages
+		private void LayOutParagraphs (Gtk.PrintContext context)
+		{
+			DisposeParagraphs ();
+			paragraphs_context = context.Handle;
+
 			Gtk.TextIter position;
 			Gtk.TextIter end_iter;
 			Buffer.GetBounds (out position, out end_iter);
 
-			double page_height = 0;
 			bool done = position.Compare (end_iter) >= 0;
 			while (!done) {
 				Gtk.TextIter line_end = position;
 				if (!line_end.EndsLine ())
 					line_end.ForwardToLineEnd ();
-				
-				int paragraph_number = position.Line;
-				int indentation;
-				using (Pango.Layout layout = CreateParagraphLayout (
-					context, position, line_end, out indentation)) {
-
-					Pango.Rectangle ink_rect = Pango.Rectangle.Zero;
-					Pango.Rectangle logical_rect = Pango.Rectangle.Zero;
-					for (int line_in_paragraph = 0; line_in_paragraph < layout.LineCount;
-					     line_in_paragraph++) {
-						Pango.LayoutLine line = layout.GetLine (line_in_paragraph);
-						line.GetExtents (ref ink_rect, ref logical_rect);
 
-						if (page_height + logical_rect.Height >= max_height) {
-							PageBreak page_break = new PageBreak (
-								paragraph_number, line_in_paragraph);
-							page_breaks.Add (page_break);
-	
-							page_height = 0;
-						}
-						page_height += logical_rect.Height;
-					}
+				int indentation;
+				Pango.Layout layout = CreateParagraphLayout (
+					context, position, line_end, out indentation);
+				paragraphs.Add (new ParagraphLayout (layout, indentation));
 
-					position.ForwardLine ();
-					done = position.Compare (end_iter) >= 0;
-				}
+				position.ForwardLine ();
+				done = position.Compare (end_iter) >= 0;
 			}
+		}
 
-			op.NPages = page_breaks.Count + 1;
+		private void DisposeParagraphs ()
+		{
+			foreach (ParagraphLayout paragraph in paragraphs)
+				paragraph.Layout.Dispose ();
+			paragraphs.Clear ();
 		}
 
 		public void OnDrawPage (object sender, Gtk.DrawPageArgs args)
@@ -332,65 +372,46 @@ namespace Tomboy.PrintNotes
 					end = new PageBreak (-1, -1);
 				}
 
-				Gtk.PrintContext context = args.Context;
-				Gtk.TextIter position;
-				Gtk.TextIter end_iter;
-				Buffer.GetBounds (out position, out end_iter);
-
-				// Fast-forward to the right starting paragraph
-				while (position.Line < start.Paragraph) {
-					position.ForwardLine ();
-				}
-				
-				bool done = position.Compare (end_iter) >= 0;
-				while (!done) {
-					Gtk.TextIter line_end = position;
-					if (!line_end.EndsLine ())
-						line_end.ForwardToLineEnd ();
-
-					int paragraph_number = position.Line;
-					int indentation;
-					using (Pango.Layout layout = CreateParagraphLayout (
-						context, position, line_end, out indentation)) {
-						
-						for (int line_number = 0;
-						     line_number < layout.LineCount && !done;
-						     line_number++) {
-							// Skip the lines up to the starting line in the
-							// first paragraph on this page
-							if ((paragraph_number == start.Paragraph) &&
-							    (line_number < start.Line)) {
-								continue;
-							}
-
-							// Break as soon as we hit the end line
-							if ((paragraph_number == end.Paragraph) &&
-							    (line_number == end.Line)) {
-								done = true;
-								break;
-							}
-
-							Pango.LayoutLine line = layout.Lines [line_number];
-							Pango.Rectangle ink_rect = Pango.Rectangle.Zero;
-							Pango.Rectangle logical_rect = Pango.Rectangle.Zero;
-							line.GetExtents (ref ink_rect, ref logical_rect);
-		
-							cr.MoveTo (margin_left + indentation,
-								cr.CurrentPoint.Y);
-							int line_height = Pango.Units.ToPixels (logical_rect.Height);
-							
-							Cairo.PointD new_line_point = new Cairo.PointD (
-								margin_left + indentation,
-								cr.CurrentPoint.Y + line_height);
-							
-							Pango.CairoHelper.ShowLayoutLine (cr, line);
-							cr.MoveTo (new_line_point);
+				// The layouts belong to the context they were made for
+				if (args.Context.Handle != paragraphs_context)
+					LayOutParagraphs (args.Context);
+
+				// Only this page's paragraphs, starting at its first line
+				bool done = false;
+				for (int paragraph_number = start.Paragraph;
+				     paragraph_number < paragraphs.Count && !done;
+				     paragraph_number++) {
+					Pango.Layout layout = paragraphs [paragraph_number].Layout;
+					int indentation = paragraphs [paragraph_number].Indentation;
+
+					int first_line = paragraph_number == start.Paragraph ? start.Line : 0;
+					for (int line_number = first_line;
+					     line_number < layout.LineCount;
+					     line_number++) {
+						// Break as soon as we hit the end line
+						if ((paragraph_number == end.Paragraph) &&
+						    (line_number == end.Line)) {
+							done = true;
+							break;
 						}
+
+						Pango.LayoutLine line = layout.GetLine (line_number);
+						Pango.Rectangle ink_rect = Pango.Rectangle.Zero;
+						Pango.Rectangle logical_rect = Pango.Rectangle.Zero;
+						line.GetExtents (ref ink_rect, ref logical_rect);
+
+						cr.MoveTo (margin_left + indentation,
+							cr.CurrentPoint.Y);
+						int line_height = Pango.Units.ToPixels (logical_rect.Height);
+
+						Cairo.PointD new_line_point = new Cairo.PointD (
+							margin_left + indentation,
+							cr.CurrentPoint.Y + line_height);
+
+						Pango.CairoHelper.ShowLayoutLine (cr, line);
+						cr.MoveTo (new_line_point);
 					}
-	
-					position.ForwardLine ();
-					done = done || position.Compare (end_iter) >= 0;
-				}				
+				}
 
 				int total_height = (int) args.Context.Height;
 				int total_width = (int) args.Context.Width; 
@@ -433,6 +454,8 @@ namespace Tomboy.PrintNotes
 				timestamp_footer.Dispose ();
 				timestamp_footer = null;
 			}
+			DisposeParagraphs ();
+			paragraphs_context = IntPtr.Zero;
 		}
 	}
 }
\ No newline at end of file
@@ -181,7 +181,10 @@ namespace VirtualPaper
 
         protected override bool OnButtonReleaseEvent(EventButton ev)
         {
-            Paper.EndStroke();
+            Stroke finishedStroke = Paper.EndStroke();
+            if(finishedStroke != null) {
+                QueueDrawArea(finishedStroke.Bounds);
+            }
 
             return true;
         }
@@ -229,7 +232,7 @@ namespace VirtualPaper
 
         private void QueueDrawArea(Stroke s)
         {
-            QueueDrawArea((int)s.X, (int)s.Y, (int)s.Width, (int)s.Height);
+            QueueDrawArea(s.Bounds);
         }
 
         private void QueueDrawArea(Gdk.Rectangle r)
@@ -7,6 +7,10 @@ namespace VirtualPaper
 {
     public class Paper
     {
+        // Finished strokes are simplified to within this many pixels
+        private const double SimplifyTolerance = 0.5;
+        private const double SimplifyPressureTolerance = 0.05;
+
         private Color        backgroundColor;
         private Stroke       activeStroke;
         private List<Stroke> strokes;
@@ -15,6 +19,12 @@ namespace VirtualPaper
 
         private int undo;
 
+        // The background and the visible finished strokes, drawn once.
+        // Only the stroke being drawn is drawn on each expose.
+        private ImageSurface cache;
+        private Gdk.Rectangle cacheDirty;
+        private StrokeGrid grid;
+
         public Color BackgroundColor {
             get {
                 return backgroundColor;
@@ -87,6 +97,7 @@ namespace VirtualPaper
             BackgroundColor = background;
 
             Strokes = new List<Stroke>();
+            grid = new StrokeGrid();
 
             Pen = new Pen();
             Pen.Color = new Cairo.Color(0.0,0.0,0.0,1.0);
@@ -116,33 +127,99 @@ namespace VirtualPaper
 
         public virtual void Draw(Context cr, Gdk.Rectangle clip)
         {
+            UpdateCache(clip);
+
+            cr.Save();
             cr.Rectangle(clip.X, clip.Y, clip.Width, clip.Height);
-            cr.Color = BackgroundColor;
-            cr.Fill();
-            cr.Stroke();
+            cr.Clip();
+            cr.SetSourceSurface(cache, 0, 0);
+            cr.Paint();
+            cr.Restore();
 
-            DrawStrokes(cr, clip);
+            if(activeStroke != null && activeStroke.Bounds.IntersectsWith(clip)) {
+                activeStroke.Draw(cr, clip);
+            }
         }
 
+        // Draw the visible finished strokes that cross clip
         protected virtual void DrawStrokes(Context cr, Gdk.Rectangle clip)
         {
-            int strokeCount = Strokes.Count;
+            int visible = Strokes.Count - undo;
 
-            foreach(Stroke stroke in Strokes) {
-                strokeCount--;
-                if(strokeCount < undo) break;
+            foreach(int i in grid.Query(clip)) {
+                if(i >= visible) break;
 
-                if(stroke.Bounds.IntersectsWith(clip)) {
+                Stroke stroke = Strokes[i];
+                if(stroke != activeStroke && stroke.Bounds.IntersectsWith(clip)) {
                     stroke.Draw(cr, clip);
                 }
             }
         }
 
+        // Make sure the cache covers clip and is up to date
+        private void UpdateCache(Gdk.Rectangle clip)
+        {
+            int width  = Math.Max(clip.X + clip.Width, 1);
+            int height = Math.Max(clip.Y + clip.Height, 1);
+
+            if(cache == null || cache.Width < width || cache.Height < height) {
+                if(cache != null) {
+                    width  = Math.Max(width, cache.Width);
+                    height = Math.Max(height, cache.Height);
+                    ((IDisposable)cache).Dispose();
+                }
+                cache = new ImageSurface(Format.Argb32, width, height);
+                cacheDirty = new Gdk.Rectangle(0, 0, width, height);
+            }
+
+            if(cacheDirty.Width <= 0 || cacheDirty.Height <= 0)
+                return;
+
+            Gdk.Rectangle dirty = cacheDirty;
+            cacheDirty = Gdk.Rectangle.Zero;
+
+            Context cacheCr = new Context(cache);
+            cacheCr.Rectangle(dirty.X, dirty.Y, dirty.Width, dirty.Height);
+            cacheCr.Clip();
+            cacheCr.Rectangle(dirty.X, dirty.Y, dirty.Width, dirty.Height);
+            cacheCr.Color = BackgroundColor;
+            cacheCr.Fill();
+
+            DrawStrokes(cacheCr, dirty);
+
+            ((IDisposable)cacheCr).Dispose();
+        }
+
+        // Redraw area of the cache on the next Draw
+        protected void InvalidateCache(Gdk.Rectangle area)
+        {
+            if(cacheDirty.Width <= 0 || cacheDirty.Height <= 0)
+                cacheDirty = area;
+            else
+                cacheDirty = cacheDirty.Union(area);
+        }
+
+        // Draw a stroke that now lies on top of all visible strokes
+        private void DrawOnCache(Stroke stroke)
+        {
+            if(cache == null)
+                return;
+
+            Gdk.Rectangle bounds = stroke.Bounds;
+            Context cacheCr = new Context(cache);
+            cacheCr.Rectangle(bounds.X, bounds.Y, bounds.Width, bounds.Height);
+            cacheCr.Clip();
+            stroke.Draw(cacheCr, bounds);
+            ((IDisposable)cacheCr).Dispose();
+        }
+
         public virtual Stroke Undo()
         {
             if(CanUndo) {
                 undo++;
-                return Strokes[Strokes.Count - undo];
+                Stroke undoneStroke = Strokes[Strokes.Count - undo];
+                InvalidateCache(undoneStroke.Bounds);
+                return undoneStroke;
             }
 
             return null;
@@ -153,6 +230,7 @@ namespace VirtualPaper
             if(CanRedo) {
                 Stroke redoneStroke = Strokes[Strokes.Count - undo];
                 undo--;
+                DrawOnCache(redoneStroke);
                 return redoneStroke;
             }
 
@@ -162,13 +240,20 @@ namespace VirtualPaper
         public virtual void Clear()
         {
             Strokes.Clear();
+            grid.Clear();
             undo = 0;
+
+            if(cache != null)
+                InvalidateCache(new Gdk.Rectangle(0, 0, cache.Width, cache.Height));
         }
 
         public virtual void BeginStroke(Pen style)
         {
             activeStroke = new Stroke(style);
 
+            // Undone strokes are already off the cache
+            for(int i = Strokes.Count - undo; i < Strokes.Count; i++)
+                grid.Remove(i, Strokes[i].Bounds);
             Strokes.RemoveRange(Strokes.Count - undo, undo);
             undo = 0;
 
@@ -189,9 +274,19 @@ namespace VirtualPaper
             return changed;
         }
 
-        public virtual void EndStroke()
+        // Returns the finished stroke, if any, whose area needs redrawing
+        // now that it is simplified and drawn from the cache
+        public virtual Stroke EndStroke()
         {
+            Stroke finished = activeStroke;
+            if(finished == null)
+                return null;
             activeStroke = null;
+
+            finished.Simplify(SimplifyTolerance, SimplifyPressureTolerance);
+            grid.Add(Strokes.Count - 1, finished.Bounds);
+            DrawOnCache(finished);
+            return finished;
         }
 
         public virtual void Serialize(XmlTextWriter xml)
@@ -128,6 +128,82 @@ namespace VirtualPaper
             return new Gdk.Rectangle((int)x - w, (int)y - w, w2, w2);
         }
 
+        // Drop the points that lie within tolerance pixels of the line
+        // through their neighbours (Douglas-Peucker), unless the pressure
+        // there differs from what the line would give by more than
+        // pressureTolerance.  The bounds are kept as they are.
+        public virtual void Simplify(double tolerance, double pressureTolerance)
+        {
+            if(count < 3)
+                return;
+
+            bool[] keep = new bool[count];
+            keep[0] = true;
+            keep[count - 1] = true;
+
+            Stack<int> ranges = new Stack<int>();
+            ranges.Push(0);
+            ranges.Push(count - 1);
+            while(ranges.Count > 0) {
+                int last = ranges.Pop();
+                int first = ranges.Pop();
+                if(last - first < 2)
+                    continue;
+
+                double dx = x[last] - x[first];
+                double dy = y[last] - y[first];
+                double length = Math.Sqrt(dx*dx + dy*dy);
+
+                int split = -1;
+                double worst = 0;
+                for(int i = first + 1; i < last; i++) {
+                    double distance;
+                    if(length == 0) {
+                        double ex = x[i] - x[first];
+                        double ey = y[i] - y[first];
+                        distance = Math.Sqrt(ex*ex + ey*ey);
+                    } else {
+                        distance = Math.Abs(dy*x[i] - dx*y[i] +
+                            x[last]*y[first] - y[last]*x[first]) / length;
+                    }
+
+                    double t = (double)(i - first) / (last - first);
+                    double pressure = color[first].A +
+                        t * (color[last].A - color[first].A);
+                    // Scaled so that either limit counts the same
+                    double error = Math.Max(distance / tolerance,
+                        Math.Abs(color[i].A - pressure) / pressureTolerance);
+
+                    if(error > 1 && error > worst) {
+                        worst = error;
+                        split = i;
+                    }
+                }
+
+                if(split >= 0) {
+                    keep[split] = true;
+                    ranges.Push(first);
+                    ranges.Push(split);
+                    ranges.Push(split);
+                    ranges.Push(last);
+                }
+            }
+
+            int kept = 0;
+            for(int i = 0; i < count; i++) {
+                if(!keep[i])
+                    continue;
+                x[kept] = x[i];
+                y[kept] = y[i];
+                color[kept] = color[i];
+                kept++;
+            }
+            x.RemoveRange(kept, count - kept);
+            y.RemoveRange(kept, count - kept);
+            color.RemoveRange(kept, count - kept);
+            count = kept;
+        }
+
         public void Draw(Context cr, Gdk.Rectangle clip)
         {
             cr.LineWidth = style.Size;
@@ -0,0 +1,86 @@
+using System;
+using System.Collections.Generic;
+
+namespace VirtualPaper
+{
+    // Finished strokes by the grid cells their bounds cover, so that a
+    // redraw only visits the strokes near the area being drawn.  Strokes
+    // are known by their index in Paper.Strokes.
+    public class StrokeGrid
+    {
+        private const int CellSize = 128;
+
+        private Dictionary<long, List<int>> cells;
+
+        public StrokeGrid()
+        {
+            cells = new Dictionary<long, List<int>>();
+        }
+
+        public virtual void Add(int index, Gdk.Rectangle bounds)
+        {
+            foreach(long key in CellsOf(bounds)) {
+                List<int> cell;
+                if(!cells.TryGetValue(key, out cell)) {
+                    cell = new List<int>();
+                    cells[key] = cell;
+                }
+                cell.Add(index);
+            }
+        }
+
+        public virtual void Remove(int index, Gdk.Rectangle bounds)
+        {
+            foreach(long key in CellsOf(bounds)) {
+                List<int> cell;
+                if(cells.TryGetValue(key, out cell)) {
+                    cell.Remove(index);
+                    if(cell.Count == 0)
+                        cells.Remove(key);
+                }
+            }
+        }
+
+        public virtual void Clear()
+        {
+            cells.Clear();
+        }
+
+        // Indices of the strokes that may cross area, in drawing order
+        public virtual List<int> Query(Gdk.Rectangle area)
+        {
+            List<int> found = new List<int>();
+            foreach(long key in CellsOf(area)) {
+                List<int> cell;
+                if(cells.TryGetValue(key, out cell))
+                    found.AddRange(cell);
+            }
+
+            found.Sort();
+            int unique = 0;
+            for(int i = 0; i < found.Count; i++) {
+                if(unique == 0 || found[i] != found[unique - 1])
+                    found[unique++] = found[i];
+            }
+            found.RemoveRange(unique, found.Count - unique);
+            return found;
+        }
+
+        private static IEnumerable<long> CellsOf(Gdk.Rectangle r)
+        {
+            int left   = Cell(r.X);
+            int top    = Cell(r.Y);
+            int right  = Cell(r.X + Math.Max(r.Width, 1) - 1);
+            int bottom = Cell(r.Y + Math.Max(r.Height, 1) - 1);
+
+            for(int cy = top; cy <= bottom; cy++)
+                for(int cx = left; cx <= right; cx++)
+                    yield return ((long)cx << 32) | (uint)cy;
+        }
+
+        private static int Cell(int coordinate)
+        {
+            return (int)Math.Floor(coordinate / (double)CellSize);
+        }
+    }
+}
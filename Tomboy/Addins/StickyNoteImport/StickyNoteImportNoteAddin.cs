@@ -2,6 +2,7 @@
 // (C) 2006 Sandy Armstrong <sanfordarmstrong@gmail.com>
 
 using System;
+using System.Collections.Generic;
 using System.IO;
 using System.Xml;
 using Mono.Unix;
@@ -17,10 +18,6 @@ namespace Tomboy.StickyNoteImport
 		private const string sticky_xml_rel_path = "/.gnome2/stickynotes_applet";
 		private const string sticky_note_query = "//note";
 
-		private const string base_note_xml =
-		        "<note-content><note-title>{0}</note-title>\n\n{1}</note-content>";
-		private const string base_duplicate_note_title = "{0} (#{1})";
-
 		private const string debug_no_sticky_file =
 		        "StickyNoteImporter: Sticky Notes XML file does not exist or is invalid!";
 		private const string debug_create_error_base =
@@ -157,15 +154,24 @@ namespace Tomboy.StickyNoteImport
 
 			int numSuccessful = 0;
 			string defaultTitle = Catalog.GetString ("Untitled");
+			List<NoteImport> imports = new List<NoteImport> (nodes.Count);
 
 			foreach (XmlNode node in nodes) {
 				XmlAttribute titleAttr = node.Attributes["title"];
 				string stickyTitle = defaultTitle;
-				if (titleAttr != null && titleAttr.InnerXml.Length > 0)
-					stickyTitle = titleAttr.InnerXml;
+				if (titleAttr != null && titleAttr.Value.Length > 0)
+					stickyTitle = titleAttr.Value;
 				string stickyContent = node.InnerXml;
 
-				if (CreateNoteFromSticky (stickyTitle, stickyContent))
+				NoteImport import = GetImportFromSticky (stickyTitle, stickyContent);
+				if (import != null)
+					imports.Add (import);
+			}
+
+			// Create all the notes at once, rather than having each one
+			// update the note list and the title links on its own
+			foreach (Note newNote in Manager.Import (imports)) {
+				if (newNote != null)
 					numSuccessful++;
 			}
 
@@ -173,7 +179,7 @@ namespace Tomboy.StickyNoteImport
 				ShowResultsDialog (numSuccessful, nodes.Count);
 		}
 
-		bool CreateNoteFromSticky (string stickyTitle, string content)
+		NoteImport GetImportFromSticky (string stickyTitle, string content)
 		{
 			// There should be no XML in the content
 			// TODO: Report the error in the results dialog
@@ -182,27 +188,12 @@ namespace Tomboy.StickyNoteImport
 				Logger.Error (string.Format (debug_create_error_base,
 				                           stickyTitle,
 				                           "Invalid characters in note XML"));
-				return false;
+				return null;
 			}
 
-			string preferredTitle = Catalog.GetString ("Sticky Note: ") + stickyTitle;
-			string title = preferredTitle;
-
-			int i = 2; // Append numbers to create unique title, starting with 2
-			while (Manager.Find (title) != null)
-				title = string.Format (base_duplicate_note_title, preferredTitle, i++);
-
-			string noteXml = string.Format (base_note_xml, title, content);
-
-			try {
-				Note newNote = Manager.Create (title, noteXml);
-				newNote.QueueSave (ChangeType.NoChange);
-				newNote.Save ();
-				return true;
-			} catch (Exception e) {
-				Logger.Error (string.Format (debug_create_error_base, title, e.Message));
-				return false;
-			}
+			// NoteManager.Import appends a number if the title is taken
+			string title = Catalog.GetString ("Sticky Note: ") + stickyTitle;
+			return NoteImport.FromXml (title, content);
 		}
 
 		void ShowMessageDialog (string title, string message, Gtk.MessageType messageType)
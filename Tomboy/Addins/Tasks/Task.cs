@@ -190,6 +190,16 @@ public enum TaskPriority :
 			}
 		}
 
+		/// <summary>
+		/// Whether the task is open and the day it was due has passed.
+		/// </summary>
+		public bool IsOverdue
+		{
+			get {
+				return !IsComplete && DateTime.Now >= TaskIndex.GetDeadline (data.DueDate);
+			}
+		}
+
 		#endregion // Public Properties
 
 		#region Public Methods
@@ -0,0 +1,381 @@
+
+using System;
+using System.Collections.Generic;
+
+namespace Tomboy.Tasks
+{
+	/// <summary>
+	/// Lookups over the TaskManager's tasks that would otherwise need a
+	/// walk over every task: the tasks of each origin note, the open tasks
+	/// in the order the tray menu lists them, and the due dates still to
+	/// pass.  The index holds the state each task had when it was last
+	/// updated, so TaskManager has to call Update whenever a task is saved
+	/// or changes status.
+	/// </summary>
+	public class TaskIndex
+	{
+		#region Private Members
+		// What a task was indexed under
+		class Entry
+		{
+			public Task Task;
+			public string NoteUri;
+			public bool IsOpen;
+			public DateTime Deadline;
+			public int Priority;
+			public DateTime CreateDate;
+
+			// Bumped whenever Deadline or IsOpen changes, which makes
+			// the task's older heap items stale.
+			public int Version;
+		}
+
+		struct DueItem
+		{
+			public DateTime Deadline;
+			public Entry Entry;
+			public int Version;
+		}
+
+		Dictionary<Task, Entry> entries;
+		Dictionary<string, List<Task>> by_note;
+
+		// Open tasks in tray menu order, sorted with OpenComparer
+		List<Entry> open;
+		int completed_count;
+
+		// Binary min-heap on Deadline.  Items are not removed when their
+		// task changes; they go stale instead, and are skipped when they
+		// reach the top.
+		List<DueItem> due;
+		#endregion // Private Members
+
+		#region Constructors
+		public TaskIndex ()
+		{
+			entries = new Dictionary<Task, Entry> ();
+			by_note = new Dictionary<string, List<Task>> ();
+			open = new List<Entry> ();
+			due = new List<DueItem> ();
+		}
+		#endregion // Constructors
+
+		#region Public Properties
+		public int Count
+		{
+			get {
+				return entries.Count;
+			}
+		}
+
+		public int OpenCount
+		{
+			get {
+				return open.Count;
+			}
+		}
+
+		public int CompletedCount
+		{
+			get {
+				return completed_count;
+			}
+		}
+
+		/// <summary>
+		/// When the next open task becomes overdue, or DateTime.MaxValue
+		/// if no open task has a due date still to pass.
+		/// </summary>
+		public DateTime NextDeadline
+		{
+			get {
+				DropStaleDueItems ();
+				if (due.Count == 0)
+					return DateTime.MaxValue;
+				return due [0].Deadline;
+			}
+		}
+		#endregion // Public Properties
+
+		#region Public Methods
+		/// <summary>
+		/// The moment a task with the specified due date becomes overdue:
+		/// the end of the day it is due.  DateTime.MaxValue if the task has
+		/// no due date.
+		/// </summary>
+		public static DateTime GetDeadline (DateTime due_date)
+		{
+			if (due_date == DateTime.MinValue)
+				return DateTime.MaxValue;
+			return due_date.Date.AddDays (1);
+		}
+
+		public bool Contains (Task task)
+		{
+			return entries.ContainsKey (task);
+		}
+
+		/// <summary>
+		/// Whether the task was open when it was last updated.
+		/// </summary>
+		public bool IsOpen (Task task)
+		{
+			Entry entry;
+			if (!entries.TryGetValue (task, out entry))
+				return false;
+			return entry.IsOpen;
+		}
+
+		/// <summary>
+		/// Add a task, or re-index one whose status, due date, priority or
+		/// origin note may have changed.
+		/// </summary>
+		public void Update (Task task)
+		{
+			Update (task, DateTime.MinValue);
+		}
+
+		/// <summary>
+		/// Update, except that a task not yet in the index whose due date
+		/// passed at or before loaded_at is never taken as overdue for
+		/// that date.  For tasks loaded at startup: their due dates passed
+		/// in an earlier run, or while Tomboy was not running.
+		/// </summary>
+		public void Update (Task task, DateTime loaded_at)
+		{
+			Entry entry;
+			if (!entries.TryGetValue (task, out entry)) {
+				entry = new Entry ();
+				entry.Task = task;
+				entry.CreateDate = task.CreateDate;
+				entry.Deadline = DateTime.MaxValue;
+				entries [task] = entry;
+				Index (entry);
+				if (entry.Deadline > loaded_at)
+					PushDue (entry);
+				return;
+			}
+
+			bool was_open = entry.IsOpen;
+			DateTime old_deadline = entry.Deadline;
+
+			Unindex (entry);
+			Index (entry);
+
+			// Leave the heap alone when only the summary or the like
+			// changed, so a save does not make a task come due twice.
+			if (entry.IsOpen == was_open && entry.Deadline == old_deadline)
+				return;
+			entry.Version++;
+			PushDue (entry);
+			if (due.Count > 2 * entries.Count + 16)
+				RebuildDue ();
+		}
+
+		public void Remove (Task task)
+		{
+			Entry entry;
+			if (!entries.TryGetValue (task, out entry))
+				return;
+
+			Unindex (entry);
+			entries.Remove (task);
+
+			// Stale heap items are also recognized by their entry being gone
+			entry.Version++;
+			if (due.Count > 2 * entries.Count + 16)
+				RebuildDue ();
+		}
+
+		public void Clear ()
+		{
+			entries.Clear ();
+			by_note.Clear ();
+			open.Clear ();
+			due.Clear ();
+			completed_count = 0;
+		}
+
+		/// <summary>
+		/// The tasks whose origin note is the note with the specified URI.
+		/// The list is a copy, so the tasks can be deleted while going
+		/// through it.
+		/// </summary>
+		public List<Task> GetTasksForNote (string note_uri)
+		{
+			List<Task> tasks;
+			if (note_uri == null || !by_note.TryGetValue (note_uri, out tasks))
+				return new List<Task> ();
+			return new List<Task> (tasks);
+		}
+
+		/// <summary>
+		/// The first max_count open tasks, the soonest due first and, among
+		/// tasks due on the same day, the highest priority first.  Tasks
+		/// with no due date come last, oldest first.
+		/// </summary>
+		public List<Task> GetTopOpenTasks (int max_count)
+		{
+			int count = Math.Min (max_count, open.Count);
+			List<Task> tasks = new List<Task> (count);
+			for (int i = 0; i < count; i++)
+				tasks.Add (open [i].Task);
+			return tasks;
+		}
+
+		/// <summary>
+		/// Remove and return the open tasks that became overdue at or
+		/// before now.  A task is returned once for each due date it is
+		/// given, and again only if it is re-opened.
+		/// </summary>
+		public List<Task> TakeOverdue (DateTime now)
+		{
+			List<Task> overdue = new List<Task> ();
+			while (true) {
+				DropStaleDueItems ();
+				if (due.Count == 0 || due [0].Deadline > now)
+					break;
+				overdue.Add (due [0].Entry.Task);
+				PopDue ();
+			}
+			return overdue;
+		}
+		#endregion // Public Methods
+
+		#region Private Methods
+		void Index (Entry entry)
+		{
+			Task task = entry.Task;
+			entry.NoteUri = task.OriginNoteUri;
+			entry.IsOpen = !task.IsComplete;
+			entry.Deadline = GetDeadline (task.DueDate);
+			entry.Priority = (int) task.Priority;
+
+			if (entry.NoteUri != null) {
+				List<Task> note_tasks;
+				if (!by_note.TryGetValue (entry.NoteUri, out note_tasks)) {
+					note_tasks = new List<Task> ();
+					by_note [entry.NoteUri] = note_tasks;
+				}
+				note_tasks.Add (task);
+			}
+
+			if (entry.IsOpen) {
+				int i = open.BinarySearch (entry, OpenComparer.Instance);
+				open.Insert (i < 0 ? ~i : i, entry);
+			} else
+				completed_count++;
+		}
+
+		void Unindex (Entry entry)
+		{
+			if (entry.NoteUri != null) {
+				List<Task> note_tasks;
+				if (by_note.TryGetValue (entry.NoteUri, out note_tasks)) {
+					note_tasks.Remove (entry.Task);
+					if (note_tasks.Count == 0)
+						by_note.Remove (entry.NoteUri);
+				}
+			}
+
+			if (entry.IsOpen) {
+				int i = open.BinarySearch (entry, OpenComparer.Instance);
+				if (i >= 0)
+					open.RemoveAt (i);
+			} else
+				completed_count--;
+		}
+
+		bool IsCurrent (DueItem item)
+		{
+			Entry entry;
+			return entries.TryGetValue (item.Entry.Task, out entry) &&
+			       entry == item.Entry &&
+			       entry.Version == item.Version &&
+			       entry.IsOpen;
+		}
+
+		void DropStaleDueItems ()
+		{
+			while (due.Count > 0 && !IsCurrent (due [0]))
+				PopDue ();
+		}
+
+		void PushDue (Entry entry)
+		{
+			if (!entry.IsOpen || entry.Deadline == DateTime.MaxValue)
+				return;
+
+			DueItem item = new DueItem ();
+			item.Deadline = entry.Deadline;
+			item.Entry = entry;
+			item.Version = entry.Version;
+
+			int i = due.Count;
+			due.Add (item);
+			while (i > 0) {
+				int parent = (i - 1) / 2;
+				if (due [parent].Deadline <= item.Deadline)
+					break;
+				due [i] = due [parent];
+				i = parent;
+			}
+			due [i] = item;
+		}
+
+		void PopDue ()
+		{
+			int last = due.Count - 1;
+			DueItem item = due [last];
+			due.RemoveAt (last);
+			if (last == 0)
+				return;
+
+			int i = 0;
+			while (true) {
+				int child = 2 * i + 1;
+				if (child >= last)
+					break;
+				if (child + 1 < last && due [child + 1].Deadline < due [child].Deadline)
+					child++;
+				if (item.Deadline <= due [child].Deadline)
+					break;
+				due [i] = due [child];
+				i = child;
+			}
+			due [i] = item;
+		}
+
+		/// <summary>
+		/// Start the heap over from the current entries, once stale items
+		/// outnumber the live ones.
+		/// </summary>
+		void RebuildDue ()
+		{
+			List<DueItem> old_due = due;
+			due = new List<DueItem> (entries.Count);
+			foreach (DueItem item in old_due) {
+				if (IsCurrent (item))
+					PushDue (item.Entry);
+			}
+		}
+
+		class OpenComparer : IComparer<Entry>
+		{
+			public static readonly OpenComparer Instance = new OpenComparer ();
+
+			public int Compare (Entry a, Entry b)
+			{
+				int result = DateTime.Compare (a.Deadline, b.Deadline);
+				if (result == 0)
+					result = b.Priority.CompareTo (a.Priority);
+				if (result == 0)
+					result = DateTime.Compare (a.CreateDate, b.CreateDate);
+				if (result == 0)
+					result = String.CompareOrdinal (a.Task.Uri, b.Task.Uri);
+				return result;
+			}
+		}
+		#endregion // Private Methods
+	}
+}
@@ -64,6 +64,16 @@ enum SortColumn :
 			note_pixbuf = GuiUtils.GetIcon ("note", 8);
 		}
 
+		/// <summary>
+		/// Flag the window, if it is open and not focused, when a task
+		/// becomes overdue.  The task's row redraws itself in red.
+		/// </summary>
+		public static void NotifyTaskOverdue (Task task)
+		{
+			if (instance != null && instance.Visible && !instance.HasToplevelFocus)
+				instance.UrgencyHint = true;
+		}
+
 		public static TaskListWindow GetInstance (TaskManager manager)
 		{
 			if (instance == null)
@@ -191,6 +201,7 @@ enum SortColumn :
 			this.Add (content_vbox);
 			this.DeleteEvent += OnDelete;
 			this.KeyPressEvent += OnKeyPressed; // For Escape
+			this.FocusInEvent += OnFocusIn;
 
 			SetUpTreeModel ();
 		}
@@ -412,6 +423,11 @@ enum SortColumn :
 				crt.Text = String.Empty;
 			else
 				crt.Text = task.Summary;
+
+			// Overdue tasks stand out
+			crt.ForegroundSet = task != null && task.IsOverdue;
+			if (crt.ForegroundSet)
+				crt.Foreground = "red";
 		}
 
 		void DueDateCellDataFunc (Gtk.TreeViewColumn tree_column,
@@ -491,10 +507,8 @@ enum SortColumn :
 
 			if (show_completed_tasks)
 				return true; // Show all tasks
-			else if (task.CompletionDate == DateTime.MinValue)
-				return true; // No completion date set
 
-			return false;
+			return manager.Index.IsOpen (task);
 		}
 
 		void UpdateTaskCount (int total)
@@ -678,7 +692,7 @@ enum SortColumn :
 		/// </summary>
 		void OnNewTask (object sender, EventArgs args)
 		{
-			int new_num = manager.Tasks.IterNChildren ();
+			int new_num = manager.Index.Count;
 			string summary;
 
 			while (true) {
@@ -788,6 +802,11 @@ enum SortColumn :
 			instance = null;
 		}
 
+		void OnFocusIn (object sender, Gtk.FocusInEventArgs args)
+		{
+			UrgencyHint = false;
+		}
+
 		void OnDelete (object sender, Gtk.DeleteEventArgs args)
 		{
 			OnCloseWindow (sender, EventArgs.Empty);
@@ -1041,14 +1060,12 @@ enum SortColumn :
 
 		void OnTaskAdded (TaskManager manager, Task task)
 		{
-			int cnt = manager.Tasks.IterNChildren ();
-			UpdateTaskCount (cnt);
+			UpdateTaskCount (manager.Index.Count);
 		}
 
 		void OnTaskDeleted (TaskManager manager, Task task)
 		{
-			int cnt = manager.Tasks.IterNChildren ();
-			UpdateTaskCount (cnt);
+			UpdateTaskCount (manager.Index.Count);
 		}
 
 		void OnTaskStatusChanged (Task task)
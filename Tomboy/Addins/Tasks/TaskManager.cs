@@ -17,6 +17,11 @@ namespace Tomboy.Tasks
 
 		Gtk.ListStore tasks;
 		Dictionary<string, Gtk.TreeIter> task_iters;
+		TaskIndex index;
+
+		// The timeout set to the next task's due date, and that date
+		uint overdue_timeout;
+		DateTime overdue_deadline;
 		#endregion // Private Members
 
 		#region Constructors
@@ -34,6 +39,7 @@ public TaskManager (string directory) :
 
 			tasks = new Gtk.ListStore (typeof (Task));
 			task_iters = new Dictionary<string,Gtk.TreeIter> ();
+			index = new TaskIndex ();
 
 			bool first_run = FirstRun ();
 			CreateTasksDir ();
@@ -44,6 +50,8 @@ public TaskManager (string directory) :
 			} else {
 				LoadTasks ();
 			}
+
+			ScheduleOverdueTimeout ();
 		}
 		#endregion // Constructors
 
@@ -54,6 +62,16 @@ public TaskManager (string directory) :
 				return tasks;
 			}
 		}
+
+		/// <summary>
+		/// The tasks by origin note, status and due date.
+		/// </summary>
+		public TaskIndex Index
+		{
+			get {
+				return index;
+			}
+		}
 		#endregion // Public Properties
 
 		#region Public Methods
@@ -99,6 +117,9 @@ public TaskManager (string directory) :
 				task.Delete ();
 			}
 
+			index.Remove (task);
+			ScheduleOverdueTimeout ();
+
 			Logger.Log ("Deleting task '{0}'.", task.Summary);
 
 			if (TaskDeleted != null)
@@ -129,6 +150,9 @@ public TaskManager (string directory) :
 			tasks.SetValue (iter, 0, new_task);
 			task_iters [new_task.Uri] = iter;
 
+			index.Update (new_task);
+			ScheduleOverdueTimeout ();
+
 			if (TaskAdded != null)
 				TaskAdded (this, new_task);
 
@@ -179,6 +203,11 @@ public TaskManager (string directory) :
 					task.Save ();
 				} while (tasks.IterNext (ref iter));
 			}
+
+			if (overdue_timeout != 0) {
+				GLib.Source.Remove (overdue_timeout);
+				overdue_timeout = 0;
+			}
 		}
 
 		/// <summary>
@@ -186,19 +215,16 @@ public TaskManager (string directory) :
 		/// </summary>
 		public List<Task> GetTasksForNote (Note note)
 		{
-			List<Task> list = new List<Task> ();
-
-			Gtk.TreeIter iter;
-			if (tasks.GetIterFirst (out iter)) {
-				do {
-					Task task = tasks.GetValue (iter, 0) as Task;
-					if (task.OriginNoteUri != null &&
-					                task.OriginNoteUri.CompareTo (note.Uri) == 0)
-						list.Add (task);
-				} while (tasks.IterNext (ref iter));
-			}
+			return index.GetTasksForNote (note.Uri);
+		}
 
-			return list;
+		/// <summary>
+		/// Return the first max_count open tasks, ordered by due date and
+		/// then by priority.
+		/// </summary>
+		public List<Task> GetTopOpenTasks (int max_count)
+		{
+			return index.GetTopOpenTasks (max_count);
 		}
 		#endregion // Public Methods
 
@@ -208,6 +234,12 @@ public TaskManager (string directory) :
 		public static event TaskRenamedHandler TaskRenamed;
 		public static event TaskSavedHandler TaskSaved;
 		public static event TaskStatusChangedHandler TaskStatusChanged;
+
+		/// <summary>
+		/// Raised when the day an open task is due has passed, once for
+		/// each due date the task is given.
+		/// </summary>
+		public static event TasksChangedHandler TaskOverdue;
 		#endregion // Events
 
 		#region Private Methods
@@ -263,6 +295,8 @@ public TaskManager (string directory) :
 		protected virtual void LoadTasks ()
 		{
 			string [] files = Directory.GetFiles (tasks_dir, "*.task");
+			// Due dates that passed before this run are not reported again
+			DateTime loaded_at = DateTime.Now;
 
 			foreach (string file_path in files) {
 				try {
@@ -275,6 +309,7 @@ public TaskManager (string directory) :
 						Gtk.TreeIter iter = tasks.Append ();
 						tasks.SetValue (iter, 0, task);
 						task_iters [task.Uri] = iter;
+						index.Update (task, loaded_at);
 					}
 				} catch (System.Xml.XmlException e) {
 					Logger.Log ("Error parsing task XML, skipping \"{0}\": {1}",
@@ -301,6 +336,30 @@ public TaskManager (string directory) :
 			}
 		}
 
+		/// <summary>
+		/// Make sure the overdue timeout fires when the next open task
+		/// becomes overdue, and not before.  Timeouts longer than GLib
+		/// allows are re-set when they fire.
+		/// </summary>
+		void ScheduleOverdueTimeout ()
+		{
+			DateTime deadline = index.NextDeadline;
+			if (overdue_timeout != 0) {
+				if (deadline == overdue_deadline)
+					return;
+				GLib.Source.Remove (overdue_timeout);
+				overdue_timeout = 0;
+			}
+
+			overdue_deadline = deadline;
+			if (deadline == DateTime.MaxValue)
+				return;
+
+			double delay = (deadline - DateTime.Now).TotalMilliseconds;
+			delay = Math.Max (0, Math.Min (delay, Int32.MaxValue));
+			overdue_timeout = GLib.Timeout.Add ((uint) delay, OnOverdueTimeout);
+		}
+
 		#endregion // Private Methods
 
 		#region Event Handlers
@@ -314,6 +373,11 @@ public TaskManager (string directory) :
 
 		void OnTaskSaved (Task task)
 		{
+			if (index.Contains (task)) {
+				index.Update (task);
+				ScheduleOverdueTimeout ();
+			}
+
 			EmitRowChangedForTask (task);
 
 			if (TaskSaved != null)
@@ -322,12 +386,32 @@ public TaskManager (string directory) :
 
 		void OnTaskStatusChanged (Task task)
 		{
+			if (index.Contains (task)) {
+				index.Update (task);
+				ScheduleOverdueTimeout ();
+			}
+
 			EmitRowChangedForTask (task);
 
 			if (TaskStatusChanged != null)
 				TaskStatusChanged (task);
 		}
 
+		bool OnOverdueTimeout ()
+		{
+			overdue_timeout = 0;
+
+			foreach (Task task in index.TakeOverdue (DateTime.Now)) {
+				EmitRowChangedForTask (task);
+
+				if (TaskOverdue != null)
+					TaskOverdue (this, task);
+			}
+
+			ScheduleOverdueTimeout ();
+			return false;
+		}
+
 		#endregion // Event Handlers
 	}
 }
@@ -87,6 +87,7 @@ namespace Tomboy.Tasks
 				Tomboy.ActionManager.UI.InsertActionGroup (action_group, 0);
 
 				Tomboy.DefaultNoteManager.NoteDeleted += OnNoteDeleted;
+				TaskManager.TaskOverdue += OnTaskOverdue;
 
 				tomboy_tray_menu = GetTomboyTrayMenu ();
 				tomboy_tray_menu.Shown += OnTomboyTrayMenuShown;
@@ -102,6 +103,8 @@ namespace Tomboy.Tasks
 			manager.Shutdown ();
 			manager = null;
 
+			TaskManager.TaskOverdue -= OnTaskOverdue;
+
 			try {
 				Tomboy.ActionManager.UI.RemoveActionGroup (action_group);
 			} catch {}
@@ -124,29 +127,8 @@ namespace Tomboy.Tasks
 			int list_size = 0;
 			Gtk.MenuItem item;
 
-			// Filter the tasks to the ones that are incomplete
-			Gtk.TreeModelFilter store_filter =
-			        new Gtk.TreeModelFilter (TasksApplicationAddin.DefaultTaskManager.Tasks, null);
-			store_filter.VisibleFunc = FilterTasks;
-
-			// TODO: Sort the tasks to order by due date and priority
-			//   store_sort = new Gtk.TreeModelSort (store_filter);
-			//   store_sort.DefaultSortFunc =
-			//    new Gtk.TreeIterCompareFunc (TaskSortFunc);
-
-			//   tree.Model = store_sort;
-
-			//   int cnt = tree.Model.IterNChildren ();
-
-			//   task_count.Text = string.Format (
-			//    Catalog.GetPluralString("Total: {0} task",
-			//       "Total: {0} tasks",
-			//       cnt),
-			//    cnt);
-
-
-			// List the top "max_size" tasks
-			Gtk.TreeIter iter;
+			// List the top "max_size" incomplete tasks, which the task
+			// index keeps ordered by due date and priority
 			Gtk.SeparatorMenuItem separator;
 
 			// Determine whether the icon is near the top/bottom of the screen
@@ -167,15 +149,12 @@ namespace Tomboy.Tasks
 			top_tasks.Add (item);
 			item.Activated += OnOpenTodoList;
 
-			if (store_filter.GetIterFirst (out iter)) {
-				do {
-					Task task = store_filter.GetValue (iter, 0) as Task;
-					item = new TomboyTaskMenuItem (task);
-					tomboy_tray_menu.Insert (item, list_size + position);
-					item.ShowAll ();
-					top_tasks.Add (item);
-					list_size++;
-				} while (store_filter.IterNext (ref iter) && list_size < max_size);
+			foreach (Task task in DefaultTaskManager.GetTopOpenTasks (max_size)) {
+				item = new TomboyTaskMenuItem (task);
+				tomboy_tray_menu.Insert (item, list_size + position);
+				item.ShowAll ();
+				top_tasks.Add (item);
+				list_size++;
 			}
 		}
 
@@ -213,6 +192,12 @@ namespace Tomboy.Tasks
 			}
 		}
 
+		private void OnTaskOverdue (TaskManager manager, Task task)
+		{
+			Logger.Info ("Task is overdue: {0}", task.Summary);
+			TaskListWindow.NotifyTaskOverdue (task);
+		}
+
 		private Gtk.Menu GetTomboyTrayMenu ()
 		{
 			Gtk.Menu menu =
@@ -221,21 +206,6 @@ namespace Tomboy.Tasks
 			return menu;
 		}
 
-		/// <summary>
-		/// Only allow incomplete tasks to pass this filter
-		/// </summary>
-		bool FilterTasks (Gtk.TreeModel model, Gtk.TreeIter iter)
-		{
-			Task task = model.GetValue (iter, 0) as Task;
-			if (task == null)
-				return false;
-
-			if (task.CompletionDate == DateTime.MinValue)
-				return true; // No completion date set
-
-			return false;
-		}
-
 		void OnOpenTodoList (object sender, EventArgs args)
 		{
 			Tomboy.ActionManager ["OpenToDoListAction"].Activate ();
@@ -260,7 +230,11 @@ namespace Tomboy.Tasks
 			this.task = task;
 
 			summary = new Label ();
-			summary.Markup = task.Summary;
+			if (task.IsOverdue)
+				summary.Markup = String.Format ("<span foreground='red'>{0}</span>",
+				                                task.Summary);
+			else
+				summary.Markup = task.Summary;
 			summary.UseUnderline = false;
 			summary.UseMarkup = true;
 			summary.Xalign = 0;
@@ -59,6 +59,24 @@ namespace Tomboy.WebSync.Api
 		{
 			return null;
 		}
+
+		public object GetJson (string uri, IDictionary<string, string> parameters)
+		{
+			HttpWebRequest webRequest = CreateRequest ("GET", BuildUri (uri, parameters));
+			try {
+				return WebTransport.ReadJson (webRequest);
+			} catch (Exception e) {
+				Logger.Error ("Caught exception. Message: {0}", e.Message);
+				Logger.Error ("Stack trace for previous exception: {0}", e.StackTrace);
+				throw;
+			}
+		}
+
+		public string PutJson (string uri, IDictionary<string, string> parameters,
+		                       Action<TextWriter> writeBody, bool compress)
+		{
+			return null;
+		}
 		#endregion
 
 		#region Private Methods
@@ -67,19 +85,10 @@ namespace Tomboy.WebSync.Api
 			string responseData = string.Empty;
 			HttpWebRequest webRequest;
 
-			ServicePointManager.SecurityProtocol |= SecurityProtocolType.Tls11 | SecurityProtocolType.Tls12;
-
-			ServicePointManager.CertificatePolicy = new CertificateManager ();
-
 			try {
-				webRequest = ProxiedWebRequest.Create (uri);
+				webRequest = CreateRequest (method, uri);
 
-				webRequest.Method = method;
-				webRequest.ServicePoint.Expect100Continue = false;
-
-				using (var responseReader = new StreamReader (webRequest.GetResponse ().GetResponseStream ())) {
-					responseData = responseReader.ReadToEnd ();
-				}
+				responseData = WebTransport.ReadString (webRequest);
 			} catch (Exception e) {
 				Logger.Error ("Caught exception. Message: {0}", e.Message);
 				Logger.Error ("Stack trace for previous exception: {0}", e.StackTrace);
@@ -89,6 +98,18 @@ namespace Tomboy.WebSync.Api
 			return responseData;
 		}
 
+		private HttpWebRequest CreateRequest (string method, string uri)
+		{
+			ServicePointManager.SecurityProtocol |= SecurityProtocolType.Tls11 | SecurityProtocolType.Tls12;
+
+			ServicePointManager.CertificatePolicy = new CertificateManager ();
+
+			HttpWebRequest webRequest = ProxiedWebRequest.Create (uri);
+			webRequest.Method = method;
+			WebTransport.Prepare (webRequest);
+			return webRequest;
+		}
+
 		private string BuildUri (string baseUri, IDictionary<string, string> queryParameters)
 		{
 			StringBuilder urlBuilder = new StringBuilder (baseUri);	// TODO: Capacity?
@@ -25,6 +25,7 @@
 
 using System;
 using System.Collections.Generic;
+using System.IO;
 
 namespace Tomboy.WebSync.Api
 {
@@ -37,5 +38,19 @@ namespace Tomboy.WebSync.Api
 		string Put (string uri, IDictionary<string, string> queryParameters, string putValue);
 
 		string Post (string uri, IDictionary<string, string> queryParameters, string postValue);
+
+		/// <summary>
+		/// Like Get, but the JSON response is parsed as it arrives rather
+		/// than returned as a string.
+		/// </summary>
+		object GetJson (string uri, IDictionary<string, string> queryParameters);
+
+		/// <summary>
+		/// Like Put, but the JSON body is written by writeBody instead of
+		/// being built as one string first, and is gzipped if compress
+		/// is set.
+		/// </summary>
+		string PutJson (string uri, IDictionary<string, string> queryParameters,
+		                Action<TextWriter> writeBody, bool compress);
 	}
 }
\ No newline at end of file
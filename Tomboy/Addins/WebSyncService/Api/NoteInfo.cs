@@ -65,6 +65,12 @@ namespace Tomboy.WebSync.Api
 				key = NoteContentVersionElementName;
 				if (jsonObj.TryGetValue (key, out val))
 					note.NoteContentVersion = (double) val;
+				key = NoteContentDeltaElementName;
+				if (jsonObj.TryGetValue (key, out val))
+					note.NoteContentDelta = (string) val;
+				key = NoteContentDeltaBaseElementName;
+				if (jsonObj.TryGetValue (key, out val))
+					note.NoteContentDeltaBase = (string) val;
 
 				key = LastChangeDateElementName;
 				if (jsonObj.TryGetValue (key, out val))
@@ -128,7 +134,11 @@ namespace Tomboy.WebSync.Api
 
 			if (Title != null)
 				noteUpdateObj [TitleElementName] = Title;
-			if (NoteContent != null)
+			if (NoteContentDelta != null) {
+				// Only sent to servers supporting RootInfo.NoteDeltaExtension
+				noteUpdateObj [NoteContentDeltaElementName] = NoteContentDelta;
+				noteUpdateObj [NoteContentDeltaBaseElementName] = NoteContentDeltaBase;
+			} else if (NoteContent != null)
 				noteUpdateObj [NoteContentElementName] = NoteContent;
 			if (NoteContentVersion.HasValue)
 				noteUpdateObj [NoteContentVersionElementName] = NoteContentVersion.Value;
@@ -175,6 +185,19 @@ namespace Tomboy.WebSync.Api
 		public string NoteContent { get; set; }
 
 		public double? NoteContentVersion { get; set; }
+
+		/// <summary>
+		/// Base64 NoteDelta turning the note-content whose hash is
+		/// NoteContentDeltaBase into this note's note-content.  When set,
+		/// it is sent instead of NoteContent.
+		/// </summary>
+		public string NoteContentDelta { get; set; }
+
+		/// <summary>
+		/// Base64 SHA-1 (NoteDelta.HashString) of the note-content
+		/// NoteContentDelta applies to.
+		/// </summary>
+		public string NoteContentDeltaBase { get; set; }
 		
 		public DateTime? LastChangeDate { get; set; }
 		
@@ -201,6 +224,8 @@ namespace Tomboy.WebSync.Api
 		private const string TitleElementName = "title";
 		private const string NoteContentElementName = "note-content";
 		private const string NoteContentVersionElementName = "note-content-version";
+		private const string NoteContentDeltaElementName = "note-content-delta";
+		private const string NoteContentDeltaBaseElementName = "note-content-delta-base";
 		private const string LastChangeDateElementName = "last-change-date";
 		private const string LastMetadataChangeDateElementName = "last-metadata-change-date";
 		private const string CreateDateElementName = "create-date";
@@ -127,6 +127,22 @@ namespace Tomboy.WebSync.Api
 			                   BuildUri (uri, queryParameters),
 			                   postValue);
 		}
+
+		public object GetJson (string uri, IDictionary<string, string> queryParameters)
+		{
+			HttpWebRequest webRequest = CreateRequest (RequestMethod.GET,
+			                                           BuildUri (uri, queryParameters));
+			return ReadResponse (webRequest, WebTransport.ReadJson);
+		}
+
+		public string PutJson (string uri, IDictionary<string, string> queryParameters,
+		                       Action<TextWriter> writeBody, bool compress)
+		{
+			HttpWebRequest webRequest = CreateRequest (RequestMethod.PUT,
+			                                           BuildUri (uri, queryParameters));
+			WebTransport.WriteBody (webRequest, writeBody, compress);
+			return ReadResponse (webRequest, WebTransport.ReadString);
+		}
 		#endregion
 
 		#region Public Properties
@@ -177,6 +193,31 @@ namespace Tomboy.WebSync.Api
 		/// <param name="postData">Data to post (query string format), if POST methods.</param>
 		/// <returns>The web server response.</returns>
 		private string WebRequest (RequestMethod method, string url, string postData)
+		{
+			HttpWebRequest webRequest = CreateRequest (method, url);
+
+			if (Debugging)
+				Logger.Debug ("Post data: {0}", postData);
+
+			if (method == RequestMethod.PUT ||
+			     method == RequestMethod.POST)
+				WebTransport.WriteBody (webRequest, postData, false);
+
+			var ret = ReadResponse (webRequest, WebTransport.ReadString);
+
+			if (Debugging)
+				Logger.Debug ("Returned value from web request: {0}", ret);
+
+			return ret;
+		}
+
+		/// <summary>
+		/// Create a web request signed using OAuth.
+		/// </summary>
+		/// <param name="method">HTTP method of the request.</param>
+		/// <param name="url">The full URL, including the query string.</param>
+		/// <returns>The request, ready for a body to be written.</returns>
+		private HttpWebRequest CreateRequest (RequestMethod method, string url)
 		{
 			Uri uri = new Uri (url);
 
@@ -206,39 +247,14 @@ namespace Tomboy.WebSync.Api
 			                                            s => string.IsNullOrEmpty (s)));
 			parameters.Sort ();
 
-			if (Debugging)
-				Logger.Debug ("Post data: {0}", postData);
-
-			var ret = MakeWebRequest (method, url, parameters, postData);
-
-			if (Debugging)
-				Logger.Debug ("Returned value from web request: {0}", ret);
-
-			return ret;
-		}
-
-		/// <summary>
-		/// Wraps a web request into a convenient package.
-		/// </summary>
-		/// <param name="method">HTTP method of the request.</param>
-		/// <param name="url">Full URL to the web resource.</param>
-		/// <param name="postData">Data to post in query string format.</param>
-		/// <returns>The web server response.</returns>
-		private string MakeWebRequest (RequestMethod method,
-		                               string url,
-		                               List<IQueryParameter<string>> parameters,
-		                               string postData)
-		{
-			var responseData = string.Empty;
-
 			ServicePointManager.SecurityProtocol |= SecurityProtocolType.Tls11 | SecurityProtocolType.Tls12;
 
 			ServicePointManager.CertificatePolicy = new CertificateManager ();
 
-			// TODO: Set UserAgent, Timeout, KeepAlive, Proxy?
+			// TODO: Set UserAgent, Timeout, Proxy?
 			HttpWebRequest webRequest = ProxiedWebRequest.Create (url);
 			webRequest.Method = method.ToString ();
-			webRequest.ServicePoint.Expect100Continue = false;
+			WebTransport.Prepare (webRequest);
 
 			var headerParams =
 				parameters.Implode (",", q => string.Format ("{0}=\"{1}\"", q.Name, q.Value));
@@ -247,33 +263,19 @@ namespace Tomboy.WebSync.Api
 			webRequest.Headers.Add ("Authorization",
 			                        String.Format ("OAuth realm=\"{0}\",{1}",
 			                                       Realm, headerParams));
-            if (postData == null) {
-                postData = string.Empty;
-            }
-
-			if (method == RequestMethod.PUT ||
-			     method == RequestMethod.POST) {
-				webRequest.ContentType = "application/json";
-				// TODO: Error handling?
-				using (var requestWriter = new StreamWriter (webRequest.GetRequestStream ()))
-					requestWriter.Write (postData);
-			}
+			return webRequest;
+		}
 
+		private T ReadResponse<T> (HttpWebRequest webRequest, Func<HttpWebRequest, T> read)
+		{
 			try {
-				using (var responseReader = new StreamReader (webRequest.GetResponse ().GetResponseStream ())) {
-			      		responseData = responseReader.ReadToEnd ();
-				}
+				return read (webRequest);
 			} catch (Exception e) {
 				Logger.Error ("Caught exception. Message: {0}", e.Message);
 				Logger.Error ("Stack trace for previous exception: {0}", e.StackTrace);
 				Logger.Error ("Rest of stack trace for above exception: {0}", System.Environment.StackTrace);
 				throw;
 			}
-
-			if (Debugging)
-				Logger.Debug ("Made web request, got response: {0}", responseData);
-
-			return responseData;
 		}
 
 		private string BuildUri (string baseUri, IDictionary<string, string> queryParameters)
@@ -24,11 +24,38 @@
 // 
 
 using System;
+using System.Collections.Generic;
 
 namespace Tomboy.WebSync.Api
 {
 	public class RootInfo
 	{
+		/// <summary>
+		/// Optional API extension: notes may be sent and received as
+		/// "note-content-delta" against a "note-content-delta-base".
+		/// An upload whose base doesn't match the server's copy of the
+		/// note is rejected as a whole with "409 Conflict" and
+		/// NoteDeltaBaseMismatchError as its "error".
+		/// </summary>
+		public const string NoteDeltaExtension = "note-delta-1";
+
+		/// <summary>
+		/// "error" of an upload rejected for a stale delta base.
+		/// </summary>
+		public const string NoteDeltaBaseMismatchError = "note-delta-base-mismatch";
+
+		/// <summary>
+		/// Optional API extension: the notes resource takes "offset" and
+		/// "limit" parameters and reports "total-notes".
+		/// </summary>
+		public const string PagedNotesExtension = "paged-notes-1";
+
+		/// <summary>
+		/// Optional API extension: request bodies may be sent with
+		/// "Content-Encoding: gzip" and "Transfer-Encoding: chunked".
+		/// </summary>
+		public const string GzipRequestExtension = "gzip-request-1";
+
 		#region Public Static Methods
 		
 		public static RootInfo GetRoot (string rootUri, IWebConnection connection)
@@ -66,6 +93,15 @@ namespace Tomboy.WebSync.Api
 			root.AccessTokenUrl = (string) jsonObj ["oauth_access_token_url"];
 			root.RequestTokenUrl = (string) jsonObj ["oauth_request_token_url"];
 
+			root.ApiExtensions = new List<string> ();
+			if (jsonObj.TryGetValue ("api-extensions", out val)) {
+				foreach (object extension in (Hyena.Json.JsonArray) val) {
+					string name = extension as string;
+					if (name != null)
+						root.ApiExtensions.Add (name);
+				}
+			}
+
 			return root;
 		}
 
@@ -83,6 +119,12 @@ namespace Tomboy.WebSync.Api
 
 		public string RequestTokenUrl { get; private set; }
 
+		/// <summary>
+		/// Extensions to the 1.0 API the server supports.  Empty for
+		/// servers that don't list any.
+		/// </summary>
+		public IList<string> ApiExtensions { get; private set; }
+
 		#endregion
 	}
 }
@@ -106,29 +106,106 @@ namespace Tomboy.WebSync.Api
 
 		public IList<NoteInfo> GetNotes (bool includeContent, int sinceRevision, out int? latestSyncRevision)
 		{
-			// TODO: Error-handling in GET and Deserialize
-			string jsonString = string.Empty;
+			return GetNotes (includeContent, sinceRevision, false, out latestSyncRevision);
+		}
 
+		/// <summary>
+		/// Like GetNotes, but when includeDeltas is set the server may
+		/// send "note-content-delta" against the note-content of
+		/// sinceRevision instead of the full content.  Only for servers
+		/// supporting RootInfo.NoteDeltaExtension.
+		/// </summary>
+		public IList<NoteInfo> GetNotes (bool includeContent, int sinceRevision, bool includeDeltas, out int? latestSyncRevision)
+		{
+			int? totalNotes;
+			return GetNotes (includeContent, sinceRevision, includeDeltas, 0, -1,
+			                 out latestSyncRevision, out totalNotes);
+		}
+
+		/// <summary>
+		/// Fetch one page of notes: at most limit of them, skipping the
+		/// first offset, along with the total number of notes matching.
+		/// A negative limit fetches them all.  Paging needs a server
+		/// supporting RootInfo.PagedNotesExtension.
+		/// </summary>
+		public IList<NoteInfo> GetNotes (bool includeContent, int sinceRevision, bool includeDeltas,
+		                                 int offset, int limit,
+		                                 out int? latestSyncRevision, out int? totalNotes)
+		{
+			// TODO: Error-handling in GET and Deserialize
 			Dictionary<string, string> parameters =
 				new Dictionary<string, string> ();
 			if (includeContent)
 				parameters ["include_notes"] = "true";
 			if (sinceRevision >= 0)
 				parameters ["since"] = sinceRevision.ToString ();
+			if (includeDeltas)
+				parameters ["include_deltas"] = "true";
+			if (offset > 0)
+				parameters ["offset"] = offset.ToString ();
+			if (limit >= 0)
+				parameters ["limit"] = limit.ToString ();
 			
-			jsonString = Connection.Get (Notes.ApiRef, parameters);
+			Hyena.Json.JsonObject jsonObj =
+				Connection.GetJson (Notes.ApiRef, parameters) as Hyena.Json.JsonObject;
+			if (jsonObj == null)
+				throw new ArgumentException ("Server response does not contain a valid note list representation");
+
+			object val;
+			if (jsonObj.TryGetValue (TotalNotesElementName, out val))
+				totalNotes = (int) val;
+			else
+				totalNotes = null;
+
+			return ParseJsonNotes (jsonObj, out latestSyncRevision);
+		}
 
-			return ParseJsonNotes (jsonString, out latestSyncRevision);
+		/// <summary>
+		/// Fetch a single note, with its full content.
+		/// </summary>
+		public NoteInfo GetNote (ResourceReference noteRef)
+		{
+			// TODO: Error-handling in GET and Deserialize
+			Hyena.Json.JsonObject jsonObj =
+				Connection.GetJson (noteRef.ApiRef, null) as Hyena.Json.JsonObject;
+			if (jsonObj == null)
+				throw new ArgumentException ("Server response does not contain a valid note representation");
+
+			// The note resource wraps the note in a one element array
+			IList<NoteInfo> notes =
+				ParseJsonNoteArray ((Hyena.Json.JsonArray) jsonObj [NoteElementName]);
+			if (notes.Count != 1)
+				throw new ApplicationException ("Expected exactly one note in server response");
+			return notes [0];
 		}
 
 		public int UpdateNotes (IList<NoteInfo> noteUpdates, int expectedNewRevision)
+		{
+			return UpdateNotes (noteUpdates, expectedNewRevision, false);
+		}
+
+		/// <summary>
+		/// Upload note changes as one new revision.  The request body is
+		/// serialized a note at a time, and gzipped if compress is set,
+		/// which needs a server supporting RootInfo.GzipRequestExtension.
+		///
+		/// This is deliberately a single PUT: the API turns every PUT
+		/// into a revision of its own, so splitting a sync into several
+		/// would let other clients see half of it and leave it half
+		/// committed if one of the requests failed.  With compress the
+		/// body is streamed as it is serialized instead.
+		/// </summary>
+		public int UpdateNotes (IList<NoteInfo> noteUpdates, int expectedNewRevision, bool compress)
 		{
 			// TODO: Error-handling in PUT, Serialize, and Deserialize
 
 			string jsonResponseString =
-				Connection.Put (Notes.ApiRef,
-				                null,
-				                CreateNoteChangesJsonString (noteUpdates, expectedNewRevision));
+				Connection.PutJson (Notes.ApiRef,
+				                    null,
+				                    delegate (System.IO.TextWriter writer) {
+				                    	WriteNoteChangesJson (writer, noteUpdates, expectedNewRevision);
+				                    },
+				                    compress);
 
 			// TODO: This response object could be extremely useful
 //			using (System.IO.StreamWriter writer = System.IO.File.CreateText ("/home/sandy/lastPutResp"))
@@ -158,8 +235,11 @@ namespace Tomboy.WebSync.Api
 			Hyena.Json.Deserializer deserializer =
 				new Hyena.Json.Deserializer (jsonString);
 			object obj = deserializer.Deserialize ();
-			Hyena.Json.JsonObject jsonObj =
-				obj as Hyena.Json.JsonObject;
+			return ParseJsonNotes (obj as Hyena.Json.JsonObject, out latestSyncRevision);
+		}
+
+		private IList<NoteInfo> ParseJsonNotes (Hyena.Json.JsonObject jsonObj, out int? latestSyncRevision)
+		{
 			Hyena.Json.JsonArray noteArray =
 				(Hyena.Json.JsonArray) jsonObj [NotesElementName];
 
@@ -184,23 +264,35 @@ namespace Tomboy.WebSync.Api
 			return noteList;
 		}
 
-		private string CreateNoteChangesJsonString (IList<NoteInfo> noteUpdates, int? expectedNewRevision)
+		/// <summary>
+		/// Write the same JSON Hyena.Json.Serializer would produce for
+		/// the whole change set, serializing one note at a time so the
+		/// full request never exists as a single string.
+		/// </summary>
+		private void WriteNoteChangesJson (System.IO.TextWriter writer, IList<NoteInfo> noteUpdates, int? expectedNewRevision)
 		{
-			Hyena.Json.JsonObject noteChangesObj =
-				new Hyena.Json.JsonObject ();
-			Hyena.Json.JsonArray noteChangesArray =
-				new Hyena.Json.JsonArray ();
-			foreach (NoteInfo note in noteUpdates)
-				noteChangesArray.Add (note.ToUpdateObject ());
-			noteChangesObj [NoteChangesElementName] = noteChangesArray;
-			if (expectedNewRevision != null)
-				noteChangesObj [LatestSyncRevisionElementName] = expectedNewRevision;
-
-			// TODO: Handle errors
 			Hyena.Json.Serializer serializer =
-				new Hyena.Json.Serializer (noteChangesObj);
-			// TODO: Log this for debugging?
-			return serializer.Serialize ();
+				new Hyena.Json.Serializer ();
+
+			writer.Write ("{");
+			if (expectedNewRevision != null) {
+				serializer.SetInput (LatestSyncRevisionElementName);
+				writer.Write (serializer.Serialize ());
+				writer.Write (":");
+				writer.Write (expectedNewRevision.Value.ToString ());
+				writer.Write (",");
+			}
+			serializer.SetInput (NoteChangesElementName);
+			writer.Write (serializer.Serialize ());
+			writer.Write (":[");
+			for (int i = 0; i < noteUpdates.Count; i++) {
+				if (i > 0)
+					writer.Write (",");
+				// TODO: Handle errors
+				serializer.SetInput (noteUpdates [i].ToUpdateObject ());
+				writer.Write (serializer.Serialize ());
+			}
+			writer.Write ("]}");
 		}
 		
 		#endregion
@@ -209,6 +301,8 @@ namespace Tomboy.WebSync.Api
 
 		private const string LatestSyncRevisionElementName = "latest-sync-revision";
 		private const string NotesElementName = "notes";
+		private const string NoteElementName = "note";
+		private const string TotalNotesElementName = "total-notes";
 		private const string NoteChangesElementName = "note-changes";
 
 		#endregion
@@ -0,0 +1,157 @@
+// Permission is hereby granted, free of charge, to any person obtaining 
+// a copy of this software and associated documentation files (the 
+// "Software"), to deal in the Software without restriction, including 
+// without limitation the rights to use, copy, modify, merge, publish, 
+// distribute, sublicense, and/or sell copies of the Software, and to 
+// permit persons to whom the Software is furnished to do so, subject to 
+// the following conditions: 
+//  
+// The above copyright notice and this permission notice shall be 
+// included in all copies or substantial portions of the Software. 
+//  
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE 
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION 
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+// 
+// Copyright (c) 2009 Novell, Inc. (http://www.novell.com)
+// Copyright (c) 2009 Canonical, Ltd (http://www.canonical.com)
+// 
+// Authors: 
+//      Rodrigo Moya <rodrigo.moya@canonical.com>
+// 
+
+using System;
+using System.IO;
+using System.IO.Compression;
+using System.Net;
+using System.Text;
+
+namespace Tomboy.WebSync.Api
+{
+	/// <summary>
+	/// Request and response handling shared by the IWebConnection
+	/// implementations: persistent connections, gzip in both directions
+	/// and JSON parsed straight off the response stream.
+	/// </summary>
+	public static class WebTransport
+	{
+		/// <summary>
+		/// How many requests to a server may be in flight at once.
+		/// </summary>
+		public const int MaxConcurrentRequests = 4;
+
+		// Small bodies aren't worth compressing
+		private const int minCompressLength = 1024;
+
+		// Size of the chunks of a streamed request body
+		private const int chunkSize = 64 * 1024;
+
+		/// <summary>
+		/// Keep connections open between requests, allow enough of them
+		/// for MaxConcurrentRequests, and accept compressed responses.
+		/// </summary>
+		public static void Prepare (HttpWebRequest webRequest)
+		{
+			webRequest.KeepAlive = true;
+			webRequest.Pipelined = true;
+			webRequest.AutomaticDecompression =
+				DecompressionMethods.GZip | DecompressionMethods.Deflate;
+			webRequest.ServicePoint.Expect100Continue = false;
+			if (webRequest.ServicePoint.ConnectionLimit < MaxConcurrentRequests)
+				webRequest.ServicePoint.ConnectionLimit = MaxConcurrentRequests;
+		}
+
+		/// <summary>
+		/// Send a JSON request body as writeBody produces it.  With
+		/// compress, the body is gzipped; only do that for servers that
+		/// advertise RootInfo.GzipRequestExtension.
+		/// </summary>
+		public static void WriteBody (HttpWebRequest webRequest, Action<TextWriter> writeBody, bool compress)
+		{
+			webRequest.ContentType = "application/json";
+
+			if (!compress) {
+				// Buffered by HttpWebRequest so it can send a
+				// Content-Length, which older servers need
+				// TODO: Error handling?
+				using (var requestWriter = new StreamWriter (webRequest.GetRequestStream ()))
+					writeBody (requestWriter);
+				return;
+			}
+
+			// Servers new enough to take gzip take chunked bodies too, so
+			// send each chunk while the next notes are being serialized
+			// and compressed instead of building the whole body first.
+			webRequest.Headers.Add ("Content-Encoding", "gzip");
+			webRequest.SendChunked = true;
+			webRequest.AllowWriteStreamBuffering = false;
+			using (Stream requestStream = webRequest.GetRequestStream ())
+			using (BufferedStream buffered = new BufferedStream (requestStream, chunkSize))
+			using (GZipStream gzip = new GZipStream (buffered, CompressionMode.Compress))
+			using (var bodyWriter = new StreamWriter (gzip, new UTF8Encoding (false)))
+				writeBody (bodyWriter);
+		}
+
+		/// <summary>
+		/// Send a request body given as a string, compressed if asked and
+		/// long enough to benefit.
+		/// </summary>
+		public static void WriteBody (HttpWebRequest webRequest, string body, bool compress)
+		{
+			if (body == null)
+				body = string.Empty;
+			WriteBody (webRequest,
+			           delegate (TextWriter writer) { writer.Write (body); },
+			           compress && body.Length >= minCompressLength);
+		}
+
+		/// <summary>
+		/// The HTTP status and the "error" member of the JSON body of a
+		/// failed request.  Null if the request didn't get as far as a
+		/// response, or the body has no error.
+		/// </summary>
+		public static string ReadError (WebException e, out HttpStatusCode status)
+		{
+			status = 0;
+			HttpWebResponse response = e.Response as HttpWebResponse;
+			if (response == null)
+				return null;
+
+			status = response.StatusCode;
+			try {
+				using (response)
+				using (var responseReader = new StreamReader (response.GetResponseStream (), Encoding.UTF8)) {
+					Hyena.Json.JsonObject error =
+						new Hyena.Json.Deserializer (responseReader).Deserialize () as Hyena.Json.JsonObject;
+					object message;
+					if (error != null && error.TryGetValue ("error", out message))
+						return message as string;
+				}
+			} catch (Exception readError) {
+				Logger.Debug ("Could not read error response: {0}", readError.Message);
+			}
+			return null;
+		}
+
+		public static string ReadString (HttpWebRequest webRequest)
+		{
+			using (var responseReader = new StreamReader (webRequest.GetResponse ().GetResponseStream ()))
+				return responseReader.ReadToEnd ();
+		}
+
+		/// <summary>
+		/// Parse the JSON response while it downloads, so the raw text is
+		/// never held in memory alongside the parsed objects.
+		/// </summary>
+		public static object ReadJson (HttpWebRequest webRequest)
+		{
+			using (WebResponse response = webRequest.GetResponse ())
+			using (var responseReader = new StreamReader (response.GetResponseStream (), Encoding.UTF8))
+				return new Hyena.Json.Deserializer (responseReader).Deserialize ();
+		}
+	}
+}
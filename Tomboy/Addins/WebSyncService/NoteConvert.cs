@@ -25,8 +25,10 @@
 
 using System;
 using System.Collections.Generic;
+using System.IO;
 using System.Text;
 using System.Text.RegularExpressions;
+using System.Xml;
 
 using Tomboy.Sync;
 using Tomboy.WebSync.Api;
@@ -56,18 +58,43 @@ namespace Tomboy.WebSync
 			foreach (Tag tag in note.Tags)
 				noteInfo.Tags.Add (tag.Name);
 
+			double contentVersion;
+			noteInfo.NoteContent = ParseNoteContent (note.XmlContent, out contentVersion);
+			noteInfo.NoteContentVersion = contentVersion;
+
+			return noteInfo;
+		}
+
+		/// <summary>
+		/// The note-content the web API sends for a complete note file,
+		/// as ToNoteInfo would produce for the note.  Used to rebuild the
+		/// base of a note delta from the last synchronized copy.
+		/// </summary>
+		public static string NoteContentFromXml (string noteXml, string guid)
+		{
+			NoteData data;
+			using (XmlTextReader xml = new XmlTextReader (new StringReader (noteXml))) {
+				xml.Namespaces = false;
+				data = NoteArchiver.Instance.Read (xml, NoteUriFromGuid (guid));
+			}
+			double version;
+			return ParseNoteContent (data.Text, out version);
+		}
+
+		static string ParseNoteContent (string xmlContent, out double version)
+		{
 			const string noteContentRegex =
 				@"^<note-content([^>]+version=""(?<contentVersion>[^""]*)"")?[^>]*((/>)|(>(?<innerContent>.*)</note-content>))$";
-			Match m = Regex.Match (note.XmlContent, noteContentRegex, RegexOptions.Singleline);
+			Match m = Regex.Match (xmlContent, noteContentRegex, RegexOptions.Singleline);
 			Group versionGroup = m.Groups ["contentVersion"];
 			Group contentGroup = m.Groups ["innerContent"];
 
 			double contentVersion;
 			if (versionGroup.Success &&
 			    double.TryParse (versionGroup.Value, out contentVersion)) {
-				noteInfo.NoteContentVersion = contentVersion;
+				version = contentVersion;
 			} else
-				noteInfo.NoteContentVersion = 0.1;	// TODO: Constants, transformations, etc, if this changes
+				version = 0.1;	// TODO: Constants, transformations, etc, if this changes
 
 			if (contentGroup.Success) {
 				string [] splits =
@@ -94,14 +121,11 @@ namespace Tomboy.WebSync
 					else
 						builder.Append (splits [1]);
 					
-					noteInfo.NoteContent = builder.ToString ();
+					return builder.ToString ();
 				}
 			}
 			
-			if (noteInfo.NoteContent == null)
-				noteInfo.NoteContent = string.Empty;
-
-			return noteInfo;
+			return string.Empty;
 		}
 
 		public static NoteData ToNoteData (NoteInfo noteInfo)
@@ -0,0 +1,462 @@
+// Permission is hereby granted, free of charge, to any person obtaining 
+// a copy of this software and associated documentation files (the 
+// "Software"), to deal in the Software without restriction, including 
+// without limitation the rights to use, copy, modify, merge, publish, 
+// distribute, sublicense, and/or sell copies of the Software, and to 
+// permit persons to whom the Software is furnished to do so, subject to 
+// the following conditions: 
+//  
+// The above copyright notice and this permission notice shall be 
+// included in all copies or substantial portions of the Software. 
+//  
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE 
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION 
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+// 
+
+#if ENABLE_TESTS
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Compression;
+using System.Net.Sockets;
+using System.Text;
+using System.Threading;
+
+using Tomboy.Sync;
+using Tomboy.WebSync.Api;
+#if !WIN32
+using HL = System.Net;
+#else
+using HL = MonoHttp;
+#endif
+
+namespace Tomboy.WebSync.Tests
+{
+	/// <summary>
+	/// A local, in-memory implementation of the parts of the Tomboy web
+	/// sync API that WebSyncServer uses, for tests and benchmarks.  It
+	/// can delay every request by a fixed latency and cap response
+	/// bandwidth, to make a laptop behave like a slow link.
+	///
+	/// Authentication is not checked.  Responses are gzipped when the
+	/// client accepts it; the paging, gzip request and note delta
+	/// extensions are advertised according to Extensions.
+	/// </summary>
+	public class StandInSyncServer : IDisposable
+	{
+		private const string apiPath = "/api/1.0/";
+		private const string userPath = apiPath + "user/";
+		private const string notesPath = userPath + "notes/";
+
+		private HL.HttpListener listener;
+		private Thread listenThread;
+		private readonly object storeLock = new object ();
+
+		// guid -> note as last uploaded, including its last-sync-revision
+		private Dictionary<string, Hyena.Json.JsonObject> notes =
+			new Dictionary<string, Hyena.Json.JsonObject> ();
+		private int latestRevision = -1;
+		private string syncGuid = Guid.NewGuid ().ToString ();
+		private int requestCount;
+
+		public StandInSyncServer ()
+		{
+			Extensions = new List<string> ();
+			MaxPageSize = 500;
+		}
+
+		/// <summary>
+		/// Added to the handling time of every request.
+		/// </summary>
+		public int LatencyMs { get; set; }
+
+		/// <summary>
+		/// Bytes per second for each response, or 0 for no limit.
+		/// </summary>
+		public int BytesPerSecond { get; set; }
+
+		/// <summary>
+		/// API extensions advertised in the root resource.
+		/// </summary>
+		public List<string> Extensions { get; private set; }
+
+		/// <summary>
+		/// Largest page served when paging is in use.
+		/// </summary>
+		public int MaxPageSize { get; set; }
+
+		/// <summary>
+		/// Base URL to give WebSyncServer; valid once started.
+		/// </summary>
+		public string Url { get; private set; }
+
+		public int RequestCount {
+			get { return requestCount; }
+		}
+
+		public int LatestRevision {
+			get {
+				lock (storeLock)
+					return latestRevision;
+			}
+		}
+
+		public int NoteCount {
+			get {
+				lock (storeLock)
+					return notes.Count;
+			}
+		}
+
+		public void Start ()
+		{
+			// Let the system pick a free port
+			TcpListener probe = new TcpListener (System.Net.IPAddress.Loopback, 0);
+			probe.Start ();
+			int port = ((System.Net.IPEndPoint) probe.LocalEndpoint).Port;
+			probe.Stop ();
+
+			Url = string.Format ("http://localhost:{0}/", port);
+			listener = new HL.HttpListener ();
+			listener.Prefixes.Add (Url);
+			listener.Start ();
+
+			listenThread = new Thread (Listen);
+			listenThread.IsBackground = true;
+			listenThread.Start ();
+		}
+
+		public void Dispose ()
+		{
+			if (listener != null) {
+				listener.Close ();
+				listener = null;
+			}
+		}
+
+		/// <summary>
+		/// Store a note directly, as if another client had uploaded it
+		/// in a revision of its own.
+		/// </summary>
+		public void AddNote (string guid, string title, string content)
+		{
+			Hyena.Json.JsonObject note = new Hyena.Json.JsonObject ();
+			note ["guid"] = guid;
+			note ["title"] = title;
+			note ["note-content"] = content;
+			note ["note-content-version"] = 0.1;
+			lock (storeLock) {
+				latestRevision++;
+				note ["last-sync-revision"] = latestRevision;
+				notes [guid] = note;
+			}
+		}
+
+		public string GetNoteContent (string guid)
+		{
+			lock (storeLock)
+				return (string) notes [guid] ["note-content"];
+		}
+
+		#region Request Handling
+
+		private void Listen ()
+		{
+			while (true) {
+				HL.HttpListenerContext context;
+				try {
+					context = listener.GetContext ();
+				} catch (Exception) {
+					return; // Closed
+				}
+				ThreadPool.QueueUserWorkItem (delegate { Handle (context); });
+			}
+		}
+
+		private void Handle (HL.HttpListenerContext context)
+		{
+			Interlocked.Increment (ref requestCount);
+			if (LatencyMs > 0)
+				Thread.Sleep (LatencyMs);
+
+			int status = 200;
+			object response;
+			try {
+				response = Dispatch (context.Request);
+			} catch (RequestException e) {
+				status = e.Status;
+				Hyena.Json.JsonObject error = new Hyena.Json.JsonObject ();
+				error ["error"] = e.Message;
+				response = error;
+			} catch (Exception e) {
+				status = 400;
+				Hyena.Json.JsonObject error = new Hyena.Json.JsonObject ();
+				error ["error"] = e.Message;
+				response = error;
+			}
+
+			if (response == null) {
+				status = 404;
+				response = new Hyena.Json.JsonObject ();
+			}
+
+			try {
+				WriteResponse (context, status, new Hyena.Json.Serializer (response).Serialize ());
+			} catch (Exception e) {
+				Logger.Debug ("Stand-in sync server: could not send response: {0}", e.Message);
+			}
+		}
+
+		private object Dispatch (HL.HttpListenerRequest request)
+		{
+			string path = request.Url.AbsolutePath;
+			if (!path.EndsWith ("/"))
+				path += "/";
+
+			if (request.HttpMethod == "GET") {
+				if (path == apiPath)
+					return GetRoot ();
+				if (path == userPath)
+					return GetUser ();
+				if (path == notesPath)
+					return GetNotes (request);
+				if (path.StartsWith (notesPath))
+					return GetNote (path.Substring (notesPath.Length).TrimEnd ('/'));
+			} else if (request.HttpMethod == "PUT" && path == notesPath)
+				return PutNotes (ReadBody (request));
+
+			return null;
+		}
+
+		private Hyena.Json.JsonObject Ref (string path)
+		{
+			Hyena.Json.JsonObject reference = new Hyena.Json.JsonObject ();
+			reference ["api-ref"] = Url.TrimEnd ('/') + path;
+			reference ["href"] = Url.TrimEnd ('/') + path;
+			return reference;
+		}
+
+		private object GetRoot ()
+		{
+			Hyena.Json.JsonObject root = new Hyena.Json.JsonObject ();
+			root ["api-version"] = "1.0";
+			root ["user-ref"] = Ref (userPath);
+			root ["oauth_authorize_url"] = Url + "oauth/authenticate/";
+			root ["oauth_access_token_url"] = Url + "oauth/access_token/";
+			root ["oauth_request_token_url"] = Url + "oauth/request_token/";
+
+			Hyena.Json.JsonArray extensions = new Hyena.Json.JsonArray ();
+			foreach (string extension in Extensions)
+				extensions.Add (extension);
+			root ["api-extensions"] = extensions;
+			return root;
+		}
+
+		private object GetUser ()
+		{
+			Hyena.Json.JsonObject user = new Hyena.Json.JsonObject ();
+			user ["user-name"] = "standin";
+			user ["first-name"] = "Stand";
+			user ["last-name"] = "In";
+			user ["notes-ref"] = Ref (notesPath);
+			lock (storeLock) {
+				user ["latest-sync-revision"] = latestRevision;
+				user ["current-sync-guid"] = syncGuid;
+			}
+			return user;
+		}
+
+		private Hyena.Json.JsonObject NoteForResponse (Hyena.Json.JsonObject stored, bool includeContent)
+		{
+			Hyena.Json.JsonObject note = new Hyena.Json.JsonObject ();
+			string guid = (string) stored ["guid"];
+			note ["guid"] = guid;
+			note ["ref"] = Ref (notesPath + guid + "/");
+			if (includeContent) {
+				foreach (KeyValuePair<string, object> pair in stored)
+					note [pair.Key] = pair.Value;
+			} else
+				note ["title"] = stored ["title"];
+			return note;
+		}
+
+		private object GetNotes (HL.HttpListenerRequest request)
+		{
+			bool includeContent = request.QueryString ["include_notes"] == "true";
+			int since = ParseInt (request.QueryString ["since"], -1);
+			bool paged = Extensions.Contains (RootInfo.PagedNotesExtension);
+			int offset = paged ? ParseInt (request.QueryString ["offset"], 0) : 0;
+			int limit = paged ? ParseInt (request.QueryString ["limit"], -1) : -1;
+			if (paged && (limit < 0 || limit > MaxPageSize))
+				limit = MaxPageSize;
+
+			Hyena.Json.JsonObject response = new Hyena.Json.JsonObject ();
+			Hyena.Json.JsonArray noteArray = new Hyena.Json.JsonArray ();
+			lock (storeLock) {
+				// A stable order, so pages don't overlap
+				List<string> guids = new List<string> ();
+				foreach (KeyValuePair<string, Hyena.Json.JsonObject> pair in notes) {
+					if ((int) pair.Value ["last-sync-revision"] > since)
+						guids.Add (pair.Key);
+				}
+				guids.Sort (string.CompareOrdinal);
+
+				int end = limit < 0 ? guids.Count : Math.Min (guids.Count, offset + limit);
+				for (int i = offset; i < end; i++)
+					noteArray.Add (NoteForResponse (notes [guids [i]], includeContent));
+
+				response ["latest-sync-revision"] = latestRevision;
+				if (paged)
+					response ["total-notes"] = guids.Count;
+			}
+			response ["notes"] = noteArray;
+			return response;
+		}
+
+		private object GetNote (string guid)
+		{
+			lock (storeLock) {
+				Hyena.Json.JsonObject stored;
+				if (!notes.TryGetValue (guid, out stored))
+					return null;
+				Hyena.Json.JsonArray noteArray = new Hyena.Json.JsonArray ();
+				noteArray.Add (NoteForResponse (stored, true));
+				Hyena.Json.JsonObject response = new Hyena.Json.JsonObject ();
+				response ["note"] = noteArray;
+				return response;
+			}
+		}
+
+		private object PutNotes (string body)
+		{
+			Hyena.Json.JsonObject changes =
+				(Hyena.Json.JsonObject) new Hyena.Json.Deserializer (body).Deserialize ();
+			Hyena.Json.JsonArray noteChanges = (Hyena.Json.JsonArray) changes ["note-changes"];
+
+			Hyena.Json.JsonObject response = new Hyena.Json.JsonObject ();
+			Hyena.Json.JsonArray changedNotes = new Hyena.Json.JsonArray ();
+			lock (storeLock) {
+				object expected;
+				if (changes.TryGetValue ("latest-sync-revision", out expected) &&
+				    (int) expected != latestRevision + 1)
+					throw new InvalidOperationException ("Unexpected latest-sync-revision");
+
+				// Check everything before changing anything
+				Dictionary<string, Hyena.Json.JsonObject> updated =
+					new Dictionary<string, Hyena.Json.JsonObject> ();
+				List<string> deleted = new List<string> ();
+				foreach (Hyena.Json.JsonObject change in noteChanges) {
+					string guid = (string) change ["guid"];
+					object command;
+					if (change.TryGetValue ("command", out command) && (string) command == "delete") {
+						deleted.Add (guid);
+						continue;
+					}
+
+					Hyena.Json.JsonObject note = new Hyena.Json.JsonObject ();
+					Hyena.Json.JsonObject existing;
+					if (notes.TryGetValue (guid, out existing)) {
+						foreach (KeyValuePair<string, object> pair in existing)
+							note [pair.Key] = pair.Value;
+					}
+					foreach (KeyValuePair<string, object> pair in change)
+						note [pair.Key] = pair.Value;
+
+					if (note.ContainsKey ("note-content-delta")) {
+						string baseContent = notes.ContainsKey (guid) ?
+							(string) notes [guid] ["note-content"] : string.Empty;
+						if (NoteDelta.HashString (baseContent) != (string) note ["note-content-delta-base"])
+							throw new RequestException (409, RootInfo.NoteDeltaBaseMismatchError);
+						note ["note-content"] = NoteDelta.Apply (
+							baseContent, Convert.FromBase64String ((string) note ["note-content-delta"]));
+						note.Remove ("note-content-delta");
+						note.Remove ("note-content-delta-base");
+					}
+					updated [guid] = note;
+				}
+
+				latestRevision++;
+				foreach (string guid in deleted)
+					notes.Remove (guid);
+				foreach (KeyValuePair<string, Hyena.Json.JsonObject> pair in updated) {
+					pair.Value ["last-sync-revision"] = latestRevision;
+					notes [pair.Key] = pair.Value;
+					changedNotes.Add (NoteForResponse (pair.Value, false));
+				}
+				response ["latest-sync-revision"] = latestRevision;
+			}
+			response ["notes"] = changedNotes;
+			return response;
+		}
+
+		/// <summary>
+		/// A request failing with a specific status.
+		/// </summary>
+		private class RequestException : Exception
+		{
+			public RequestException (int status, string error) :
+				base (error)
+			{
+				Status = status;
+			}
+
+			public int Status { get; private set; }
+		}
+
+		private static int ParseInt (string value, int defaultValue)
+		{
+			int result;
+			if (value != null && int.TryParse (value, out result))
+				return result;
+			return defaultValue;
+		}
+
+		private static string ReadBody (HL.HttpListenerRequest request)
+		{
+			Stream body = request.InputStream;
+			if (request.Headers ["Content-Encoding"] == "gzip")
+				body = new GZipStream (body, CompressionMode.Decompress);
+			using (StreamReader reader = new StreamReader (body, Encoding.UTF8))
+				return reader.ReadToEnd ();
+		}
+
+		private void WriteResponse (HL.HttpListenerContext context, int status, string json)
+		{
+			byte [] data = Encoding.UTF8.GetBytes (json);
+
+			string acceptEncoding = context.Request.Headers ["Accept-Encoding"];
+			if (acceptEncoding != null && acceptEncoding.Contains ("gzip")) {
+				MemoryStream compressed = new MemoryStream ();
+				using (GZipStream gzip = new GZipStream (compressed, CompressionMode.Compress, true))
+					gzip.Write (data, 0, data.Length);
+				data = compressed.ToArray ();
+				context.Response.AddHeader ("Content-Encoding", "gzip");
+			}
+
+			context.Response.StatusCode = status;
+			context.Response.ContentType = "application/json";
+			context.Response.ContentLength64 = data.Length;
+
+			// Send in small chunks, sleeping to stay under BytesPerSecond
+			const int chunkSize = 4096;
+			using (Stream output = context.Response.OutputStream) {
+				for (int offset = 0; offset < data.Length; offset += chunkSize) {
+					int count = Math.Min (chunkSize, data.Length - offset);
+					output.Write (data, offset, count);
+					if (BytesPerSecond > 0)
+						Thread.Sleep ((int) (1000L * count / BytesPerSecond));
+				}
+			}
+		}
+
+		#endregion
+	}
+}
+
+#endif
@@ -0,0 +1,232 @@
+// Permission is hereby granted, free of charge, to any person obtaining 
+// a copy of this software and associated documentation files (the 
+// "Software"), to deal in the Software without restriction, including 
+// without limitation the rights to use, copy, modify, merge, publish, 
+// distribute, sublicense, and/or sell copies of the Software, and to 
+// permit persons to whom the Software is furnished to do so, subject to 
+// the following conditions: 
+//  
+// The above copyright notice and this permission notice shall be 
+// included in all copies or substantial portions of the Software. 
+//  
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE 
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION 
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. 
+// 
+
+#if ENABLE_TESTS
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Net;
+using System.Reflection;
+
+using Tomboy.Sync;
+using Tomboy.WebSync;
+using Tomboy.WebSync.Api;
+
+using NUnit.Framework;
+
+namespace Tomboy.WebSync.Tests
+{
+	/// <summary>
+	/// WebSyncServer reads sync preferences, so keep them in memory.
+	/// </summary>
+	public abstract class InMemoryPreferencesFixture
+	{
+		[TestFixtureSetUp]
+		public void FixtureSetUp ()
+		{
+			InMemoryPreferencesClient memPrefsClient = new InMemoryPreferencesClient ();
+			typeof (Preferences).GetField ("client", BindingFlags.NonPublic | BindingFlags.Static)
+				.SetValue (null, memPrefsClient);
+			typeof (Services).GetField ("prefs", BindingFlags.NonPublic | BindingFlags.Static)
+				.SetValue (null, memPrefsClient);
+		}
+
+		[TestFixtureTearDown]
+		public void FixtureTearDown ()
+		{
+			typeof (Preferences).GetField ("client", BindingFlags.NonPublic | BindingFlags.Static)
+				.SetValue (null, null);
+			typeof (Services).GetField ("prefs", BindingFlags.NonPublic | BindingFlags.Static)
+				.SetValue (null, null);
+		}
+	}
+
+	[TestFixture]
+	public class WebSyncTransportTests : InMemoryPreferencesFixture
+	{
+		private StandInSyncServer standIn;
+
+		[SetUp]
+		public void StartServer ()
+		{
+			standIn = new StandInSyncServer ();
+			standIn.Start ();
+		}
+
+		[TearDown]
+		public void StopServer ()
+		{
+			standIn.Dispose ();
+		}
+
+		private static OAuth CreateConnection (string url)
+		{
+			// The stand-in server doesn't check signatures
+			OAuth oauth = new OAuth ();
+			oauth.ConsumerKey = "anyone";
+			oauth.ConsumerSecret = "anyone";
+			oauth.Realm = "Stand-in";
+			oauth.RequestTokenBaseUrl = url + "oauth/request_token/";
+			oauth.AccessTokenBaseUrl = url + "oauth/access_token/";
+			oauth.Token = "token";
+			oauth.TokenSecret = "secret";
+			oauth.IsAccessToken = true;
+			return oauth;
+		}
+
+		[Test]
+		public void PagedFetchReturnsEveryNote ()
+		{
+			standIn.Extensions.Add (RootInfo.PagedNotesExtension);
+			standIn.MaxPageSize = 7;
+			for (int i = 0; i < 25; i++)
+				standIn.AddNote (Guid.NewGuid ().ToString (), "Note " + i, "Content " + i);
+
+			WebSyncServer server = new WebSyncServer (standIn.Url, CreateConnection (standIn.Url));
+			Assert.IsTrue (server.BeginSyncTransaction ());
+			IDictionary<string, NoteUpdate> updates = server.GetNoteUpdatesSince (-1);
+			Assert.AreEqual (25, updates.Count);
+			// Root, user, and four pages
+			Assert.AreEqual (6, standIn.RequestCount);
+		}
+
+		[Test]
+		public void CompressedUploadIsStored ()
+		{
+			standIn.Extensions.Add (RootInfo.GzipRequestExtension);
+			OAuth connection = CreateConnection (standIn.Url);
+			RootInfo root = RootInfo.GetRoot (standIn.Url + "api/1.0/", connection);
+			UserInfo user = UserInfo.GetUser (root.User.ApiRef, connection);
+
+			List<NoteInfo> changes = new List<NoteInfo> ();
+			for (int i = 0; i < 10; i++) {
+				NoteInfo note = new NoteInfo ();
+				note.Guid = Guid.NewGuid ().ToString ();
+				note.Title = "Note " + i;
+				note.NoteContent = new string ('x', 4096);
+				note.NoteContentVersion = 0.1;
+				changes.Add (note);
+			}
+
+			Assert.AreEqual (0, user.UpdateNotes (changes, 0, true));
+			Assert.AreEqual (10, standIn.NoteCount);
+			Assert.AreEqual (new string ('x', 4096), standIn.GetNoteContent (changes [3].Guid));
+		}
+
+		private WebException UpdateNotesError (IList<NoteInfo> changes, int expectedNewRevision)
+		{
+			OAuth connection = CreateConnection (standIn.Url);
+			RootInfo root = RootInfo.GetRoot (standIn.Url + "api/1.0/", connection);
+			UserInfo user = UserInfo.GetUser (root.User.ApiRef, connection);
+			try {
+				user.UpdateNotes (changes, expectedNewRevision, false);
+			} catch (WebException e) {
+				return e;
+			}
+			Assert.Fail ("Upload should have been rejected");
+			return null;
+		}
+
+		[Test]
+		public void StaleDeltaBaseIsRejectedAsConflict ()
+		{
+			standIn.Extensions.Add (RootInfo.NoteDeltaExtension);
+			string guid = Guid.NewGuid ().ToString ();
+			standIn.AddNote (guid, "Note", "Changed by another client");
+
+			NoteInfo note = new NoteInfo ();
+			note.Guid = guid;
+			note.Title = "Note";
+			note.NoteContentVersion = 0.1;
+			note.NoteContentDelta = Convert.ToBase64String (NoteDelta.Create ("Base", "Base, edited"));
+			note.NoteContentDeltaBase = NoteDelta.HashString ("Base");
+
+			HttpStatusCode status;
+			WebException error = UpdateNotesError (new NoteInfo [] { note }, 1);
+			Assert.AreEqual (RootInfo.NoteDeltaBaseMismatchError, WebTransport.ReadError (error, out status));
+			Assert.AreEqual (HttpStatusCode.Conflict, status);
+			// Nothing was committed
+			Assert.AreEqual (0, standIn.LatestRevision);
+			Assert.AreEqual ("Changed by another client", standIn.GetNoteContent (guid));
+		}
+
+		[Test]
+		public void OtherRejectionsAreNotDeltaConflicts ()
+		{
+			NoteInfo note = new NoteInfo ();
+			note.Guid = Guid.NewGuid ().ToString ();
+			note.Title = "Note";
+			note.NoteContent = "Content";
+			note.NoteContentVersion = 0.1;
+
+			// The server is at revision -1, so 5 is not the next one
+			HttpStatusCode status;
+			WebException error = UpdateNotesError (new NoteInfo [] { note }, 5);
+			Assert.AreNotEqual (RootInfo.NoteDeltaBaseMismatchError, WebTransport.ReadError (error, out status));
+			Assert.AreNotEqual (HttpStatusCode.Conflict, status);
+			Assert.AreEqual (0, standIn.NoteCount);
+		}
+	}
+
+	/// <summary>
+	/// Initial sync of a large account over a slow link, with and
+	/// without paging.  Not run by default.
+	/// </summary>
+	[TestFixture, Explicit]
+	public class WebSyncTransportBenchmark : InMemoryPreferencesFixture
+	{
+		private const int noteCount = 2000;
+		private const int latencyMs = 50;
+		private const int bytesPerSecond = 2 * 1024 * 1024;
+
+		private double TimeInitialFetch (bool paged)
+		{
+			using (StandInSyncServer standIn = new StandInSyncServer ()) {
+				standIn.LatencyMs = latencyMs;
+				standIn.BytesPerSecond = bytesPerSecond;
+				if (paged)
+					standIn.Extensions.Add (RootInfo.PagedNotesExtension);
+				standIn.Start ();
+				for (int i = 0; i < noteCount; i++)
+					standIn.AddNote (Guid.NewGuid ().ToString (), "Note " + i,
+					                 "Benchmark note " + i + "\n" + new string ('x', 4096));
+
+				WebSyncServer server = new WebSyncServer (standIn.Url, new AnonymousConnection ());
+				Stopwatch watch = Stopwatch.StartNew ();
+				server.BeginSyncTransaction ();
+				Assert.AreEqual (noteCount, server.GetNoteUpdatesSince (-1).Count);
+				watch.Stop ();
+				return watch.Elapsed.TotalSeconds;
+			}
+		}
+
+		[Test]
+		public void InitialFetch ()
+		{
+			Console.WriteLine ("{0} notes, {1} ms latency, {2} KB/s",
+			                   noteCount, latencyMs, bytesPerSecond / 1024);
+			Console.WriteLine ("single request: {0,7:F2}s", TimeInitialFetch (false));
+			Console.WriteLine ("paged:          {0,7:F2}s", TimeInitialFetch (true));
+		}
+	}
+}
+
+#endif
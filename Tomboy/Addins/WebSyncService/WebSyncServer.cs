@@ -25,6 +25,7 @@
 
 using System;
 using System.Collections.Generic;
+using System.Net;
 using System.Text.RegularExpressions;
 
 using Tomboy.Sync;
@@ -40,6 +41,14 @@ namespace Tomboy.WebSync
 		private RootInfo root;
 		private UserInfo user;
 		private List<NoteInfo> pendingCommits;
+		private bool useDeltas;
+		private bool usePaging;
+		private bool compressRequests;
+
+		/// <summary>
+		/// Notes per request when the server supports paging.
+		/// </summary>
+		public const int NotesPageSize = 100;
 		
 		public WebSyncServer (string serverUrl, IWebConnection connection)
 		{
@@ -63,6 +72,10 @@ namespace Tomboy.WebSync
 				throw new TomboySyncException ("No sync GUID for user provided in server response");
 			
 			pendingCommits = new List<NoteInfo> ();
+			useDeltas = SyncManager.DeltaTransferEnabled &&
+				root.ApiExtensions.Contains (RootInfo.NoteDeltaExtension);
+			usePaging = root.ApiExtensions.Contains (RootInfo.PagedNotesExtension);
+			compressRequests = root.ApiExtensions.Contains (RootInfo.GzipRequestExtension);
 			return true;
 		}
 		
@@ -76,7 +89,23 @@ namespace Tomboy.WebSync
 		public bool CommitSyncTransaction ()
 		{
 			if (pendingCommits != null && pendingCommits.Count > 0) {
-				LatestRevision = user.UpdateNotes (pendingCommits, LatestRevision + 1);
+				try {
+					LatestRevision = user.UpdateNotes (pendingCommits, LatestRevision + 1, compressRequests);
+				} catch (WebException e) {
+					// Anything else, a timeout in particular, may have
+					// been committed; sending it again could apply it twice
+					if (!IsDeltaBaseMismatch (e) || !RemoveDeltas (pendingCommits))
+						throw;
+					Logger.Debug ("Sync: Delta upload failed, sending whole notes: {0}", e.Message);
+
+					// Don't reuse the revision number if someone took it meanwhile
+					UserInfo current = UserInfo.GetUser (root.User.ApiRef, connection);
+					if (current.LatestSyncRevision != LatestRevision)
+						throw new TomboySyncException (string.Format (
+							"Server revision changed from {0} to {1} during sync",
+							LatestRevision, current.LatestSyncRevision), e);
+					LatestRevision = user.UpdateNotes (pendingCommits, LatestRevision + 1, compressRequests);
+				}
 				pendingCommits.Clear ();
 			}
 			return true;
@@ -113,10 +142,17 @@ namespace Tomboy.WebSync
 		{
 			Dictionary<string, NoteUpdate> updates =
 				new Dictionary<string, NoteUpdate> ();
-			int? latestRevision;
-			IList<NoteInfo> serverNotes = user.GetNotes (true, revision, out latestRevision);
-			VerifyLatestSyncRevision (latestRevision);
+			IList<NoteInfo> serverNotes;
+			if (usePaging)
+				serverNotes = GetNotesPaged (revision);
+			else {
+				int? latestRevision;
+				serverNotes = user.GetNotes (true, revision, useDeltas, out latestRevision);
+				VerifyLatestSyncRevision (latestRevision);
+			}
 			foreach (NoteInfo noteInfo in serverNotes) {
+				if (noteInfo.NoteContentDelta != null)
+					ResolveDelta (noteInfo);
 				string noteXml = NoteConvert.ToNoteXml (noteInfo);
 				NoteUpdate update = new NoteUpdate (noteXml,
 				                                    noteInfo.Title,
@@ -137,8 +173,12 @@ namespace Tomboy.WebSync
 		
 		public void UploadNotes (IList<Note> notes)
 		{
-			foreach (Note note in notes)
-				pendingCommits.Add (NoteConvert.ToNoteInfo (note));
+			foreach (Note note in notes) {
+				NoteInfo noteInfo = NoteConvert.ToNoteInfo (note);
+				if (useDeltas)
+					AddDelta (noteInfo);
+				pendingCommits.Add (noteInfo);
+			}
 		}
 
 		public bool UpdatesAvailableSince (int revision)
@@ -153,6 +193,132 @@ namespace Tomboy.WebSync
 
 		#region Private Methods
 
+		/// <summary>
+		/// Fetch the notes changed since revision a page at a time.  The
+		/// first page tells us how many there are; the rest are then
+		/// requested several at once over the kept-alive connections.
+		/// </summary>
+		private IList<NoteInfo> GetNotesPaged (int revision)
+		{
+			int? latestRevision;
+			int? totalNotes;
+			IList<NoteInfo> firstPage = user.GetNotes (true, revision, useDeltas, 0, NotesPageSize,
+			                                           out latestRevision, out totalNotes);
+			VerifyLatestSyncRevision (latestRevision);
+			if (!totalNotes.HasValue || firstPage.Count == 0 ||
+			    totalNotes.Value <= firstPage.Count)
+				return firstPage;
+
+			// The server may cap the page size below what we asked for
+			int pageSize = firstPage.Count;
+			List<int> pageIndexes = new List<int> ();
+			for (int i = 0; (i + 1) * pageSize < totalNotes.Value; i++)
+				pageIndexes.Add (i);
+
+			IList<NoteInfo> [] pages = new IList<NoteInfo> [pageIndexes.Count];
+			IOUtils.ForEachParallel (pageIndexes, WebTransport.MaxConcurrentRequests, delegate (int i) {
+				int? pageRevision;
+				int? pageTotal;
+				pages [i] = user.GetNotes (true, revision, useDeltas, (i + 1) * pageSize, pageSize,
+				                           out pageRevision, out pageTotal);
+				// Each page must come from the same revision as the first
+				VerifyLatestSyncRevision (pageRevision);
+			});
+
+			List<NoteInfo> notes = new List<NoteInfo> (totalNotes.Value);
+			notes.AddRange (firstPage);
+			foreach (IList<NoteInfo> page in pages)
+				notes.AddRange (page);
+			Logger.Debug ("Sync: Fetched {0} notes in {1} pages", notes.Count, pages.Length + 1);
+			return notes;
+		}
+
+		/// <summary>
+		/// Replace the note-content of an upload with a delta against the
+		/// copy of the note we last synchronized, if we have it and the
+		/// delta is worth sending.
+		/// </summary>
+		private void AddDelta (NoteInfo noteInfo)
+		{
+			string baseXml = SyncBaseStore.Instance.Get (noteInfo.Guid);
+			if (baseXml == null)
+				return;
+
+			try {
+				string baseContent = NoteConvert.NoteContentFromXml (baseXml, noteInfo.Guid);
+				byte [] delta = NoteDelta.Create (baseContent, noteInfo.NoteContent);
+				// Base64 grows by a third; only send clear wins
+				if (delta.Length * 2 > System.Text.Encoding.UTF8.GetByteCount (noteInfo.NoteContent))
+					return;
+				noteInfo.NoteContentDelta = Convert.ToBase64String (delta);
+				noteInfo.NoteContentDeltaBase = NoteDelta.HashString (baseContent);
+			} catch (Exception e) {
+				Logger.Debug ("Sync: Sending whole note {0}: {1}", noteInfo.Guid, e.Message);
+			}
+		}
+
+		/// <summary>
+		/// Whether an upload was rejected, without committing anything,
+		/// because the server's copy of some note didn't match the base
+		/// of our delta.
+		/// </summary>
+		private static bool IsDeltaBaseMismatch (WebException e)
+		{
+			HttpStatusCode status;
+			string error = WebTransport.ReadError (e, out status);
+			return status == HttpStatusCode.Conflict &&
+				error == RootInfo.NoteDeltaBaseMismatchError;
+		}
+
+		/// <summary>
+		/// Drop any deltas from the pending uploads, so they are sent
+		/// whole.  Returns false if there weren't any.
+		/// </summary>
+		private bool RemoveDeltas (IList<NoteInfo> noteInfos)
+		{
+			bool hadDeltas = false;
+			foreach (NoteInfo noteInfo in noteInfos) {
+				if (noteInfo.NoteContentDelta != null) {
+					noteInfo.NoteContentDelta = null;
+					noteInfo.NoteContentDeltaBase = null;
+					hadDeltas = true;
+				}
+			}
+			return hadDeltas;
+		}
+
+		/// <summary>
+		/// Turn a downloaded delta back into note-content, using our copy
+		/// of the note's base.  If we don't have that base, fetch the
+		/// whole note instead.
+		/// </summary>
+		private void ResolveDelta (NoteInfo noteInfo)
+		{
+			string baseXml = SyncBaseStore.Instance.Get (noteInfo.Guid);
+			if (baseXml != null) {
+				try {
+					string baseContent = NoteConvert.NoteContentFromXml (baseXml, noteInfo.Guid);
+					if (NoteDelta.HashString (baseContent) == noteInfo.NoteContentDeltaBase) {
+						noteInfo.NoteContent = NoteDelta.Apply (
+							baseContent, Convert.FromBase64String (noteInfo.NoteContentDelta));
+						noteInfo.NoteContentDelta = null;
+						noteInfo.NoteContentDeltaBase = null;
+						return;
+					}
+				} catch (Exception e) {
+					Logger.Debug ("Sync: Could not apply delta to note {0}: {1}", noteInfo.Guid, e.Message);
+				}
+			}
+
+			if (noteInfo.ResourceReference == null)
+				throw new TomboySyncException ("No way to fetch note " + noteInfo.Guid + " without a delta");
+			NoteInfo fullNote = user.GetNote (noteInfo.ResourceReference);
+			noteInfo.NoteContent = fullNote.NoteContent;
+			noteInfo.NoteContentVersion = fullNote.NoteContentVersion;
+			noteInfo.NoteContentDelta = null;
+			noteInfo.NoteContentDeltaBase = null;
+		}
+
 		private void VerifyLatestSyncRevision (int? latestRevision)
 		{
 			if (!latestRevision.HasValue)
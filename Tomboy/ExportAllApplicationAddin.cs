@@ -8,6 +8,12 @@ using Tomboy.Notebooks;
 
 namespace Tomboy
 {
+	/// <summary>
+	/// Called on the GTK thread when an export is over, with the
+	/// exception that stopped it, or null if every note was exported.
+	/// </summary>
+	public delegate void ExportFinishedHandler (Exception error);
+
 	/// <summary>
 	/// An abstract class which handles all the details of "export all",
 	/// to be subclassed with a method that defines what to do with a
@@ -38,6 +44,35 @@ namespace Tomboy
 		/// </summary>
 		private bool exporting_single_notebook = false;
 
+		/// <summary>
+		/// The index of the export ExportNotes is running, for
+		/// ResolveRelativePath (string, string).
+		/// </summary>
+		private ExportIndex export_index;
+
+		internal class ExportedNote
+		{
+			public string SanitizedTitle;
+			// Normalized name, or null for unfiled notes
+			public string Notebook;
+		}
+
+		/// <summary>
+		/// Where each note goes, by lower case title, for resolving links
+		/// between exported notes.  Made on the GTK thread with
+		/// MakeExportIndex; it doesn't change after that, so links can
+		/// be resolved with it on any thread.
+		/// </summary>
+		public class ExportIndex
+		{
+			internal readonly Dictionary<string, ExportedNote> Notes =
+				new Dictionary<string, ExportedNote> ();
+
+			internal ExportIndex ()
+			{
+			}
+		}
+
 		/// <summary>
 		/// Called when Tomboy has started up and is nearly 100% initialized.
 		/// </summary>
@@ -153,6 +188,15 @@ namespace Tomboy
 			for (int i = 0; i < cmd_line.Addin_argslist.Count; i++) {
 				if (cmd_line.Addin_argslist[i] == "--addin:" + export_file_suffix + "-export-all"
 				    || cmd_line.Addin_argslist[i] == "--addin:" + export_file_suffix + "-export-all-quit") {
+					bool quit = cmd_line.Addin_argslist[i] == "--addin:" + export_file_suffix + "-export-all-quit";
+					ExportFinishedHandler finished = delegate (Exception error) {
+						if (error != null)
+							LogExportError (error);
+						if (quit)
+							System.Environment.Exit (1);
+					};
+
+					Exception start_error = null;
 					try {
 						if (cmd_line.Addin_argslist[i].StartsWith ("\"")) {
 							//Path may include spaces, have to look for ending quotation mark
@@ -161,37 +205,43 @@ namespace Tomboy
 								pathbuilder.Append (cmd_line.Addin_argslist[i+j]);
 								if (cmd_line.Addin_argslist[i+j].EndsWith ("\"")) break;
 							}
-							ExportAllNotes (SanitizePath (pathbuilder.ToString ().Trim ('"')));
+							ExportAllNotes (SanitizePath (pathbuilder.ToString ().Trim ('"')), finished);
 						} else {
 							//Expecting a whole path without spaces
-							ExportAllNotes (SanitizePath (cmd_line.Addin_argslist[i+1]));
+							ExportAllNotes (SanitizePath (cmd_line.Addin_argslist[i+1]), finished);
 						}
-
-					} catch (UnauthorizedAccessException) {
-						Logger.Error (Catalog.GetString ("Could not export, access denied."));
-					} catch (DirectoryNotFoundException) {
-						Logger.Error (Catalog.GetString ("Could not export, folder does not exist."));
-					} catch (IndexOutOfRangeException) {
-						Logger.Error (Catalog.GetString ("Could not export, error with the path. (No ending \"?)"));
 					} catch (Exception ex) {
-						Logger.Error (Catalog.GetString ("Could not export: {0}"), ex);
+						start_error = ex;
 					}
-					if (cmd_line.Addin_argslist[i] == "--addin:" + export_file_suffix + "-export-all-quit")
-						System.Environment.Exit (1);
+					if (start_error != null)
+						finished (start_error);
 				}
 			}
 		}
 
+		private static void LogExportError (Exception error)
+		{
+			if (error is UnauthorizedAccessException)
+				Logger.Error (Catalog.GetString ("Could not export, access denied."));
+			else if (error is DirectoryNotFoundException)
+				Logger.Error (Catalog.GetString ("Could not export, folder does not exist."));
+			else if (error is IndexOutOfRangeException || error is ArgumentOutOfRangeException)
+				Logger.Error (Catalog.GetString ("Could not export, error with the path. (No ending \"?)"));
+			else
+				Logger.Error (Catalog.GetString ("Could not export: {0}"), error);
+		}
+
 		void ExportAllButtonClicked (object sender, EventArgs args)
 		{
 			ExportAllNotesViaGUI ();
 		}
 
 		/// <summary>
-		/// Exports all notes to a given folder.
+		/// Exports all notes to a given folder.  finished is called
+		/// when the export is over, unless this throws.
 		/// </summary>
 		/// <param name="output_folder"> The folder that the notes will be exported to. </param>
-		private void ExportAllNotes (string output_folder)
+		private void ExportAllNotes (string output_folder, ExportFinishedHandler finished)
 		{
 			Logger.Debug ("Creating an export folder in: " + output_folder);
 			System.IO.Directory.CreateDirectory (output_folder);
@@ -199,6 +249,7 @@ namespace Tomboy
 			//Iterate through notebooks
 			Notebooks.Notebook notebook;
 			string notebook_folder;
+			List<KeyValuePair<Note, string>> exports = new List<KeyValuePair<Note, string>> ();
 
 			foreach (Tag tag in TagManager.AllTags) {
 				// Skip over tags that aren't notebooks
@@ -210,11 +261,14 @@ namespace Tomboy
 				notebook_folder = SanitizePath (output_folder + System.IO.Path.DirectorySeparatorChar
 				                  + notebook.NormalizedName);
 				System.IO.Directory.CreateDirectory (notebook_folder);
-				ExportNotesInList (notebook.Tag.Notes, notebook_folder);
+				AddNotesInList (exports, notebook.Tag.Notes, notebook_folder);
 			}
 			//Finally we have to export all unfiled notes.
 			Logger.Debug ("Exporting Unfiled Notes");
-			ExportNotesInList (ListUnfiledNotes (), output_folder);
+			AddNotesInList (exports, ListUnfiledNotes (), output_folder);
+
+			// All at once, so that exporters can spread the work
+			ExportNotes (exports, finished);
 		}
 
 		/// <summary>
@@ -237,36 +291,40 @@ namespace Tomboy
 			}
 			string output_folder = SanitizePath (dialog.Filename);
 
-			try {
-				ExportAllNotes (output_folder);
+			RunExport (dialog, output_folder, delegate (ExportFinishedHandler finished) {
+				ExportAllNotes (output_folder, finished);
+			});
+		}
 
-				//Successful export: clean up and inform.
-				dialog.SavePreferences ();
-				ShowSuccessDialog (output_folder);
+		/// <summary>
+		/// Starts an export chosen with dialog, and tells the user how
+		/// it went once it is over.  The dialog is hidden meanwhile, and
+		/// destroyed at the end.
+		/// </summary>
+		private void RunExport (ExportMultipleDialog dialog, string output_folder,
+		                        Action<ExportFinishedHandler> export)
+		{
+			dialog.Hide ();
 
-			} catch (UnauthorizedAccessException) {
-				Logger.Error (Catalog.GetString ("Could not export, access denied."));
-				ShowErrorDialog (output_folder, dialog,
-				                 Catalog.GetString ("Access denied."));
-				return;
-			} catch (DirectoryNotFoundException) {
-				Logger.Error (Catalog.GetString ("Could not export, folder does not exist."));
-				ShowErrorDialog (output_folder, dialog,
-				                 Catalog.GetString ("Folder does not exist."));
-				return;
-			} catch (Exception ex) {
-				Logger.Error (Catalog.GetString ("Could not export: {0}"), ex);
-				ShowErrorDialog (output_folder, dialog,
-				                 Catalog.GetString ("Unknown error."));
-				return;
-			} finally {
-				if (dialog != null) {
+			ExportFinishedHandler finished = delegate (Exception error) {
+				if (error == null) {
+					//Successful export: clean up and inform.
+					dialog.SavePreferences ();
+					ShowSuccessDialog (output_folder);
 					dialog.Destroy ();
-					dialog = null;
-				}
+				} else
+					ShowExportError (output_folder, dialog, error);
+			};
+
+			Exception start_error = null;
+			try {
+				export (finished);
+			} catch (Exception ex) {
+				start_error = ex;
 			}
+			if (start_error != null)
+				finished (start_error);
 		}
-
 		/// <summary>
 		/// Called when the user chooses "Export Notebook"
 		/// (Even when "All Notes or "Unfiled Notes" are
@@ -274,82 +332,77 @@ namespace Tomboy
 		/// </summary>
 		void ExportNotebookButtonClicked (object sender, EventArgs args)
 		{
-			string output_folder = null;
-			ExportMultipleDialog dialog = null;
 			Logger.Info ("Activated export notebook to " + export_file_suffix);
 
 			Notebook notebook = NoteRecentChanges.GetInstance (Tomboy.DefaultNoteManager).GetSelectedNotebook ();
 
-			try {
-				//Handling the two special notebooks
-				string notebook_name = notebook.NormalizedName;
-				if (notebook_name == "___NotebookManager___AllNotes__Notebook___") {
-					Logger.Info ("This notebook includes all notes, activating Export All");
-					ExportAllNotesViaGUI ();
-					return;
-				} else if (notebook_name == "___NotebookManager___UnfiledNotes__Notebook___") {
-					dialog = new ExportMultipleDialog (Catalog.GetString ("Unfiled Notes"), export_type_pretty_name);
-					int response = dialog.Run ();
-					output_folder = SanitizePath (dialog.Filename);
-					if (response != (int) Gtk.ResponseType.Ok) {
-						Logger.Debug("User clicked cancel.");
-						dialog.Destroy ();
-						return;
-					}
-
-					exporting_single_notebook = true;
-					Logger.Debug ("Creating an export folder in: " + output_folder);
-					System.IO.Directory.CreateDirectory (output_folder);
-					ExportNotesInList (ListUnfiledNotes (), output_folder);
-				} else {
-					//Ordinary notebooks
-					dialog = new ExportMultipleDialog (notebook_name, export_type_pretty_name);
-					int response = dialog.Run ();
-					output_folder = SanitizePath (dialog.Filename);
-					if (response != (int) Gtk.ResponseType.Ok) {
-						Logger.Debug("User clicked cancel.");
-						dialog.Destroy ();
-						return;
-					}
-
-					exporting_single_notebook = true;
-					Logger.Debug ("Creating an export folder in: " + output_folder);
-					System.IO.Directory.CreateDirectory (output_folder);
-					ExportNotesInList (notebook.Tag.Notes, output_folder);
-				}
-
-				//Successful export: clean up and inform.
-				dialog.SavePreferences ();
-				ShowSuccessDialog (output_folder);
-
-			} catch (UnauthorizedAccessException) {
-				Logger.Error (Catalog.GetString ("Could not export, access denied."));
-				ShowErrorDialog (output_folder, dialog,
-				                 Catalog.GetString ("Access denied."));
+			//Handling the two special notebooks
+			string notebook_name = notebook.NormalizedName;
+			string dialog_name;
+			List<Note> notes;
+			if (notebook_name == "___NotebookManager___AllNotes__Notebook___") {
+				Logger.Info ("This notebook includes all notes, activating Export All");
+				ExportAllNotesViaGUI ();
 				return;
-			} catch (DirectoryNotFoundException) {
-				Logger.Error (Catalog.GetString ("Could not export, folder does not exist."));
-				ShowErrorDialog (output_folder, dialog,
-				                 Catalog.GetString ("Folder does not exist."));
-				return;
-			} catch (Exception ex) {
-				Logger.Error (Catalog.GetString ("Could not export: {0}"), ex);
-				ShowErrorDialog (output_folder, dialog,
-				                 Catalog.GetString ("Unknown error."));
+			} else if (notebook_name == "___NotebookManager___UnfiledNotes__Notebook___") {
+				dialog_name = Catalog.GetString ("Unfiled Notes");
+				notes = ListUnfiledNotes ();
+			} else {
+				//Ordinary notebooks
+				dialog_name = notebook_name;
+				notes = notebook.Tag.Notes;
+			}
+
+			ExportMultipleDialog dialog = new ExportMultipleDialog (dialog_name, export_type_pretty_name);
+			int response = dialog.Run ();
+			string output_folder = SanitizePath (dialog.Filename);
+			if (response != (int) Gtk.ResponseType.Ok) {
+				Logger.Debug("User clicked cancel.");
+				dialog.Destroy ();
 				return;
-			} finally {
-				if (dialog != null) {
-					dialog.Destroy ();
-					dialog = null;
-				}
 			}
+
+			exporting_single_notebook = true;
+			RunExport (dialog, output_folder, delegate (ExportFinishedHandler finished) {
+				Logger.Debug ("Creating an export folder in: " + output_folder);
+				System.IO.Directory.CreateDirectory (output_folder);
+				ExportNotesInList (notes, output_folder, finished);
+			});
 		}
 
 		/// <summary>
-		/// Exports the specified list of notes to *** files in the given folder,
-		/// excludes template notes.
+		/// Exports the specified list of notes to *** files in the given
+		/// folder, excludes template notes.  Exporters that work while
+		/// the GTK main loop runs may return before the export is over;
+		/// an error is logged instead of thrown.
 		/// </summary>
 		public void ExportNotesInList (List<Note> note_list, string output_folder)
+		{
+			ExportNotesInList (note_list, output_folder, delegate (Exception error) {
+				if (error != null)
+					LogExportError (error);
+			});
+		}
+
+		/// <summary>
+		/// Exports the specified list of notes to *** files in the given folder,
+		/// excludes template notes.  finished is called when the export
+		/// is over, unless this throws.
+		/// </summary>
+		public void ExportNotesInList (List<Note> note_list, string output_folder,
+		                               ExportFinishedHandler finished)
+		{
+			List<KeyValuePair<Note, string>> exports = new List<KeyValuePair<Note, string>> ();
+			AddNotesInList (exports, note_list, output_folder);
+			ExportNotes (exports, finished);
+		}
+
+		/// <summary>
+		/// Adds the notes in the list that aren't templates to exports,
+		/// each with the folder it is to be exported to.
+		/// </summary>
+		private static void AddNotesInList (List<KeyValuePair<Note, string>> exports,
+		                                    List<Note> note_list, string output_folder)
 		{
 			output_folder = output_folder + System.IO.Path.DirectorySeparatorChar;
 			bool save;
@@ -362,11 +415,78 @@ namespace Tomboy
 						save = false;
 				}
 
-				if (save) {
-					ExportSingleNote (note, output_folder);
-				}
+				if (save)
+					exports.Add (new KeyValuePair<Note, string> (note, output_folder));
+			}
+		}
+
+		/// <summary>
+		/// Exports each note to the folder paired with it, and calls
+		/// finished on the GTK thread when done.  Called on the GTK
+		/// thread.  By default, notes are exported one at a time with
+		/// ExportSingleNote before this returns; override to do better,
+		/// e.g. on worker threads while the GTK main loop runs.
+		/// ResolveRelativePath may be called from any thread until
+		/// finished is called.
+		/// </summary>
+		protected virtual void ExportNotes (List<KeyValuePair<Note, string>> exports,
+		                                    ExportFinishedHandler finished)
+		{
+			Exception error = null;
+			BuildExportIndex ();
+			try {
+				foreach (KeyValuePair<Note, string> export in exports)
+					ExportSingleNote (export.Key, export.Value);
+			} catch (Exception e) {
+				error = e;
+			} finally {
+				ClearExportIndex ();
+			}
+			finished (error);
+		}
+
+		/// <summary>
+		/// Records where every note would be exported, for
+		/// ResolveRelativePath (string, string).  Call on the GTK
+		/// thread, before exporting.
+		/// </summary>
+		protected void BuildExportIndex ()
+		{
+			export_index = MakeExportIndex ();
+		}
+
+		/// <summary>
+		/// Records where every note would be exported.  Call on the GTK
+		/// thread.
+		/// </summary>
+		public static ExportIndex MakeExportIndex ()
+		{
+			ExportIndex index = new ExportIndex ();
+			foreach (Note note in Tomboy.DefaultNoteManager.Notes) {
+				// NoteManager.Find returns the first match
+				string key = note.Title.ToLower ();
+				if (!index.Notes.ContainsKey (key))
+					index.Notes [key] = MakeExportedNote (note);
 			}
-			return;
+			return index;
+		}
+
+		private static ExportedNote MakeExportedNote (Note note)
+		{
+			ExportedNote exported = new ExportedNote ();
+			exported.SanitizedTitle = SanitizeNoteTitle (note.Title);
+			Notebook notebook = NotebookManager.GetNotebookFromNote (note);
+			if (notebook != null)
+				exported.Notebook = notebook.NormalizedName;
+			return exported;
+		}
+
+		/// <summary>
+		/// Forgets what BuildExportIndex recorded.
+		/// </summary>
+		protected void ClearExportIndex ()
+		{
+			export_index = null;
 		}
 
 		/// <summary>
@@ -457,6 +577,25 @@ namespace Tomboy
 			msg_dialog.Destroy ();
 		}
 
+		/// <summary>
+		/// Logs why an export failed and tells the user, then destroys
+		/// dialog.
+		/// </summary>
+		private static void ShowExportError (string output_folder, ExportMultipleDialog dialog,
+		                                     Exception error)
+		{
+			LogExportError (error);
+
+			string error_message;
+			if (error is UnauthorizedAccessException)
+				error_message = Catalog.GetString ("Access denied.");
+			else if (error is DirectoryNotFoundException)
+				error_message = Catalog.GetString ("Folder does not exist.");
+			else
+				error_message = Catalog.GetString ("Unknown error.");
+			ShowErrorDialog (output_folder, dialog, error_message);
+		}
+
 		/// <summary>
 		/// Shows an error dialog if things go wrong.
 		/// </summary>
@@ -505,12 +644,58 @@ namespace Tomboy
 		/// </returns>
 		public string ResolveRelativePath (Note note_from, string title_to)
 		{
-			NoteManager manager = Tomboy.DefaultNoteManager;
-			Note note_to = manager.Find (title_to);
-			string title_from = SanitizeNoteTitle (note_from.Title);
+			Notebook notebook = NotebookManager.GetNotebookFromNote (note_from);
+			return ResolveRelativePathFromNotebook (export_index,
+			                                        notebook == null ? null : notebook.NormalizedName,
+			                                        title_to);
+		}
+
+		/// <summary>
+		/// Like ResolveRelativePath (Note, string), but by title, for
+		/// calling from other threads while ExportNotes is running.
+		/// </summary>
+		public string ResolveRelativePath (string title_from, string title_to)
+		{
+			return ResolveRelativePath (export_index, title_from, title_to);
+		}
+
+		/// <summary>
+		/// Like ResolveRelativePath (string, string), but with an index
+		/// from MakeExportIndex, for calling from any thread.  If index
+		/// is null, the notes are looked up on the GTK thread instead.
+		/// </summary>
+		public string ResolveRelativePath (ExportIndex index, string title_from, string title_to)
+		{
+			ExportedNote from = FindExportedNote (index, title_from);
+			if (from == null) {
+				Logger.Error("Could not find note titled '{0}' to construct a link from it", title_from);
+				return "";
+			}
+			return ResolveRelativePathFromNotebook (index, from.Notebook, title_to);
+		}
+
+		// From the index of the export if there is one.  Otherwise just
+		// the one note is looked up, on the GTK thread.
+		private static ExportedNote FindExportedNote (ExportIndex index, string title)
+		{
+			if (index != null) {
+				ExportedNote exported;
+				index.Notes.TryGetValue (title.ToLower (), out exported);
+				return exported;
+			}
+
+			Note note = Tomboy.DefaultNoteManager.Find (title);
+			return note == null ? null : MakeExportedNote (note);
+		}
+
+		// notebook_from is a normalized name, or null for unfiled notes
+		private string ResolveRelativePathFromNotebook (ExportIndex index, string notebook_from,
+		                                                string title_to)
+		{
+			ExportedNote note_to = FindExportedNote (index, title_to);
 			if (note_to != null) {
-				title_to = SanitizeNoteTitle(note_to.Title);
-				Logger.Debug("Found linked note '{0}', sanitized title: '{1}'", note_to.Title, title_to);
+				Logger.Debug("Found linked note '{0}', sanitized title: '{1}'", title_to, note_to.SanitizedTitle);
+				title_to = note_to.SanitizedTitle;
 			} else {
 				Logger.Error("Could not find note titled '{0}' to construct a link to it", title_to);
 				return "";
@@ -518,41 +703,25 @@ namespace Tomboy
 
 			if (exporting_single_notebook) {
 				//If there is only one notebook being exported
-				if (NotebookManager.GetNotebookFromNote (note_from) == NotebookManager.GetNotebookFromNote (note_to)) {
+				if (notebook_from == note_to.Notebook) {
 					return title_to + "." + export_file_suffix;
 				} else {
 					return "";
 				}
 			} else {
 				//If all notebooks are available
-				if (NotebookManager.GetNotebookFromNote (note_from) == NotebookManager.GetNotebookFromNote (note_to)) {
+				if (notebook_from == note_to.Notebook) {
 					//Both notes are in the same notebook
 					return title_to + "." + export_file_suffix;
+				} else if (note_to.Notebook == null) {
+					//Unfiled notes are a special case because they're in the root directory
+					return ".." + System.IO.Path.DirectorySeparatorChar + title_to + "." + export_file_suffix;
+				} else if (notebook_from == null) {
+					return SanitizePath (note_to.Notebook) + System.IO.Path.DirectorySeparatorChar
+						+ title_to + "." + export_file_suffix;
 				} else {
-					//Unfiled notes are a special case because they're in the root directory and will
-					// throw an exception from the notebookmanager
-					string notebook_from;
-					string notebook_to;
-					try {
-						notebook_from = NotebookManager.GetNotebookFromNote (note_from).NormalizedName;
-					} catch (Exception ex) {
-						notebook_from = "___NotebookManager___UnfiledNotes__Notebook___"; //TODO: Ugly!
-					}
-					try {
-						notebook_to = NotebookManager.GetNotebookFromNote (note_to).NormalizedName;
-					} catch (Exception ex) {
-						notebook_to = "___NotebookManager___UnfiledNotes__Notebook___";
-					}
-
-					if (notebook_to == "___NotebookManager___UnfiledNotes__Notebook___") {
-						return ".." + System.IO.Path.DirectorySeparatorChar + title_to + "." + export_file_suffix;
-					} else if (notebook_from == "___NotebookManager___UnfiledNotes__Notebook___") {
-						return SanitizePath (notebook_to) + System.IO.Path.DirectorySeparatorChar
-							+ title_to + "." + export_file_suffix;
-					} else {
-						return ".." + System.IO.Path.DirectorySeparatorChar + SanitizePath (notebook_to)
-							+ System.IO.Path.DirectorySeparatorChar + title_to + "." + export_file_suffix;
-					}
+					return ".." + System.IO.Path.DirectorySeparatorChar + SanitizePath (note_to.Notebook)
+						+ System.IO.Path.DirectorySeparatorChar + title_to + "." + export_file_suffix;
 				}
 			}
 		}
@@ -598,4 +767,43 @@ namespace Tomboy
 			CurrentName = default_folder;
 		}
 	}
+
+	/// <summary>
+	/// Shows how far an export has got, for exporters that work while
+	/// the GTK main loop runs.
+	/// </summary>
+	public class ExportProgressDialog : Gtk.Dialog
+	{
+		Gtk.ProgressBar progress_bar;
+
+		public ExportProgressDialog (string export_type_name)
+			: base (String.Format (Catalog.GetString ("Exporting to {0}"), export_type_name),
+			        null, Gtk.DialogFlags.Modal)
+		{
+			SetSizeRequest (400, -1);
+			HasSeparator = false;
+			Deletable = false;
+
+			progress_bar = new Gtk.ProgressBar ();
+			progress_bar.Orientation = Gtk.ProgressBarOrientation.LeftToRight;
+			progress_bar.BarStyle = Gtk.ProgressBarStyle.Continuous;
+			progress_bar.Show ();
+
+			Gtk.VBox box = new Gtk.VBox (false, 6);
+			box.BorderWidth = 12;
+			box.PackStart (progress_bar, false, false, 0);
+			box.Show ();
+			VBox.PackStart (box, true, true, 0);
+		}
+
+		/// <summary>
+		/// Call on the GTK thread.
+		/// </summary>
+		public void SetProgress (int exported, int total)
+		{
+			progress_bar.Fraction = total == 0 ? 1.0 : (double) exported / total;
+			progress_bar.Text = String.Format (Catalog.GetString ("{0} of {1} notes"),
+			                                   exported, total);
+		}
+	}
 }
@@ -1,4 +1,5 @@
 using System;
+using System.Collections.Generic;
 
 namespace Tomboy
 {
@@ -10,6 +11,7 @@ namespace Tomboy
 		string CreateNamedNote (string linked_title);
 		string CreateNamedNoteWithUri (string linked_title, string uri);
 		string CreateNote ();
+		string [] CreateNotes (string [] titles, string [] text_contents);
 		bool DeleteNote (string uri);
 		bool DisplayNote (string uri);
 		bool DisplayNoteWithSearch (string uri, string search);
@@ -25,6 +27,9 @@ namespace Tomboy
 		string GetNoteContents (string uri);
 		string GetNoteContentsXml (string uri);
 		long GetNoteCreateDate (string uri);
+		IDictionary<string, object> [] GetNotes (string [] uris, string [] fields);
+		IDictionary<string, object> [] GetNotesChangedSince (long timestamp, string [] fields);
+		IDictionary<string, object> [] GetNotesPage (string after_uri, int max_count, string [] fields);
 		string GetNoteTitle (string uri);
 		string [] GetTagsForNote (string uri);
 		bool HideNote (string uri);
@@ -35,9 +40,12 @@ namespace Tomboy
 		event RemoteSavedHandler NoteSaved;
 		bool RemoveTagFromNote (string uri, string tag_name);
 		string [] SearchNotes (string query, bool case_sensitive);
+		IDictionary<string, object> [] SearchNotesRanked (string query, bool case_sensitive, int max_results);
 		bool SetNoteCompleteXml (string uri, string xml_contents);
 		bool SetNoteContents (string uri, string text_contents);
 		bool SetNoteContentsXml (string uri, string xml_contents);
+		void SetTracingEnabled (bool enabled);
 		string Version ();
+		string WriteTrace (string path);
 	}
 }
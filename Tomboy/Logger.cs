@@ -1,6 +1,7 @@
 using System;
 using System.IO;
 using System.Runtime.InteropServices;
+using System.Threading;
 
 namespace Tomboy
 {
@@ -11,6 +12,14 @@ namespace Tomboy
 		void Log (Level lvl, string msg, params object[] args);
 	}
 
+	// Output side of a logger, for messages that have already been
+	// formatted.  Write may buffer; Flush pushes it out.
+	public interface ILogWriter
+	{
+		void Write (Level lvl, DateTime time, string msg);
+		void Flush ();
+	}
+
 	class NullLogger : ILogger
 	{
 		public void Log (Level lvl, string msg, params object[] args)
@@ -18,7 +27,7 @@ namespace Tomboy
 		}
 	}
 
-	class ConsoleLogger : ILogger
+	class ConsoleLogger : ILogger, ILogWriter
 	{
 #if WIN32
 		[DllImport("kernel32.dll")]
@@ -40,21 +49,27 @@ namespace Tomboy
 
 		public void Log (Level lvl, string msg, params object[] args)
 		{
-			Console.Write ("[{0} {1:00}:{2:00}:{3:00}.{4:000}]",
-			               Enum.GetName (typeof (Level), lvl),
-			               DateTime.Now.Hour,
-			               DateTime.Now.Minute,
-			               DateTime.Now.Second,
-			               DateTime.Now.Millisecond);
-			msg = string.Format (" {0}", msg);
-			if (args.Length > 0)
-				Console.WriteLine (msg, args);
-			else
-				Console.WriteLine (msg);
+			Write (lvl, DateTime.Now, Logger.Format (msg, args));
+		}
+
+		public void Write (Level lvl, DateTime time, string msg)
+		{
+			Console.WriteLine ("[{0} {1:00}:{2:00}:{3:00}.{4:000}] {5}",
+			                   Enum.GetName (typeof (Level), lvl),
+			                   time.Hour,
+			                   time.Minute,
+			                   time.Second,
+			                   time.Millisecond,
+			                   msg);
+		}
+
+		public void Flush ()
+		{
+			Console.Out.Flush ();
 		}
 	}
 
-	class FileLogger : ILogger
+	class FileLogger : ILogger, ILogWriter
 	{
 		StreamWriter log;
 		ConsoleLogger console;
@@ -94,19 +109,20 @@ namespace Tomboy
 
 		public void Log (Level lvl, string msg, params object[] args)
 		{
-			console.Log (lvl, msg, args);
+			Write (lvl, DateTime.Now, Logger.Format (msg, args));
+			Flush ();
+		}
+
+		public void Write (Level lvl, DateTime time, string msg)
+		{
+			console.Write (lvl, time, msg);
 
 			if (log != null) {
-				msg = string.Format ("{0} [{1}]: {2}",
-				                     DateTime.Now.ToString(),
-				                     Enum.GetName (typeof (Level), lvl),
-				                     msg);
 				try {
-					if (args.Length > 0)
-						log.WriteLine (msg, args);
-					else
-						log.WriteLine (msg);
-					log.Flush();
+					log.WriteLine ("{0} [{1}]: {2}",
+					               time.ToString (),
+					               Enum.GetName (typeof (Level), lvl),
+					               msg);
 				} catch (IOException iox) {
 					console.Log(Level.ERROR,
 					            "Failed to write to the log file due to IO exception: {0}",
@@ -118,16 +134,223 @@ namespace Tomboy
 				}
 			}
 		}
+
+		public void Flush ()
+		{
+			console.Flush ();
+
+			if (log != null) {
+				try {
+					log.Flush ();
+				} catch (IOException iox) {
+					console.Log (Level.ERROR,
+					             "Failed to flush the log file due to IO exception: {0}",
+					             iox.Message);
+				}
+			}
+		}
+	}
+
+	// Queues messages for a background thread that formats and writes
+	// them, so logging never waits on the console or the disk.
+	//
+	// Messages go into a fixed size ring buffer as the format string and
+	// its arguments; nothing is formatted on the logging thread.  Slots
+	// are claimed with a compare-and-swap on the write position, so
+	// threads logging at the same time never take a lock (this is
+	// Dmitry Vyukov's bounded queue, with a single consumer).  When the
+	// buffer is full new messages are dropped and counted, and the count
+	// is logged once there is room again.  The writer thread drains the
+	// buffer every FlushInterval milliseconds, or as soon as an error is
+	// logged, and flushes once per batch.
+	//
+	// Only messages whose arguments are all strings or value types are
+	// queued unformatted.  Any other argument could be a GTK object, or
+	// change before the writer gets to it, so those messages are
+	// formatted on the logging thread.
+	public class AsyncLogger : ILogger
+	{
+		public const int DefaultCapacity = 4096;
+		public const int FlushInterval = 250;
+
+		class Slot
+		{
+			public int Sequence;
+			public Level Level;
+			public DateTime Time;
+			public string Message;
+			public object[] Args;
+		}
+
+		readonly ILogWriter writer;
+		readonly Slot[] slots;
+		readonly int mask;
+		int enqueue_pos;
+		int dequeue_pos;	// Only touched with drain_lock held
+		int dropped;
+
+		readonly object drain_lock = new object ();
+		readonly AutoResetEvent wake = new AutoResetEvent (false);
+		readonly Thread thread;
+
+		public AsyncLogger (ILogWriter writer) : this (writer, DefaultCapacity)
+		{
+		}
+
+		public AsyncLogger (ILogWriter writer, int capacity)
+		{
+			this.writer = writer;
+
+			int size = 2;
+			while (size < capacity)
+				size <<= 1;
+			slots = new Slot [size];
+			for (int i = 0; i < size; i++) {
+				slots [i] = new Slot ();
+				slots [i].Sequence = i;
+			}
+			mask = size - 1;
+
+			AppDomain.CurrentDomain.ProcessExit += delegate { Flush (); };
+
+			thread = new Thread (Run);
+			thread.Name = "Logger";
+			thread.IsBackground = true;
+			thread.Priority = ThreadPriority.BelowNormal;
+			thread.Start ();
+		}
+
+		public void Log (Level lvl, string msg, params object[] args)
+		{
+			if (!CanDefer (args)) {
+				msg = Logger.Format (msg, args);
+				args = null;
+			}
+
+			int pos = Thread.VolatileRead (ref enqueue_pos);
+			Slot slot;
+			while (true) {
+				slot = slots [pos & mask];
+				int diff = Thread.VolatileRead (ref slot.Sequence) - pos;
+				if (diff == 0) {
+					int seen = Interlocked.CompareExchange (ref enqueue_pos, pos + 1, pos);
+					if (seen == pos)
+						break;
+					pos = seen;
+				} else if (diff < 0) {
+					// Full: the writer hasn't freed this slot yet
+					Interlocked.Increment (ref dropped);
+					wake.Set ();
+					return;
+				} else {
+					pos = Thread.VolatileRead (ref enqueue_pos);
+				}
+			}
+
+			slot.Level = lvl;
+			slot.Time = DateTime.UtcNow;
+			slot.Message = msg;
+			slot.Args = args;
+			// Publishes the fields above to the writer
+			Thread.VolatileWrite (ref slot.Sequence, pos + 1);
+
+			if (lvl >= Level.ERROR)
+				wake.Set ();
+			if (lvl == Level.FATAL)
+				Flush ();
+		}
+
+		static bool CanDefer (object[] args)
+		{
+			if (args == null)
+				return true;
+			foreach (object arg in args) {
+				if (arg != null && !(arg is string) && !(arg is ValueType))
+					return false;
+			}
+			return true;
+		}
+
+		// Write out everything logged so far, on the calling thread.
+		public void Flush ()
+		{
+			lock (drain_lock) {
+				Drain ();
+			}
+		}
+
+		void Run ()
+		{
+			while (true) {
+				wake.WaitOne (FlushInterval, false);
+				Flush ();
+			}
+		}
+
+		void Drain ()
+		{
+			int written = 0;
+
+			while (true) {
+				Slot slot = slots [dequeue_pos & mask];
+				if (Thread.VolatileRead (ref slot.Sequence) != dequeue_pos + 1)
+					break;
+
+				Level lvl = slot.Level;
+				DateTime time = slot.Time;
+				string msg = slot.Message;
+				object[] args = slot.Args;
+				slot.Message = null;
+				slot.Args = null;
+				// Hand the slot back to the loggers for the next lap
+				Thread.VolatileWrite (ref slot.Sequence, dequeue_pos + mask + 1);
+				dequeue_pos++;
+
+				Write (lvl, time.ToLocalTime (), Logger.Format (msg, args));
+				written++;
+			}
+
+			int reported_drops = Interlocked.Exchange (ref dropped, 0);
+			if (reported_drops > 0) {
+				Write (Level.WARN, DateTime.Now,
+				       string.Format ("Logger: {0} messages dropped, the log buffer was full",
+				                      reported_drops));
+				written++;
+			}
+
+			if (written > 0) {
+				try {
+					writer.Flush ();
+				} catch (Exception e) {
+					Console.Error.WriteLine ("Failed to flush the log: {0}", e.Message);
+				}
+			}
+		}
+
+		void Write (Level lvl, DateTime time, string msg)
+		{
+			try {
+				writer.Write (lvl, time, msg);
+			} catch (Exception e) {
+				Console.Error.WriteLine ("Failed to write to the log: {0}", e.Message);
+			}
+		}
 	}
 
 	// This class provides a generic logging facility. By default all
-	// information is written to standard out and a log file, but other
-	// loggers are pluggable.
+	// information is written to standard out and a log file from a
+	// background thread, but other loggers are pluggable.
+	//
+	// The level is checked before anything else, so a disabled message
+	// costs a comparison.  The generic Debug overloads check it before
+	// boxing their arguments into the params array, which the device
+	// queues with the message for its own thread to format.  For
+	// anything expensive to compute, check IsEnabled first.
 	public static class Logger
 	{
 		private static Level log_level = Level.DEBUG;
 
-		static ILogger log_dev = new FileLogger ();
+		static ILogger log_dev = new AsyncLogger (new FileLogger ());
 
 		static bool muted = false;
 
@@ -151,11 +374,40 @@ namespace Tomboy
 			}
 		}
 
+		public static bool IsEnabled (Level lvl)
+		{
+			return !muted && lvl >= log_level;
+		}
+
 		public static void Debug (string msg, params object[] args)
 		{
 			Log (Level.DEBUG, msg, args);
 		}
 
+		public static void Debug (string msg)
+		{
+			if (IsEnabled (Level.DEBUG))
+				log_dev.Log (Level.DEBUG, msg);
+		}
+
+		public static void Debug<T0> (string msg, T0 arg0)
+		{
+			if (IsEnabled (Level.DEBUG))
+				log_dev.Log (Level.DEBUG, msg, arg0);
+		}
+
+		public static void Debug<T0, T1> (string msg, T0 arg0, T1 arg1)
+		{
+			if (IsEnabled (Level.DEBUG))
+				log_dev.Log (Level.DEBUG, msg, arg0, arg1);
+		}
+
+		public static void Debug<T0, T1, T2> (string msg, T0 arg0, T1 arg1, T2 arg2)
+		{
+			if (IsEnabled (Level.DEBUG))
+				log_dev.Log (Level.DEBUG, msg, arg0, arg1, arg2);
+		}
+
 		public static void Info (string msg, params object[] args)
 		{
 			Log (Level.INFO, msg, args);
@@ -178,10 +430,35 @@ namespace Tomboy
 
 		public static void Log (Level lvl, string msg, params object[] args)
 		{
-			if (!muted && lvl >= log_level)
+			if (IsEnabled (lvl))
 				log_dev.Log (lvl, msg, args);
 		}
 
+		// Write out any messages still queued by an asynchronous device.
+		public static void Flush ()
+		{
+			AsyncLogger async = log_dev as AsyncLogger;
+			if (async != null)
+				async.Flush ();
+		}
+
+		// Format a message the way String.Format would, but never throw:
+		// a bad format string shouldn't take down the caller or the log
+		// writer.
+		internal static string Format (string msg, object[] args)
+		{
+			if (msg == null)
+				return string.Empty;
+			if (args == null || args.Length == 0)
+				return msg;
+			try {
+				return string.Format (msg, args);
+			} catch (FormatException) {
+				return msg + " [" + string.Join (", ", Array.ConvertAll<object, string> (
+					args, delegate (object arg) { return arg == null ? "null" : arg.ToString (); })) + "]";
+			}
+		}
+
 		// This is here to support the original logging, but it should be
 		// considered deprecated and old code that uses it should be upgraded to
 		// call one of the level specific log methods.
@@ -26,7 +26,7 @@ namespace Tomboy
 	{
 		readonly string uri;
 		string title;
-		string text;
+		NoteText text;
 		DateTime create_date;
 		DateTime change_date;
 		DateTime metadata_change_date;
@@ -43,7 +43,7 @@ namespace Tomboy
 		public NoteData (string uri)
 		{
 			this.uri = uri;
-			this.text = "";
+			this.text = NoteText.Empty;
 			x = noPosition;
 			y = noPosition;
 			selection_bound_pos = noPosition;
@@ -75,10 +75,20 @@ namespace Tomboy
 		public string Text
 		{
 			get {
-				return text;
+				return text.Value;
 			}
 			set {
-				text = value;
+				text = value == string.Empty ? NoteText.Empty : new NoteText (value);
+			}
+		}
+
+		/// <summary>
+		/// Where Text is kept, which NoteContentStore may deflate.
+		/// </summary>
+		public NoteText StoredText
+		{
+			get {
+				return text;
 			}
 		}
 
@@ -225,6 +235,17 @@ namespace Tomboy
 		{
 			return width != 0 && height != 0;
 		}
+
+		/// <summary>
+		/// A copy that doesn't change when this one does.  The Tag
+		/// objects and the stored text themselves are shared.
+		/// </summary>
+		public NoteData Clone ()
+		{
+			NoteData copy = (NoteData) MemberwiseClone ();
+			copy.tags = new Dictionary<string, Tag> (tags);
+			return copy;
+		}
 	}
 
 	// This class wraps a NoteData instance. Most method calls are
@@ -286,6 +307,23 @@ namespace Tomboy
 			}
 		}
 
+		/// <summary>
+		/// Serialize the buffer into Data.Text one last time and stop
+		/// following it.  Setting Buffer again rehydrates from the text.
+		/// </summary>
+		public void ReleaseBuffer ()
+		{
+			if (buffer == null)
+				return;
+
+			SynchronizeText ();
+
+			buffer.Changed -= OnBufferChanged;
+			buffer.TagApplied -= BufferTagApplied;
+			buffer.TagRemoved -= BufferTagRemoved;
+			buffer = null;
+		}
+
 		// Custom Methods
 
 		void InvalidateText ()
@@ -298,16 +336,18 @@ namespace Tomboy
 			return data.Text == "";
 		}
 
+		// Without a buffer, this must not read data.Text, which would
+		// inflate a cold note's text.
 		void SynchronizeText ()
 		{
-			if (TextInvalid () && buffer != null) {
+			if (buffer != null && TextInvalid ()) {
 				data.Text = NoteBufferArchiver.Serialize (buffer);
 			}
 		}
 
 		void SynchronizeBuffer ()
 		{
-			if (!TextInvalid () && buffer != null) {
+			if (buffer != null && !TextInvalid ()) {
 				// Don't create Undo actions during load
 				buffer.Undoer.FreezeUndo ();
 
@@ -373,6 +413,7 @@ namespace Tomboy
 		bool is_deleting;
 		bool enabled = true;
 		bool save_errordlg_active;
+		string content_hash;
 
 		NoteManager manager;
 		NoteWindow window;
@@ -498,7 +539,7 @@ namespace Tomboy
 		// Load from an existing Note...
 		public static Note Load (string read_file, NoteManager manager)
 		{
-			NoteData data = NoteArchiver.Read (read_file, UrlFromPath (read_file));
+			NoteData data = manager.Store.Read (read_file, UrlFromPath (read_file));
 			Note note = CreateExistingNote (data, read_file, manager);
 
 			return note;
@@ -535,7 +576,11 @@ namespace Tomboy
 			Logger.Debug ("Saving '{0}'...", data.Data.Title);
 
 			try {
-				NoteArchiver.Write (filepath, data.GetDataSynchronized ());
+				using (Tracer.Span ("Note.Save", "save")) {
+					NoteData saved_data = data.GetDataSynchronized ();
+					manager.Store.Write (filepath, saved_data);
+					content_hash = NoteContentHash.Compute (saved_data);
+				}
 			} catch (Exception e) {
 				// Probably IOException or UnauthorizedAccessException?
 				Logger.Error ("Exception while saving note: " + e.ToString ());
@@ -629,6 +674,12 @@ namespace Tomboy
 		{
 			window = null;
 		}
+
+		void WindowHidden (object sender, EventArgs args)
+		{
+			if (manager != null && manager.BufferCache != null)
+				manager.BufferCache.OnWindowHidden (this);
+		}
 		
 		/// <summary>
 		/// Set a timeout to execute the save.  Possibly
@@ -942,6 +993,8 @@ namespace Tomboy
 			xmlDoc.LoadXml (foreignNoteXml);
 			xmlDoc = null;
 
+			content_hash = null;
+
 			// Remove tags now, since a note with no tags has
 			// no "tags" element in the XML
 			List<Tag> newTags = new List<Tag> ();
@@ -1111,6 +1164,10 @@ namespace Tomboy
 					Logger.Debug ("Creating Buffer for '{0}'...",
 					data.Data.Title);
 
+					// Addins may register dynamic tags, so they have to
+					// be in place before the note text is deserialized.
+					EnsureAddins ();
+
 					buffer = new NoteBuffer (TagTable, this);
 					data.Buffer = buffer;
 
@@ -1119,7 +1176,11 @@ namespace Tomboy
 					buffer.TagApplied += BufferTagApplied;
 					buffer.TagRemoved += BufferTagRemoved;
 					buffer.MarkSet += OnBufferMarkSet;
-				}
+
+					if (manager != null && manager.BufferCache != null)
+						manager.BufferCache.OnBufferCreated (this);
+				} else if (manager != null && manager.BufferCache != null)
+					manager.BufferCache.Touch (this);
 				return buffer;
 			}
 		}
@@ -1131,6 +1192,112 @@ namespace Tomboy
 			}
 		}
 
+		/// <summary>
+		/// Position of this note's last buffer or window access, as
+		/// counted by NoteBufferCache.  Used for LRU eviction.
+		/// </summary>
+		public long LastAccess
+		{
+			get; set;
+		}
+
+		/// <summary>
+		/// Where the note's text is kept, without serializing the
+		/// buffer into it first.  For NoteContentStore.
+		/// </summary>
+		public NoteText StoredText
+		{
+			get {
+				return data.Data.StoredText;
+			}
+		}
+
+		/// <summary>
+		/// NoteContentHash of the note as last saved, or as loaded if it
+		/// hasn't been saved since.  Updated on every save so sync can
+		/// compare notes without serializing them.
+		/// </summary>
+		public string ContentHash
+		{
+			get {
+				if (content_hash == null)
+					content_hash = NoteContentHash.Compute (data.Data);
+				return content_hash;
+			}
+		}
+
+		/// <summary>
+		/// Number of characters in the live buffer, or 0 if the note
+		/// has none.  Does not create the buffer.
+		/// </summary>
+		public int BufferCharCount
+		{
+			get {
+				return buffer != null ? buffer.CharCount : 0;
+			}
+		}
+
+		/// <summary>
+		/// True if the note has a buffer that isn't in use by a visible
+		/// window and could be released by ReleaseBuffer.
+		/// </summary>
+		public bool CanReleaseBuffer
+		{
+			get {
+				return buffer != null &&
+				       !is_deleting &&
+				       enabled &&
+				       !save_errordlg_active &&
+				       (window == null || !window.Visible);
+			}
+		}
+
+		/// <summary>
+		/// Release the NoteBuffer (and with it the undo history), the
+		/// hidden NoteWindow and the lazily created NoteAddins of a
+		/// closed note.  The serialized text is kept in NoteData, and
+		/// everything is recreated the next time Buffer or Window is
+		/// accessed.  Pending saves are unaffected.
+		/// </summary>
+		public bool ReleaseBuffer ()
+		{
+			if (!CanReleaseBuffer)
+				return false;
+
+			Logger.Debug ("Releasing Buffer for '{0}'...", data.Data.Title);
+
+			data.ReleaseBuffer ();
+
+			buffer.Changed -= OnBufferChanged;
+			buffer.TagApplied -= BufferTagApplied;
+			buffer.TagRemoved -= BufferTagRemoved;
+			buffer.MarkSet -= OnBufferMarkSet;
+
+			// Addins are shut down while the buffer and window are still
+			// around, since most of them detach from both.
+			if (manager != null && manager.AddinManager != null)
+				manager.AddinManager.ReleaseAddinsForNote (this);
+
+			if (window != null)
+				window.Destroy ();
+
+			childWidgetQueue.Clear ();
+
+			buffer.Detach ();
+			buffer.Dispose ();
+			buffer = null;
+
+			return true;
+		}
+
+		// Create the NoteAddins that are deferred until the note
+		// is actually used.  See AddinManager.EnsureAddinsForNote.
+		void EnsureAddins ()
+		{
+			if (manager != null && manager.AddinManager != null)
+				manager.AddinManager.EnsureAddinsForNote (this);
+		}
+
 		private Gtk.Widget focusWidget;
 		public bool Enabled
 		{
@@ -1151,8 +1318,11 @@ namespace Tomboy
 		{
 			get {
 				if (window == null) {
+					EnsureAddins ();
+
 					window = new NoteWindow (this);
 					window.Destroyed += WindowDestroyed;
+					window.Hidden += WindowHidden;
 					window.ConfigureEvent += WindowConfigureEvent;
 					// TODO: What about a disabled set where you can still copy text?
 					window.Editor.Sensitive = Enabled;
@@ -1241,6 +1411,8 @@ namespace Tomboy
 					// the window is showing.
 					ProcessChildWidgetQueue ();
 				}
+				if (manager != null && manager.BufferCache != null)
+					manager.BufferCache.Touch (this);
 				return window;
 			}
 		}
@@ -1380,8 +1552,12 @@ namespace Tomboy
 		{
 			NoteData data;
 			string version;
-			using (var xml = new XmlTextReader (new StreamReader (read_file, System.Text.Encoding.UTF8)) {Namespaces = false})
-				data = Read (xml, uri, out version);
+			using (Tracer.Span ("NoteArchiver.Read", "load")) {
+				if (!NoteCodec.TryReadFile (read_file, uri, out data, out version)) {
+					using (var xml = new XmlTextReader (new StreamReader (read_file, System.Text.Encoding.UTF8)) {Namespaces = false})
+						data = Read (xml, uri, out version);
+				}
+			}
 
 			if (version != NoteArchiver.CURRENT_VERSION) {
 				// Note has old format, so rewrite it.  No need
@@ -1393,11 +1569,33 @@ namespace Tomboy
 			return data;
 		}
 
+		public static NoteData Read (byte [] note_bytes, string uri)
+		{
+			return Instance.ReadBytes (note_bytes, uri);
+		}
+
+		/// <summary>
+		/// Read a note from the contents of a note file, as written by
+		/// WriteBytes.  Older formats are read but not rewritten.
+		/// </summary>
+		public virtual NoteData ReadBytes (byte [] note_bytes, string uri)
+		{
+			NoteData data;
+			string version; // discarded
+			using (Tracer.Span ("NoteArchiver.Read", "load")) {
+				if (NoteCodec.TryRead (note_bytes, note_bytes.Length, uri, out data, out version))
+					return data;
+				using (var xml = new XmlTextReader (new StreamReader (new MemoryStream (note_bytes),
+				                                                      System.Text.Encoding.UTF8)) {Namespaces = false})
+					return Read (xml, uri, out version);
+			}
+		}
+
 		public virtual NoteData Read (XmlTextReader xml, string uri)
 		{
 			string version; // discarded
-			NoteData data = Read (xml, uri, out version);
-			return data;
+			using (Tracer.Span ("NoteArchiver.Read", "load"))
+				return Read (xml, uri, out version);
 		}
 
 		private NoteData Read (XmlTextReader xml, string uri, out string version)
@@ -1488,8 +1686,10 @@ namespace Tomboy
 		public static string WriteString(NoteData note)
 		{
 			StringWriter str = new StringWriter ();
-			using (var xml = XmlWriter.Create (str, XmlEncoder.DocumentSettings))
-				Instance.Write (xml, note);
+			if (!NoteCodec.TryWrite (note, str)) {
+				using (var xml = XmlWriter.Create (str, XmlEncoder.DocumentSettings))
+					Instance.Write (xml, note);
+			}
 			str.Flush();
 			return str.ToString ();
 		}
@@ -1501,33 +1701,53 @@ namespace Tomboy
 
 		public virtual void WriteFile (string write_file, NoteData note)
 		{
-			string tmp_file = write_file + ".tmp";
+			using (Tracer.Span ("NoteArchiver.Write", "save")) {
+				string tmp_file = write_file + ".tmp";
 
-			using (FileStream fs = new FileStream(tmp_file, FileMode.Create, FileAccess.Write)) {
-				using (var xml = XmlWriter.Create (fs, XmlEncoder.DocumentSettings))
-					Write (xml, note);
-				fs.Flush(true);
-			}
+				using (FileStream fs = new FileStream(tmp_file, FileMode.Create, FileAccess.Write)) {
+					Write (fs, note);
+					fs.Flush(true);
+				}
 
-			if (File.Exists (write_file)) {
-				string backup_path = write_file + "~";
-				if (File.Exists (backup_path))
-					File.Delete (backup_path);
+				if (File.Exists (write_file)) {
+					string backup_path = write_file + "~";
+					if (File.Exists (backup_path))
+						File.Delete (backup_path);
 
-				// Backup the to a ~ file, just in case
-				File.Move (write_file, backup_path);
+					// Backup the to a ~ file, just in case
+					File.Move (write_file, backup_path);
 
-				// Move the temp file to write_file
-				File.Move (tmp_file, write_file);
+					// Move the temp file to write_file
+					File.Move (tmp_file, write_file);
 
-				// Delete the ~ file
-				File.Delete (backup_path);
-			} else {
-				// Move the temp file to write_file
-				File.Move (tmp_file, write_file);
+					// Delete the ~ file
+					File.Delete (backup_path);
+				} else {
+					// Move the temp file to write_file
+					File.Move (tmp_file, write_file);
+				}
 			}
 		}
 
+		/// <summary>
+		/// The contents of the note's file, as WriteFile would write it.
+		/// </summary>
+		public static byte [] WriteBytes (NoteData note)
+		{
+			MemoryStream stream = new MemoryStream ();
+			using (Tracer.Span ("NoteArchiver.Write", "save"))
+				Instance.Write (stream, note);
+			return stream.ToArray ();
+		}
+
+		void Write (Stream stream, NoteData note)
+		{
+			if (NoteCodec.TryWrite (note, stream))
+				return;
+			using (var xml = XmlWriter.Create (stream, XmlEncoder.DocumentSettings))
+				Write (xml, note);
+		}
+
 		public static void Write (TextWriter writer, NoteData note)
 		{
 			Instance.WriteFile (writer, note);
@@ -1535,8 +1755,12 @@ namespace Tomboy
 
 		public void WriteFile (TextWriter writer, NoteData note)
 		{
-			using (var xml = XmlWriter.Create (writer, XmlEncoder.DocumentSettings))
-				Write (xml, note);
+			using (Tracer.Span ("NoteArchiver.Write", "save")) {
+				if (NoteCodec.TryWrite (note, writer))
+					return;
+				using (var xml = XmlWriter.Create (writer, XmlEncoder.DocumentSettings))
+					Write (xml, note);
+			}
 		}
 
 		void Write (XmlWriter xml, NoteData note)
@@ -1642,6 +1866,8 @@ namespace Tomboy
 		public virtual string GetRenamedNoteXml (string noteXml, string oldTitle, string newTitle)
 		{
 			string updatedXml;
+			if (NoteCodec.TryRenameTitle (noteXml, oldTitle, newTitle, out updatedXml))
+				return updatedXml;
 
 			// Replace occurences of oldTitle with newTitle in noteXml
 			string titleTagPattern =
@@ -1662,6 +1888,10 @@ namespace Tomboy
 		public virtual string GetTitleFromNoteXml (string noteXml)
 		{
 			if (noteXml != null && noteXml.Length > 0) {
+				string title;
+				if (NoteCodec.TryReadTitle (noteXml, out title))
+					return title;
+
 				XmlTextReader xml = new XmlTextReader (new StringReader (noteXml));
 				xml.Namespaces = false;
 
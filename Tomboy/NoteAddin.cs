@@ -195,4 +195,15 @@ namespace Tomboy
 			}
 		}
 	}
+
+	/// <summary>
+	/// Marks a NoteAddin that must be attached to a note as soon as the
+	/// note is loaded.  By default NoteAddins are only created once the
+	/// note's buffer or window is first needed; addins that react to
+	/// changes on closed notes (tags, metadata) should use this.
+	/// </summary>
+	[AttributeUsage (AttributeTargets.Class, Inherited = true)]
+	public sealed class EagerNoteAddinAttribute : Attribute
+	{
+	}
 }
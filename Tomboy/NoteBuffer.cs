@@ -78,6 +78,22 @@ namespace Tomboy
 			this.note = note;
 		}
 
+		/// <summary>
+		/// Disconnect from the shared tag table and drop any pending
+		/// widget insertions, so the buffer can be collected once the
+		/// owning note lets go of it.
+		/// </summary>
+		public void Detach ()
+		{
+			TagTable.TagChanged -= OnTagChanged;
+
+			if (widgetQueueTimeout != 0) {
+				GLib.Source.Remove (widgetQueueTimeout);
+				widgetQueueTimeout = 0;
+			}
+			widgetQueue.Clear ();
+		}
+
 		private static XslTransform html_transform;
 		private static XslTransform HtmlTransform {
 			get {
@@ -1194,7 +1210,8 @@ namespace Tomboy
 			StringWriter stream = new StringWriter ();
 			XmlTextWriter xml = new XmlTextWriter (stream);
 
-			Serialize (buffer, start, end, xml);
+			using (Tracer.Span ("NoteBufferArchiver.Serialize", "save"))
+				Serialize (buffer, start, end, xml);
 
 			xml.Close ();
 			string serializedBuffer = stream.ToString ();
@@ -1463,7 +1480,8 @@ namespace Tomboy
 			XmlTextReader xml = new XmlTextReader (reader);
 			xml.Namespaces = false;
 
-			Deserialize (buffer, buffer.StartIter, xml);
+			using (Tracer.Span ("NoteBufferArchiver.Deserialize", "render"))
+				Deserialize (buffer, buffer.StartIter, xml);
 		}
 
 		public static void Deserialize (Gtk.TextBuffer buffer,
@@ -0,0 +1,170 @@
+
+using System;
+using System.Collections.Generic;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// Keeps track of the notes that have a live NoteBuffer and releases
+	/// the buffer, undo history, window and addins of the least recently
+	/// used closed notes once there are more than the configured number
+	/// of them.  Released notes are rehydrated from their serialized text
+	/// the next time their buffer or window is needed.
+	/// </summary>
+	public class NoteBufferCache
+	{
+		// Wait a little before evicting so that code still holding on to
+		// a buffer in the current main loop iteration isn't surprised.
+		const uint EVICT_DELAY_MS = 30000;
+
+		// Very rough per-character cost of a live note: the GtkTextBuffer
+		// btree, applied tags, undo history and the window's layout.
+		const long BYTES_PER_CHAR_ESTIMATE = 24;
+
+		readonly List<Note> live_notes;
+		readonly InterruptableTimeout evict_timeout;
+		bool evict_pending;
+		long access_clock;
+		int budget;
+
+		public NoteBufferCache (NoteManager manager)
+		{
+			live_notes = new List<Note> ();
+
+			evict_timeout = new InterruptableTimeout ();
+			evict_timeout.Timeout += EvictTimeout;
+
+			budget = (int) Preferences.Get (Preferences.NOTE_BUFFER_CACHE_SIZE);
+			Preferences.SettingChanged += OnSettingChanged;
+
+			manager.NoteDeleted += OnNoteDeleted;
+		}
+
+		void OnSettingChanged (object sender, NotifyEventArgs args)
+		{
+			if (args.Key != Preferences.NOTE_BUFFER_CACHE_SIZE)
+				return;
+
+			budget = (int) args.Value;
+			ScheduleEviction ();
+		}
+
+		void OnNoteDeleted (object sender, Note deleted)
+		{
+			live_notes.Remove (deleted);
+		}
+
+		/// <summary>
+		/// Record an access to the note's buffer or window.  Called very
+		/// often, so this only bumps a counter.
+		/// </summary>
+		public void Touch (Note note)
+		{
+			note.LastAccess = ++access_clock;
+		}
+
+		public void OnBufferCreated (Note note)
+		{
+			if (!live_notes.Contains (note))
+				live_notes.Add (note);
+			Touch (note);
+			ScheduleEviction ();
+		}
+
+		public void OnWindowHidden (Note note)
+		{
+			ScheduleEviction ();
+		}
+
+		void ScheduleEviction ()
+		{
+			if (budget < 0 || evict_pending || live_notes.Count <= budget)
+				return;
+
+			evict_pending = true;
+			evict_timeout.Reset (EVICT_DELAY_MS);
+		}
+
+		void EvictTimeout (object sender, EventArgs args)
+		{
+			evict_pending = false;
+			Evict ();
+		}
+
+		/// <summary>
+		/// Release closed notes, least recently used first, until no
+		/// more than the configured number of buffers are alive.
+		/// </summary>
+		public void Evict ()
+		{
+			if (budget < 0 || live_notes.Count <= budget)
+				return;
+
+			List<Note> candidates = new List<Note> ();
+			foreach (Note note in live_notes) {
+				if (note.CanReleaseBuffer)
+					candidates.Add (note);
+			}
+			candidates.Sort (delegate (Note a, Note b) {
+				return a.LastAccess.CompareTo (b.LastAccess);
+			});
+
+			int released = 0;
+			foreach (Note note in candidates) {
+				if (live_notes.Count <= budget)
+					break;
+
+				try {
+					if (note.ReleaseBuffer ()) {
+						live_notes.Remove (note);
+						released++;
+					}
+				} catch (Exception e) {
+					Logger.Warn ("Error releasing buffer for '{0}': {1}",
+					             note.Title, e.Message);
+				}
+			}
+
+			Logger.Debug ("NoteBufferCache: released {0} buffers, {1} live (~{2} bytes)",
+			              released, LiveBufferCount, EstimatedBytes);
+		}
+
+		/// <summary>
+		/// Number of notes that currently have a NoteBuffer.
+		/// </summary>
+		public int LiveBufferCount
+		{
+			get {
+				return live_notes.Count;
+			}
+		}
+
+		/// <summary>
+		/// Number of notes that currently have a NoteWindow, shown or not.
+		/// </summary>
+		public int LiveWindowCount
+		{
+			get {
+				int count = 0;
+				foreach (Note note in live_notes) {
+					if (note.HasWindow)
+						count++;
+				}
+				return count;
+			}
+		}
+
+		/// <summary>
+		/// A rough estimate of the memory held by live buffers.
+		/// </summary>
+		public long EstimatedBytes
+		{
+			get {
+				long bytes = 0;
+				foreach (Note note in live_notes)
+					bytes += note.BufferCharCount * BYTES_PER_CHAR_ESTIMATE;
+				return bytes;
+			}
+		}
+	}
+}
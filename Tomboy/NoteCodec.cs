@@ -0,0 +1,1119 @@
+
+using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Text;
+using System.Xml;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// Reads and writes the fixed .note schema without XmlTextReader and
+	/// XmlWriter.  Files are scanned in a per-thread buffer and strings
+	/// are only made for the values a note keeps: the note's &lt;text&gt;
+	/// is one substring of the file, and dates and numbers are parsed
+	/// where they lie.  Notes are written into a per-thread builder and
+	/// encoded in one go.
+	///
+	/// The results are exactly those of NoteArchiver's XmlTextReader and
+	/// XmlWriter code.  Whenever the codec can't be sure of that, say
+	/// for comments, CDATA, unknown elements or note content that
+	/// ReadInnerXml would rewrite, the Try methods return false without
+	/// side effects, and NoteArchiver falls back to the generic code,
+	/// which also reports any errors.
+	/// </summary>
+	public static class NoteCodec
+	{
+		const string note_namespace = "http://beatniksoftware.com/tomboy";
+		const string link_namespace = "http://beatniksoftware.com/tomboy/link";
+		const string size_namespace = "http://beatniksoftware.com/tomboy/size";
+
+		// Buffers bigger than this aren't kept for the next note
+		const int max_pooled_size = 1024 * 1024;
+
+		// Characters that make the titles in GetRenamedNoteXml's
+		// patterns more than plain text
+		static readonly char [] regex_specials = {
+			'\\', '*', '+', '?', '|', '{', '[', '(', ')', '^', '$', '.', '#'
+		};
+
+		static readonly Encoding utf8 = new UTF8Encoding (true);
+
+		[ThreadStatic] static char [] pooled_chars;
+		[ThreadStatic] static byte [] pooled_bytes;
+		[ThreadStatic] static StringBuilder pooled_builder;
+		[ThreadStatic] static Scanner pooled_scanner;
+
+		static volatile bool enabled = true;
+
+		/// <summary>
+		/// Whether the Try methods do anything.  Turn it off to make
+		/// NoteArchiver use only XmlTextReader and XmlWriter, say to
+		/// compare the two.
+		/// </summary>
+		public static bool Enabled
+		{
+			get {
+				return enabled;
+			}
+			set {
+				enabled = value;
+			}
+		}
+
+		/// <summary>
+		/// Read a note file as NoteArchiver.ReadFile does.  version is
+		/// the note element's version attribute, or null if it has none.
+		/// </summary>
+		public static bool TryReadFile (string read_file, string uri,
+		                                out NoteData data, out string version)
+		{
+			data = null;
+			version = null;
+			if (!enabled)
+				return false;
+
+			byte [] bytes;
+			int read = 0;
+			using (FileStream fs = new FileStream (read_file, FileMode.Open,
+			                                       FileAccess.Read, FileShare.Read)) {
+				long size = fs.Length;
+				if (size > max_pooled_size * 64)
+					return false;
+
+				bytes = Rent (ref pooled_bytes, (int) size);
+				int n;
+				while (read < size && (n = fs.Read (bytes, read, (int) size - read)) > 0)
+					read += n;
+			}
+
+			return TryRead (bytes, read, uri, out data, out version);
+		}
+
+		/// <summary>
+		/// Read the first count bytes of a note file's contents, as
+		/// TryReadFile reads the file.
+		/// </summary>
+		public static bool TryRead (byte [] bytes, int count, string uri,
+		                            out NoteData data, out string version)
+		{
+			data = null;
+			version = null;
+			if (!enabled)
+				return false;
+
+			// StreamReader would switch to UTF-16 or UTF-32
+			if (count >= 2 && ((bytes [0] == 0xFF && bytes [1] == 0xFE) ||
+			                   (bytes [0] == 0xFE && bytes [1] == 0xFF)))
+				return false;
+			if (count >= 4 && bytes [0] == 0 && bytes [1] == 0 &&
+			    bytes [2] == 0xFE && bytes [3] == 0xFF)
+				return false;
+
+			int start = 0;
+			if (count >= 3 && bytes [0] == 0xEF && bytes [1] == 0xBB && bytes [2] == 0xBF)
+				start = 3;
+
+			char [] chars = Rent (ref pooled_chars, utf8.GetMaxCharCount (count - start));
+			int length = utf8.GetChars (bytes, start, count - start, chars, 0);
+
+			NoteData note = new NoteData (uri);
+			List<string> tags = new List<string> ();
+			Scanner scanner = Scan (chars, length);
+			bool scanned = scanner.ReadNote (note, tags, out version);
+			scanner.Reset (null, 0);
+			if (!scanned)
+				return false;
+
+			// Only now, so that nothing happens if the scan gives up
+			foreach (string tag_str in tags) {
+				Tag tag = TagManager.GetOrCreateTag (tag_str);
+				note.Tags [tag.NormalizedName] = tag;
+			}
+
+			data = note;
+			return true;
+		}
+
+		/// <summary>
+		/// Find the title as NoteArchiver.GetTitleFromNoteXml does,
+		/// reading no further than the title element.
+		/// </summary>
+		public static bool TryReadTitle (string note_xml, out string title)
+		{
+			title = null;
+			if (!enabled || note_xml == null)
+				return false;
+
+			char [] chars = Rent (ref pooled_chars, note_xml.Length);
+			note_xml.CopyTo (0, chars, 0, note_xml.Length);
+			Scanner scanner = Scan (chars, note_xml.Length);
+			bool scanned = scanner.ReadTitle (out title);
+			scanner.Reset (null, 0);
+			return scanned;
+		}
+
+		/// <summary>
+		/// Replace the title as NoteArchiver.GetRenamedNoteXml does,
+		/// without going through Regex.  Titles that the regular
+		/// expressions there would read as more than text are left to it.
+		/// </summary>
+		public static bool TryRenameTitle (string note_xml, string old_title,
+		                                   string new_title, out string renamed)
+		{
+			renamed = null;
+			if (!enabled || note_xml == null || string.IsNullOrEmpty (old_title) ||
+			    new_title == null)
+				return false;
+			if (old_title.IndexOfAny (regex_specials) >= 0 ||
+			    char.IsWhiteSpace (old_title [0]) ||
+			    new_title.IndexOf ('$') >= 0)
+				return false;
+
+			renamed = ReplaceAll (note_xml,
+			                      "<title>" + old_title + "</title>",
+			                      "<title>" + new_title + "</title>");
+			renamed = ReplaceContentTitle (renamed, old_title, new_title);
+			return true;
+		}
+
+		/// <summary>
+		/// Write the note to stream in UTF-8, as an XmlWriter with
+		/// XmlEncoder.DocumentSettings would.  Nothing is written when
+		/// this returns false.
+		/// </summary>
+		public static bool TryWrite (NoteData note, Stream stream)
+		{
+			if (!enabled)
+				return false;
+
+			StringBuilder xml = Builder ();
+			if (!Format (note, "utf-8", xml))
+				return false;
+
+			int length = xml.Length;
+			char [] chars = Rent (ref pooled_chars, length);
+			xml.CopyTo (0, chars, 0, length);
+			byte [] bytes = Rent (ref pooled_bytes, utf8.GetMaxByteCount (length));
+			int count = utf8.GetBytes (chars, 0, length, bytes, 0);
+
+			byte [] preamble = utf8.GetPreamble ();
+			stream.Write (preamble, 0, preamble.Length);
+			stream.Write (bytes, 0, count);
+			return true;
+		}
+
+		/// <summary>
+		/// Write the note to writer, as an XmlWriter with
+		/// XmlEncoder.DocumentSettings would.  Nothing is written when
+		/// this returns false.
+		/// </summary>
+		public static bool TryWrite (NoteData note, TextWriter writer)
+		{
+			if (!enabled || writer.Encoding == null)
+				return false;
+
+			StringBuilder xml = Builder ();
+			if (!Format (note, writer.Encoding.WebName, xml))
+				return false;
+
+			int length = xml.Length;
+			char [] chars = Rent (ref pooled_chars, length);
+			xml.CopyTo (0, chars, 0, length);
+			writer.Write (chars, 0, length);
+			return true;
+		}
+
+		static bool Format (NoteData note, string encoding_name, StringBuilder xml)
+		{
+			// XmlWriter closes empty elements with " />", and changes
+			// line breaks in raw text; leave those notes to it.
+			if (string.IsNullOrEmpty (note.Title) || string.IsNullOrEmpty (note.Text) ||
+			    !IsRawSafe (note.Text))
+				return false;
+
+			xml.Length = 0;
+			xml.Append ("<?xml version=\"1.0\" encoding=\"");
+			xml.Append (encoding_name);
+			xml.Append ("\"?>\n<note version=\"");
+			xml.Append (NoteArchiver.CURRENT_VERSION);
+			xml.Append ("\" xmlns:link=\"");
+			xml.Append (link_namespace);
+			xml.Append ("\" xmlns:size=\"");
+			xml.Append (size_namespace);
+			xml.Append ("\" xmlns=\"");
+			xml.Append (note_namespace);
+			xml.Append ("\">");
+
+			if (!AppendElement (xml, "  ", "title", note.Title))
+				return false;
+
+			xml.Append ("\n  <text xml:space=\"preserve\">");
+			xml.Append (note.Text);
+			xml.Append ("</text>");
+
+			AppendElement (xml, "  ", "last-change-date",
+			               XmlConvert.ToString (note.ChangeDate, NoteArchiver.DATE_TIME_FORMAT));
+			AppendElement (xml, "  ", "last-metadata-change-date",
+			               XmlConvert.ToString (note.MetadataChangeDate, NoteArchiver.DATE_TIME_FORMAT));
+			if (note.CreateDate != DateTime.MinValue)
+				AppendElement (xml, "  ", "create-date",
+				               XmlConvert.ToString (note.CreateDate, NoteArchiver.DATE_TIME_FORMAT));
+
+			if (!AppendElement (xml, "  ", "cursor-position", note.CursorPosition.ToString ()) ||
+			    !AppendElement (xml, "  ", "selection-bound-position", note.SelectionBoundPosition.ToString ()) ||
+			    !AppendElement (xml, "  ", "width", note.Width.ToString ()) ||
+			    !AppendElement (xml, "  ", "height", note.Height.ToString ()) ||
+			    !AppendElement (xml, "  ", "x", note.X.ToString ()) ||
+			    !AppendElement (xml, "  ", "y", note.Y.ToString ()))
+				return false;
+
+			if (note.Tags.Count > 0) {
+				xml.Append ("\n  <tags>");
+				foreach (Tag tag in note.Tags.Values) {
+					if (!AppendElement (xml, "    ", "tag", tag.Name))
+						return false;
+				}
+				xml.Append ("\n  </tags>");
+			}
+
+			AppendElement (xml, "  ", "open-on-startup", note.IsOpenOnStartup.ToString ());
+			xml.Append ("\n</note>");
+			return true;
+		}
+
+		static bool AppendElement (StringBuilder xml, string indent, string name, string value)
+		{
+			if (string.IsNullOrEmpty (value))
+				return false;
+
+			xml.Append ('\n');
+			xml.Append (indent);
+			xml.Append ('<');
+			xml.Append (name);
+			xml.Append ('>');
+			for (int i = 0; i < value.Length; i++) {
+				char c = value [i];
+				switch (c) {
+				case '&':
+					xml.Append ("&amp;");
+					break;
+				case '<':
+					xml.Append ("&lt;");
+					break;
+				case '>':
+					xml.Append ("&gt;");
+					break;
+				default:
+					int width = CharWidth (value, i);
+					if (width == 0)
+						return false;
+					xml.Append (value, i, width);
+					i += width - 1;
+					break;
+				}
+			}
+			xml.Append ("</");
+			xml.Append (name);
+			xml.Append ('>');
+			return true;
+		}
+
+		// Whether XmlWriter.WriteRaw would copy text unchanged
+		static bool IsRawSafe (string text)
+		{
+			for (int i = 0; i < text.Length; i++) {
+				char c = text [i];
+				if (c >= ' ' && c < 0xD800)
+					continue;
+				int width = CharWidth (text, i);
+				if (width == 0)
+					return false;
+				i += width - 1;
+			}
+			return true;
+		}
+
+		// How many chars the character at i takes up, or 0 if XmlWriter
+		// and XmlTextReader would not pass it through unchanged.
+		static int CharWidth (string s, int i)
+		{
+			char c = s [i];
+			if ((c >= ' ' && c < 0xD800) || c == '\t' || c == '\n' ||
+			    (c >= 0xE000 && c <= 0xFFFD))
+				return 1;
+			if (char.IsHighSurrogate (c) && i + 1 < s.Length && char.IsLowSurrogate (s [i + 1]))
+				return 2;
+			return 0;
+		}
+
+		static string ReplaceAll (string text, string pattern, string replacement)
+		{
+			int found = text.IndexOf (pattern, StringComparison.Ordinal);
+			if (found < 0)
+				return text;
+
+			StringBuilder result = Builder ();
+			result.Length = 0;
+			int copied = 0;
+			while (found >= 0) {
+				result.Append (text, copied, found - copied);
+				result.Append (replacement);
+				copied = found + pattern.Length;
+				found = text.IndexOf (pattern, copied, StringComparison.Ordinal);
+			}
+			result.Append (text, copied, text.Length - copied);
+			return result.ToString ();
+		}
+
+		// Does what replacing "<note-content([^>]*)>\s*old_title" with
+		// "<note-content$1>new_title" does
+		static string ReplaceContentTitle (string text, string old_title, string new_title)
+		{
+			const string open_tag = "<note-content";
+
+			StringBuilder result = null;
+			int copied = 0;
+			int search = 0;
+			while (true) {
+				int open = text.IndexOf (open_tag, search, StringComparison.Ordinal);
+				if (open < 0)
+					break;
+				int close = text.IndexOf ('>', open + open_tag.Length);
+				if (close < 0)
+					break;
+
+				int title = close + 1;
+				while (title < text.Length && char.IsWhiteSpace (text [title]))
+					title++;
+
+				if (title + old_title.Length <= text.Length &&
+				    string.CompareOrdinal (text, title, old_title, 0, old_title.Length) == 0) {
+					if (result == null) {
+						result = Builder ();
+						result.Length = 0;
+					}
+					result.Append (text, copied, close + 1 - copied);
+					result.Append (new_title);
+					copied = search = title + old_title.Length;
+				} else
+					search = open + 1;
+			}
+
+			if (result == null)
+				return text;
+			result.Append (text, copied, text.Length - copied);
+			return result.ToString ();
+		}
+
+		static StringBuilder Builder ()
+		{
+			StringBuilder builder = pooled_builder;
+			if (builder == null || builder.Capacity > max_pooled_size) {
+				builder = new StringBuilder (4096);
+				pooled_builder = builder;
+			}
+			builder.Length = 0;
+			return builder;
+		}
+
+		static T [] Rent<T> (ref T [] pooled, int size)
+		{
+			if (pooled != null && pooled.Length >= size)
+				return pooled;
+
+			int capacity = 4096;
+			while (capacity < size)
+				capacity *= 2;
+			T [] buffer = new T [capacity];
+			if (capacity <= max_pooled_size)
+				pooled = buffer;
+			return buffer;
+		}
+
+		static Scanner Scan (char [] buf, int length)
+		{
+			Scanner scanner = pooled_scanner;
+			if (scanner == null) {
+				scanner = new Scanner ();
+				pooled_scanner = scanner;
+			}
+			scanner.Reset (buf, length);
+			return scanner;
+		}
+
+		/// <summary>
+		/// Walks a note document in a char buffer.  Every method returns
+		/// false as soon as it finds something it can't vouch for.
+		/// </summary>
+		class Scanner
+		{
+			char [] buf;
+			int end;
+			int pos;
+
+			// The last text read by ReadText: a span of buf, or a
+			// string if entities had to be decoded
+			int value_start;
+			int value_length;
+			string value_decoded;
+			readonly StringBuilder decoder = new StringBuilder ();
+
+			// Attribute names of the current start tag
+			int [] attr_starts = new int [8];
+			int [] attr_lengths = new int [8];
+			int attr_count;
+
+			// Open elements inside <text>
+			int [] open_starts = new int [16];
+			int [] open_lengths = new int [16];
+			int open_count;
+
+			public void Reset (char [] buf, int length)
+			{
+				this.buf = buf;
+				end = length;
+				pos = 0;
+			}
+
+			public bool ReadNote (NoteData note, List<string> tags, out string version)
+			{
+				int root_start, root_length;
+				bool empty;
+				if (!ReadRoot (out root_start, out root_length, out version, out empty))
+					return false;
+
+				while (!empty) {
+					SkipSpace ();
+					if (pos + 1 >= end || buf [pos] != '<')
+						return false;
+					if (buf [pos + 1] == '/') {
+						if (!ReadEndTag (root_start, root_length))
+							return false;
+						break;
+					}
+
+					pos++;
+					int name_start, name_length;
+					bool child_empty;
+					string ignored;
+					if (!ReadName (out name_start, out name_length) ||
+					    !ReadTagEnd (false, out ignored, out child_empty) ||
+					    !ReadElement (note, tags, name_start, name_length, child_empty))
+						return false;
+				}
+
+				SkipSpace ();
+				return pos == end;
+			}
+
+			public bool ReadTitle (out string title)
+			{
+				title = null;
+				int root_start, root_length;
+				string version;
+				bool empty;
+				if (!ReadRoot (out root_start, out root_length, out version, out empty) || empty)
+					return false;
+
+				SkipSpace ();
+				if (!Skip ('<'))
+					return false;
+
+				int name_start, name_length;
+				string ignored;
+				if (!ReadName (out name_start, out name_length) ||
+				    !NameIs (name_start, name_length, "title") ||
+				    !ReadTagEnd (false, out ignored, out empty))
+					return false;
+
+				if (empty)
+					title = string.Empty;
+				else if (ReadText (name_start, name_length))
+					title = Value ();
+				else
+					return false;
+				return true;
+			}
+
+			// The XML declaration and the note start tag
+			bool ReadRoot (out int name_start, out int name_length,
+			               out string version, out bool empty)
+			{
+				name_start = 0;
+				name_length = 0;
+				version = null;
+				empty = false;
+
+				if (Skip ("<?xml")) {
+					if (!Skip (" version=\"1.0\""))
+						return false;
+					if (Skip (" encoding=\"")) {
+						if (!(SkipIgnoreCase ("utf-8\"") || SkipIgnoreCase ("utf-16\"")))
+							return false;
+					}
+					if (!Skip ("?>"))
+						return false;
+				}
+
+				SkipSpace ();
+				return Skip ('<') &&
+				       ReadName (out name_start, out name_length) &&
+				       NameIs (name_start, name_length, "note") &&
+				       ReadTagEnd (true, out version, out empty);
+			}
+
+			bool ReadElement (NoteData note, List<string> tags,
+			                  int name_start, int name_length, bool empty)
+			{
+				if (NameIs (name_start, name_length, "text")) {
+					if (empty)
+						note.Text = string.Empty;
+					else {
+						string text;
+						if (!ReadInnerXml (name_start, name_length, out text))
+							return false;
+						note.Text = text;
+					}
+					// XmlTextReader has already read the node after
+					// </text> and skips it; only whitespace is safe.
+					return pos < end && buf [pos] != '<';
+				}
+
+				if (NameIs (name_start, name_length, "tags"))
+					return empty || ReadTags (tags, name_start, name_length);
+
+				if (empty) {
+					value_start = pos;
+					value_length = 0;
+					value_decoded = null;
+				} else if (!ReadText (name_start, name_length))
+					return false;
+
+				int num;
+				if (NameIs (name_start, name_length, "title"))
+					note.Title = Value ();
+				else if (NameIs (name_start, name_length, "last-change-date"))
+					note.ChangeDate = ParseDate ();
+				else if (NameIs (name_start, name_length, "last-metadata-change-date"))
+					note.MetadataChangeDate = ParseDate ();
+				else if (NameIs (name_start, name_length, "create-date"))
+					note.CreateDate = ParseDate ();
+				else if (NameIs (name_start, name_length, "cursor-position")) {
+					if (ParseInt (out num))
+						note.CursorPosition = num;
+				} else if (NameIs (name_start, name_length, "selection-bound-position")) {
+					if (ParseInt (out num))
+						note.SelectionBoundPosition = num;
+				} else if (NameIs (name_start, name_length, "width")) {
+					if (ParseInt (out num))
+						note.Width = num;
+				} else if (NameIs (name_start, name_length, "height")) {
+					if (ParseInt (out num))
+						note.Height = num;
+				} else if (NameIs (name_start, name_length, "x")) {
+					if (ParseInt (out num))
+						note.X = num;
+				} else if (NameIs (name_start, name_length, "y")) {
+					if (ParseInt (out num))
+						note.Y = num;
+				} else if (NameIs (name_start, name_length, "open-on-startup")) {
+					bool is_startup;
+					if (ValueIs ("True"))
+						note.IsOpenOnStartup = true;
+					else if (ValueIs ("False"))
+						note.IsOpenOnStartup = false;
+					else if (bool.TryParse (Value (), out is_startup))
+						note.IsOpenOnStartup = is_startup;
+				} else
+					// The generic reader looks inside unknown
+					// elements for known ones
+					return false;
+				return true;
+			}
+
+			bool ReadTags (List<string> tags, int name_start, int name_length)
+			{
+				while (true) {
+					SkipSpace ();
+					if (pos + 1 >= end || buf [pos] != '<')
+						return false;
+					if (buf [pos + 1] == '/')
+						return ReadEndTag (name_start, name_length);
+
+					pos++;
+					int tag_start, tag_length;
+					bool empty;
+					string ignored;
+					if (!ReadName (out tag_start, out tag_length) ||
+					    !NameIs (tag_start, tag_length, "tag") ||
+					    !ReadTagEnd (false, out ignored, out empty) ||
+					    empty ||
+					    !ReadText (tag_start, tag_length))
+						return false;
+					tags.Add (Value ());
+				}
+			}
+
+			// The attributes and the > or /> of a start tag outside
+			// <text>.  Only the note element's version is kept.
+			bool ReadTagEnd (bool is_note, out string version, out bool empty)
+			{
+				version = null;
+				empty = false;
+				attr_count = 0;
+
+				while (true) {
+					bool spaced = SkipSpace ();
+					if (pos >= end)
+						return false;
+					if (Skip ('>'))
+						return true;
+					if (Skip ("/>")) {
+						empty = true;
+						return true;
+					}
+
+					int name_start, name_length;
+					if (!spaced ||
+					    !ReadName (out name_start, out name_length) ||
+					    !AddAttribute (name_start, name_length))
+						return false;
+					SkipSpace ();
+					if (!Skip ('='))
+						return false;
+					SkipSpace ();
+					if (pos >= end || (buf [pos] != '"' && buf [pos] != '\''))
+						return false;
+
+					char quote = buf [pos++];
+					int attr_value_start = pos;
+					while (pos < end && buf [pos] != quote) {
+						// Leave entities and whitespace normalization
+						// to XmlTextReader
+						char c = buf [pos];
+						if (c == '<' || c == '&' || c < ' ')
+							return false;
+						int width = CharWidth (pos);
+						if (width == 0)
+							return false;
+						pos += width;
+					}
+					if (pos >= end)
+						return false;
+					if (is_note && NameIs (name_start, name_length, "version"))
+						version = new string (buf, attr_value_start, pos - attr_value_start);
+					pos++;
+				}
+			}
+
+			bool AddAttribute (int name_start, int name_length)
+			{
+				for (int i = 0; i < attr_count; i++) {
+					if (SpanEquals (attr_starts [i], attr_lengths [i], name_start, name_length))
+						return false;
+				}
+				if (attr_count == attr_starts.Length)
+					return false;
+				attr_starts [attr_count] = name_start;
+				attr_lengths [attr_count] = name_length;
+				attr_count++;
+				return true;
+			}
+
+			// An element's text, as ReadString gives it, and the end
+			// tag.  Child elements, comments and CDATA are refused.
+			bool ReadText (int name_start, int name_length)
+			{
+				value_start = pos;
+				value_decoded = null;
+				decoder.Length = 0;
+				bool decoding = false;
+				int run_start = pos;
+
+				while (pos < end && buf [pos] != '<') {
+					char c = buf [pos];
+					if (c == '&') {
+						decoder.Append (buf, run_start, pos - run_start);
+						if (!ReadEntity ())
+							return false;
+						decoding = true;
+						run_start = pos;
+					} else if (c == '>')
+						return false;
+					else {
+						int width = CharWidth (pos);
+						if (width == 0)
+							return false;
+						pos += width;
+					}
+				}
+
+				value_length = pos - value_start;
+				if (decoding) {
+					decoder.Append (buf, run_start, pos - run_start);
+					value_decoded = decoder.ToString ();
+				}
+				return ReadEndTag (name_start, name_length);
+			}
+
+			bool ReadEntity ()
+			{
+				int semicolon = pos + 1;
+				while (semicolon < end && semicolon - pos < 10 && buf [semicolon] != ';')
+					semicolon++;
+				if (semicolon >= end || buf [semicolon] != ';')
+					return false;
+
+				int name_start = pos + 1;
+				int name_length = semicolon - name_start;
+				if (NameIs (name_start, name_length, "amp"))
+					decoder.Append ('&');
+				else if (NameIs (name_start, name_length, "lt"))
+					decoder.Append ('<');
+				else if (NameIs (name_start, name_length, "gt"))
+					decoder.Append ('>');
+				else if (NameIs (name_start, name_length, "quot"))
+					decoder.Append ('"');
+				else if (NameIs (name_start, name_length, "apos"))
+					decoder.Append ('\'');
+				else if (name_length > 1 && buf [name_start] == '#') {
+					int code = 0;
+					bool hex = buf [name_start + 1] == 'x';
+					int i = name_start + (hex ? 2 : 1);
+					if (i == semicolon)
+						return false;
+					for (; i < semicolon; i++) {
+						int digit = HexDigit (buf [i]);
+						if (digit < 0 || (!hex && digit > 9))
+							return false;
+						code = code * (hex ? 16 : 10) + digit;
+					}
+					// Only what CharWidth passes, and no surrogates
+					if (!((code >= 0x20 && code < 0xD800) || code == '\t' || code == '\n' ||
+					      (code >= 0xE000 && code <= 0xFFFD)))
+						return false;
+					decoder.Append ((char) code);
+				} else
+					return false;
+
+				pos = semicolon + 1;
+				return true;
+			}
+
+			// The content of <text>, if it is already what ReadInnerXml
+			// would make of it, and the end tag.
+			bool ReadInnerXml (int name_start, int name_length, out string inner)
+			{
+				inner = null;
+				int start = pos;
+				open_count = 0;
+
+				while (pos < end) {
+					char c = buf [pos];
+					if (c == '<') {
+						int tag_start = pos;
+						int tag_name_start, tag_name_length;
+						if (Skip ("</")) {
+							if (!ReadName (out tag_name_start, out tag_name_length) || !Skip ('>'))
+								return false;
+							if (open_count == 0) {
+								if (!SpanEquals (tag_name_start, tag_name_length, name_start, name_length))
+									return false;
+								inner = new string (buf, start, tag_start - start);
+								return true;
+							}
+							open_count--;
+							if (!SpanEquals (tag_name_start, tag_name_length,
+							                 open_starts [open_count], open_lengths [open_count]))
+								return false;
+						} else {
+							pos++;
+							bool empty;
+							if (!ReadName (out tag_name_start, out tag_name_length) ||
+							    !ReadWrittenAttributes (out empty))
+								return false;
+							if (!empty)
+								Push (tag_name_start, tag_name_length);
+						}
+					} else if (c == '&') {
+						if (!(Skip ("&amp;") || Skip ("&lt;") || Skip ("&gt;")))
+							return false;
+					} else if (c == '>')
+						return false;
+					else {
+						int width = CharWidth (pos);
+						if (width == 0)
+							return false;
+						pos += width;
+					}
+				}
+				return false;
+			}
+
+			// The attributes and the > or " />" of a start tag in
+			// <text>, if XmlTextWriter would write them the same way
+			bool ReadWrittenAttributes (out bool empty)
+			{
+				empty = false;
+				attr_count = 0;
+
+				while (true) {
+					if (Skip ('>'))
+						return true;
+					if (!Skip (' '))
+						return false;
+					if (Skip ("/>")) {
+						empty = true;
+						return true;
+					}
+
+					int name_start, name_length;
+					if (!ReadName (out name_start, out name_length) ||
+					    (name_length >= 5 && NameIs (name_start, 5, "xmlns")) ||
+					    !AddAttribute (name_start, name_length) ||
+					    !Skip ("=\""))
+						return false;
+
+					while (pos < end && buf [pos] != '"') {
+						char c = buf [pos];
+						if (c == '&') {
+							if (!(Skip ("&amp;") || Skip ("&lt;") || Skip ("&gt;") || Skip ("&quot;")))
+								return false;
+						} else if (c == '<' || c == '>' || c < ' ')
+							return false;
+						else {
+							int width = CharWidth (pos);
+							if (width == 0)
+								return false;
+							pos += width;
+						}
+					}
+					if (!Skip ('"'))
+						return false;
+				}
+			}
+
+			void Push (int name_start, int name_length)
+			{
+				if (open_count == open_starts.Length) {
+					Array.Resize (ref open_starts, open_count * 2);
+					Array.Resize (ref open_lengths, open_count * 2);
+				}
+				open_starts [open_count] = name_start;
+				open_lengths [open_count] = name_length;
+				open_count++;
+			}
+
+			bool ReadEndTag (int name_start, int name_length)
+			{
+				int end_start, end_length;
+				if (!Skip ("</") ||
+				    !ReadName (out end_start, out end_length) ||
+				    !SpanEquals (end_start, end_length, name_start, name_length))
+					return false;
+				SkipSpace ();
+				return Skip ('>');
+			}
+
+			// Names as Tomboy writes them; anything fancier is left to
+			// XmlTextReader
+			bool ReadName (out int name_start, out int name_length)
+			{
+				name_start = pos;
+				name_length = 0;
+				if (pos >= end || !IsNameStart (buf [pos]))
+					return false;
+				pos++;
+				while (pos < end && (IsNameStart (buf [pos]) || buf [pos] == '-' ||
+				                     buf [pos] == '.' || buf [pos] == ':' ||
+				                     (buf [pos] >= '0' && buf [pos] <= '9')))
+					pos++;
+				name_length = pos - name_start;
+				return true;
+			}
+
+			static bool IsNameStart (char c)
+			{
+				return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+			}
+
+			static int HexDigit (char c)
+			{
+				if (c >= '0' && c <= '9')
+					return c - '0';
+				if (c >= 'a' && c <= 'f')
+					return c - 'a' + 10;
+				if (c >= 'A' && c <= 'F')
+					return c - 'A' + 10;
+				return -1;
+			}
+
+			DateTime ParseDate ()
+			{
+				DateTime date;
+				if (TryParseDate (out date) || DateTime.TryParse (Value (), out date))
+					return date;
+				return DateTime.Now;
+			}
+
+			// NoteArchiver.DATE_TIME_FORMAT, read without DateTime.Parse;
+			// gives the same local time it would.
+			bool TryParseDate (out DateTime date)
+			{
+				date = DateTime.MinValue;
+				if (value_decoded != null || value_length != 33)
+					return false;
+
+				int i = value_start;
+				int year, month, day, hour, minute, second, fraction;
+				int offset_hours, offset_minutes;
+				if (!Digits (i, 4, out year) || buf [i + 4] != '-' ||
+				    !Digits (i + 5, 2, out month) || buf [i + 7] != '-' ||
+				    !Digits (i + 8, 2, out day) || buf [i + 10] != 'T' ||
+				    !Digits (i + 11, 2, out hour) || buf [i + 13] != ':' ||
+				    !Digits (i + 14, 2, out minute) || buf [i + 16] != ':' ||
+				    !Digits (i + 17, 2, out second) || buf [i + 19] != '.' ||
+				    !Digits (i + 20, 7, out fraction) ||
+				    (buf [i + 27] != '+' && buf [i + 27] != '-') ||
+				    !Digits (i + 28, 2, out offset_hours) || buf [i + 30] != ':' ||
+				    !Digits (i + 31, 2, out offset_minutes))
+					return false;
+
+				if (year < 1 || month < 1 || month > 12 ||
+				    day < 1 || day > DateTime.DaysInMonth (year, month) ||
+				    hour > 23 || minute > 59 || second > 59 ||
+				    offset_hours > 14 || offset_minutes > 59)
+					return false;
+
+				long offset = (offset_hours * 60L + offset_minutes) * TimeSpan.TicksPerMinute;
+				if (buf [i + 27] == '-')
+					offset = -offset;
+				long utc = new DateTime (year, month, day, hour, minute, second).Ticks +
+				           fraction - offset;
+				// Leave the edges of the range to DateTime.Parse
+				if (utc < TimeSpan.TicksPerDay || utc > DateTime.MaxValue.Ticks - TimeSpan.TicksPerDay)
+					return false;
+
+				date = new DateTime (utc, DateTimeKind.Utc).ToLocalTime ();
+				return true;
+			}
+
+			bool Digits (int start, int count, out int value)
+			{
+				value = 0;
+				for (int i = start; i < start + count; i++) {
+					char c = buf [i];
+					if (c < '0' || c > '9')
+						return false;
+					value = value * 10 + (c - '0');
+				}
+				return true;
+			}
+
+			bool ParseInt (out int num)
+			{
+				if (value_decoded == null && value_length > 0 && value_length <= 10) {
+					int i = value_start;
+					bool negative = buf [i] == '-' &&
+						NumberFormatInfo.CurrentInfo.NegativeSign == "-";
+					if (negative)
+						i++;
+					int count = value_start + value_length - i;
+					if (count > 0 && count <= 9 && Digits (i, count, out num)) {
+						if (negative)
+							num = -num;
+						return true;
+					}
+				}
+				return int.TryParse (Value (), out num);
+			}
+
+			string Value ()
+			{
+				if (value_decoded == null)
+					value_decoded = new string (buf, value_start, value_length);
+				return value_decoded;
+			}
+
+			bool ValueIs (string text)
+			{
+				if (value_decoded != null)
+					return value_decoded == text;
+				return NameIs (value_start, value_length, text);
+			}
+
+			bool SkipSpace ()
+			{
+				int start = pos;
+				while (pos < end && (buf [pos] == ' ' || buf [pos] == '\n' ||
+				                     buf [pos] == '\t' || buf [pos] == '\r'))
+					pos++;
+				return pos > start;
+			}
+
+			bool Skip (char c)
+			{
+				if (pos < end && buf [pos] == c) {
+					pos++;
+					return true;
+				}
+				return false;
+			}
+
+			bool Skip (string text)
+			{
+				if (end - pos < text.Length || !NameIs (pos, text.Length, text))
+					return false;
+				pos += text.Length;
+				return true;
+			}
+
+			bool SkipIgnoreCase (string text)
+			{
+				if (end - pos < text.Length)
+					return false;
+				for (int i = 0; i < text.Length; i++) {
+					if (char.ToLowerInvariant (buf [pos + i]) != text [i])
+						return false;
+				}
+				pos += text.Length;
+				return true;
+			}
+
+			bool NameIs (int start, int length, string name)
+			{
+				if (length != name.Length)
+					return false;
+				for (int i = 0; i < length; i++) {
+					if (buf [start + i] != name [i])
+						return false;
+				}
+				return true;
+			}
+
+			bool SpanEquals (int a, int a_length, int b, int b_length)
+			{
+				if (a_length != b_length)
+					return false;
+				for (int i = 0; i < a_length; i++) {
+					if (buf [a + i] != buf [b + i])
+						return false;
+				}
+				return true;
+			}
+
+			int CharWidth (int i)
+			{
+				char c = buf [i];
+				if ((c >= ' ' && c < 0xD800) || c == '\t' || c == '\n' ||
+				    (c >= 0xE000 && c <= 0xFFFD))
+					return 1;
+				if (char.IsHighSurrogate (c) && i + 1 < end && char.IsLowSurrogate (buf [i + 1]))
+					return 2;
+				return 0;
+			}
+		}
+	}
+}
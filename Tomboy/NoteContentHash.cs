@@ -0,0 +1,79 @@
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Security.Cryptography;
+using System.Text;
+using System.Text.RegularExpressions;
+using System.Xml;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// Fingerprint of the parts of a note that synchronization cares
+	/// about: the title, the set of tags and the text inside
+	/// &lt;note-content&gt;.  Dates, window geometry, pinned and
+	/// open-on-startup state are left out, as is the note-content
+	/// version attribute, so two notes with the same hash are "basically
+	/// equal" in the sense SyncManager has always used.
+	/// </summary>
+	public static class NoteContentHash
+	{
+		const string noteContentRegex =
+			@"^<note-content([^>]+version=""(?<contentVersion>[^""]*)"")?[^>]*((/>)|(>(?<innerContent>.*)</note-content>))$";
+
+		public static string Compute (NoteData data)
+		{
+			List<string> tags = new List<string> (data.Tags.Keys);
+			tags.Sort (string.CompareOrdinal);
+
+			StringBuilder normalized = new StringBuilder ();
+			normalized.Append (data.Title);
+			normalized.Append ('\0');
+			foreach (string tag in tags) {
+				normalized.Append (tag);
+				normalized.Append ('\0');
+			}
+			normalized.Append ('\0');
+			normalized.Append (GetInnerContent (data.Text));
+
+			byte [] hash;
+			using (SHA1 sha = SHA1.Create ())
+				hash = sha.ComputeHash (Encoding.UTF8.GetBytes (normalized.ToString ()));
+
+			StringBuilder hex = new StringBuilder (hash.Length * 2);
+			foreach (byte b in hash)
+				hex.Append (b.ToString ("x2"));
+			return hex.ToString ();
+		}
+
+		/// <summary>
+		/// Hash a complete note document, as stored on disk or sent by a
+		/// sync server.  Throws XmlException if it can't be parsed.
+		/// </summary>
+		public static string Compute (string noteXml, string uri)
+		{
+			using (XmlTextReader xml = new XmlTextReader (new StringReader (noteXml))) {
+				xml.Namespaces = false;
+				return Compute (NoteArchiver.Instance.Read (xml, uri));
+			}
+		}
+
+		/// <summary>
+		/// The markup between &lt;note-content&gt; and
+		/// &lt;/note-content&gt;, or the whole string if it isn't
+		/// wrapped.
+		/// </summary>
+		public static string GetInnerContent (string fullContentElement)
+		{
+			if (fullContentElement == null)
+				return string.Empty;
+
+			Match m = Regex.Match (fullContentElement, noteContentRegex, RegexOptions.Singleline);
+			Group contentGroup = m.Groups ["innerContent"];
+			if (!contentGroup.Success)
+				return m.Success ? string.Empty : fullContentElement;
+			return contentGroup.Value;
+		}
+	}
+}
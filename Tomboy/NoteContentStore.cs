@@ -0,0 +1,391 @@
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.IO.Compression;
+using System.Text;
+using System.Threading;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// One value of a note's XML content, held as a string or as
+	/// deflated UTF-8, never both.  Reading Value inflates a packed text
+	/// again and drops the deflated copy; Peek reads it without keeping
+	/// the string.
+	///
+	/// A NoteText never changes: NoteData makes a new one whenever its
+	/// text is set, and NoteData.Clone shares it, so packing a note also
+	/// frees the string held by snapshot copies of it.  Safe to use from
+	/// any thread.
+	/// </summary>
+	public class NoteText
+	{
+		// Shorter texts aren't worth the block and the inflating
+		const int MIN_PACK_LENGTH = 512;
+
+		public static readonly NoteText Empty = new NoteText (string.Empty);
+
+		static readonly object pack_lock = new object ();
+		static long pack_count;
+		static long unpack_count;
+
+		// Exactly one of these is set, except for a null text.  Both
+		// change together, with pack_lock held.
+		volatile string text;
+		volatile byte [] packed;
+		int utf8_length;
+		bool incompressible;
+		readonly int length;
+		int last_access;
+
+		public NoteText (string text)
+		{
+			this.text = text;
+			length = text == null ? 0 : text.Length;
+			last_access = Environment.TickCount;
+		}
+
+		public string Value
+		{
+			get {
+				last_access = Environment.TickCount;
+
+				string value = text;
+				if (value != null)
+					return value;
+
+				lock (pack_lock) {
+					if (text == null && packed != null) {
+						text = Inflate (packed, utf8_length);
+						packed = null;
+						Interlocked.Increment (ref unpack_count);
+					}
+					return text;
+				}
+			}
+		}
+
+		/// <summary>
+		/// The text, like Value, but a packed text stays packed: it is
+		/// inflated for the caller only, and doesn't count as a read.
+		/// For going through every note, as search does, without
+		/// bringing all of them back into memory.
+		/// </summary>
+		public string Peek ()
+		{
+			string value = text;
+			if (value != null)
+				return value;
+
+			byte [] block;
+			int size;
+			lock (pack_lock) {
+				if (text != null || packed == null)
+					return text;
+				block = packed;
+				size = utf8_length;
+			}
+			return Inflate (block, size);
+		}
+
+		/// <summary>
+		/// Length of the text in characters.
+		/// </summary>
+		public int Length
+		{
+			get {
+				return length;
+			}
+		}
+
+		/// <summary>
+		/// True if only the deflated text is in memory.
+		/// </summary>
+		public bool IsPacked
+		{
+			get {
+				return text == null && packed != null;
+			}
+		}
+
+		/// <summary>
+		/// Size of the deflated text, or 0 if it isn't packed.
+		/// </summary>
+		public int PackedSize
+		{
+			get {
+				byte [] block = packed;
+				return block == null ? 0 : block.Length;
+			}
+		}
+
+		/// <summary>
+		/// Milliseconds since Value was last read.
+		/// </summary>
+		public int IdleMilliseconds
+		{
+			get {
+				return unchecked (Environment.TickCount - last_access);
+			}
+		}
+
+		/// <summary>
+		/// Number of texts deflated and inflated since startup.
+		/// </summary>
+		public static long PackCount
+		{
+			get {
+				return Interlocked.Read (ref pack_count);
+			}
+		}
+
+		public static long UnpackCount
+		{
+			get {
+				return Interlocked.Read (ref unpack_count);
+			}
+		}
+
+		/// <summary>
+		/// Deflate the text and drop the string.  Returns false, and
+		/// keeps the string, if the text is short or its UTF-8 doesn't
+		/// shrink by at least a quarter.
+		/// </summary>
+		public bool Pack ()
+		{
+			string value = text;
+			if (value == null)
+				return packed != null;
+			if (incompressible || length < MIN_PACK_LENGTH)
+				return false;
+
+			// Done outside the lock, so that readers of other notes
+			// don't wait for it
+			if (!IsWellFormed (value)) {
+				incompressible = true;
+				return false;
+			}
+			byte [] utf8 = Encoding.UTF8.GetBytes (value);
+			byte [] block = Deflate (utf8);
+			if (block.Length > utf8.Length * 3 / 4) {
+				incompressible = true;
+				return false;
+			}
+
+			lock (pack_lock) {
+				// Unless another thread packed it meanwhile
+				if (text != null) {
+					utf8_length = utf8.Length;
+					packed = block;
+					text = null;
+				}
+			}
+			Interlocked.Increment (ref pack_count);
+			return true;
+		}
+
+		// Unpaired surrogates don't survive UTF-8
+		static bool IsWellFormed (string value)
+		{
+			for (int i = 0; i < value.Length; i++) {
+				char c = value [i];
+				if (!char.IsSurrogate (c))
+					continue;
+				if (!char.IsHighSurrogate (c) || i + 1 == value.Length ||
+				    !char.IsLowSurrogate (value [i + 1]))
+					return false;
+				i++;
+			}
+			return true;
+		}
+
+		static byte [] Deflate (byte [] data)
+		{
+			MemoryStream output = new MemoryStream (data.Length / 3 + 64);
+			using (DeflateStream deflate = new DeflateStream (output, CompressionMode.Compress, true))
+				deflate.Write (data, 0, data.Length);
+			return output.ToArray ();
+		}
+
+		static string Inflate (byte [] data, int utf8_length)
+		{
+			byte [] utf8 = new byte [utf8_length];
+			using (DeflateStream inflate = new DeflateStream (new MemoryStream (data),
+			                                                   CompressionMode.Decompress)) {
+				int read = 0;
+				int n;
+				while (read < utf8_length &&
+				       (n = inflate.Read (utf8, read, utf8_length - read)) > 0)
+					read += n;
+			}
+			return Encoding.UTF8.GetString (utf8);
+		}
+	}
+
+	/// <summary>
+	/// Memory held by note text, from NoteContentStore.GetStatistics.
+	/// </summary>
+	public class NoteContentStatistics
+	{
+		/// <summary>
+		/// Notes whose text is in memory as a string.
+		/// </summary>
+		public int HotNotes { get; set; }
+
+		/// <summary>
+		/// Notes whose text is only in memory deflated.
+		/// </summary>
+		public int ColdNotes { get; set; }
+
+		/// <summary>
+		/// Bytes of the hot notes' strings.
+		/// </summary>
+		public long HotBytes { get; set; }
+
+		/// <summary>
+		/// Bytes of the cold notes' deflated texts.
+		/// </summary>
+		public long PackedBytes { get; set; }
+
+		/// <summary>
+		/// Bytes the cold notes' strings would take.
+		/// </summary>
+		public long ColdTextBytes { get; set; }
+
+		public long PackCount { get; set; }
+		public long UnpackCount { get; set; }
+
+		public override string ToString ()
+		{
+			return string.Format ("{0} hot notes ({1} KB), {2} cold notes ({3} KB " +
+			                      "of text in {4} KB deflated), {5} packs, {6} unpacks",
+			                      HotNotes, HotBytes / 1024, ColdNotes,
+			                      ColdTextBytes / 1024, PackedBytes / 1024,
+			                      PackCount, UnpackCount);
+		}
+	}
+
+	/// <summary>
+	/// Keeps the text of notes that haven't been read for a while only
+	/// as deflated UTF-8, instead of as strings at two bytes a
+	/// character.  Reading a note's XmlContent brings the string back
+	/// until the next sweep finds it idle again.  Notes with a buffer
+	/// are left alone; their text follows the buffer.
+	///
+	/// Sweeps run on the GTK thread every minute, a few milliseconds at
+	/// a time.
+	/// </summary>
+	public class NoteContentStore
+	{
+		const uint SWEEP_INTERVAL_MS = 60000;
+
+		// Longest a sweep keeps the main loop busy at a time
+		const int SLICE_MS = 20;
+
+		readonly NoteManager manager;
+		int cold_after_ms;
+
+		List<Note> sweep_notes;
+		int sweep_index;
+		int swept;
+
+		public NoteContentStore (NoteManager manager)
+		{
+			this.manager = manager;
+
+			SetDelay ((int) Preferences.Get (Preferences.NOTE_COLD_STORAGE_DELAY));
+			Preferences.SettingChanged += OnSettingChanged;
+
+			GLib.Timeout.Add (SWEEP_INTERVAL_MS, OnSweepTimeout);
+		}
+
+		void OnSettingChanged (object sender, NotifyEventArgs args)
+		{
+			if (args.Key == Preferences.NOTE_COLD_STORAGE_DELAY)
+				SetDelay ((int) args.Value);
+		}
+
+		void SetDelay (int seconds)
+		{
+			cold_after_ms = seconds < 0 ? -1 : (int) Math.Min (seconds * 1000L, int.MaxValue);
+		}
+
+		bool OnSweepTimeout ()
+		{
+			if (cold_after_ms >= 0 && sweep_notes == null) {
+				sweep_notes = new List<Note> (manager.Notes);
+				sweep_index = 0;
+				swept = 0;
+				ContinueSweep ();
+			}
+			return true;
+		}
+
+		bool ContinueSweep ()
+		{
+			Stopwatch watch = Stopwatch.StartNew ();
+			while (sweep_index < sweep_notes.Count &&
+			       watch.ElapsedMilliseconds < SLICE_MS) {
+				if (PackIfIdle (sweep_notes [sweep_index++], cold_after_ms))
+					swept++;
+			}
+
+			if (sweep_index < sweep_notes.Count) {
+				GLib.Timeout.Add (10, ContinueSweep);
+				return false;
+			}
+
+			sweep_notes = null;
+			if (swept > 0)
+				Logger.Debug ("NoteContentStore: packed {0} notes; {1}",
+				              swept, GetStatistics ());
+			return false;
+		}
+
+		static bool PackIfIdle (Note note, int idle_ms)
+		{
+			if (note.HasBuffer)
+				return false;
+
+			NoteText text = note.StoredText;
+			if (text.IsPacked || text.IdleMilliseconds < idle_ms)
+				return false;
+			return text.Pack ();
+		}
+
+		/// <summary>
+		/// Pack every note without a buffer that hasn't been read for
+		/// idle_ms, all at once.  Returns the number of notes packed.
+		/// </summary>
+		public int PackIdle (int idle_ms)
+		{
+			int packed = 0;
+			foreach (Note note in manager.Notes) {
+				if (PackIfIdle (note, idle_ms))
+					packed++;
+			}
+			return packed;
+		}
+
+		public NoteContentStatistics GetStatistics ()
+		{
+			NoteContentStatistics stats = new NoteContentStatistics ();
+			foreach (Note note in manager.Notes) {
+				NoteText text = note.StoredText;
+				stats.PackedBytes += text.PackedSize;
+				if (text.IsPacked) {
+					stats.ColdNotes++;
+					stats.ColdTextBytes += text.Length * 2L;
+				} else {
+					stats.HotNotes++;
+					stats.HotBytes += text.Length * 2L;
+				}
+			}
+			stats.PackCount = NoteText.PackCount;
+			stats.UnpackCount = NoteText.UnpackCount;
+			return stats;
+		}
+	}
+}
@@ -3,25 +3,38 @@ using System;
 using System.IO;
 using System.Collections.Generic;
 using System.Threading;
+using System.Xml;
 
 using Mono.Unix;
 
 namespace Tomboy
 {
 	public delegate void NotesChangedHandler (object sender, Note changed);
+	public delegate void NotesImportedHandler (object sender, List<Note> imported);
 
 	public class NoteManager
 	{
 		string notes_dir;
 		string backup_dir;
 		List<Note> notes;
+		// Same notes as above, for FindByUri
+		Dictionary<string, Note> notes_by_uri;
 		AddinManager addin_mgr;
 		TrieController trie_controller;
+		NoteBufferCache buffer_cache;
+		NoteContentStore content_store;
+		NoteStore store;
+		int bulk_update_depth;
+		bool sort_pending;
+		readonly Thread gtk_thread;
 
 		public static string NoteTemplateTitle = Catalog.GetString ("New Note Template");
 
 		static string start_note_uri = String.Empty;
 
+		// Fewer notes than this are not worth another thread in Import
+		const int IMPORT_NOTES_PER_WORKER = 64;
+
 		static void OnSettingChanged (object sender, NotifyEventArgs args)
 		{
 			switch (args.Key) {
@@ -38,6 +51,7 @@ namespace Tomboy
 
 		public NoteManager (string directory, string backup_directory)
 		{
+			gtk_thread = Thread.CurrentThread;
 			Logger.Debug ("NoteManager created with note path \"{0}\".", directory);
 
 			notes_dir = directory;
@@ -48,6 +62,14 @@ namespace Tomboy
 			get; private set;
 		}
 
+		/// <summary>
+		/// Whether this is the GTK+ main thread, the one that created
+		/// the NoteManager.
+		/// </summary>
+		public bool IsGtkThread {
+			get { return Thread.CurrentThread == gtk_thread; }
+		}
+
 		public TomboyCommandLine CommandLine {
 			get; set;
 		}
@@ -60,9 +82,10 @@ namespace Tomboy
 		/// <summary>
 		/// Use Gtk.Application.Invoke to invoke the Action delegate
 		/// once this NoteManager is initialized. If this NoteManager
-		/// is already initialized, Gtk.Application.Invoke is *not*
-		/// used (for performance reasons).  In other words, this method
-		/// should only be called from the GTK+ main thread.
+		/// is already initialized and this is the GTK+ main thread (the
+		/// one that created the NoteManager), Gtk.Application.Invoke is
+		/// *not* used (for performance reasons), and the delegate is
+		/// invoked before this returns.
 		/// </summary>
 		public void GtkInvoke (Action a)
 		{
@@ -72,6 +95,8 @@ namespace Tomboy
 						;
 					Gtk.Application.Invoke ((o, e) => a ());
 				}).Start ();
+			else if (Thread.CurrentThread != gtk_thread)
+				Gtk.Application.Invoke ((o, e) => a ());
 			else
 				a ();
 		}
@@ -91,6 +116,7 @@ namespace Tomboy
 		public void Initialize ()
 		{
 			notes = new List<Note> ();
+			notes_by_uri = new Dictionary<string, Note> ();
 
 			string conf_dir = Services.NativeApplication.ConfigurationDirectory;
 
@@ -134,7 +160,10 @@ namespace Tomboy
 				first_run = false;
 			}
 
+			store = CreateNoteStore ();
 			trie_controller = CreateTrieController ();
+			buffer_cache = new NoteBufferCache (this);
+			content_store = new NoteContentStore (this);
 			addin_mgr = new AddinManager (conf_dir,
 			                              migration_needed ? old_notes_dir : null);
 
@@ -142,7 +171,8 @@ namespace Tomboy
 				// First run. Create "Start Here" notes.
 				CreateStartNotes ();
 			} else {
-				LoadNotes ();
+				using (Tracer.Span ("NoteManager.LoadNotes", "load"))
+					LoadNotes ();
 			}
 
 			if (migration_needed) {
@@ -210,6 +240,12 @@ Ciao!");
 			return new TrieController (this);
 		}
 
+		// Create the NoteStore. For overriding in test methods.
+		protected virtual NoteStore CreateNoteStore ()
+		{
+			return NoteStore.Create (notes_dir, backup_dir);
+		}
+
 		// For overriding in test methods.
 		protected virtual bool DirectoryExists (string directory)
 		{
@@ -240,14 +276,55 @@ Ciao!");
 		{
 			if (NoteRenamed != null)
 				NoteRenamed (note, old_title);
-			this.notes.Sort (new CompareDates ());
+			if (InBulkUpdate)
+				sort_pending = true;
+			else
+				this.notes.Sort (new CompareDates ());
+		}
+
+		/// <summary>
+		/// Start a batch of note additions, deletions and renames, such
+		/// as an outside program changing many note files at once.
+		/// Until the matching EndBulkUpdate, the title trie and the sort
+		/// order of Notes are brought up to date once at the end rather
+		/// than after every change.  Calls may nest.
+		/// </summary>
+		public void BeginBulkUpdate ()
+		{
+			bulk_update_depth++;
+			store.BeginBatch ();
+		}
+
+		public void EndBulkUpdate ()
+		{
+			if (bulk_update_depth == 0)
+				throw new InvalidOperationException ("EndBulkUpdate without BeginBulkUpdate");
+			store.EndBatch ();
+			if (--bulk_update_depth > 0)
+				return;
+
+			if (sort_pending) {
+				sort_pending = false;
+				notes.Sort (new CompareDates ());
+			}
+			trie_controller.UpdateIfPending ();
+		}
+
+		public bool InBulkUpdate
+		{
+			get {
+				return bulk_update_depth > 0;
+			}
 		}
 
 		void OnNoteSave (Note note)
 		{
 			if (NoteSaved != null)
 				NoteSaved (note);
-			this.notes.Sort (new CompareDates ());
+			if (InBulkUpdate)
+				sort_pending = true;
+			else
+				this.notes.Sort (new CompareDates ());
 		}
 
 		void OnBufferChanged (Note note)
@@ -320,8 +397,9 @@ Ciao!");
 		protected virtual void LoadNotes ()
 		{
 			Logger.Debug ("Loading notes");
-			string [] files = Directory.GetFiles (notes_dir, "*.note");
+			ICollection<string> files = store.GetNotePaths ();
 
+			TraceSpan read_span = Tracer.Span ("LoadNotes.Read", "load");
 			foreach (string file_path in files) {
 				try {
 					Note note = Note.Load (file_path, this);
@@ -330,6 +408,7 @@ Ciao!");
 						note.Saved += OnNoteSave;
 						note.BufferChanged += OnBufferChanged;
 						notes.Add (note);
+						notes_by_uri [note.Uri] = note;
 					}
 				} catch (System.Xml.XmlException e) {
 					Logger.Error ("Error parsing note XML, skipping \"{0}\": {1}",
@@ -363,8 +442,11 @@ Ciao!");
 					md.Destroy();
 				}	
 			}
-			
-			notes.Sort (new CompareDates ());
+			read_span.Dispose ();
+			Tracer.Count ("Notes", notes.Count);
+
+			using (Tracer.Span ("LoadNotes.Sort", "load"))
+				notes.Sort (new CompareDates ());
 
 			// Update the trie so addins can access it, if they want.
 			trie_controller.Update ();
@@ -372,19 +454,22 @@ Ciao!");
 			bool startup_notes_enabled = (bool)
 			                             Preferences.Get (Preferences.ENABLE_STARTUP_NOTES);
 
-			// Load all the addins for our notes.
+			// Load the eager addins for our notes; the rest are created
+			// when a note's buffer or window is first needed.
 			// Iterating through copy of notes list, because list may be
 			// changed when loading addins.
 			List<Note> notesCopy = new List<Note> (notes);
-			foreach (Note note in notesCopy) {
-				addin_mgr.LoadAddinsForNote (note);
+			using (Tracer.Span ("LoadNotes.Addins", "load")) {
+				foreach (Note note in notesCopy) {
+					addin_mgr.LoadAddinsForNote (note);
 
-				// Show all notes that were visible when tomboy was shut down
-				if (note.IsOpenOnStartup) {
-					if (startup_notes_enabled)
-						note.Window.Show ();
+					// Show all notes that were visible when tomboy was shut down
+					if (note.IsOpenOnStartup) {
+						if (startup_notes_enabled)
+							note.Window.Show ();
 
-					note.QueueSave (ChangeType.NoChange);
+						note.QueueSave (ChangeType.NoChange);
+					}
 				}
 			}
 
@@ -400,8 +485,10 @@ Ciao!");
 					Preferences.Set (Preferences.START_NOTE_URI, start_note.Uri);
 			}
 
-			if (NotesLoaded != null)
-				NotesLoaded (this, EventArgs.Empty);
+			if (NotesLoaded != null) {
+				using (Tracer.Span ("LoadNotes.NotesLoaded", "load"))
+					NotesLoaded (this, EventArgs.Empty);
+			}
 		}
 
 		void OnExitingEvent (object sender, EventArgs args)
@@ -421,6 +508,7 @@ Ciao!");
 			// Use a copy of the notes to prevent bug #510442 (crash on exit
 			// when iterating the notes to save them.
 			List<Note> notesCopy = new List<Note> (notes);
+			store.BeginBatch ();
 			foreach (Note note in notesCopy) {
 				// If the note is visible, it will be shown automatically on
 				// next startup
@@ -431,27 +519,18 @@ Ciao!");
 
 				note.Save ();
 			}
+			store.EndBatch ();
+			// Saves that come later, from other exit handlers or a
+			// session that doesn't end after all, open it again
+			store.Close ();
 		}
 
 		public void Delete (Note note)
 		{
-			if (File.Exists (note.FilePath)) {
-				if (backup_dir != null) {
-					if (!Directory.Exists (backup_dir))
-						Directory.CreateDirectory (backup_dir);
-
-					string backup_path =
-					        Path.Combine (backup_dir,
-					                      Path.GetFileName (note.FilePath));
-					if (File.Exists (backup_path))
-						File.Delete (backup_path);
-
-					File.Move (note.FilePath, backup_path);
-				} else
-					File.Delete (note.FilePath);
-			}
+			store.Delete (note.FilePath);
 
 			notes.Remove (note);
+			notes_by_uri.Remove (note.Uri);
 			note.Delete ();
 
 			Logger.Debug ("Deleting note '{0}'.", note.Title);
@@ -597,6 +676,7 @@ Ciao!");
 			new_note.BufferChanged += OnBufferChanged;
 
 			notes.Add (new_note);
+			notes_by_uri [new_note.Uri] = new_note;
 
 			// Load all the addins for the new note
 			addin_mgr.LoadAddinsForNote (new_note);
@@ -673,10 +753,9 @@ Ciao!");
 
 		public Note FindByUri (string uri)
 		{
-			foreach (Note note in notes) {
-				if (note.Uri == uri)
-					return note;
-			}
+			Note note;
+			if (uri != null && notes_by_uri.TryGetValue (uri, out note))
+				return note;
 			return null;
 		}
 		
@@ -772,6 +851,234 @@ Ciao!");
 			return title;
 		}
 
+		// Same as above, against a set of lowercased titles in use
+		static string GetUniqueName (string basename, int id, Dictionary<string, bool> taken)
+		{
+			string title;
+			while (true) {
+				title = String.Concat (basename, " ", id++);
+				if (!taken.ContainsKey (title.ToLower ()))
+					break;
+			}
+
+			return title;
+		}
+
+		/// <summary>
+		/// Create many notes at once, such as when importing them from
+		/// another program.  A title already in use gets a number
+		/// appended, as with GetUniqueName.  The notes' contents are
+		/// built and checked on worker threads, the notes are written
+		/// as one batch of the note store, and NotesImported is raised
+		/// once for all of them instead of NoteAdded for each.  Only the
+		/// segment store makes a batch durable at once; the directory
+		/// store still syncs each note's file as it writes it.
+		/// </summary>
+		/// <returns>
+		/// The new notes, in the order of imports.  An entry is null if
+		/// that note could not be created: its title was empty, its body
+		/// was not well-formed, or it could not be written.
+		/// </returns>
+		public Note [] Import (IList<NoteImport> imports)
+		{
+			int total = imports.Count;
+			Note [] imported = new Note [total];
+			if (total == 0)
+				return imported;
+
+			TraceSpan span = Tracer.Span ("NoteManager.Import", "import");
+
+			// Titles have to be made unique one after another, but this
+			// checks a set of the titles in use instead of calling Find
+			// for every note.
+			Dictionary<string, bool> taken = new Dictionary<string, bool> (notes.Count + total);
+			foreach (Note note in notes)
+				taken [note.Title.ToLower ()] = true;
+
+			string [] titles = new string [total];
+			for (int i = 0; i < total; i++) {
+				string title = imports [i].Title;
+				if (title != null)
+					title = title.Trim ();
+				if (String.IsNullOrEmpty (title))
+					continue;
+
+				if (taken.ContainsKey (title.ToLower ()))
+					title = GetUniqueName (title, 2, taken);
+				taken [title.ToLower ()] = true;
+				titles [i] = title;
+			}
+
+			// Build and check the contents on worker threads
+			string [] contents = new string [total];
+			int next = -1;
+			ThreadStart work = delegate {
+				int i;
+				while ((i = Interlocked.Increment (ref next)) < total) {
+					if (titles [i] == null)
+						continue;
+					try {
+						contents [i] = GetImportContent (titles [i], imports [i]);
+					} catch (Exception e) {
+						Logger.Warn ("Not importing note \"{0}\": {1}",
+						             titles [i], e.Message);
+					}
+				}
+			};
+
+			int worker_count = Math.Max (1, Math.Min (Environment.ProcessorCount,
+			                                          total / IMPORT_NOTES_PER_WORKER));
+			if (worker_count == 1)
+				work ();
+			else {
+				Thread [] workers = new Thread [worker_count];
+				for (int i = 0; i < workers.Length; i++) {
+					workers [i] = new Thread (work);
+					workers [i].Name = "NoteImport";
+					workers [i].IsBackground = true;
+					workers [i].Start ();
+				}
+				foreach (Thread worker in workers)
+					worker.Join ();
+			}
+
+			// Write them all in one batch
+			List<Note> added = new List<Note> (total);
+			BeginBulkUpdate ();
+			try {
+				for (int i = 0; i < total; i++) {
+					if (contents [i] == null)
+						continue;
+
+					Note note = Note.CreateNewNote (titles [i], MakeNewFileName (), this);
+					note.XmlContent = contents [i];
+					// Written without QueueSave, so set what it would
+					note.Data.MetadataChangeDate = note.Data.CreateDate;
+					try {
+						store.Write (note.FilePath, note.Data);
+					} catch (Exception e) {
+						Logger.Error ("Error writing imported note \"{0}\": {1}",
+						              titles [i], e.Message);
+						continue;
+					}
+
+					note.Renamed += OnNoteRename;
+					note.Saved += OnNoteSave;
+					note.BufferChanged += OnBufferChanged;
+					notes.Add (note);
+					notes_by_uri [note.Uri] = note;
+					addin_mgr.LoadAddinsForNote (note);
+
+					imported [i] = note;
+					added.Add (note);
+				}
+				sort_pending = true;
+			} finally {
+				EndBulkUpdate ();
+			}
+			span.Dispose ();
+
+			Logger.Debug ("Imported {0} of {1} notes", added.Count, total);
+			if (added.Count > 0 && NotesImported != null)
+				NotesImported (this, added);
+
+			return imported;
+		}
+
+		// The XmlContent of an imported note, with its title as the first
+		// line.  Throws XmlException if the body is not well-formed.
+		static string GetImportContent (string title, NoteImport import)
+		{
+			string body = import.Body;
+			if (body == null)
+				body = String.Empty;
+			else if (!import.BodyIsXml)
+				body = XmlEncoder.Encode (body);
+
+			string content = SanitizeXmlContent (
+				String.Format ("<note-content version=\"0.1\">{0}\n\n{1}</note-content>",
+				               XmlEncoder.Encode (title), body));
+
+			XmlTextReader reader = new XmlTextReader (new StringReader (content));
+			reader.Namespaces = false;
+			while (reader.Read ())
+				;
+
+			return content;
+		}
+
+		/// <summary>
+		/// Add notes that another program wrote into the notes
+		/// directory, given each one's id and complete note document.
+		/// Like Import, they are written as one batch of the note store
+		/// and NotesImported is raised once instead of NoteAdded for each.
+		/// No NoteSaved is raised for the writes either, so listeners
+		/// that track saves, like SyncManager, must handle NotesImported.
+		/// </summary>
+		/// <returns>
+		/// The new notes, in the order of ids.  An entry is null if that
+		/// note already exists, its document could not be parsed, its
+		/// title is empty or in use, or it could not be written.
+		/// </returns>
+		public Note [] AddForeignNotes (IList<string> ids, IList<string> note_xmls)
+		{
+			Note [] created = new Note [ids.Count];
+			List<Note> added = new List<Note> (ids.Count);
+
+			BeginBulkUpdate ();
+			try {
+				for (int i = 0; i < ids.Count; i++) {
+					string filename = MakeNewFileName (ids [i]);
+					string uri = "note://tomboy/" + ids [i];
+					if (notes_by_uri.ContainsKey (uri))
+						continue;
+
+					NoteData data;
+					try {
+						using (XmlTextReader xml = new XmlTextReader (new StringReader (note_xmls [i]))) {
+							xml.Namespaces = false;
+							data = NoteArchiver.Instance.Read (xml, uri);
+						}
+					} catch (Exception e) {
+						Logger.Error ("Error reading note {0}: {1}", ids [i], e.Message);
+						continue;
+					}
+
+					if (String.IsNullOrEmpty (data.Title) || Find (data.Title) != null) {
+						Logger.Error ("Not adding note {0}: its title \"{1}\" is empty or in use",
+						              ids [i], data.Title);
+						continue;
+					}
+
+					Note note = Note.CreateExistingNote (data, filename, this);
+					try {
+						store.Write (note.FilePath, note.Data);
+					} catch (Exception e) {
+						Logger.Error ("Error writing note \"{0}\": {1}", data.Title, e.Message);
+						continue;
+					}
+
+					note.Renamed += OnNoteRename;
+					note.Saved += OnNoteSave;
+					note.BufferChanged += OnBufferChanged;
+					notes.Add (note);
+					notes_by_uri [note.Uri] = note;
+					addin_mgr.LoadAddinsForNote (note);
+
+					created [i] = note;
+					added.Add (note);
+				}
+				sort_pending = true;
+			} finally {
+				EndBulkUpdate ();
+			}
+
+			if (added.Count > 0 && NotesImported != null)
+				NotesImported (this, added);
+
+			return created;
+		}
+
 		class CompareDates : IComparer<Note>
 		{
 			public int Compare (Note a, Note b)
@@ -825,6 +1132,39 @@ Ciao!");
 			}
 		}
 
+		/// <summary>
+		/// Tracks live note buffers and evicts those of long-idle closed
+		/// notes.  Also the place to read buffer memory counters from.
+		/// </summary>
+		public NoteBufferCache BufferCache
+		{
+			get {
+				return buffer_cache;
+			}
+		}
+
+		/// <summary>
+		/// Compresses the text of notes that haven't been read for a
+		/// while.  Also the place to read text memory counters from.
+		/// </summary>
+		public NoteContentStore ContentStore
+		{
+			get {
+				return content_store;
+			}
+		}
+
+		/// <summary>
+		/// Where the notes are kept: a .note file each, or in one file
+		/// with the segment store.
+		/// </summary>
+		public NoteStore Store
+		{
+			get {
+				return store;
+			}
+		}
+
 		public string NoteDirectoryPath
 		{
 			get {
@@ -834,22 +1174,85 @@ Ciao!");
 
 		public event NotesChangedHandler NoteDeleted;
 		public event NotesChangedHandler NoteAdded;
+		/// <summary>
+		/// Raised once for the notes created by Import, which raises no
+		/// NoteAdded for them.
+		/// </summary>
+		public event NotesImportedHandler NotesImported;
 		public event NoteRenameHandler NoteRenamed;
 		public event NoteSavedHandler NoteSaved;
 		public event Action<Note> NoteBufferChanged;
 		public event EventHandler NotesLoaded;
 	}
 
+	/// <summary>
+	/// A note for NoteManager.Import to create: its title, and its body,
+	/// the rest of the note below the title line.
+	/// </summary>
+	public class NoteImport
+	{
+		readonly string title;
+		readonly string body;
+		readonly bool body_is_xml;
+
+		NoteImport (string title, string body, bool body_is_xml)
+		{
+			this.title = title;
+			this.body = body;
+			this.body_is_xml = body_is_xml;
+		}
+
+		/// <summary>
+		/// A note whose body is note content markup, such as
+		/// "Some &lt;bold&gt;text&lt;/bold&gt;".
+		/// </summary>
+		public static NoteImport FromXml (string title, string body_xml)
+		{
+			return new NoteImport (title, body_xml, true);
+		}
+
+		/// <summary>
+		/// A note whose body is plain text.
+		/// </summary>
+		public static NoteImport FromText (string title, string body_text)
+		{
+			return new NoteImport (title, body_text, false);
+		}
+
+		public string Title
+		{
+			get {
+				return title;
+			}
+		}
+
+		public string Body
+		{
+			get {
+				return body;
+			}
+		}
+
+		public bool BodyIsXml
+		{
+			get {
+				return body_is_xml;
+			}
+		}
+	}
+
 	public class TrieController
 	{
 		TrieTree title_trie;
 		NoteManager manager;
+		bool update_pending;
 
 		public TrieController (NoteManager manager)
 		{
 			this.manager = manager;
 			manager.NoteDeleted += OnNoteDeleted;
 			manager.NoteAdded += OnNoteAdded;
+			manager.NotesImported += OnNotesImported;
 			manager.NoteRenamed += OnNoteRenamed;
 
 			Update ();
@@ -857,28 +1260,53 @@ Ciao!");
 
 		void OnNoteAdded (object sender, Note added)
 		{
-			Update ();
+			RequestUpdate ();
+		}
+
+		void OnNotesImported (object sender, List<Note> imported)
+		{
+			RequestUpdate ();
 		}
 
 		void OnNoteDeleted (object sender, Note deleted)
 		{
-			Update ();
+			RequestUpdate ();
 		}
 
 		void OnNoteRenamed (Note renamed, string old_title)
 		{
-			Update ();
+			RequestUpdate ();
+		}
+
+		void RequestUpdate ()
+		{
+			if (manager.InBulkUpdate)
+				update_pending = true;
+			else
+				Update ();
+		}
+
+		/// <summary>
+		/// Rebuild the trie if changes were held back by a bulk update.
+		/// </summary>
+		public void UpdateIfPending ()
+		{
+			if (update_pending)
+				Update ();
 		}
 
 		public void Update ()
 		{
-			title_trie = new TrieTree (false /* !case_sensitive */);
+			using (Tracer.Span ("TrieController.Update", "load")) {
+				update_pending = false;
+				title_trie = new TrieTree (false /* !case_sensitive */);
 
-			foreach (Note note in manager.Notes) {
-				title_trie.AddKeyword (note.Title, note);
-			}
+				foreach (Note note in manager.Notes) {
+					title_trie.AddKeyword (note.Title, note);
+				}
 
-			title_trie.ComputeFailureGraph ();
+				title_trie.ComputeFailureGraph ();
+			}
 		}
 
 		public TrieTree TitleTrie
@@ -0,0 +1,452 @@
+
+using System;
+using System.Collections.Generic;
+
+using Tomboy.Notebooks;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// An immutable copy of every note's metadata and saved content, so
+	/// that other threads can answer questions about notes without
+	/// touching Note objects, which belong to the GTK thread.
+	///
+	/// Snapshots are never changed.  With and Without return a new
+	/// snapshot that shares the unchanged entries, so a reader that
+	/// holds on to one sees a consistent set of notes for as long as it
+	/// likes.  Create them on the GTK thread only.
+	///
+	/// With and Without don't copy the lookup tables, which would make
+	/// every save cost time in proportion to the number of notes.  The
+	/// new snapshot only records the change on top of the one it was
+	/// made from, and the tables are rebuilt by the first reader that
+	/// needs them, on the reader's thread.  Once the unapplied changes
+	/// outnumber the notes, With rebuilds them itself, so a snapshot no
+	/// one reads doesn't hold on to every version of every note.
+	/// </summary>
+	public class NoteSnapshot
+	{
+		/// <summary>
+		/// What a snapshot knows about one note.
+		/// </summary>
+		public class Entry
+		{
+			readonly NoteData data;
+			readonly string [] tags;
+			readonly string notebook;
+			readonly bool is_template;
+
+			// Worked out on first use, by whichever thread asks
+			string text_content;
+			string complete_xml;
+
+			public Entry (Note note)
+			{
+				data = note.Data.Clone ();
+
+				tags = new string [note.Tags.Count];
+				for (int i = 0; i < tags.Length; i++)
+					tags [i] = note.Tags [i].NormalizedName;
+
+				Notebook nb = NotebookManager.GetNotebookFromNote (note);
+				notebook = nb == null ? string.Empty : nb.Name;
+
+				is_template = note.ContainsTag (
+					TagManager.GetOrCreateSystemTag (TagManager.TemplateNoteSystemTag));
+			}
+
+			/// <summary>
+			/// An entry for a note that is not loaded.  The entry keeps
+			/// data, so don't change it afterwards.
+			/// </summary>
+			public Entry (NoteData data, string [] tags, string notebook, bool is_template)
+			{
+				this.data = data;
+				this.tags = tags == null ? new string [0] : (string []) tags.Clone ();
+				this.notebook = notebook == null ? string.Empty : notebook;
+				this.is_template = is_template;
+			}
+
+			public string Uri
+			{
+				get {
+					return data.Uri;
+				}
+			}
+
+			public string Title
+			{
+				get {
+					return data.Title;
+				}
+			}
+
+			// Peeked, so that reading a cold note doesn't keep it
+			// inflated in the note it's shared with
+			public string XmlContent
+			{
+				get {
+					return data.StoredText.Peek ();
+				}
+			}
+
+			public string TextContent
+			{
+				get {
+					if (text_content == null)
+						text_content = XmlDecoder.Decode (data.StoredText.Peek ());
+					return text_content;
+				}
+			}
+
+			public string CompleteXml
+			{
+				get {
+					if (complete_xml == null)
+						complete_xml = NoteArchiver.WriteString (data);
+					return complete_xml;
+				}
+			}
+
+			public DateTime CreateDate
+			{
+				get {
+					return data.CreateDate;
+				}
+			}
+
+			public DateTime ChangeDate
+			{
+				get {
+					return data.ChangeDate;
+				}
+			}
+
+			public DateTime MetadataChangeDate
+			{
+				get {
+					return data.MetadataChangeDate;
+				}
+			}
+
+			/// <summary>
+			/// Normalized names of the note's tags.
+			/// </summary>
+			public string [] Tags
+			{
+				get {
+					return (string []) tags.Clone ();
+				}
+			}
+
+			public bool HasTag (string normalized_name)
+			{
+				return Array.IndexOf (tags, normalized_name) >= 0;
+			}
+
+			/// <summary>
+			/// Name of the note's notebook, or an empty string.
+			/// </summary>
+			public string Notebook
+			{
+				get {
+					return notebook;
+				}
+			}
+
+			public bool IsTemplate
+			{
+				get {
+					return is_template;
+				}
+			}
+		}
+
+		// The lookup tables of a snapshot.  Never changed once a
+		// snapshot has them, except for filling in SortedUris.
+		class Tables
+		{
+			public readonly Dictionary<string, Entry> ByUri;
+			// Lower case title -> entry, as NoteManager.Find matches
+			public readonly Dictionary<string, Entry> ByTitle;
+			// URIs in ordinal order; made on first use
+			public string [] SortedUris;
+
+			public Tables (int capacity)
+			{
+				ByUri = new Dictionary<string, Entry> (capacity);
+				ByTitle = new Dictionary<string, Entry> (capacity);
+			}
+
+			public Tables (Tables other)
+			{
+				ByUri = new Dictionary<string, Entry> (other.ByUri);
+				ByTitle = new Dictionary<string, Entry> (other.ByTitle);
+			}
+
+			// Returns whether the note is new
+			public bool Put (Entry entry)
+			{
+				Entry old;
+				bool is_new = !ByUri.TryGetValue (entry.Uri, out old);
+				if (!is_new)
+					RemoveTitle (old);
+				ByUri [entry.Uri] = entry;
+				ByTitle [entry.Title.ToLower ()] = entry;
+				return is_new;
+			}
+
+			// Returns whether there was such a note
+			public bool Remove (string uri)
+			{
+				Entry old;
+				if (!ByUri.TryGetValue (uri, out old))
+					return false;
+				ByUri.Remove (uri);
+				RemoveTitle (old);
+				return true;
+			}
+
+			void RemoveTitle (Entry entry)
+			{
+				string key = entry.Title.ToLower ();
+				Entry titled;
+				if (ByTitle.TryGetValue (key, out titled) && titled == entry)
+					ByTitle.Remove (key);
+			}
+		}
+
+		// Keep at least this many changes before With rebuilds the
+		// tables itself
+		const int MIN_PENDING_CHANGES = 64;
+
+		public static readonly NoteSnapshot Empty = new NoteSnapshot (new Tables (0));
+
+		// Null until a reader needs them.  Until then, parent and the
+		// change below say how to make them.
+		volatile Tables tables;
+		volatile NoteSnapshot parent;
+
+		// The change from parent: entries put in, or a note taken out
+		readonly Entry [] put;
+		readonly string removed_uri;
+
+		// How many changes lead back to a snapshot with tables, and how
+		// many notes that one has
+		readonly int pending;
+		readonly int base_count;
+
+		readonly object tables_lock = new object ();
+
+		NoteSnapshot (Tables tables)
+		{
+			this.tables = tables;
+			base_count = tables.ByUri.Count;
+		}
+
+		NoteSnapshot (NoteSnapshot parent, Entry [] put, string removed_uri)
+		{
+			this.parent = parent;
+			this.put = put;
+			this.removed_uri = removed_uri;
+
+			Tables parent_tables = parent.tables;
+			if (parent_tables != null) {
+				pending = 1;
+				base_count = parent_tables.ByUri.Count;
+			} else {
+				pending = parent.pending + 1;
+				base_count = parent.base_count;
+			}
+		}
+
+		public NoteSnapshot (IEnumerable<Note> notes)
+		{
+			Tables all = new Tables (0);
+			foreach (Note note in notes)
+				all.Put (new Entry (note));
+			tables = all;
+			base_count = all.ByUri.Count;
+		}
+
+		/// <summary>
+		/// A snapshot like this one, but with note's current saved
+		/// state in place of what this one has for it.
+		/// </summary>
+		public NoteSnapshot With (Note note)
+		{
+			return With (new Entry (note));
+		}
+
+		/// <summary>
+		/// A snapshot like this one with all the notes in it, made as one
+		/// change.  Reads the notes, so GTK thread only.
+		/// </summary>
+		public NoteSnapshot With (IEnumerable<Note> notes)
+		{
+			List<Entry> entries = new List<Entry> ();
+			foreach (Note note in notes)
+				entries.Add (new Entry (note));
+			if (entries.Count == 0)
+				return this;
+			return Limit (new NoteSnapshot (this, entries.ToArray (), null));
+		}
+
+		/// <summary>
+		/// A snapshot like this one, but with entry in place of what
+		/// this one has for the same URI.
+		/// </summary>
+		public NoteSnapshot With (Entry entry)
+		{
+			return Limit (new NoteSnapshot (this, new Entry [] { entry }, null));
+		}
+
+		/// <summary>
+		/// A snapshot like this one, but without the given note.
+		/// </summary>
+		public NoteSnapshot Without (string uri)
+		{
+			return Limit (new NoteSnapshot (this, null, uri));
+		}
+
+		static NoteSnapshot Limit (NoteSnapshot snapshot)
+		{
+			if (snapshot.pending > Math.Max (MIN_PENDING_CHANGES, snapshot.base_count))
+				snapshot.GetTables ();
+			return snapshot;
+		}
+
+		// The tables, rebuilt from the nearest snapshot that has them
+		// if need be.  Any thread.
+		Tables GetTables ()
+		{
+			Tables result = tables;
+			if (result != null)
+				return result;
+
+			lock (tables_lock) {
+				if (tables != null)
+					return tables;
+
+				List<NoteSnapshot> changes = new List<NoteSnapshot> (pending);
+				NoteSnapshot from = this;
+				Tables from_tables;
+				while ((from_tables = from.tables) == null) {
+					NoteSnapshot next = from.parent;
+					// Another reader just gave it tables
+					if (next == null)
+						continue;
+					changes.Add (from);
+					from = next;
+				}
+
+				result = new Tables (from_tables);
+				bool same_uris = true;
+				for (int i = changes.Count - 1; i >= 0; i--) {
+					NoteSnapshot change = changes [i];
+					if (change.put != null) {
+						foreach (Entry entry in change.put) {
+							if (result.Put (entry))
+								same_uris = false;
+						}
+					} else if (result.Remove (change.removed_uri))
+						same_uris = false;
+				}
+				if (same_uris)
+					result.SortedUris = from_tables.SortedUris;
+
+				tables = result;
+				// Older snapshots can go now
+				parent = null;
+				return result;
+			}
+		}
+
+		public int Count
+		{
+			get {
+				return GetTables ().ByUri.Count;
+			}
+		}
+
+		public ICollection<Entry> Entries
+		{
+			get {
+				return GetTables ().ByUri.Values;
+			}
+		}
+
+		/// <summary>
+		/// The entry for a note, or null if there is no such note.
+		/// </summary>
+		public Entry Get (string uri)
+		{
+			Entry entry;
+			if (uri != null && GetTables ().ByUri.TryGetValue (uri, out entry))
+				return entry;
+			return null;
+		}
+
+		/// <summary>
+		/// The entry for the note with the given title, ignoring case,
+		/// or null.
+		/// </summary>
+		public Entry Find (string title)
+		{
+			Entry entry;
+			if (title != null && GetTables ().ByTitle.TryGetValue (title.ToLower (), out entry))
+				return entry;
+			return null;
+		}
+
+		/// <summary>
+		/// URIs of all notes in ordinal order.  Don't change the array.
+		/// </summary>
+		public string [] SortedUris
+		{
+			get {
+				Tables current = GetTables ();
+				string [] uris = current.SortedUris;
+				if (uris == null) {
+					uris = new string [current.ByUri.Count];
+					current.ByUri.Keys.CopyTo (uris, 0);
+					Array.Sort (uris, StringComparer.Ordinal);
+					current.SortedUris = uris;
+				}
+				return uris;
+			}
+		}
+
+		/// <summary>
+		/// Search as Search.SearchNotes does, without a notebook.
+		/// </summary>
+		public IDictionary<Entry, int> Search (string query, bool case_sensitive)
+		{
+			string [] words = Tomboy.Search.SplitWatchingQuotes (query);
+			string [] encoded_words =
+				Tomboy.Search.SplitWatchingQuotes (XmlEncoder.Encode (query));
+			Dictionary<Entry, int> matches = new Dictionary<Entry, int> ();
+
+			foreach (Entry entry in GetTables ().ByUri.Values) {
+				if (entry.IsTemplate)
+					continue;
+
+				if (0 < Tomboy.Search.FindMatchCountInNote (entry.Title,
+				                                            words,
+				                                            case_sensitive))
+					matches.Add (entry, int.MaxValue);
+				else if (Tomboy.Search.CheckNoteHasMatch (entry.XmlContent,
+				                                          encoded_words,
+				                                          case_sensitive)) {
+					int match_count =
+						Tomboy.Search.FindMatchCountInNote (entry.TextContent,
+						                                    words,
+						                                    case_sensitive);
+					if (match_count > 0)
+						matches.Add (entry, match_count);
+				}
+			}
+			return matches;
+		}
+	}
+}
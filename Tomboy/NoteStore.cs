@@ -0,0 +1,203 @@
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// Where NoteManager keeps its notes.  Notes are named by the path
+	/// their file has in the classic layout, one .note file per note in
+	/// the notes directory, whether or not a store keeps such files:
+	/// the path gives the note its URI, and is what Note.FilePath
+	/// returns.
+	///
+	/// NoteManager uses a store on the GTK thread; synchronization also
+	/// calls ReadBytes from its own threads.
+	/// </summary>
+	public abstract class NoteStore
+	{
+		readonly string notes_dir;
+		readonly string backup_dir;
+
+		protected NoteStore (string notes_dir, string backup_dir)
+		{
+			this.notes_dir = notes_dir;
+			this.backup_dir = backup_dir;
+		}
+
+		public string NotesDirectory
+		{
+			get {
+				return notes_dir;
+			}
+		}
+
+		/// <summary>
+		/// Where deleted notes go, or null to drop them.
+		/// </summary>
+		public string BackupDirectory
+		{
+			get {
+				return backup_dir;
+			}
+		}
+
+		/// <summary>
+		/// The paths of all stored notes.
+		/// </summary>
+		public abstract ICollection<string> GetNotePaths ();
+
+		public abstract NoteData Read (string path, string uri);
+
+		public abstract void Write (string path, NoteData data);
+
+		/// <summary>
+		/// The stored note's file, as it would be on disk.
+		/// </summary>
+		public abstract byte [] ReadBytes (string path);
+
+		/// <summary>
+		/// Remove the note, keeping a copy of it in BackupDirectory.
+		/// Does nothing if no such note is stored.
+		/// </summary>
+		public abstract void Delete (string path);
+
+		/// <summary>
+		/// A file with the stored note's contents, for handing to other
+		/// programs, or null if no such note is stored.  Not updated when
+		/// the note changes later.
+		/// </summary>
+		public virtual string GetFile (string path)
+		{
+			return File.Exists (path) ? path : null;
+		}
+
+		/// <summary>
+		/// Hold back making writes durable until the matching EndBatch,
+		/// when a store can make many writes durable at once.  Calls may
+		/// nest.
+		/// </summary>
+		public virtual void BeginBatch ()
+		{
+		}
+
+		public virtual void EndBatch ()
+		{
+		}
+
+		public virtual void Close ()
+		{
+		}
+
+		/// <summary>
+		/// The stored note's XML, as File.ReadAllText would read its file.
+		/// </summary>
+		public string ReadXml (string path)
+		{
+			return DecodeXml (ReadBytes (path));
+		}
+
+		/// <summary>
+		/// A note file's bytes, as ReadBytes returns them, decoded the
+		/// way File.ReadAllText would decode the file.
+		/// </summary>
+		public static string DecodeXml (byte [] data)
+		{
+			using (StreamReader reader = new StreamReader (new MemoryStream (data),
+			                                               System.Text.Encoding.UTF8))
+				return reader.ReadToEnd ();
+		}
+
+		protected string GetBackupPath (string path)
+		{
+			if (!Directory.Exists (backup_dir))
+				Directory.CreateDirectory (backup_dir);
+
+			string backup_path = Path.Combine (backup_dir, Path.GetFileName (path));
+			if (File.Exists (backup_path))
+				File.Delete (backup_path);
+			return backup_path;
+		}
+
+		/// <summary>
+		/// The store named by the NOTE_STORE_BACKEND preference.  Notes
+		/// left in the other store's format by a previous run are moved
+		/// into it.
+		/// </summary>
+		public static NoteStore Create (string notes_dir, string backup_dir)
+		{
+			string backend = (string) Preferences.Get (Preferences.NOTE_STORE_BACKEND);
+
+			if (backend == SegmentNoteStore.BackendName) {
+				SegmentNoteStore segment = new SegmentNoteStore (notes_dir, backup_dir);
+				bool import = !segment.Exists;
+				segment.Open ();
+				if (import) {
+					Logger.Info ("Moving notes in {0} into {1}", notes_dir, segment.SegmentPath);
+					segment.ImportDirectory (notes_dir, true);
+				}
+				return segment;
+			}
+
+			if (backend != DirectoryNoteStore.BackendName)
+				Logger.Warn ("Unknown note store \"{0}\", using \"{1}\"",
+				             backend, DirectoryNoteStore.BackendName);
+
+			SegmentNoteStore old_segment = new SegmentNoteStore (notes_dir, backup_dir);
+			if (old_segment.Exists) {
+				Logger.Info ("Moving notes in {0} back into {1}",
+				             old_segment.SegmentPath, notes_dir);
+				old_segment.Open ();
+				old_segment.ExportDirectory (notes_dir);
+				old_segment.Close ();
+				old_segment.Retire ();
+			}
+			return new DirectoryNoteStore (notes_dir, backup_dir);
+		}
+	}
+
+	/// <summary>
+	/// The classic layout: one .note file per note.
+	/// </summary>
+	public class DirectoryNoteStore : NoteStore
+	{
+		public const string BackendName = "directory";
+
+		public DirectoryNoteStore (string notes_dir, string backup_dir) :
+			base (notes_dir, backup_dir)
+		{
+		}
+
+		public override ICollection<string> GetNotePaths ()
+		{
+			return Directory.GetFiles (NotesDirectory, "*.note");
+		}
+
+		public override NoteData Read (string path, string uri)
+		{
+			return NoteArchiver.Read (path, uri);
+		}
+
+		public override void Write (string path, NoteData data)
+		{
+			NoteArchiver.Write (path, data);
+		}
+
+		public override byte [] ReadBytes (string path)
+		{
+			return File.ReadAllBytes (path);
+		}
+
+		public override void Delete (string path)
+		{
+			if (!File.Exists (path))
+				return;
+
+			if (BackupDirectory != null)
+				File.Move (path, GetBackupPath (path));
+			else
+				File.Delete (path);
+		}
+	}
+}
@@ -155,6 +155,7 @@ namespace Tomboy.Notebooks
 			}
 					
 			Tomboy.DefaultNoteManager.NoteAdded += OnNoteAdded;
+			Tomboy.DefaultNoteManager.NotesImported += OnNotesImported;
 			Tomboy.DefaultNoteManager.NoteDeleted += OnNoteDeleted;
 				
 			initialized = true;
@@ -308,6 +309,12 @@ namespace Tomboy.Notebooks
 			note.TagAdded += OnTagAdded;
 			note.TagRemoved += OnTagRemoved;
 		}
+
+		private void OnNotesImported (object sender, List<Note> imported)
+		{
+			foreach (Note note in imported)
+				OnNoteAdded (sender, note);
+		}
 		
 		private void OnNoteDeleted (object sender, Note note)
 		{
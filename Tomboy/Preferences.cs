@@ -44,8 +44,13 @@ namespace Tomboy
 		public const string SYNC_SELECTED_SERVICE_ADDIN = "/apps/tomboy/sync/sync_selected_service_addin";
 		public const string SYNC_CONFIGURED_CONFLICT_BEHAVIOR = "/apps/tomboy/sync/sync_conflict_behavior";
 		public const string SYNC_AUTOSYNC_TIMEOUT = "/apps/tomboy/sync/autosync_timeout";
+		public const string SYNC_FS_PACK_FORMAT = "/apps/tomboy/sync/fs_pack_format";
+		public const string SYNC_DELTA_TRANSFER = "/apps/tomboy/sync/delta_transfer";
 
 		public const string NOTE_RENAME_BEHAVIOR = "/apps/tomboy/note_rename_behavior";
+		public const string NOTE_BUFFER_CACHE_SIZE = "/apps/tomboy/note_buffer_cache_size";
+		public const string NOTE_COLD_STORAGE_DELAY = "/apps/tomboy/note_cold_storage_delay";
+		public const string NOTE_STORE_BACKEND = "/apps/tomboy/note_store_backend";
 
 		public const string INSERT_TIMESTAMP_FORMAT = "/apps/tomboy/insert_timestamp/format";
 		
@@ -160,9 +165,24 @@ namespace Tomboy
 			case SYNC_AUTOSYNC_TIMEOUT:
 				return -1;
 
+			case SYNC_FS_PACK_FORMAT:
+				return false;
+
+			case SYNC_DELTA_TRANSFER:
+				return false;
+
 			case NOTE_RENAME_BEHAVIOR:
 				return 0;
 
+			case NOTE_BUFFER_CACHE_SIZE:
+				return 32;
+
+			case NOTE_COLD_STORAGE_DELAY:
+				return 300;
+
+			case NOTE_STORE_BACKEND:
+				return "directory";
+
 			case INSERT_TIMESTAMP_FORMAT:
 				return Catalog.GetString ("dddd, MMMM d, h:mm tt");
 			}
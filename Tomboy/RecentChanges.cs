@@ -153,6 +153,7 @@ namespace Tomboy
 			// Update on changes to notes
 			manager.NoteDeleted += OnNotesDeleted;
 			manager.NoteAdded += OnNotesChanged;
+			manager.NotesImported += OnNotesImported;
 			manager.NoteRenamed += OnNoteRenamed;
 			manager.NoteSaved += OnNoteSaved;
 
@@ -738,6 +739,12 @@ namespace Tomboy
 			UpdateResults ();
 		}
 
+		void OnNotesImported (object sender, List<Note> imported)
+		{
+			RestoreMatchesWindow ();
+			UpdateResults ();
+		}
+
 		void OnNoteRenamed (Note note, string old_title)
 		{
 			RestoreMatchesWindow ();
@@ -762,7 +769,10 @@ namespace Tomboy
 			string paths = string.Empty;
 			foreach (Note note in selected_notes) {
 				uris += note.Uri + "\r\n";
-				paths += "file://" + note.FilePath + "\r\n";
+				// Not there for a note that was never saved
+				string file = manager.Store.GetFile (note.FilePath);
+				if (file != null)
+					paths += "file://" + file + "\r\n";
 			}
 
 			if(args.Info == (uint) Target.Path)
@@ -1100,6 +1110,7 @@ namespace Tomboy
 			// Disconnect external signal handlers to prevent bloweup
 			manager.NoteDeleted -= OnNotesDeleted;
 			manager.NoteAdded -= OnNotesChanged;
+			manager.NotesImported -= OnNotesImported;
 			manager.NoteRenamed -= OnNoteRenamed;
 			manager.NoteSaved -= OnNoteSaved;
 
@@ -1,6 +1,8 @@
 
 using System;
 using System.Collections.Generic;
+using System.Reflection;
+using System.Threading;
 #if ENABLE_DBUS
 using DBus;
 using org.freedesktop.DBus;
@@ -13,6 +15,19 @@ namespace Tomboy
 	public delegate void RemoteDeletedHandler (string uri, string title);
 	public delegate void RemoteAddedHandler (string uri);
 	public delegate void RemoteSavedHandler (string uri);
+
+	/// <summary>
+	/// Methods may be called on any thread; RemoteControlProxy serves
+	/// them on a thread of their own so that clients don't wait for the
+	/// GTK main loop, or slow it down.
+	///
+	/// Methods that only read are answered from a NoteSnapshot, which is
+	/// republished on the GTK thread whenever a note is saved, added,
+	/// deleted or renamed, and after every change made through this
+	/// class.  Each call reads the snapshot once, so it sees a consistent
+	/// set of notes.  Methods that change notes or show windows are run
+	/// on the GTK thread with NoteManager.GtkInvoke, and wait for it.
+	/// </summary>
 #if ENABLE_DBUS
 	[Interface ("org.gnome.Tomboy.RemoteControl")]
 #endif
@@ -20,12 +35,25 @@ namespace Tomboy
 	{
 		private NoteManager note_manager;
 
+		// Replaced, never changed, on the GTK thread
+		private volatile NoteSnapshot snapshot;
+
+		// Fields returned by the bulk methods when none are asked for
+		private static readonly string [] default_fields =
+			{ "uri", "title", "change-date" };
+
+		private const int default_page_size = 100;
+
 		public RemoteControl (NoteManager mgr)
 		{
 			note_manager = mgr;
+			snapshot = new NoteSnapshot (note_manager.Notes);
 			note_manager.NoteDeleted += OnNoteDeleted;
 			note_manager.NoteAdded += OnNoteAdded;
+			note_manager.NotesImported += OnNotesImported;
 			note_manager.NoteSaved += OnNoteSaved;
+			note_manager.NoteRenamed += OnNoteRenamed;
+			note_manager.NotesLoaded += OnNotesLoaded;
 		}
 
 		//Convert System.DateTime to unix timestamp
@@ -36,6 +64,58 @@ namespace Tomboy
 			return (d.ToUniversalTime ().Ticks - epoch_ticks) / 10000000;
 		}
 
+		/// <summary>
+		/// Run call on the GTK thread and return its result.  Anything it
+		/// throws is rethrown as the InnerException of a
+		/// TargetInvocationException, which keeps its stack trace.
+		/// On the GTK thread, or before the NoteManager is initialized,
+		/// call runs right away.  Before initialization GtkInvoke holds
+		/// calls back until it is done, and on the GTK thread that never
+		/// happens while this waits.
+		/// </summary>
+		private T OnGtkThread<T> (Func<T> call)
+		{
+			T result = default (T);
+			Exception error = null;
+			if (!note_manager.Initialized || note_manager.IsGtkThread) {
+				try {
+					result = call ();
+				} catch (Exception e) {
+					error = e;
+				}
+			} else {
+				using (ManualResetEvent done = new ManualResetEvent (false)) {
+					note_manager.GtkInvoke (() => {
+						try {
+							result = call ();
+						} catch (Exception e) {
+							error = e;
+						}
+						done.Set ();
+					});
+					done.WaitOne ();
+				}
+			}
+			if (error != null)
+				throw new TargetInvocationException (error.Message, error);
+			return result;
+		}
+
+		private void OnGtkThread (Action call)
+		{
+			OnGtkThread<bool> (() => {
+				call ();
+				return true;
+			});
+		}
+
+		// Make a change visible to the read-only methods straight away,
+		// rather than when the note is next saved.  GTK thread only.
+		private void Publish (Note note)
+		{
+			snapshot = snapshot.With (note);
+		}
+
 		public string Version ()
 		{
 			return Defines.VERSION;
@@ -43,96 +123,99 @@ namespace Tomboy
 
 		public bool DisplayNote (string uri)
 		{
-			Note note;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
 
-			note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-
-			note.Window.Present ();
-			return true;
+				note.Window.Present ();
+				return true;
+			});
 		}
 
 		public bool HideNote (string uri)
 		{
-			Note note;
-
-			note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
 
-			note.Window.Hide ();
-			return true;
+				note.Window.Hide ();
+				return true;
+			});
 		}
 
 		public bool DisplayNoteWithSearch (string uri, string search)
 		{
-			Note note;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
 
-			note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-
-			note.Window.Present ();
+				note.Window.Present ();
 
-			// Pop open the find-bar
-			NoteFindBar find = note.Window.Find;
-			find.ShowAll ();
-			find.Visible = true;
-			find.SearchText = search;
+				// Pop open the find-bar
+				NoteFindBar find = note.Window.Find;
+				find.ShowAll ();
+				find.Visible = true;
+				find.SearchText = search;
 
-			return true;
+				return true;
+			});
 		}
 
 		public string FindNote (string linked_title)
 		{
-			Note note = note_manager.Find (linked_title);
-			return (note == null) ? String.Empty : note.Uri;
+			NoteSnapshot.Entry entry = snapshot.Find (linked_title);
+			return (entry == null) ? String.Empty : entry.Uri;
 		}
 
 		public string FindStartHereNote ()
 		{
-			Note note = note_manager.FindByUri (NoteManager.StartNoteUri);
-			return (note == null) ? String.Empty : note.Uri;
+			NoteSnapshot.Entry entry = snapshot.Get (NoteManager.StartNoteUri);
+			return (entry == null) ? String.Empty : entry.Uri;
 		}
 
 		public string CreateNote ()
 		{
 			if (note_manager.ReadOnly)
 				return string.Empty;
-			try {
-				Note note = note_manager.Create ();
-				note.QueueSave (ChangeType.ContentChanged);
-				return note.Uri;
-			} catch {
-				return string.Empty;
-			}
+			return OnGtkThread (() => {
+				try {
+					Note note = note_manager.Create ();
+					note.QueueSave (ChangeType.ContentChanged);
+					return note.Uri;
+				} catch {
+					return string.Empty;
+				}
+			});
 		}
 
 		public string CreateNamedNote (string linked_title)
 		{
 			if (note_manager.ReadOnly)
 				return string.Empty;
-			Note note;
+			return OnGtkThread (() => {
+				Note note;
 
-			note = note_manager.Find (linked_title);
-			if (note != null)
-				return string.Empty;
+				note = note_manager.Find (linked_title);
+				if (note != null)
+					return string.Empty;
 
-			try {
-				note = note_manager.Create (linked_title);
-				note.QueueSave (ChangeType.ContentChanged);
-				return note.Uri;
-			} catch {
-				return string.Empty;
-			}
+				try {
+					note = note_manager.Create (linked_title);
+					note.QueueSave (ChangeType.ContentChanged);
+					return note.Uri;
+				} catch {
+					return string.Empty;
+				}
+			});
 		}
 
 		public string CreateNamedNoteWithUri (string linked_title, string uri)
 		{
 			if (note_manager.ReadOnly)
 				return string.Empty;
-			Note note;
 			string guid;
 			try {
 				guid = uri.Replace ("note://tomboy/", "");
@@ -143,144 +226,172 @@ namespace Tomboy
 			if (String.IsNullOrEmpty (guid))
 				return string.Empty;
 
-			note = note_manager.Find (linked_title);
-			if (note != null)
-				return string.Empty;
+			return OnGtkThread (() => {
+				Note note;
 
-			note = note_manager.FindByUri (uri);
-			if (note != null)
-				return string.Empty;
+				note = note_manager.Find (linked_title);
+				if (note != null)
+					return string.Empty;
 
-			try {
-				note = note_manager.CreateWithGuid (linked_title, guid);
-				note.QueueSave (ChangeType.ContentChanged);
-				return note.Uri;
-			} catch {
-				return string.Empty;
-			}
+				note = note_manager.FindByUri (uri);
+				if (note != null)
+					return string.Empty;
+
+				try {
+					note = note_manager.CreateWithGuid (linked_title, guid);
+					note.QueueSave (ChangeType.ContentChanged);
+					return note.Uri;
+				} catch {
+					return string.Empty;
+				}
+			});
+		}
+
+		/// <summary>
+		/// Create one note for each title, with the text at the same
+		/// index below the title, all at once.  A title that is already
+		/// taken gets a number appended.  Returns the URIs of the new
+		/// notes, with an empty string for each note not created.
+		/// </summary>
+		public string [] CreateNotes (string [] titles, string [] text_contents)
+		{
+			if (note_manager.ReadOnly || titles.Length != text_contents.Length)
+				return new string [0];
+
+			List<NoteImport> imports = new List<NoteImport> (titles.Length);
+			for (int i = 0; i < titles.Length; i++)
+				imports.Add (NoteImport.FromText (titles [i], text_contents [i]));
+
+			return OnGtkThread (() => {
+				Note [] notes = note_manager.Import (imports);
+				string [] uris = new string [notes.Length];
+				for (int i = 0; i < notes.Length; i++)
+					uris [i] = notes [i] != null ? notes [i].Uri : string.Empty;
+				return uris;
+			});
 		}
 
 		public bool DeleteNote (string uri)
 		{
 			if (note_manager.ReadOnly)
 				return false;
-			Note note;
-
-			note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
 
-			note_manager.Delete (note);
-			return true;
+				note_manager.Delete (note);
+				return true;
+			});
 		}
 
 		public void DisplaySearch ()
 		{
-			NoteRecentChanges.GetInstance (note_manager).Present ();
+			OnGtkThread (() => NoteRecentChanges.GetInstance (note_manager).Present ());
 		}
 
 		public void DisplaySearchWithText (string search_text)
 		{
-			NoteRecentChanges recent_changes =
-			        NoteRecentChanges.GetInstance (note_manager);
-			if (recent_changes == null)
-				return;
+			OnGtkThread (() => {
+				NoteRecentChanges recent_changes =
+				        NoteRecentChanges.GetInstance (note_manager);
+				if (recent_changes == null)
+					return;
 
-			recent_changes.SearchText = search_text;
-			recent_changes.Present ();
+				recent_changes.SearchText = search_text;
+				recent_changes.Present ();
+			});
 		}
 
 		public bool NoteExists (string uri)
 		{
-			Note note = note_manager.FindByUri (uri);
-			return note != null;
+			return snapshot.Get (uri) != null;
 		}
 
 		public string[] ListAllNotes ()
 		{
-			List<string> uris = new List<string> ();
-			foreach (Note note in note_manager.Notes) {
-				uris.Add (note.Uri);
+			ICollection<NoteSnapshot.Entry> entries = snapshot.Entries;
+			List<string> uris = new List<string> (entries.Count);
+			foreach (NoteSnapshot.Entry entry in entries) {
+				uris.Add (entry.Uri);
 			}
 			return uris.ToArray ();
 		}
 
 		public string GetNoteContents (string uri)
 		{
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return string.Empty;
-			return note.TextContent;
+			return entry.TextContent;
 		}
 
 		public string GetNoteTitle (string uri)
 		{
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return string.Empty;
-			return note.Title;
+			return entry.Title;
 		}
 
 		public long GetNoteCreateDate (string uri)
 		{
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return -1;
-			return UnixDateTime (note.CreateDate);
+			return UnixDateTime (entry.CreateDate);
 		}
 
 		public long GetNoteChangeDate (string uri)
 		{
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return -1;
-			return UnixDateTime (note.MetadataChangeDate);
+			return UnixDateTime (entry.MetadataChangeDate);
 		}
 
 		public string GetNoteContentsXml (string uri)
 		{
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return string.Empty;
-			return note.XmlContent;
+			return entry.XmlContent;
 		}
 
 		public string GetNoteCompleteXml (string uri)
 		{
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return string.Empty;
-			return note.GetCompleteNoteXml () ?? string.Empty;
+			return entry.CompleteXml ?? string.Empty;
 		}
 
 		public bool SetNoteContents (string uri, string text_contents)
 		{
 			if (note_manager.ReadOnly)
 				return false;
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-			note.TextContent = text_contents;
-			return true;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
+				note.TextContent = text_contents;
+				Publish (note);
+				return true;
+			});
 		}
 
 		public bool SetNoteContentsXml (string uri, string xml_contents)
 		{
 			if (note_manager.ReadOnly)
 				return false;
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-			note.XmlContent = xml_contents;
-			return true;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
+				note.XmlContent = xml_contents;
+				Publish (note);
+				return true;
+			});
 		}
 
 		/// <summary>
@@ -291,139 +402,343 @@ namespace Tomboy
 		{
 			if (note_manager.ReadOnly)
 				return false;
-			Note note;
-			note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-			note.LoadForeignNoteXml (xml_contents, ChangeType.ContentChanged);
-			return true;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
+				note.LoadForeignNoteXml (xml_contents, ChangeType.ContentChanged);
+				Publish (note);
+				return true;
+			});
 		}
 
 		public string[] GetTagsForNote (string uri)
 		{
-			Note note = note_manager.FindByUri (uri);
-			if (note == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return new string [0];
-			string [] tags = new string [note.Tags.Count];
-			for (int i = 0; i < tags.Length; i++)
-				tags [i] = note.Tags [i].NormalizedName;
-			return tags;
+			return entry.Tags;
 		}
 
 		public bool AddTagToNote (string uri, string tag_name)
 		{
 			if (note_manager.ReadOnly)
 				return false;
-			Note note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-			Tag tag = TagManager.GetOrCreateTag (tag_name);
-			note.AddTag (tag);
-			note.QueueSave (ChangeType.OtherDataChanged);
-			return true;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
+				Tag tag = TagManager.GetOrCreateTag (tag_name);
+				note.AddTag (tag);
+				note.QueueSave (ChangeType.OtherDataChanged);
+				Publish (note);
+				return true;
+			});
 		}
 
 		public bool RemoveTagFromNote (string uri, string tag_name)
 		{
-			Note note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-			Tag tag = TagManager.GetTag (tag_name);
-			if (tag != null)
-				note.RemoveTag (tag);
-			note.QueueSave (ChangeType.OtherDataChanged);
-			return true;
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
+				Tag tag = TagManager.GetTag (tag_name);
+				if (tag != null)
+					note.RemoveTag (tag);
+				note.QueueSave (ChangeType.OtherDataChanged);
+				Publish (note);
+				return true;
+			});
 		}
 
 		public string[] GetAllNotesWithTag (string tag_name)
 		{
-			Tag tag = TagManager.GetTag (tag_name);
-			if (tag == null)
-				return new string [0];
-			string [] tagged_note_uris = new string [tag.Notes.Count];
-			for (int i = 0; i < tagged_note_uris.Length; i++)
-				tagged_note_uris [i] = tag.Notes [i].Uri;
-			return tagged_note_uris;
+			return GetAllNotesWithNormalizedTag (tag_name.Trim ().ToLower ());
+		}
+
+		private string [] GetAllNotesWithNormalizedTag (string normalized_name)
+		{
+			List<string> tagged_note_uris = new List<string> ();
+			if (normalized_name == String.Empty)
+				return tagged_note_uris.ToArray ();
+			foreach (NoteSnapshot.Entry entry in snapshot.Entries) {
+				if (entry.HasTag (normalized_name))
+					tagged_note_uris.Add (entry.Uri);
+			}
+			return tagged_note_uris.ToArray ();
 		}
 
 		public string GetNotebookForNote (string uri)
 		{
-			Note note = note_manager.FindByUri (uri);
-			if (note == null)
-				return string.Empty;
-			Notebook notebook = NotebookManager.GetNotebookFromNote (note);
-			if (notebook == null)
+			NoteSnapshot.Entry entry = snapshot.Get (uri);
+			if (entry == null)
 				return string.Empty;
-			return notebook.Name;
+			return entry.Notebook;
 		}
 
 		public bool AddNoteToNotebook (string uri, string notebook_name)
 		{
 			if (note_manager.ReadOnly)
 				return false;
-			Note note = note_manager.FindByUri (uri);
-			if (note == null)
-				return false;
-			Notebook notebook = NotebookManager.GetNotebook (notebook_name);
-			if (notebook == null)
-				return false;
-			return NotebookManager.MoveNoteToNotebook (note, notebook);
+			return OnGtkThread (() => {
+				Note note = note_manager.FindByUri (uri);
+				if (note == null)
+					return false;
+				Notebook notebook = NotebookManager.GetNotebook (notebook_name);
+				if (notebook == null)
+					return false;
+				bool moved = NotebookManager.MoveNoteToNotebook (note, notebook);
+				Publish (note);
+				return moved;
+			});
 		}
 
 		public string [] GetAllNotesInNotebook (string notebook_name)
 		{
-			Tag tag = TagManager.GetTag (Tag.SYSTEM_TAG_PREFIX + Notebook.NotebookTagPrefix + notebook_name);
-			if (tag == null)
-				return new string [0];
-			string [] tagged_note_uris = new string [tag.Notes.Count];
-			for (int i = 0; i < tagged_note_uris.Length; i++)
-				tagged_note_uris [i] = tag.Notes [i].Uri;
-			return tagged_note_uris;
+			return GetAllNotesWithNormalizedTag (
+				(Tag.SYSTEM_TAG_PREFIX + Notebook.NotebookTagPrefix + notebook_name).Trim ().ToLower ());
 		}
 
 		public bool AddNotebook (string notebook_name)
 		{
-			if (NotebookManager.GetNotebook (notebook_name) != null)
-				return false;
-			Notebook notebook = NotebookManager.GetOrCreateNotebook (notebook_name);
-			if (notebook == null)
-				return false;
-			return true;
+			return OnGtkThread (() => {
+				if (NotebookManager.GetNotebook (notebook_name) != null)
+					return false;
+				Notebook notebook = NotebookManager.GetOrCreateNotebook (notebook_name);
+				if (notebook == null)
+					return false;
+				return true;
+			});
 		}
 
 		private void OnNoteDeleted (object sender, Note note)
 		{
+			snapshot = snapshot.Without (note.Uri);
 			if (NoteDeleted != null)
 				NoteDeleted (note.Uri, note.Title);
 		}
 
 		private void OnNoteAdded (object sender, Note note)
 		{
+			Publish (note);
 			if (NoteAdded != null)
 				NoteAdded (note.Uri);
 		}
 
+		// One snapshot for the whole import, then the usual signals
+		private void OnNotesImported (object sender, List<Note> imported)
+		{
+			snapshot = snapshot.With (imported);
+			if (NoteAdded == null)
+				return;
+			foreach (Note note in imported)
+				NoteAdded (note.Uri);
+		}
+
 		private void OnNoteSaved (Note note)
 		{
+			Publish (note);
 			if (NoteSaved != null)
 				NoteSaved (note.Uri);
 		}
 
+		private void OnNoteRenamed (Note note, string old_title)
+		{
+			Publish (note);
+		}
+
+		private void OnNotesLoaded (object sender, EventArgs args)
+		{
+			snapshot = new NoteSnapshot (note_manager.Notes);
+		}
+
 		public string[] SearchNotes (string query, bool case_sensitive)
 		{
 			if (query == null)
 				return null;
 
-			Search search =  new Search(note_manager);
 			List<string> list = new List<string>();
-			IDictionary<Note,int> results =
-				search.SearchNotes(query, case_sensitive, null);
-			foreach (Note note in results.Keys) {
-				list.Add (note.Uri);
+			IDictionary<NoteSnapshot.Entry,int> results =
+				snapshot.Search (query, case_sensitive);
+			foreach (NoteSnapshot.Entry entry in results.Keys) {
+				list.Add (entry.Uri);
 			}
 			return list.ToArray ();
 		}
 
+		/// <summary>
+		/// Like SearchNotes, but best matches first, each with "uri",
+		/// "title" and "matches": the number of matches in the note, or
+		/// Int32.MaxValue if the title matches.  At most max_results are
+		/// returned, or all of them if max_results isn't positive.
+		/// </summary>
+		public IDictionary<string, object> [] SearchNotesRanked (string query,
+		                                                         bool case_sensitive,
+		                                                         int max_results)
+		{
+			if (query == null)
+				return new IDictionary<string, object> [0];
+
+			List<KeyValuePair<NoteSnapshot.Entry, int>> ranked =
+				new List<KeyValuePair<NoteSnapshot.Entry, int>> (
+					snapshot.Search (query, case_sensitive));
+			ranked.Sort (delegate (KeyValuePair<NoteSnapshot.Entry, int> a,
+			                       KeyValuePair<NoteSnapshot.Entry, int> b) {
+				int cmp = b.Value.CompareTo (a.Value);
+				if (cmp == 0)
+					cmp = b.Key.ChangeDate.CompareTo (a.Key.ChangeDate);
+				return cmp;
+			});
+
+			int count = ranked.Count;
+			if (max_results > 0 && max_results < count)
+				count = max_results;
+
+			IDictionary<string, object> [] results = new IDictionary<string, object> [count];
+			for (int i = 0; i < count; i++) {
+				Dictionary<string, object> result = new Dictionary<string, object> ();
+				result ["uri"] = ranked [i].Key.Uri;
+				result ["title"] = ranked [i].Key.Title;
+				result ["matches"] = ranked [i].Value;
+				results [i] = result;
+			}
+			return results;
+		}
+
+		/// <summary>
+		/// Get several fields of many notes in one call.  Notes that
+		/// don't exist are left out; every result has a "uri" to tell
+		/// them apart.  The fields are:
+		///
+		///   uri, title, contents, contents-xml, complete-xml,
+		///   create-date, change-date (Unix time, as GetNoteCreateDate and
+		///   GetNoteChangeDate), tags (string array), notebook
+		///
+		/// Unknown fields are ignored.  With no fields, uri, title and
+		/// change-date are returned.
+		/// </summary>
+		public IDictionary<string, object> [] GetNotes (string [] uris, string [] fields)
+		{
+			NoteSnapshot notes = snapshot;
+			List<IDictionary<string, object>> results =
+				new List<IDictionary<string, object>> (uris.Length);
+			foreach (string uri in uris) {
+				NoteSnapshot.Entry entry = notes.Get (uri);
+				if (entry != null)
+					results.Add (GetNoteFields (entry, fields));
+			}
+			return results.ToArray ();
+		}
+
+		/// <summary>
+		/// Get the given fields (see GetNotes) of every note changed
+		/// after the given Unix time.  Only tells about notes that still
+		/// exist; compare ListAllNotes to find deleted ones.
+		/// </summary>
+		public IDictionary<string, object> [] GetNotesChangedSince (long timestamp, string [] fields)
+		{
+			List<IDictionary<string, object>> results = new List<IDictionary<string, object>> ();
+			foreach (NoteSnapshot.Entry entry in snapshot.Entries) {
+				if (UnixDateTime (entry.MetadataChangeDate) > timestamp)
+					results.Add (GetNoteFields (entry, fields));
+			}
+			return results.ToArray ();
+		}
+
+		/// <summary>
+		/// Page through all notes in URI order.  Returns the given fields
+		/// (see GetNotes) of up to max_count notes whose URI sorts after
+		/// after_uri; pass an empty after_uri for the first page, and the
+		/// last URI of each page to get the next.  An empty result means
+		/// there are no more notes.  Notes added or deleted while paging
+		/// don't make other notes be skipped or repeated.
+		/// </summary>
+		public IDictionary<string, object> [] GetNotesPage (string after_uri,
+		                                                    int max_count,
+		                                                    string [] fields)
+		{
+			NoteSnapshot notes = snapshot;
+			string [] sorted_uris = notes.SortedUris;
+
+			int start = 0;
+			if (!string.IsNullOrEmpty (after_uri)) {
+				start = Array.BinarySearch (sorted_uris, after_uri, StringComparer.Ordinal);
+				start = start >= 0 ? start + 1 : ~start;
+			}
+			if (max_count <= 0)
+				max_count = default_page_size;
+
+			int end = Math.Min (sorted_uris.Length, start + max_count);
+			List<IDictionary<string, object>> results =
+				new List<IDictionary<string, object>> (Math.Max (0, end - start));
+			for (int i = start; i < end; i++)
+				results.Add (GetNoteFields (notes.Get (sorted_uris [i]), fields));
+			return results.ToArray ();
+		}
+
+		private static IDictionary<string, object> GetNoteFields (NoteSnapshot.Entry entry,
+		                                                          string [] fields)
+		{
+			if (fields == null || fields.Length == 0)
+				fields = default_fields;
+
+			Dictionary<string, object> info = new Dictionary<string, object> ();
+			info ["uri"] = entry.Uri;
+			foreach (string field in fields) {
+				switch (field) {
+				case "title":
+					info [field] = entry.Title;
+					break;
+				case "contents":
+					info [field] = entry.TextContent;
+					break;
+				case "contents-xml":
+					info [field] = entry.XmlContent;
+					break;
+				case "complete-xml":
+					info [field] = entry.CompleteXml ?? string.Empty;
+					break;
+				case "create-date":
+					info [field] = UnixDateTime (entry.CreateDate);
+					break;
+				case "change-date":
+					info [field] = UnixDateTime (entry.MetadataChangeDate);
+					break;
+				case "tags":
+					info [field] = entry.Tags;
+					break;
+				case "notebook":
+					info [field] = entry.Notebook;
+					break;
+				}
+			}
+			return info;
+		}
+
+		/// <summary>
+		/// Start or stop recording tracing spans.
+		/// </summary>
+		public void SetTracingEnabled (bool enabled)
+		{
+			Tracer.Enabled = enabled;
+		}
+
+		/// <summary>
+		/// Write the tracing spans recorded so far as Chrome trace-event
+		/// JSON.  An empty path means the default location in the log
+		/// directory.  Returns the path written, or an empty string if
+		/// writing failed.
+		/// </summary>
+		public string WriteTrace (string path)
+		{
+			try {
+				return Tracer.WriteChromeTrace (path);
+			} catch (Exception e) {
+				Logger.Error ("Could not write trace to {0}: {1}", path, e.Message);
+				return string.Empty;
+			}
+		}
+
 		public event RemoteDeletedHandler NoteDeleted;
 		public event RemoteAddedHandler NoteAdded;
 		public event RemoteSavedHandler NoteSaved;
@@ -1,9 +1,9 @@
 using System;
+using System.Threading;
 #if ENABLE_DBUS
 using DBus;
 using org.freedesktop.DBus;
 #else
-using System.Threading;
 using System.Runtime.Remoting;
 using System.Runtime.Remoting.Activation;
 using System.Runtime.Remoting.Channels;
@@ -17,6 +17,9 @@ namespace Tomboy
 		private const string Path = "/org/gnome/Tomboy/RemoteControl";
 		private const string Namespace = "org.gnome.Tomboy";
 		private static bool? firstInstance;
+		// Our own connection to the session bus, which serves the
+		// remote control on a thread of its own
+		private static Bus remoteBus;
 #else
 		private static Mutex mutex;
 		private static bool firstInstance;
@@ -29,8 +32,12 @@ namespace Tomboy
 		private static string ServiceUrl =
 			string.Format ("ipc://{0}/{1}", ServerName, WrapperName);
 #endif
+		private static RemoteControl registered;
 
 		public static IRemoteControl GetInstance () {
+			// Calls to ourselves would wait on the thread serving them
+			if (registered != null)
+				return registered;
 #if ENABLE_DBUS
 			BusG.Init ();
 
@@ -55,8 +62,27 @@ namespace Tomboy
 				return null;
 
 			RemoteControl remote_control = new RemoteControl (manager);
-			Bus.Session.Register (new ObjectPath (Path),
-			                      remote_control);
+			registered = remote_control;
+
+			// Bus.Session dispatches on the GTK main loop, so serve
+			// the remote control from a connection of its own, and
+			// hand it the name that Bus.Session took in FirstInstance.
+			try {
+				remoteBus = Bus.Open (Address.Session);
+				remoteBus.Register (new ObjectPath (Path), remote_control);
+				remoteBus.RequestName (Namespace);
+				Bus.Session.ReleaseName (Namespace);
+
+				Thread thread = new Thread (ServeRemoteControl);
+				thread.Name = "RemoteControl";
+				thread.IsBackground = true;
+				thread.Start ();
+			} catch (Exception e) {
+				Logger.Warn ("Serving remote control on the main loop: {0}", e.Message);
+				remoteBus = null;
+				Bus.Session.Register (new ObjectPath (Path),
+				                      remote_control);
+			}
 			return remote_control;
 #else
 			if (FirstInstance) {
@@ -69,19 +95,19 @@ namespace Tomboy
 					WrapperName,
 					WellKnownObjectMode.Singleton);
 
-				// The actual Remote Control has many methods
-				// that need to be called in the GTK+ mainloop,
-				// which will not happen when the method calls
-				// come from a .NET remoting client. So we wrap
-				// the Remote Control in a class that implements
-				// the same interface, but wraps most method
-				// calls in Gtk.Application.Invoke.
+				// .NET remoting needs a type it can create, so
+				// we wrap the Remote Control in a class that
+				// implements the same interface and forwards
+				// every call to it.  Calls arrive on remoting
+				// threads; the Remote Control runs the ones that
+				// need the GTK+ mainloop there itself.
 				//
 				// Note that only one RemoteControl is ever
 				// created, and that it is stored statically
 				// in the RemoteControlWrapper.
 				RemoteControl realRemote = new RemoteControl (manager);
 				RemoteControlWrapper.Initialize (realRemote);
+				registered = realRemote;
 
 				RemoteControlWrapper remoteWrapper = (RemoteControlWrapper) Activator.GetObject (
 					typeof (RemoteControlWrapper),
@@ -97,6 +123,18 @@ namespace Tomboy
 #endif
 		}
 
+#if ENABLE_DBUS
+		private static void ServeRemoteControl ()
+		{
+			try {
+				while (true)
+					remoteBus.Iterate ();
+			} catch (Exception e) {
+				Logger.Error ("Remote control stopped: {0}", e.Message);
+			}
+		}
+#endif
+
 		public static bool FirstInstance {
 			get {
 #if ENABLE_DBUS
@@ -1,9 +1,11 @@
 using System;
+using System.Collections.Generic;
 
 namespace Tomboy
 {
 	/// <summary>
-	/// Wrap the RemoteControl class methods in Gtk.Application.Invoke.
+	/// Forward .NET remoting calls to the RemoteControl, which runs the
+	/// ones that need the GTK thread there.
 	/// </summary>
 	public class RemoteControlWrapper : MarshalByRefObject, IRemoteControl
 	{
@@ -43,6 +45,11 @@ namespace Tomboy
 			return remote.CreateNote ();
 		}
 
+		public string [] CreateNotes (string [] titles, string [] text_contents)
+		{
+			return remote.CreateNotes (titles, text_contents);
+		}
+
 		public bool DeleteNote (string uri)
 		{
 			return remote.DeleteNote (uri);
@@ -165,6 +172,26 @@ namespace Tomboy
 			return remote.SearchNotes (query, case_sensitive);
 		}
 
+		public IDictionary<string, object> [] SearchNotesRanked (string query, bool case_sensitive, int max_results)
+		{
+			return remote.SearchNotesRanked (query, case_sensitive, max_results);
+		}
+
+		public IDictionary<string, object> [] GetNotes (string [] uris, string [] fields)
+		{
+			return remote.GetNotes (uris, fields);
+		}
+
+		public IDictionary<string, object> [] GetNotesChangedSince (long timestamp, string [] fields)
+		{
+			return remote.GetNotesChangedSince (timestamp, fields);
+		}
+
+		public IDictionary<string, object> [] GetNotesPage (string after_uri, int max_count, string [] fields)
+		{
+			return remote.GetNotesPage (after_uri, max_count, fields);
+		}
+
 		public bool SetNoteCompleteXml (string uri, string xml_contents)
 		{
 			return remote.SetNoteCompleteXml (uri, xml_contents);
@@ -185,6 +212,16 @@ namespace Tomboy
 			return remote.Version ();
 		}
 
+		public void SetTracingEnabled (bool enabled)
+		{
+			remote.SetTracingEnabled (enabled);
+		}
+
+		public string WriteTrace (string path)
+		{
+			return remote.WriteTrace (path);
+		}
+
 		public string GetNotebookForNote (string uri)
 		{
 			return remote.GetNotebookForNote (uri);
@@ -40,6 +40,7 @@ namespace Tomboy
 				bool case_sensitive,
 				Notebooks.Notebook selected_notebook)
 		{
+			TraceSpan span = Tracer.Span ("Search.SearchNotes", "search");
 			string [] words = Search.SplitWatchingQuotes (query);
 
 			// Used for matching in the raw note XML
@@ -63,13 +64,17 @@ namespace Tomboy
 				// First check the note's title for a match,
 				// if there is no match check the note's raw
 				// XML for at least one match, to avoid
-				// deserializing Buffers unnecessarily.
+				// deserializing Buffers unnecessarily.  A
+				// packed note is only peeked at, so it stays
+				// packed unless it matches.
 
 				if (0 < FindMatchCountInNote (note.Title,
 						                      words,
 						                      case_sensitive))
 					temp_matches.Add(note,int.MaxValue);
-				else if (CheckNoteHasMatch (note,
+				else if (CheckNoteHasMatch (note.HasBuffer ?
+				                            note.XmlContent :
+				                            note.StoredText.Peek (),
 					               encoded_words,
 					               case_sensitive)){
 					int match_count =
@@ -82,6 +87,9 @@ namespace Tomboy
 						temp_matches.Add(note,match_count);
 				}
 			}
+
+			span.Dispose ();
+			Tracer.Count ("SearchResults", temp_matches.Count);
 			return temp_matches;
 		}
 		
@@ -104,9 +112,8 @@ namespace Tomboy
 			return wordsList.ToArray ();
 		}
 
-		bool CheckNoteHasMatch (Note note, string [] encoded_words, bool match_case)
+		internal static bool CheckNoteHasMatch (string note_text, string [] encoded_words, bool match_case)
 		{
-			string note_text = note.XmlContent;
 			if (!match_case)
 				note_text = note_text.ToLower ();
 
@@ -120,7 +127,7 @@ namespace Tomboy
 			return true;
 		}
 
-		int FindMatchCountInNote (string note_text, string [] words, bool match_case)
+		internal static int FindMatchCountInNote (string note_text, string [] words, bool match_case)
 		{
 			int matches = 0;
 
@@ -0,0 +1,828 @@
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Text;
+using System.Threading;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// Keeps all notes in one file, notes.seg, instead of one file per
+	/// note.  Each record holds a note's file contents as NoteArchiver
+	/// writes them, so exporting a note is a copy.
+	///
+	/// The segment is only ever replaced whole.  Its records are
+	/// followed by an index record and a footer pointing at it, so
+	/// opening the store reads the index and no notes.  Saves and
+	/// deletes are appended to a write-ahead log, notes.wal, and made
+	/// durable with one fsync each, or one per batch.  Opening the store
+	/// replays the log over the index and drops a record cut short by a
+	/// crash.
+	///
+	/// Once the log has grown to a quarter of the segment, a background
+	/// thread writes the live notes to a new segment and starts a new
+	/// log with whatever was appended meanwhile.  The files are swapped
+	/// the way NoteArchiver.WriteFile swaps a note file, so a crash
+	/// leaves either the old or the new pair; replaying an old log over
+	/// a new segment changes nothing.
+	///
+	/// Record layout: kind byte, key (the note's file name), payload
+	/// length, payload, Adler-32 of key and payload.
+	/// </summary>
+	public class SegmentNoteStore : NoteStore
+	{
+		public const string BackendName = "segment";
+
+		const string segment_name = "notes.seg";
+		const string log_name = "notes.wal";
+
+		const int SEGMENT_MAGIC = 0x47455354;
+		const int LOG_MAGIC = 0x4c415754;
+		const int INDEX_MAGIC = 0x58444e49;
+		const int FORMAT_VERSION = 1;
+		const int HEADER_SIZE = 8;
+		const int FOOTER_SIZE = 12;
+
+		const byte RECORD_PUT = 1;
+		const byte RECORD_DELETE = 2;
+		const byte RECORD_INDEX = 3;
+
+		// Smallest log worth compacting
+		const long MIN_COMPACT_LOG_SIZE = 4 * 1024 * 1024;
+
+		const int BUFFER_SIZE = 64 * 1024;
+
+		static readonly Encoding utf8 = new UTF8Encoding (false);
+
+		// Where a note's payload lies.  Never changed once made, so that
+		// compaction can tell whether a note was saved while it ran.
+		class Location
+		{
+			public readonly bool InLog;
+			public readonly long Offset;
+			public readonly int Length;
+
+			public Location (bool in_log, long offset, int length)
+			{
+				InLog = in_log;
+				Offset = offset;
+				Length = length;
+			}
+		}
+
+		readonly string segment_path;
+		readonly string log_path;
+		readonly string export_dir;
+
+		readonly object sync_root = new object ();
+		// Held for a whole compaction, which takes sync_root only briefly
+		readonly object compact_lock = new object ();
+		Dictionary<string, Location> index;
+		bool closed;
+		FileStream segment_reader;
+		FileStream log_reader;
+		FileStream log;
+		long segment_length;
+		long log_length;
+		int batch_depth;
+		bool sync_pending;
+
+		Thread compactor;
+
+		public SegmentNoteStore (string notes_dir, string backup_dir) :
+			base (notes_dir, backup_dir)
+		{
+			segment_path = Path.Combine (notes_dir, segment_name);
+			log_path = Path.Combine (notes_dir, log_name);
+			export_dir = Path.Combine (Path.GetTempPath (),
+			                           "tomboy-notes-" + Guid.NewGuid ().ToString ());
+		}
+
+		public string SegmentPath
+		{
+			get {
+				return segment_path;
+			}
+		}
+
+		/// <summary>
+		/// Whether the notes directory has a store in it.
+		/// </summary>
+		public bool Exists
+		{
+			get {
+				return File.Exists (segment_path) || File.Exists (segment_path + "~") ||
+				       File.Exists (log_path) || File.Exists (log_path + "~");
+			}
+		}
+
+		/// <summary>
+		/// Size of the write-ahead log, in bytes.
+		/// </summary>
+		public long LogSize
+		{
+			get {
+				lock (sync_root)
+					return log_length;
+			}
+		}
+
+		/// <summary>
+		/// Open the store, creating it if needed.
+		/// </summary>
+		public void Open ()
+		{
+			lock (sync_root) {
+				if (index != null)
+					throw new InvalidOperationException ("Store is already open");
+
+				RecoverSwap (segment_path);
+				RecoverSwap (log_path);
+
+				index = new Dictionary<string, Location> ();
+				segment_length = 0;
+				try {
+					if (File.Exists (segment_path)) {
+						segment_reader = OpenRead (segment_path);
+						segment_length = segment_reader.Length;
+						ReadSegment ();
+					}
+
+					if (File.Exists (log_path))
+						ReplayLog ();
+					else
+						CreateLog (log_path).Close ();
+
+					OpenLog ();
+				} catch {
+					if (segment_reader != null)
+						segment_reader.Close ();
+					segment_reader = null;
+					index = null;
+					throw;
+				}
+
+				Logger.Debug ("Opened {0}: {1} notes, {2} KB of log",
+				              segment_path, index.Count, log_length / 1024);
+			}
+		}
+
+		void OpenLog ()
+		{
+			log_reader = OpenRead (log_path);
+			log = new FileStream (log_path, FileMode.Open, FileAccess.Write,
+			                      FileShare.ReadWrite);
+			log_length = log.Length;
+			log.Seek (0, SeekOrigin.End);
+		}
+
+		// Finish or undo a swap that a crash interrupted
+		static void RecoverSwap (string path)
+		{
+			string backup_path = path + "~";
+			if (File.Exists (backup_path)) {
+				if (File.Exists (path))
+					File.Delete (backup_path);
+				else
+					File.Move (backup_path, path);
+			}
+			if (File.Exists (path + ".tmp"))
+				File.Delete (path + ".tmp");
+		}
+
+		static FileStream OpenRead (string path)
+		{
+			return new FileStream (path, FileMode.Open, FileAccess.Read,
+			                       FileShare.ReadWrite, BUFFER_SIZE);
+		}
+
+		static FileStream CreateLog (string path)
+		{
+			FileStream stream = new FileStream (path, FileMode.Create, FileAccess.Write,
+			                                    FileShare.ReadWrite);
+			BinaryWriter writer = new BinaryWriter (stream);
+			writer.Write (LOG_MAGIC);
+			writer.Write (FORMAT_VERSION);
+			writer.Flush ();
+			stream.Flush (true);
+			return stream;
+		}
+
+		void ReadSegment ()
+		{
+			BinaryReader reader = new BinaryReader (segment_reader);
+			if (segment_length < HEADER_SIZE ||
+			    reader.ReadInt32 () != SEGMENT_MAGIC ||
+			    reader.ReadInt32 () != FORMAT_VERSION)
+				throw new IOException ("Not a note segment: " + segment_path);
+
+			if (ReadIndex (reader))
+				return;
+
+			// No index; find the notes the slow way
+			Logger.Warn ("Index of {0} is damaged, scanning the notes", segment_path);
+			reader.BaseStream.Position = HEADER_SIZE;
+			int applied = Replay (reader, false);
+			Logger.Debug ("Recovered {0} records from {1}", applied, segment_path);
+		}
+
+		bool ReadIndex (BinaryReader reader)
+		{
+			if (segment_length < HEADER_SIZE + FOOTER_SIZE)
+				return false;
+
+			reader.BaseStream.Position = segment_length - FOOTER_SIZE;
+			long index_offset = reader.ReadInt64 ();
+			if (reader.ReadInt32 () != INDEX_MAGIC ||
+			    index_offset < HEADER_SIZE || index_offset >= segment_length - FOOTER_SIZE)
+				return false;
+
+			reader.BaseStream.Position = index_offset;
+			byte kind;
+			string key;
+			long payload_offset;
+			byte [] payload;
+			if (!ReadRecord (reader, segment_length, out kind, out key,
+			                 out payload_offset, out payload) ||
+			    kind != RECORD_INDEX)
+				return false;
+
+			BinaryReader entries = new BinaryReader (new MemoryStream (payload));
+			int count = entries.ReadInt32 ();
+			for (int i = 0; i < count; i++) {
+				string name = entries.ReadString ();
+				long offset = entries.ReadInt64 ();
+				int length = entries.ReadInt32 ();
+				index [name] = new Location (false, offset, length);
+			}
+			return true;
+		}
+
+		void ReplayLog ()
+		{
+			int applied;
+			long good_length;
+			using (FileStream stream = OpenRead (log_path)) {
+				BinaryReader reader = new BinaryReader (stream);
+				if (stream.Length < HEADER_SIZE ||
+				    reader.ReadInt32 () != LOG_MAGIC ||
+				    reader.ReadInt32 () != FORMAT_VERSION)
+					throw new IOException ("Not a note log: " + log_path);
+
+				applied = Replay (reader, true);
+				good_length = stream.Position;
+				if (good_length < stream.Length)
+					Logger.Warn ("Dropping {0} bytes cut short at the end of {1}",
+					             stream.Length - good_length, log_path);
+			}
+
+			if (good_length < new FileInfo (log_path).Length) {
+				using (FileStream stream = new FileStream (log_path, FileMode.Open,
+				                                           FileAccess.Write))
+					stream.SetLength (good_length);
+			}
+			Logger.Debug ("Replayed {0} records from {1}", applied, log_path);
+		}
+
+		// Apply records up to the first damaged one or an index, and
+		// leave the stream after the last good record
+		int Replay (BinaryReader reader, bool in_log)
+		{
+			Stream stream = reader.BaseStream;
+			long length = stream.Length;
+			int applied = 0;
+
+			while (true) {
+				long start = stream.Position;
+				byte kind;
+				string key;
+				long payload_offset;
+				byte [] payload;
+				if (!ReadRecord (reader, length, out kind, out key,
+				                 out payload_offset, out payload) ||
+				    kind == RECORD_INDEX) {
+					stream.Position = start;
+					return applied;
+				}
+
+				if (kind == RECORD_PUT)
+					index [key] = new Location (in_log, payload_offset, payload.Length);
+				else
+					index.Remove (key);
+				applied++;
+			}
+		}
+
+		// False at the end of the stream, and for a record that is cut
+		// short or doesn't match its checksum
+		static bool ReadRecord (BinaryReader reader, long stream_length, out byte kind,
+		                        out string key, out long payload_offset, out byte [] payload)
+		{
+			kind = 0;
+			key = null;
+			payload_offset = 0;
+			payload = null;
+
+			Stream stream = reader.BaseStream;
+			try {
+				if (stream.Position >= stream_length)
+					return false;
+				kind = reader.ReadByte ();
+				if (kind != RECORD_PUT && kind != RECORD_DELETE && kind != RECORD_INDEX)
+					return false;
+				key = reader.ReadString ();
+				int count = reader.ReadInt32 ();
+				payload_offset = stream.Position;
+				if (count < 0 || count > stream_length - payload_offset - 4)
+					return false;
+				payload = reader.ReadBytes (count);
+				uint checksum = reader.ReadUInt32 ();
+				return payload.Length == count && checksum == Checksum (key, payload, count);
+			} catch (EndOfStreamException) {
+				return false;
+			} catch (FormatException) {
+				return false;
+			}
+		}
+
+		// Returns where the payload starts, relative to where the
+		// writer started
+		static long WriteRecord (BinaryWriter writer, byte kind, string key,
+		                         byte [] payload, int count)
+		{
+			long start = writer.BaseStream.Position;
+			writer.Write (kind);
+			writer.Write (key);
+			writer.Write (count);
+			long payload_offset = writer.BaseStream.Position - start;
+			writer.Write (payload, 0, count);
+			writer.Write (Checksum (key, payload, count));
+			return payload_offset;
+		}
+
+		static uint Checksum (string key, byte [] payload, int count)
+		{
+			byte [] key_bytes = utf8.GetBytes (key);
+			return Adler32 (Adler32 (1, key_bytes, key_bytes.Length), payload, count);
+		}
+
+		static uint Adler32 (uint adler, byte [] data, int count)
+		{
+			const uint modulus = 65521;
+			uint a = adler & 0xffff;
+			uint b = adler >> 16;
+			int i = 0;
+			while (i < count) {
+				// Largest run that can't overflow b before the modulo
+				int end = Math.Min (count, i + 5552);
+				for (; i < end; i++) {
+					a += data [i];
+					b += a;
+				}
+				a %= modulus;
+				b %= modulus;
+			}
+			return (b << 16) | a;
+		}
+
+		void CheckOpen ()
+		{
+			if (index == null)
+				throw new InvalidOperationException ("Store is not open");
+		}
+
+		// Saves can still come after NoteManager closed the store at
+		// exit: from later exit handlers, or a session that didn't end
+		// after all.  Open the store again for them.
+		void OpenIfClosed ()
+		{
+			if (index == null && closed) {
+				Logger.Debug ("Opening {0} again after it was closed", segment_path);
+				closed = false;
+				Open ();
+			}
+			CheckOpen ();
+		}
+
+		string GetPath (string key)
+		{
+			return Path.Combine (NotesDirectory, key);
+		}
+
+		static string GetKey (string path)
+		{
+			return Path.GetFileName (path);
+		}
+
+		/// <summary>
+		/// The paths of all stored notes, in the order they lie in the
+		/// files, so that reading them in turn reads ahead.
+		/// </summary>
+		public override ICollection<string> GetNotePaths ()
+		{
+			List<KeyValuePair<string, Location>> entries;
+			lock (sync_root) {
+				OpenIfClosed ();
+				entries = new List<KeyValuePair<string, Location>> (index);
+			}
+
+			entries.Sort (delegate (KeyValuePair<string, Location> x,
+			                        KeyValuePair<string, Location> y) {
+				if (x.Value.InLog != y.Value.InLog)
+					return x.Value.InLog ? 1 : -1;
+				return x.Value.Offset.CompareTo (y.Value.Offset);
+			});
+
+			List<string> paths = new List<string> (entries.Count);
+			foreach (KeyValuePair<string, Location> entry in entries)
+				paths.Add (GetPath (entry.Key));
+			return paths;
+		}
+
+		public override NoteData Read (string path, string uri)
+		{
+			return NoteArchiver.Read (ReadBytes (path), uri);
+		}
+
+		public override byte [] ReadBytes (string path)
+		{
+			lock (sync_root) {
+				OpenIfClosed ();
+				Location location;
+				if (!index.TryGetValue (GetKey (path), out location))
+					throw new FileNotFoundException ("No such note in " + segment_path, path);
+				return ReadPayload (location.InLog ? log_reader : segment_reader, location);
+			}
+		}
+
+		static byte [] ReadPayload (FileStream stream, Location location)
+		{
+			byte [] payload = new byte [location.Length];
+			stream.Position = location.Offset;
+			int read = 0;
+			int n;
+			while (read < payload.Length &&
+			       (n = stream.Read (payload, read, payload.Length - read)) > 0)
+				read += n;
+			if (read < payload.Length)
+				throw new EndOfStreamException ("Note cut short in " + stream.Name);
+			return payload;
+		}
+
+		public override void Write (string path, NoteData data)
+		{
+			byte [] payload = NoteArchiver.WriteBytes (data);
+			lock (sync_root) {
+				OpenIfClosed ();
+				string key = GetKey (path);
+				index [key] = Append (RECORD_PUT, key, payload);
+			}
+			CompactIfNeeded ();
+		}
+
+		public override void Delete (string path)
+		{
+			lock (sync_root) {
+				OpenIfClosed ();
+				string key = GetKey (path);
+				if (!index.ContainsKey (key))
+					return;
+
+				if (BackupDirectory != null)
+					File.WriteAllBytes (GetBackupPath (path), ReadBytes (path));
+
+				Append (RECORD_DELETE, key, new byte [0]);
+				index.Remove (key);
+			}
+		}
+
+		Location Append (byte kind, string key, byte [] payload)
+		{
+			MemoryStream record = new MemoryStream (payload.Length + key.Length + 16);
+			long payload_offset = WriteRecord (new BinaryWriter (record), kind, key,
+			                                   payload, payload.Length);
+
+			log.Write (record.GetBuffer (), 0, (int) record.Length);
+			if (batch_depth > 0) {
+				log.Flush ();
+				sync_pending = true;
+			} else
+				log.Flush (true);
+
+			Location location = new Location (true, log_length + payload_offset, payload.Length);
+			log_length += record.Length;
+			return location;
+		}
+
+		/// <summary>
+		/// Writes the note to a temporary directory that Close deletes.
+		/// </summary>
+		public override string GetFile (string path)
+		{
+			byte [] data;
+			lock (sync_root) {
+				OpenIfClosed ();
+				if (!index.ContainsKey (GetKey (path)))
+					return null;
+				data = ReadBytes (path);
+			}
+
+			if (!Directory.Exists (export_dir))
+				Directory.CreateDirectory (export_dir);
+			string file = Path.Combine (export_dir, GetKey (path));
+			File.WriteAllBytes (file, data);
+			return file;
+		}
+
+		public override void BeginBatch ()
+		{
+			lock (sync_root)
+				batch_depth++;
+		}
+
+		public override void EndBatch ()
+		{
+			lock (sync_root) {
+				if (batch_depth == 0)
+					throw new InvalidOperationException ("EndBatch without BeginBatch");
+				if (--batch_depth > 0 || !sync_pending)
+					return;
+				sync_pending = false;
+				log.Flush (true);
+			}
+		}
+
+		/// <summary>
+		/// Wait for compaction to finish, close the files and delete the
+		/// files GetFile wrote.  Using the store afterwards opens it
+		/// again.
+		/// </summary>
+		public override void Close ()
+		{
+			Thread running = compactor;
+			if (running != null)
+				running.Join ();
+
+			try {
+				if (Directory.Exists (export_dir))
+					Directory.Delete (export_dir, true);
+			} catch (Exception e) {
+				Logger.Warn ("Could not remove {0}: {1}", export_dir, e.Message);
+			}
+
+			lock (sync_root) {
+				if (index == null)
+					return;
+				closed = true;
+				log.Flush (true);
+				log.Close ();
+				log_reader.Close ();
+				if (segment_reader != null)
+					segment_reader.Close ();
+				log = null;
+				log_reader = null;
+				segment_reader = null;
+				index = null;
+			}
+		}
+
+		/// <summary>
+		/// Move the closed store's files aside, once its notes have been
+		/// exported.
+		/// </summary>
+		public void Retire ()
+		{
+			lock (sync_root)
+				closed = false;
+			foreach (string path in new string [] { segment_path, log_path }) {
+				if (!File.Exists (path))
+					continue;
+				string old_path = path + ".old";
+				if (File.Exists (old_path))
+					File.Delete (old_path);
+				File.Move (path, old_path);
+			}
+		}
+
+		/// <summary>
+		/// Store every .note file in directory, as if it were in the
+		/// notes directory, replacing notes with the same file name.
+		/// Files that can't be read are logged and left alone.  If
+		/// remove is true, the stored files are deleted once the store
+		/// is durable.  Returns the number of notes stored.
+		/// </summary>
+		public int ImportDirectory (string directory, bool remove)
+		{
+			List<string> imported = new List<string> ();
+			BeginBatch ();
+			try {
+				foreach (string file in Directory.GetFiles (directory, "*.note")) {
+					string path = GetPath (Path.GetFileName (file));
+					NoteData data;
+					try {
+						data = NoteArchiver.Read (file, "note://tomboy/" +
+						                          Path.GetFileNameWithoutExtension (file));
+					} catch (Exception e) {
+						Logger.Warn ("Not importing {0}: {1}", file, e.Message);
+						continue;
+					}
+					Write (path, data);
+					imported.Add (file);
+				}
+			} finally {
+				EndBatch ();
+			}
+
+			// So that the next start reads an index instead of a log
+			if (imported.Count > 0)
+				Compact ();
+
+			if (remove) {
+				foreach (string file in imported)
+					File.Delete (file);
+			}
+			return imported.Count;
+		}
+
+		/// <summary>
+		/// Write every stored note to its own file in directory, as the
+		/// directory store would.  Returns the number of notes written.
+		/// </summary>
+		public int ExportDirectory (string directory)
+		{
+			if (!Directory.Exists (directory))
+				Directory.CreateDirectory (directory);
+
+			ICollection<string> paths = GetNotePaths ();
+			foreach (string path in paths) {
+				string file = Path.Combine (directory, GetKey (path));
+				string tmp_file = file + ".tmp";
+				File.WriteAllBytes (tmp_file, ReadBytes (path));
+				if (File.Exists (file))
+					File.Delete (file);
+				File.Move (tmp_file, file);
+			}
+			return paths.Count;
+		}
+
+		void CompactIfNeeded ()
+		{
+			lock (sync_root) {
+				if (compactor != null || log_length < MIN_COMPACT_LOG_SIZE ||
+				    log_length < segment_length / 4)
+					return;
+
+				compactor = new Thread (delegate () {
+					try {
+						Compact ();
+					} catch (Exception e) {
+						Logger.Error ("Error compacting {0}: {1}", segment_path, e);
+					} finally {
+						lock (sync_root)
+							compactor = null;
+					}
+				});
+				compactor.Name = "NoteStoreCompactor";
+				compactor.IsBackground = true;
+				compactor.Start ();
+			}
+		}
+
+		/// <summary>
+		/// Write the live notes to a new segment and empty the log.
+		/// Saves may go on meanwhile; they wait only while the files are
+		/// swapped.
+		/// </summary>
+		public void Compact ()
+		{
+			lock (compact_lock)
+				CompactLocked ();
+		}
+
+		void CompactLocked ()
+		{
+			List<KeyValuePair<string, Location>> snapshot;
+			long log_mark;
+			lock (sync_root) {
+				CheckOpen ();
+				snapshot = new List<KeyValuePair<string, Location>> (index);
+				log_mark = log_length;
+			}
+
+			// Make the new segment without the lock, from handles of our
+			// own.  Nothing changes the bytes it reads: the segment is
+			// only replaced below, and the log only grows.
+			string tmp_segment = segment_path + ".tmp";
+			Dictionary<string, Location> moved = new Dictionary<string, Location> ();
+			FileStream old_segment = File.Exists (segment_path) ? OpenRead (segment_path) : null;
+			try {
+				using (FileStream old_log = OpenRead (log_path))
+				using (FileStream output = new FileStream (tmp_segment, FileMode.Create,
+				                                           FileAccess.Write, FileShare.None,
+				                                           BUFFER_SIZE)) {
+					BinaryWriter writer = new BinaryWriter (output);
+					writer.Write (SEGMENT_MAGIC);
+					writer.Write (FORMAT_VERSION);
+
+					MemoryStream entries = new MemoryStream ();
+					BinaryWriter entry_writer = new BinaryWriter (entries);
+					entry_writer.Write (snapshot.Count);
+					foreach (KeyValuePair<string, Location> entry in snapshot) {
+						Location location = entry.Value;
+						byte [] payload = ReadPayload (location.InLog ? old_log : old_segment,
+						                               location);
+						long start = output.Position;
+						long offset = start + WriteRecord (writer, RECORD_PUT, entry.Key,
+						                                   payload, payload.Length);
+						moved [entry.Key] = new Location (false, offset, payload.Length);
+
+						entry_writer.Write (entry.Key);
+						entry_writer.Write (offset);
+						entry_writer.Write (payload.Length);
+					}
+
+					long index_offset = output.Position;
+					WriteRecord (writer, RECORD_INDEX, string.Empty,
+					             entries.GetBuffer (), (int) entries.Length);
+					writer.Write (index_offset);
+					writer.Write (INDEX_MAGIC);
+					writer.Flush ();
+					output.Flush (true);
+				}
+			} finally {
+				if (old_segment != null)
+					old_segment.Close ();
+			}
+
+			lock (sync_root) {
+				CheckOpen ();
+
+				// Start the new log with what was appended meanwhile
+				string tmp_log = log_path + ".tmp";
+				long tail_length = log_length - log_mark;
+				using (FileStream new_log = CreateLog (tmp_log)) {
+					log.Flush ();
+					log_reader.Position = log_mark;
+					byte [] buffer = new byte [BUFFER_SIZE];
+					long copied = 0;
+					int n;
+					while (copied < tail_length &&
+					       (n = log_reader.Read (buffer, 0, (int) Math.Min (buffer.Length, tail_length - copied))) > 0) {
+						new_log.Write (buffer, 0, n);
+						copied += n;
+					}
+					new_log.Flush (true);
+				}
+
+				log.Close ();
+				log_reader.Close ();
+				if (segment_reader != null)
+					segment_reader.Close ();
+
+				Swap (tmp_segment, segment_path);
+				Swap (tmp_log, log_path);
+
+				segment_reader = OpenRead (segment_path);
+				segment_length = segment_reader.Length;
+				OpenLog ();
+				sync_pending = false;
+
+				// Notes saved or deleted since the snapshot keep what the
+				// log says, at its new offsets
+				Dictionary<string, Location> new_index =
+					new Dictionary<string, Location> (index.Count);
+				foreach (KeyValuePair<string, Location> entry in snapshot) {
+					Location current;
+					if (index.TryGetValue (entry.Key, out current) && current == entry.Value)
+						new_index [entry.Key] = moved [entry.Key];
+				}
+				foreach (KeyValuePair<string, Location> entry in index) {
+					Location location = entry.Value;
+					if (location.InLog && location.Offset >= log_mark)
+						new_index [entry.Key] =
+							new Location (true, location.Offset - log_mark + HEADER_SIZE,
+							              location.Length);
+				}
+				index = new_index;
+
+				Logger.Debug ("Compacted {0}: {1} notes, {2} KB", segment_path,
+				              index.Count, segment_length / 1024);
+			}
+		}
+
+		// Replace path with new_path, as NoteArchiver.WriteFile does
+		static void Swap (string new_path, string path)
+		{
+			if (File.Exists (path)) {
+				string backup_path = path + "~";
+				if (File.Exists (backup_path))
+					File.Delete (backup_path);
+				File.Move (path, backup_path);
+				File.Move (new_path, path);
+				File.Delete (backup_path);
+			} else
+				File.Move (new_path, path);
+		}
+	}
+}
@@ -1,6 +1,8 @@
 using System;
 using System.IO;
+using System.Text;
 using System.Xml;
+using System.Threading;
 using System.Collections.Generic;
 
 namespace Tomboy.Sync
@@ -8,22 +10,45 @@ namespace Tomboy.Sync
 	public class FileSystemSyncServer : SyncServer
 	{
 		private List<string> updatedNotes;
+		private Dictionary<string, string> updatedHashes;
+		private Dictionary<string, int> updatedDeltaBases;
+		private NotePackStore packs;
+		private NotePackStore.PackWriter packWriter;
 		private List<string> deletedNotes;
 
 		private string serverId;
 
 		private string serverPath;
-		private string cachePath;
 		private string lockPath;
 		private string manifestPath;
 
 		private int newRevision;
 		private string newRevisionPath;
 
+		// Manifest index loaded when the sync lock is taken; the
+		// manifest can't change under us until the lock is released.
+		private ServerManifest transactionManifest;
+
+		// Last manifest read outside a transaction, and the stamp of the
+		// file it was read from
+		private readonly object manifestCacheLock = new object ();
+		private ServerManifest cachedManifest;
+		private DateTime cachedManifestTime;
+		private long cachedManifestSize;
+
+		// Merging packs after the last commit.  It holds the sync lock
+		// until it is done.
+		private static Thread repackThread;
+
 		private static DateTime initialSyncAttempt = DateTime.MinValue;
 		private static string lastSyncLockHash = string.Empty;
 		InterruptableTimeout lockTimeout;
 		SyncLockInfo syncLock;
+		// Set once the repack thread has deleted the lock file, so a
+		// renewal still queued on the main loop doesn't write it again.
+		// Guarded by lockFileLock.
+		bool lockReleased;
+		readonly object lockFileLock = new object ();
 
 		public FileSystemSyncServer (string localSyncPath)
 		{
@@ -32,7 +57,6 @@ namespace Tomboy.Sync
 			if (!Directory.Exists (serverPath))
 				throw new DirectoryNotFoundException (serverPath);
 
-			cachePath = Services.NativeApplication.CacheDirectory;
 			lockPath = Path.Combine (serverPath, "lock");
 			manifestPath = Path.Combine (serverPath, "manifest.xml");
 
@@ -42,6 +66,37 @@ namespace Tomboy.Sync
 			lockTimeout = new InterruptableTimeout ();
 			lockTimeout.Timeout += LockTimeout;
 			syncLock = new SyncLockInfo ();
+
+			MaxParallelTransfers = DEFAULT_MAX_PARALLEL_TRANSFERS;
+
+			packs = new NotePackStore (serverPath, AdjustPermissions);
+			UsePackFormat = (bool) Preferences.Get (Preferences.SYNC_FS_PACK_FORMAT);
+		}
+
+		// Merge packs once this many have piled up
+		private const int MAX_PACKS_BEFORE_REPACK = 16;
+
+		// On network mounts every file costs at least one round trip, so
+		// keep a few of them in flight at a time.
+		public const int DEFAULT_MAX_PARALLEL_TRANSFERS = 8;
+
+		/// <summary>
+		/// Maximum number of note files read from or written to the
+		/// server at the same time.
+		/// </summary>
+		public int MaxParallelTransfers
+		{
+			get; set;
+		}
+
+		/// <summary>
+		/// Store uploaded notes in one pack per revision instead of one
+		/// file per note; see NotePackStore.  Notes already on the server
+		/// are read from either layout regardless.
+		/// </summary>
+		public bool UsePackFormat
+		{
+			get; set;
 		}
 
 		public virtual void UploadNotes (IList<Note> notes)
@@ -52,12 +107,147 @@ namespace Tomboy.Sync
 				AdjustPermissions (newRevisionPath);
 			}
 			Logger.Debug ("UploadNotes: notes.Count = {0}", notes.Count);
-			foreach (Note note in notes) {
+
+			if (UsePackFormat) {
+				UploadNotesToPack (notes);
+				return;
+			}
+
+			bool useDeltas = SyncManager.DeltaTransferEnabled;
+			bool [] uploaded = new bool [notes.Count];
+			string [] hashes = GetContentHashes (notes);
+			int [] deltaBases = new int [notes.Count];
+			List<int> indices = new List<int> (notes.Count);
+			for (int i = 0; i < notes.Count; i++)
+				indices.Add (i);
+
+			IOUtils.ForEachParallel (indices, MaxParallelTransfers, delegate (int i) {
+				Note note = notes [i];
 				try {
 					string serverNotePath = Path.Combine (newRevisionPath, Path.GetFileName (note.FilePath));
-					File.Copy (note.FilePath, serverNotePath, true);
-					AdjustPermissions (serverNotePath);
-					updatedNotes.Add (Path.GetFileNameWithoutExtension (note.FilePath));
+					byte [] data = ReadLocalNote (note);
+					WriteToServer (serverNotePath, data);
+					uploaded [i] = true;
+
+					deltaBases [i] = -1;
+					if (useDeltas)
+						deltaBases [i] = UploadDelta (Path.GetFileNameWithoutExtension (note.FilePath),
+						                              data);
+				} catch (Exception e) {
+					Logger.Error ("Sync: Error uploading note \"{0}\": {1}", note.Title, e.Message);
+				}
+			});
+
+			// Record in the original order so the manifest stays stable
+			for (int i = 0; i < notes.Count; i++) {
+				if (uploaded [i]) {
+					string id = Path.GetFileNameWithoutExtension (notes [i].FilePath);
+					updatedNotes.Add (id);
+					updatedHashes [id] = hashes [i];
+					if (deltaBases [i] >= 0)
+						updatedDeltaBases [id] = deltaBases [i];
+				}
+			}
+		}
+
+		/// <summary>
+		/// The note's file as saved, read from its NoteStore.
+		/// </summary>
+		private static byte [] ReadLocalNote (Note note)
+		{
+			if (note.Manager == null || note.Manager.Store == null)
+				return File.ReadAllBytes (note.FilePath);
+			return note.Manager.Store.ReadBytes (note.FilePath);
+		}
+
+		/// <summary>
+		/// Store a NoteDelta next to the uploaded note, made against the
+		/// copy this client last synchronized, if that copy is still the
+		/// server's current version.  Returns the revision the delta
+		/// applies to, or -1 if none was stored.
+		/// </summary>
+		private int UploadDelta (string id, byte [] data)
+		{
+			try {
+				SyncBaseStore bases = SyncBaseStore.Instance;
+				int baseRev = bases.GetRevision (id);
+				if (baseRev < 0 || baseRev != Manifest.GetNoteRevision (id))
+					return -1;
+				string baseXml = bases.Get (id);
+				if (baseXml == null)
+					return -1;
+
+				string noteXml = NoteStore.DecodeXml (data);
+				byte [] delta = NoteDelta.Create (baseXml, noteXml);
+				// Not worth it when most of the note changed
+				if (delta.Length * 2 > Encoding.UTF8.GetByteCount (noteXml))
+					return -1;
+
+				WriteToServer (Path.Combine (newRevisionPath, id + ".delta"), delta);
+				return baseRev;
+			} catch (Exception e) {
+				Logger.Debug ("Sync: Not storing delta for note {0}: {1}", id, e.Message);
+				return -1;
+			}
+		}
+
+		/// <summary>
+		/// Rebuild a note from its stored delta and this client's copy of
+		/// the revision the delta applies to.  Returns null if either is
+		/// missing or they don't match, so the full note is read instead.
+		/// </summary>
+		private string DownloadDelta (ServerManifest manifest, string id, int rev)
+		{
+			SyncBaseStore bases = SyncBaseStore.Instance;
+			int deltaBase = manifest.GetNoteDeltaBase (id);
+			if (deltaBase < 0 || deltaBase != bases.GetRevision (id))
+				return null;
+			string baseXml = bases.Get (id);
+			if (baseXml == null)
+				return null;
+
+			try {
+				byte [] delta = ReadServerBytes (Path.Combine (GetRevisionDirPath (rev), id + ".delta"));
+				return NoteDelta.Apply (baseXml, delta);
+			} catch (Exception e) {
+				Logger.Debug ("Sync: Reading whole note {0} instead of delta: {1}", id, e.Message);
+				return null;
+			}
+		}
+
+		/// <summary>
+		/// The notes' content hashes, read before the upload fans out to
+		/// worker threads.  A note's hash is computed lazily and replaced
+		/// by every save, so the workers must not touch it; SyncManager
+		/// has already computed it on the GTK thread when it saved the
+		/// note for upload, so this only reads the cached value.
+		/// </summary>
+		private static string [] GetContentHashes (IList<Note> notes)
+		{
+			string [] hashes = new string [notes.Count];
+			for (int i = 0; i < notes.Count; i++)
+				hashes [i] = notes [i].ContentHash;
+			return hashes;
+		}
+
+		/// <summary>
+		/// Append the notes to this revision's pack: one file written
+		/// sequentially instead of a file per note.
+		/// </summary>
+		private void UploadNotesToPack (IList<Note> notes)
+		{
+			if (packWriter == null)
+				packWriter = packs.CreatePack (newRevision);
+
+			string [] hashes = GetContentHashes (notes);
+			for (int i = 0; i < notes.Count; i++) {
+				Note note = notes [i];
+				try {
+					string id = Path.GetFileNameWithoutExtension (note.FilePath);
+					string hash = hashes [i];
+					packWriter.Add (id, newRevision, ReadLocalNote (note));
+					updatedNotes.Add (id);
+					updatedHashes [id] = hash;
 				} catch (Exception e) {
 					Logger.Error ("Sync: Error uploading note \"{0}\": {1}", note.Title, e.Message);
 				}
@@ -77,23 +267,9 @@ namespace Tomboy.Sync
 
 		public IList<string> GetAllNoteUUIDs ()
 		{
-			List<string> noteUUIDs = new List<string> ();
-
-			if (IsValidXmlFile (manifestPath)) {
-				// TODO: Permission errors
-				using (FileStream fs = new FileStream (manifestPath, FileMode.Open)) {
-					XmlDocument doc = new XmlDocument ();
-					doc.Load (fs);
-
-					XmlNodeList noteIds = doc.SelectNodes ("//note/@id");
-					Logger.Debug ("GetAllNoteUUIDs has {0} notes", noteIds.Count);
-					foreach (XmlNode idNode in noteIds) {
-						noteUUIDs.Add (idNode.InnerText);
-					}
-				}
-			}
-
-			return noteUUIDs;
+			ServerManifest manifest = Manifest;
+			Logger.Debug ("GetAllNoteUUIDs has {0} notes", manifest.Count);
+			return new List<string> (manifest.NoteIds);
 		}
 
 		public bool UpdatesAvailableSince (int revision)
@@ -105,50 +281,47 @@ namespace Tomboy.Sync
 		{
 			Dictionary<string, NoteUpdate> noteUpdates = new Dictionary<string, NoteUpdate> ();
 
-			string tempPath = Path.Combine (cachePath, "sync_temp");
-			if (!Directory.Exists (tempPath)) {
-				Directory.CreateDirectory (tempPath);
-			} else {
-				// Empty the temp dir
-				try {
-					foreach (string oldFile in Directory.GetFiles (tempPath)) {
-						File.Delete (oldFile);
-					}
-				} catch {}
-			}
-
-			if (IsValidXmlFile (manifestPath)) {
-				// TODO: Permissions errors
-				using (FileStream fs = new FileStream (manifestPath, FileMode.Open)) {
-					XmlDocument doc = new XmlDocument ();
-					doc.Load (fs);
-
-					string xpath =
-					        string.Format ("//note[@rev > {0}]", revision.ToString ());
-					XmlNodeList noteNodes = doc.SelectNodes (xpath);
-					Logger.Debug ("GetNoteUpdatesSince xpath returned {0} nodes", noteNodes.Count);
-					foreach (XmlNode node in noteNodes) {
-						string id = node.SelectSingleNode ("@id").InnerText;
-						int rev = Int32.Parse (node.SelectSingleNode ("@rev").InnerText);
-						if (noteUpdates.ContainsKey (id) == false) {
-							// Copy the file from the server to the temp directory
-							string revDir = GetRevisionDirPath (rev);
-							string serverNotePath = Path.Combine (revDir, id + ".note");
-							string noteTempPath = Path.Combine (tempPath, id + ".note");
-							File.Copy (serverNotePath, noteTempPath, true);
-
-							// Get the title, contents, etc.
-							string noteTitle = string.Empty;
-							string noteXml = null;
-							using (StreamReader reader = new StreamReader (noteTempPath)) {
-								noteXml = reader.ReadToEnd ();
-							}
-							NoteUpdate update = new NoteUpdate (noteXml, noteTitle, id, rev);
-							noteUpdates [id] = update;
-						}
-					}
-				}
-			}
+			ServerManifest manifest = Manifest;
+			CheckFormat (manifest);
+			IList<KeyValuePair<string, int>> changedNotes =
+				manifest.GetNoteRevisionsSince (revision);
+			Logger.Debug ("GetNoteUpdatesSince found {0} changed notes", changedNotes.Count);
+
+			// Read the notes straight from their packs or revision
+			// directories, several at a time.  A failed read fails the
+			// whole sync, as it always has.
+			bool havePacks = packs.Exists;
+			if (havePacks)
+				packs.LoadIndex ();
+			bool useDeltas = SyncManager.DeltaTransferEnabled;
+
+			NoteUpdate [] updates = new NoteUpdate [changedNotes.Count];
+			List<int> indices = new List<int> (changedNotes.Count);
+			for (int i = 0; i < changedNotes.Count; i++)
+				indices.Add (i);
+
+			IOUtils.ForEachParallel (indices, MaxParallelTransfers, delegate (int i) {
+				string id = changedNotes [i].Key;
+				int rev = changedNotes [i].Value;
+
+				string revDir = GetRevisionDirPath (rev);
+				string serverNotePath = Path.Combine (revDir, id + ".note");
+
+				// Get the title, contents, etc.
+				string noteTitle = string.Empty;
+				string noteXml = null;
+				if (havePacks)
+					noteXml = packs.ReadNote (id, rev);
+				if (noteXml == null && useDeltas)
+					noteXml = DownloadDelta (manifest, id, rev);
+				if (noteXml == null)
+					noteXml = ReadServerFile (serverNotePath);
+				updates [i] = new NoteUpdate (noteXml, noteTitle, id, rev);
+				updates [i].ContentHash = manifest.GetNoteHash (id);
+			});
+
+			foreach (NoteUpdate update in updates)
+				noteUpdates [update.UUID] = update;
 
 			Logger.Debug ("GetNoteUpdatesSince ({0}) returning: {1}", revision, noteUpdates.Count);
 			return noteUpdates;
@@ -156,6 +329,11 @@ namespace Tomboy.Sync
 
 		public virtual bool BeginSyncTransaction ()
 		{
+			// Our own repack still holds the lock
+			Thread repack = repackThread;
+			if (repack != null)
+				repack.Join ();
+
 			// Lock expiration: If a lock file exists on the server, a client
 			// will never be able to synchronize on its first attempt.  The
 			// client should record the time elapsed
@@ -198,21 +376,42 @@ namespace Tomboy.Sync
 			// actively synchronizing right now.
 			syncLock.RenewCount = 0;
 			syncLock.Revision = newRevision;
-			UpdateLockFile (syncLock);
+			lock (lockFileLock) {
+				lockReleased = false;
+				UpdateLockFile (syncLock);
+			}
 			// TODO: Verify that the lockTimeout is actually working or figure
 			// out some other way to automatically update the lock file.
 			// Reset the timer to 20 seconds sooner than the sync lock duration
 			lockTimeout.Reset ((uint)syncLock.Duration.TotalMilliseconds - 20000);
 
 			updatedNotes = new List<string> ();
+			updatedHashes = new Dictionary<string, string> ();
+			updatedDeltaBases = new Dictionary<string, int> ();
 			deletedNotes = new List<string> ();
 
+			transactionManifest = LoadManifest ();
+			CheckFormat (transactionManifest);
+
 			return true;
 		}
 
+		/// <summary>
+		/// Refuse servers written by a newer Tomboy in a format this one
+		/// can't read, before any note is downloaded.
+		/// </summary>
+		private static void CheckFormat (ServerManifest manifest)
+		{
+			if (!manifest.IsFormatSupported)
+				throw new TomboySyncException (string.Format (
+					"Server uses an unsupported storage format \"{0}\"",
+					manifest.Format));
+		}
+
 		public virtual bool CommitSyncTransaction ()
 		{
 			bool commitSucceeded = false;
+			ServerManifest repackManifest = null;
 
 			if (updatedNotes.Count > 0 || deletedNotes.Count > 0)
 			{
@@ -226,61 +425,45 @@ namespace Tomboy.Sync
 					AdjustPermissions (newRevisionPath);
 				}
 
-				XmlNodeList noteNodes = null;
-				if (IsValidXmlFile (manifestPath) == true) {
-					using (FileStream fs = new FileStream (manifestPath, FileMode.Open)) {
-						XmlDocument doc = new XmlDocument ();
-						doc.Load (fs);
-						noteNodes = doc.SelectNodes ("//note");
-					}
-				} else {
-					using (StringReader sr = new StringReader ("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<sync>\n</sync>")) {
-						XmlDocument doc = new XmlDocument ();
-						doc.Load (sr);
-						noteNodes = doc.SelectNodes ("//note");
-					}
+				Dictionary<string, bool> changedSet = new Dictionary<string, bool> ();
+				foreach (string uuid in deletedNotes)
+					changedSet [uuid] = true;
+				foreach (string uuid in updatedNotes)
+					changedSet [uuid] = true;
+
+				// The pack must be on disk before the manifest refers to it
+				if (packWriter != null) {
+					packWriter.Commit ();
+					packWriter.Dispose ();
+					packWriter = null;
 				}
 
-				// Write out the new manifest file
-				XmlWriter xml = XmlWriter.Create (manifestFilePath, XmlEncoder.DocumentSettings);
-				try {
-					xml.WriteStartDocument ();
-					xml.WriteStartElement (null, "sync", null);
-					xml.WriteAttributeString ("revision", newRevision.ToString ());
-					xml.WriteAttributeString ("server-id", serverId);
-
-					foreach (XmlNode node in noteNodes) {
-						string id = node.SelectSingleNode ("@id").InnerText;
-						string rev = node.SelectSingleNode ("@rev").InnerText;
-
-						// Don't write out deleted notes
-						if (deletedNotes.Contains (id))
-							continue;
-
-						// Skip updated notes, we'll update them in a sec
-						if (updatedNotes.Contains (id))
-							continue;
-
-						xml.WriteStartElement (null, "note", null);
-						xml.WriteAttributeString ("id", id);
-						xml.WriteAttributeString ("rev", rev);
-						xml.WriteEndElement ();
-					}
-
-					// Write out all the updated notes
-					foreach (string uuid in updatedNotes) {
-						xml.WriteStartElement (null, "note", null);
-						xml.WriteAttributeString ("id", uuid);
-						xml.WriteAttributeString ("rev", newRevision.ToString ());
-						xml.WriteEndElement ();
-					}
-
-					xml.WriteEndElement ();
-					xml.WriteEndDocument ();
-				} finally {
-					xml.Close ();
+				// Build the new manifest: unchanged notes keep their revision
+				// and order, updated notes go at the end, deleted ones go away.
+				ServerManifest newManifest = new ServerManifest ();
+				newManifest.Revision = newRevision;
+				newManifest.ServerId = serverId;
+				// Lets clients refuse formats they don't know; see
+				// ServerManifest
+				if (packs.Exists)
+					newManifest.Format = ServerManifest.PackFormat;
+				ServerManifest oldManifest = Manifest;
+				foreach (string id in oldManifest.NoteIds) {
+					if (!changedSet.ContainsKey (id))
+						newManifest.SetNoteRevision (id, oldManifest.GetNoteRevision (id),
+						                             oldManifest.GetNoteHash (id),
+						                             oldManifest.GetNoteDeltaBase (id));
+				}
+				foreach (string uuid in updatedNotes) {
+					int deltaBase;
+					if (!updatedDeltaBases.TryGetValue (uuid, out deltaBase))
+						deltaBase = -1;
+					newManifest.SetNoteRevision (uuid, newRevision, updatedHashes [uuid], deltaBase);
 				}
 
+				// Write out the new manifest file
+				newManifest.Write (manifestFilePath);
+
 				AdjustPermissions (manifestFilePath);
 
 
@@ -316,8 +499,7 @@ namespace Tomboy.Sync
 						FileInfo oldManifestFilePathInfo = new FileInfo (oldManifestFilePath);
 						foreach (FileInfo file in oldManifestFilePathInfo.Directory.GetFiles ()) {
 							string fileGuid = Path.GetFileNameWithoutExtension (file.Name);
-							if (deletedNotes.Contains (fileGuid) ||
-							                updatedNotes.Contains (fileGuid))
+							if (changedSet.ContainsKey (fileGuid))
 								File.Delete (file.FullName);
 							// TODO: Need to check *all* revision dirs, not just previous (duh)
 							//       Should be a way to cache this from checking earlier.
@@ -333,18 +515,70 @@ namespace Tomboy.Sync
 					              "files floating around.  Here's the error:\n" +
 					              e.Message);
 				}
+
+				if (packs.PackCount > MAX_PACKS_BEFORE_REPACK)
+					repackManifest = newManifest;
 				// * * * End Cleanup Code * * *
 			}
 
+			transactionManifest = null;
+			if (repackManifest != null) {
+				// The sync is complete; merge the packs without making
+				// it wait.  The repack releases the lock when it's done.
+				StartRepack (repackManifest);
+				return true;
+			}
 			lockTimeout.Cancel ();
 			File.Delete (lockPath);// TODO: Errors?
 			commitSucceeded = true;// TODO: When return false?
 			return commitSucceeded;
 		}
 
+		/// <summary>
+		/// Merge the packs on a background thread, keeping the sync lock
+		/// (and renewing it) until done so no other client reads a pack
+		/// while it is deleted.
+		/// </summary>
+		private void StartRepack (ServerManifest manifest)
+		{
+			Thread thread = new Thread (delegate () {
+				try {
+					packs.Repack (manifest);
+				} catch (Exception e) {
+					Logger.Error ("Exception while repacking sync server notes.  " +
+					              "Server integrity is OK; the old packs are kept.  " +
+					              "Here's the error:\n" + e.Message);
+				} finally {
+					try {
+						// The lock is renewed from the main loop, which
+						// may have stopped if Tomboy is quitting, so
+						// only tell the renewal to stop instead of
+						// waiting for the main loop to cancel it
+						lock (lockFileLock) {
+							lockReleased = true;
+							File.Delete (lockPath);
+						}
+					} catch (Exception e) {
+						Logger.Warn ("Error releasing the sync lock after repacking: {0}",
+						             e.Message);
+					}
+					repackThread = null;
+				}
+			});
+			thread.IsBackground = true;
+			thread.Name = "Sync repack";
+			repackThread = thread;
+			thread.Start ();
+		}
+
 		// TODO: Return false if this is a bad time to cancel sync?
 		public bool CancelSyncTransaction ()
 		{
+			if (packWriter != null) {
+				packWriter.Dispose ();
+				packWriter = null;
+			}
+			transactionManifest = null;
 			lockTimeout.Cancel ();
 			File.Delete (lockPath);
 			return true;
@@ -354,18 +588,8 @@ namespace Tomboy.Sync
 		{
 			get
 			{
-				int latestRev = -1;
+				int latestRev = Manifest.Revision;
 				int latestRevDir = -1;
-				if (IsValidXmlFile (manifestPath) == true) {
-					using (FileStream fs = new FileStream (manifestPath, FileMode.Open)) {
-						XmlDocument doc = new XmlDocument ();
-						doc.Load (fs);
-						XmlNode syncNode = doc.SelectSingleNode ("//sync");
-						string latestRevStr = syncNode.Attributes.GetNamedItem ("revision").InnerText;
-						if (latestRevStr != null && latestRevStr != string.Empty)
-							latestRev = Int32.Parse (latestRevStr);
-					}
-				}
 
 				bool foundValidManifest = false;
 				while (!foundValidManifest)
@@ -468,16 +692,7 @@ namespace Tomboy.Sync
 				serverId = null;
 
 				// Attempt to read from manifest file first
-				if (IsValidXmlFile (manifestPath)) {
-					using (FileStream fs = new FileStream (manifestPath, FileMode.Open)) {
-						XmlDocument doc = new XmlDocument ();
-						doc.Load (fs);
-						XmlNode syncNode = doc.SelectSingleNode ("//sync");
-						XmlNode serverIdNode = syncNode.Attributes.GetNamedItem ("server-id");
-						if (serverIdNode != null && !(string.IsNullOrEmpty (serverIdNode.InnerText)))
-							serverId = serverIdNode.InnerText;
-					}
-				}
+				serverId = Manifest.ServerId;
 
 				// Generate a new ID if there isn't already one
 				if (serverId == null)
@@ -489,6 +704,78 @@ namespace Tomboy.Sync
 
 		#region Private Methods
 
+		/// <summary>
+		/// The server manifest index.  During a sync transaction this is
+		/// the one read when the lock was taken; otherwise it is the one
+		/// last read, unless the file has changed since.  Never null: a
+		/// missing or invalid manifest gives an empty one with revision -1.
+		/// The index is shared, so callers must not change it.
+		/// </summary>
+		private ServerManifest Manifest
+		{
+			get {
+				if (transactionManifest != null)
+					return transactionManifest;
+				return LoadManifest ();
+			}
+		}
+
+		/// <summary>
+		/// Read a whole file from the server.  Called from several
+		/// threads at once.
+		/// </summary>
+		protected virtual string ReadServerFile (string path)
+		{
+			using (StreamReader reader = new StreamReader (path)) {
+				return reader.ReadToEnd ();
+			}
+		}
+
+		/// <summary>
+		/// Read a whole file from the server as bytes.
+		/// </summary>
+		protected virtual byte [] ReadServerBytes (string path)
+		{
+			return File.ReadAllBytes (path);
+		}
+
+		/// <summary>
+		/// Write a new file on the server and make it accessible to other
+		/// clients.  Called from several threads at once.
+		/// </summary>
+		protected virtual void WriteToServer (string serverPath, byte [] data)
+		{
+			File.WriteAllBytes (serverPath, data);
+			AdjustPermissions (serverPath);
+		}
+
+		private ServerManifest LoadManifest ()
+		{
+			FileInfo info = new FileInfo (manifestPath);
+			if (!info.Exists)
+				return new ServerManifest ();
+
+			DateTime time = info.LastWriteTimeUtc;
+			long size = info.Length;
+			lock (manifestCacheLock) {
+				if (cachedManifest != null &&
+				    cachedManifestTime == time && cachedManifestSize == size)
+					return cachedManifest;
+			}
+
+			// TODO: Permissions errors
+			ServerManifest manifest = ServerManifest.TryRead (manifestPath);
+			if (manifest == null)
+				return new ServerManifest ();
+
+			lock (manifestCacheLock) {
+				cachedManifest = manifest;
+				cachedManifestTime = time;
+				cachedManifestSize = size;
+			}
+			return manifest;
+		}
+
 		// NOTE: Assumes serverPath is set
 		private string GetRevisionDirPath (int rev)
 		{
@@ -560,6 +847,13 @@ namespace Tomboy.Sync
 				}
 			}
 
+			// Forget packs of revisions that never made it into the manifest
+			try {
+				packs.DiscardPacksAfter (LoadManifest ().Revision);
+			} catch (Exception e) {
+				Logger.Warn ("Error discarding packs of a failed sync: {0}", e.Message);
+			}
+
 			// Delete the old lock file
 			Logger.Debug ("Sync: Deleting expired lockfile");
 			try {
@@ -581,12 +875,15 @@ namespace Tomboy.Sync
 				return false;
 
 			// TODO: Permissions errors
-			// Attempt to load the file and parse it as XML
+			// Attempt to parse the whole file as XML, without building a DOM
 			try {
-				using (FileStream fs = new FileStream (xmlFilePath, FileMode.Open)) {
-					XmlDocument doc = new XmlDocument ();
-					// TODO: Make this be a validating XML reader.  Not sure if it's validating yet.
-					doc.Load (fs);
+				using (FileStream fs = new FileStream (xmlFilePath, FileMode.Open,
+				                                       FileAccess.Read, FileShare.Read)) {
+					using (XmlReader xml = XmlReader.Create (fs)) {
+						// TODO: Make this be a validating XML reader.
+						while (xml.Read ())
+							;
+					}
 				}
 			} catch (Exception e) {
 				Logger.Debug ("Exception while validating lock file: " + e.ToString ());
@@ -607,8 +904,12 @@ namespace Tomboy.Sync
 		#region Private Event Handlers
 		private void LockTimeout (object sender, EventArgs args)
 		{
-			syncLock.RenewCount++;
-			UpdateLockFile (syncLock);
+			lock (lockFileLock) {
+				if (lockReleased)
+					return;
+				syncLock.RenewCount++;
+				UpdateLockFile (syncLock);
+			}
 			// Reset the timer to 20 seconds sooner than the sync lock duration
 			lockTimeout.Reset ((uint)syncLock.Duration.TotalMilliseconds - 20000);
 		}
@@ -0,0 +1,254 @@
+using System;
+using System.IO;
+using System.Security.Cryptography;
+using System.Text;
+using System.Collections.Generic;
+
+namespace Tomboy.Sync
+{
+	/// <summary>
+	/// Compact binary difference between two versions of a note, used to
+	/// send only what changed when both sides have the older version.
+	///
+	/// Works like rsync: the base is cut into fixed size blocks, and a
+	/// rolling hash over the target finds runs that can be copied from
+	/// the base.  Everything else is sent literally.  The result is:
+	///
+	///   "TDL1", SHA-1 of the base, SHA-1 of the target, then operations:
+	///     1 offset length     copy characters from the base
+	///     2 length bytes      insert UTF-8 text
+	///
+	/// with numbers as 7-bit variable length integers.  Apply checks both
+	/// hashes, so a delta against the wrong base is rejected rather than
+	/// producing a damaged note.
+	/// </summary>
+	public static class NoteDelta
+	{
+		const int blockSize = 32;
+		const byte copyOp = 1;
+		const byte insertOp = 2;
+		static readonly byte [] magic = Encoding.ASCII.GetBytes ("TDL1");
+
+		public static byte [] Create (string baseText, string targetText)
+		{
+			MemoryStream output = new MemoryStream ();
+			output.Write (magic, 0, magic.Length);
+			byte [] baseHash = Hash (baseText);
+			byte [] targetHash = Hash (targetText);
+			output.Write (baseHash, 0, baseHash.Length);
+			output.Write (targetHash, 0, targetHash.Length);
+
+			// Weak hash of every whole block in the base -> block offsets
+			Dictionary<uint, List<int>> blocks = new Dictionary<uint, List<int>> ();
+			for (int offset = 0; offset + blockSize <= baseText.Length; offset += blockSize) {
+				uint weak = WeakHash (baseText, offset);
+				List<int> offsets;
+				if (!blocks.TryGetValue (weak, out offsets)) {
+					offsets = new List<int> (1);
+					blocks [weak] = offsets;
+				}
+				offsets.Add (offset);
+			}
+
+			int literalStart = 0;
+			int i = 0;
+			uint a = 0, b = 0;
+			bool hashValid = false;
+
+			while (i + blockSize <= targetText.Length) {
+				if (!hashValid) {
+					InitRolling (targetText, i, out a, out b);
+					hashValid = true;
+				}
+
+				int matchOffset = -1;
+				int matchLength = 0;
+				List<int> candidates;
+				if (!char.IsLowSurrogate (targetText [i]) &&
+				    blocks.TryGetValue ((b << 16) | a, out candidates)) {
+					foreach (int candidate in candidates) {
+						int length = MatchLength (baseText, candidate, targetText, i);
+						if (length >= blockSize && length > matchLength) {
+							matchOffset = candidate;
+							matchLength = length;
+						}
+					}
+					// Never split a surrogate pair between a copy and a literal
+					if (matchLength > 0 && char.IsHighSurrogate (targetText [i + matchLength - 1]))
+						matchLength--;
+				}
+
+				if (matchLength >= blockSize) {
+					WriteLiteral (output, targetText, literalStart, i - literalStart);
+					output.WriteByte (copyOp);
+					WriteVarInt (output, matchOffset);
+					WriteVarInt (output, matchLength);
+					i += matchLength;
+					literalStart = i;
+					hashValid = false;
+				} else {
+					// Roll the window one character forward
+					if (i + blockSize < targetText.Length) {
+						uint outChar = targetText [i];
+						uint inChar = targetText [i + blockSize];
+						a = (a - outChar + inChar) & 0xffff;
+						b = (b - (uint) blockSize * outChar + a) & 0xffff;
+					}
+					i++;
+				}
+			}
+
+			WriteLiteral (output, targetText, literalStart, targetText.Length - literalStart);
+			return output.ToArray ();
+		}
+
+		/// <summary>
+		/// Rebuild the target from the base and a delta.  Throws
+		/// InvalidDataException if the delta doesn't belong to this base
+		/// or is damaged.
+		/// </summary>
+		public static string Apply (string baseText, byte [] delta)
+		{
+			MemoryStream input = new MemoryStream (delta, false);
+			byte [] header = ReadBytes (input, magic.Length);
+			for (int i = 0; i < magic.Length; i++) {
+				if (header [i] != magic [i])
+					throw new InvalidDataException ("Not a note delta");
+			}
+
+			byte [] baseHash = ReadBytes (input, 20);
+			byte [] targetHash = ReadBytes (input, 20);
+			if (!HashEquals (baseHash, Hash (baseText)))
+				throw new InvalidDataException ("Note delta was made against a different base");
+
+			StringBuilder target = new StringBuilder (baseText.Length);
+			int op;
+			while ((op = input.ReadByte ()) != -1) {
+				switch (op) {
+				case copyOp:
+					int offset = ReadVarInt (input);
+					int length = ReadVarInt (input);
+					if (offset < 0 || length < 0 || offset + length > baseText.Length)
+						throw new InvalidDataException ("Note delta copies past the end of the base");
+					target.Append (baseText, offset, length);
+					break;
+				case insertOp:
+					byte [] literal = ReadBytes (input, ReadVarInt (input));
+					target.Append (Encoding.UTF8.GetString (literal));
+					break;
+				default:
+					throw new InvalidDataException ("Unknown note delta operation " + op);
+				}
+			}
+
+			string result = target.ToString ();
+			if (!HashEquals (targetHash, Hash (result)))
+				throw new InvalidDataException ("Note delta produced the wrong text");
+			return result;
+		}
+
+		/// <summary>
+		/// SHA-1 of the UTF-8 encoding of text.
+		/// </summary>
+		public static byte [] Hash (string text)
+		{
+			using (SHA1 sha = SHA1.Create ())
+				return sha.ComputeHash (Encoding.UTF8.GetBytes (text));
+		}
+
+		public static string HashString (string text)
+		{
+			return Convert.ToBase64String (Hash (text));
+		}
+
+		static bool HashEquals (byte [] x, byte [] y)
+		{
+			if (x.Length != y.Length)
+				return false;
+			for (int i = 0; i < x.Length; i++) {
+				if (x [i] != y [i])
+					return false;
+			}
+			return true;
+		}
+
+		static uint WeakHash (string text, int offset)
+		{
+			uint a, b;
+			InitRolling (text, offset, out a, out b);
+			return (b << 16) | a;
+		}
+
+		static void InitRolling (string text, int offset, out uint a, out uint b)
+		{
+			a = 0;
+			b = 0;
+			for (int k = 0; k < blockSize; k++) {
+				uint c = text [offset + k];
+				a += c;
+				b += (uint) (blockSize - k) * c;
+			}
+			a &= 0xffff;
+			b &= 0xffff;
+		}
+
+		static int MatchLength (string baseText, int baseOffset, string targetText, int targetOffset)
+		{
+			int length = 0;
+			while (baseOffset + length < baseText.Length &&
+			       targetOffset + length < targetText.Length &&
+			       baseText [baseOffset + length] == targetText [targetOffset + length])
+				length++;
+			return length;
+		}
+
+		static void WriteLiteral (Stream output, string text, int start, int length)
+		{
+			if (length <= 0)
+				return;
+			byte [] bytes = Encoding.UTF8.GetBytes (text.Substring (start, length));
+			output.WriteByte (insertOp);
+			WriteVarInt (output, bytes.Length);
+			output.Write (bytes, 0, bytes.Length);
+		}
+
+		static void WriteVarInt (Stream output, int value)
+		{
+			uint v = (uint) value;
+			while (v >= 0x80) {
+				output.WriteByte ((byte) (v | 0x80));
+				v >>= 7;
+			}
+			output.WriteByte ((byte) v);
+		}
+
+		static int ReadVarInt (Stream input)
+		{
+			int result = 0;
+			for (int shift = 0; shift < 32; shift += 7) {
+				int b = input.ReadByte ();
+				if (b == -1)
+					throw new InvalidDataException ("Truncated note delta");
+				result |= (b & 0x7f) << shift;
+				if ((b & 0x80) == 0)
+					return result;
+			}
+			throw new InvalidDataException ("Bad number in note delta");
+		}
+
+		static byte [] ReadBytes (Stream input, int count)
+		{
+			if (count < 0)
+				throw new InvalidDataException ("Bad length in note delta");
+			byte [] bytes = new byte [count];
+			int read = 0;
+			while (read < count) {
+				int n = input.Read (bytes, read, count - read);
+				if (n == 0)
+					throw new InvalidDataException ("Truncated note delta");
+				read += n;
+			}
+			return bytes;
+		}
+	}
+}
@@ -0,0 +1,331 @@
+using System;
+using System.IO;
+using System.Text;
+using System.Collections.Generic;
+
+namespace Tomboy.Sync
+{
+	/// <summary>
+	/// Optional pack storage for a file system sync server.  Instead of
+	/// one file per note per revision, each revision's uploaded notes are
+	/// appended to a single pack file in the server's "packs" directory,
+	/// with a small text index next to it:
+	///
+	///   packs/rev-42.pack   the note files, back to back
+	///   packs/rev-42.idx    one "id TAB rev TAB offset TAB length" line per note
+	///
+	/// A pack is only visible once its index exists, and indexes are
+	/// written under a temporary name and renamed into place, so readers
+	/// never see half-written packs.  Repack merges all packs into one,
+	/// dropping notes the manifest no longer refers to.
+	///
+	/// Revision directories and their manifest.xml are kept as before;
+	/// only the note files move.  Notes can be in a pack or in their
+	/// revision directory, so servers with mixed layouts read fine.
+	/// </summary>
+	public class NotePackStore
+	{
+		public const string PackDirectoryName = "packs";
+		const string packExtension = ".pack";
+		const string indexExtension = ".idx";
+
+		struct PackEntry
+		{
+			public string PackPath;
+			public long Offset;
+			public int Length;
+		}
+
+		readonly string packDir;
+		readonly Action<string> adjustPermissions;
+
+		// Keyed on "id/rev"
+		Dictionary<string, PackEntry> index;
+
+		public NotePackStore (string serverPath, Action<string> adjustPermissions)
+		{
+			packDir = Path.Combine (serverPath, PackDirectoryName);
+			this.adjustPermissions = adjustPermissions;
+		}
+
+		/// <summary>
+		/// Whether this server has ever stored notes in packs.
+		/// </summary>
+		public bool Exists
+		{
+			get {
+				return Directory.Exists (packDir);
+			}
+		}
+
+		/// <summary>
+		/// Number of packs with an index.
+		/// </summary>
+		public int PackCount
+		{
+			get {
+				if (!Exists)
+					return 0;
+				return Directory.GetFiles (packDir, "*" + indexExtension).Length;
+			}
+		}
+
+		static string Key (string id, int rev)
+		{
+			return id + "/" + rev.ToString ();
+		}
+
+		/// <summary>
+		/// Read the index of every pack.  Done automatically on first
+		/// use; call it before reading from several threads at once.
+		/// </summary>
+		public void LoadIndex ()
+		{
+			Dictionary<string, PackEntry> newIndex = new Dictionary<string, PackEntry> ();
+
+			if (Exists) {
+				foreach (string indexPath in Directory.GetFiles (packDir, "*" + indexExtension)) {
+					string packPath = Path.ChangeExtension (indexPath, packExtension);
+					if (!File.Exists (packPath))
+						continue;
+					try {
+						ReadIndex (indexPath, packPath, newIndex);
+					} catch (Exception e) {
+						Logger.Warn ("Sync: Ignoring unreadable pack index {0}: {1}",
+						             indexPath, e.Message);
+					}
+				}
+			}
+
+			index = newIndex;
+		}
+
+		static void ReadIndex (string indexPath, string packPath,
+		                       Dictionary<string, PackEntry> into)
+		{
+			using (StreamReader reader = new StreamReader (indexPath, Encoding.UTF8)) {
+				string line;
+				while ((line = reader.ReadLine ()) != null) {
+					if (line.Length == 0)
+						continue;
+					string [] fields = line.Split ('\t');
+					if (fields.Length != 4)
+						throw new FormatException ("Bad pack index line: " + line);
+
+					PackEntry entry;
+					entry.PackPath = packPath;
+					entry.Offset = long.Parse (fields [2]);
+					entry.Length = int.Parse (fields [3]);
+					into [Key (fields [0], int.Parse (fields [1]))] = entry;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Read the note with the given id as of the given revision, or
+		/// return null if no pack has it.
+		/// </summary>
+		public string ReadNote (string id, int rev)
+		{
+			byte [] data = ReadNoteBytes (id, rev);
+			if (data == null)
+				return null;
+
+			// Same encoding detection as reading the note file directly
+			using (StreamReader reader = new StreamReader (new MemoryStream (data)))
+				return reader.ReadToEnd ();
+		}
+
+		byte [] ReadNoteBytes (string id, int rev)
+		{
+			if (index == null)
+				LoadIndex ();
+
+			PackEntry entry;
+			if (!index.TryGetValue (Key (id, rev), out entry))
+				return null;
+
+			byte [] data = new byte [entry.Length];
+			using (FileStream fs = new FileStream (entry.PackPath, FileMode.Open,
+			                                       FileAccess.Read, FileShare.Read)) {
+				fs.Seek (entry.Offset, SeekOrigin.Begin);
+				int read = 0;
+				while (read < data.Length) {
+					int count = fs.Read (data, read, data.Length - read);
+					if (count == 0)
+						throw new EndOfStreamException (
+							string.Format ("Pack {0} is truncated", entry.PackPath));
+					read += count;
+				}
+			}
+			return data;
+		}
+
+		/// <summary>
+		/// Start the pack for a new revision.  Nothing is visible to
+		/// readers until the writer is committed.
+		/// </summary>
+		public PackWriter CreatePack (int rev)
+		{
+			return CreatePack ("rev-" + rev.ToString ());
+		}
+
+		PackWriter CreatePack (string name)
+		{
+			if (!Exists) {
+				Directory.CreateDirectory (packDir);
+				adjustPermissions (packDir);
+			}
+			return new PackWriter (Path.Combine (packDir, name + packExtension),
+			                       Path.Combine (packDir, name + indexExtension),
+			                       adjustPermissions);
+		}
+
+		/// <summary>
+		/// Delete the packs of revisions newer than rev.  Used when a
+		/// failed sync is cleaned up, so that a pack committed just before
+		/// the crash can't shadow notes another client later stores under
+		/// the same revision number.
+		/// </summary>
+		public void DiscardPacksAfter (int rev)
+		{
+			if (!Exists)
+				return;
+
+			foreach (string indexPath in Directory.GetFiles (packDir, "rev-*" + indexExtension)) {
+				int packRev;
+				string name = Path.GetFileNameWithoutExtension (indexPath);
+				if (!int.TryParse (name.Substring ("rev-".Length), out packRev) || packRev <= rev)
+					continue;
+
+				Logger.Debug ("Sync: Discarding pack of uncommitted revision {0}", packRev);
+				File.Delete (indexPath);
+				File.Delete (Path.ChangeExtension (indexPath, packExtension));
+			}
+			index = null;
+		}
+
+		/// <summary>
+		/// Merge every pack into a single new one, keeping only the notes
+		/// the manifest still points at, then delete the old packs.  Must
+		/// be called with the server locked.  If interrupted, the old
+		/// packs are still there and the next repack tidies up.
+		/// </summary>
+		public void Repack (ServerManifest manifest)
+		{
+			if (!Exists)
+				return;
+
+			LoadIndex ();
+			string [] oldIndexes = Directory.GetFiles (packDir, "*" + indexExtension);
+			string [] oldPacks = Directory.GetFiles (packDir, "*" + packExtension);
+
+			// Every revision at or below the manifest's has been committed;
+			// anything newer in a pack was left behind by a failed sync.
+			int keptNotes = 0;
+			PackWriter writer = CreatePack (string.Format ("base-{0}-{1}",
+			                                               manifest.Revision,
+			                                               DateTime.UtcNow.Ticks));
+			try {
+				foreach (string id in manifest.NoteIds) {
+					int rev = manifest.GetNoteRevision (id);
+					byte [] data = ReadNoteBytes (id, rev);
+					if (data == null)
+						continue; // In a revision directory
+					writer.Add (id, rev, data);
+					keptNotes++;
+				}
+				writer.Commit ();
+			} finally {
+				writer.Dispose ();
+			}
+
+			// Indexes first, so no reader ever sees an index without its pack
+			foreach (string path in oldIndexes)
+				File.Delete (path);
+			foreach (string path in oldPacks)
+				File.Delete (path);
+
+			LoadIndex ();
+			Logger.Debug ("Sync: Repacked {0} packs into one with {1} notes",
+			              oldIndexes.Length, keptNotes);
+		}
+
+		/// <summary>
+		/// Appends notes to a pack and writes its index on commit.
+		/// </summary>
+		public class PackWriter : IDisposable
+		{
+			readonly string packPath;
+			readonly string indexPath;
+			readonly Action<string> adjustPermissions;
+			readonly StringBuilder indexLines;
+			FileStream stream;
+
+			internal PackWriter (string packPath, string indexPath,
+			                     Action<string> adjustPermissions)
+			{
+				this.packPath = packPath;
+				this.indexPath = indexPath;
+				this.adjustPermissions = adjustPermissions;
+				indexLines = new StringBuilder ();
+
+				// A leftover index from a failed attempt at this
+				// revision would point into the pack we are about to
+				// overwrite.
+				if (File.Exists (indexPath))
+					File.Delete (indexPath);
+				stream = new FileStream (packPath, FileMode.Create, FileAccess.Write);
+			}
+
+			public void Add (string id, int rev, string localPath)
+			{
+				Add (id, rev, File.ReadAllBytes (localPath));
+			}
+
+			public void Add (string id, int rev, byte [] data)
+			{
+				long offset = stream.Position;
+				stream.Write (data, 0, data.Length);
+				indexLines.AppendFormat ("{0}\t{1}\t{2}\t{3}\n", id, rev, offset, data.Length);
+			}
+
+			/// <summary>
+			/// Flush the pack to disk and publish its index.
+			/// </summary>
+			public void Commit ()
+			{
+				stream.Flush (true);
+				stream.Close ();
+				stream = null;
+				adjustPermissions (packPath);
+
+				string tmpPath = indexPath + ".tmp";
+				using (FileStream fs = new FileStream (tmpPath, FileMode.Create, FileAccess.Write)) {
+					byte [] data = new UTF8Encoding (false).GetBytes (indexLines.ToString ());
+					fs.Write (data, 0, data.Length);
+					fs.Flush (true);
+				}
+				File.Move (tmpPath, indexPath);
+				adjustPermissions (indexPath);
+			}
+
+			/// <summary>
+			/// Close the pack.  If it wasn't committed it is deleted.
+			/// </summary>
+			public void Dispose ()
+			{
+				if (stream != null) {
+					stream.Close ();
+					stream = null;
+					try {
+						File.Delete (packPath);
+					} catch (Exception e) {
+						Logger.Debug ("Sync: Could not delete abandoned pack {0}: {1}",
+						              packPath, e.Message);
+					}
+				}
+			}
+		}
+	}
+}
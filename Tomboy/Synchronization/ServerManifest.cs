@@ -0,0 +1,373 @@
+using System;
+using System.IO;
+using System.Xml;
+using System.Collections.Generic;
+
+namespace Tomboy.Sync
+{
+	/// <summary>
+	/// In-memory index of a file system sync server's manifest.xml.
+	/// Maps note ids to the revision they were last changed in, keeps
+	/// the order of the file so that rewriting an unchanged manifest
+	/// gives the same bytes, and answers "changed since" queries from a
+	/// revision-sorted view that is built on first use.
+	///
+	/// The file is read and written with XmlReader/XmlWriter, never
+	/// loaded into an XmlDocument.  The format is:
+	///
+	///   &lt;sync revision="N" server-id="..." format="..."&gt;
+	///     &lt;note id="..." rev="..." hash="..." delta-base="..." /&gt;
+	///   &lt;/sync&gt;
+	///
+	/// The hash attribute is the NoteContentHash of the uploaded note.
+	/// It is optional: older clients neither write nor keep it, so a
+	/// note they touched simply has no hash until it is uploaded again.
+	/// delta-base is set when a NoteDelta against that earlier revision
+	/// of the note was stored next to it.
+	///
+	/// The format attribute is only present on servers that use
+	/// NotePackStore, and clients refuse formats they don't know before
+	/// reading any note.  Such manifests also put their elements in the
+	/// PackNamespace, except for one empty "sync" element in no
+	/// namespace whose revision is LegacyRevision.  Clients from before
+	/// packs find only that element, fail to parse its revision and
+	/// refuse to open the server, instead of throwing on a missing
+	/// element or taking the server for an empty one and writing a
+	/// manifest of their own over it.
+	/// </summary>
+	public class ServerManifest
+	{
+		/// <summary>
+		/// Format of servers that may keep notes in packs.
+		/// </summary>
+		public const string PackFormat = "pack-1";
+
+		/// <summary>
+		/// Namespace of the elements of manifests that have a format.
+		/// </summary>
+		public const string PackNamespace = "http://beatniksoftware.com/tomboy/sync/pack-1";
+
+		/// <summary>
+		/// Revision given to clients from before packs.  Not a number,
+		/// so that they stop while opening the server.
+		/// </summary>
+		public const string LegacyRevision = "server-format-too-new";
+
+		int revision;
+		string serverId;
+		string format;
+
+		List<string> noteIds;
+		Dictionary<string, int> noteRevisions;
+		Dictionary<string, string> noteHashes;
+		Dictionary<string, int> noteDeltaBases;
+
+		// Lazily built, sorted by revision, then id
+		KeyValuePair<string, int> [] sortedByRevision;
+
+		public ServerManifest ()
+		{
+			revision = -1;
+			noteIds = new List<string> ();
+			noteRevisions = new Dictionary<string, int> ();
+			noteHashes = new Dictionary<string, string> ();
+			noteDeltaBases = new Dictionary<string, int> ();
+		}
+
+		/// <summary>
+		/// Read a manifest file.  Returns null if the file does not
+		/// exist or is not well-formed XML.
+		/// </summary>
+		public static ServerManifest TryRead (string manifestPath)
+		{
+			if (!File.Exists (manifestPath))
+				return null;
+
+			try {
+				return Read (manifestPath);
+			} catch (Exception e) {
+				Logger.Debug ("Exception while reading manifest {0}: {1}",
+				              manifestPath, e.Message);
+				return null;
+			}
+		}
+
+		/// <summary>
+		/// Read a manifest file, throwing XmlException if it is not
+		/// well-formed.
+		/// </summary>
+		public static ServerManifest Read (string manifestPath)
+		{
+			using (FileStream fs = new FileStream (manifestPath, FileMode.Open,
+			                                       FileAccess.Read, FileShare.Read))
+				return Read (fs);
+		}
+
+		public static ServerManifest Read (Stream stream)
+		{
+			ServerManifest manifest = new ServerManifest ();
+			XmlReaderSettings settings = new XmlReaderSettings ();
+			settings.IgnoreComments = true;
+			settings.IgnoreWhitespace = true;
+			settings.IgnoreProcessingInstructions = true;
+
+			using (XmlReader xml = XmlReader.Create (stream, settings)) {
+				// Read all the way through, so that truncated or otherwise
+				// broken files are rejected just like XmlDocument.Load did.
+				while (xml.Read ()) {
+					if (xml.NodeType != XmlNodeType.Element)
+						continue;
+
+					switch (xml.LocalName) {
+					case "sync":
+						// Only the root; the one for old clients is ignored
+						if (xml.Depth > 0)
+							break;
+						int rev;
+						if (Int32.TryParse (xml.GetAttribute ("revision"), out rev))
+							manifest.revision = rev;
+						string id = xml.GetAttribute ("server-id");
+						if (!string.IsNullOrEmpty (id))
+							manifest.serverId = id;
+						manifest.format = xml.GetAttribute ("format");
+						break;
+					case "note":
+						string noteId = xml.GetAttribute ("id");
+						int noteRev;
+						if (noteId == null ||
+						    !Int32.TryParse (xml.GetAttribute ("rev"), out noteRev))
+							break;
+						// First entry wins, as with the old XPath lookups
+						if (manifest.noteRevisions.ContainsKey (noteId))
+							break;
+						int deltaBase;
+						if (!Int32.TryParse (xml.GetAttribute ("delta-base"), out deltaBase))
+							deltaBase = -1;
+						manifest.SetNoteRevision (noteId, noteRev,
+						                          xml.GetAttribute ("hash"), deltaBase);
+						break;
+					}
+				}
+			}
+
+			return manifest;
+		}
+
+		public void Write (string manifestPath)
+		{
+			XmlWriter xml = XmlWriter.Create (manifestPath, XmlEncoder.DocumentSettings);
+			try {
+				Write (xml);
+			} finally {
+				xml.Close ();
+			}
+		}
+
+		public void Write (XmlWriter xml)
+		{
+			xml.WriteStartDocument ();
+			xml.WriteStartElement (null, "sync", format != null ? PackNamespace : null);
+			xml.WriteAttributeString ("revision", revision.ToString ());
+			xml.WriteAttributeString ("server-id", serverId);
+			if (format != null)
+				xml.WriteAttributeString ("format", format);
+
+			if (format != null) {
+				xml.WriteStartElement (null, "sync", string.Empty);
+				xml.WriteAttributeString ("revision", LegacyRevision);
+				xml.WriteEndElement ();
+			}
+
+			foreach (string id in noteIds) {
+				xml.WriteStartElement (null, "note", null);
+				xml.WriteAttributeString ("id", id);
+				xml.WriteAttributeString ("rev", noteRevisions [id].ToString ());
+				string hash;
+				if (noteHashes.TryGetValue (id, out hash))
+					xml.WriteAttributeString ("hash", hash);
+				int deltaBase;
+				if (noteDeltaBases.TryGetValue (id, out deltaBase))
+					xml.WriteAttributeString ("delta-base", deltaBase.ToString ());
+				xml.WriteEndElement ();
+			}
+
+			xml.WriteEndElement ();
+			xml.WriteEndDocument ();
+		}
+
+		/// <summary>
+		/// Revision of the server this manifest describes, or -1 if unknown.
+		/// </summary>
+		public int Revision
+		{
+			get {
+				return revision;
+			}
+			set {
+				revision = value;
+			}
+		}
+
+		public string ServerId
+		{
+			get {
+				return serverId;
+			}
+			set {
+				serverId = value;
+			}
+		}
+
+		/// <summary>
+		/// Storage format of the server, or null for the classic
+		/// one-file-per-note layout.
+		/// </summary>
+		public string Format
+		{
+			get {
+				return format;
+			}
+			set {
+				format = value;
+			}
+		}
+
+		/// <summary>
+		/// Whether this client can read and write a server of the
+		/// manifest's format.
+		/// </summary>
+		public bool IsFormatSupported
+		{
+			get {
+				return format == null || format == PackFormat;
+			}
+		}
+
+		public int Count
+		{
+			get {
+				return noteIds.Count;
+			}
+		}
+
+		/// <summary>
+		/// Note ids in manifest order.
+		/// </summary>
+		public IList<string> NoteIds
+		{
+			get {
+				return noteIds.AsReadOnly ();
+			}
+		}
+
+		public bool ContainsNote (string id)
+		{
+			return noteRevisions.ContainsKey (id);
+		}
+
+		/// <summary>
+		/// Revision a note was last changed in, or -1 if it's not on
+		/// the server.
+		/// </summary>
+		public int GetNoteRevision (string id)
+		{
+			int rev;
+			if (noteRevisions.TryGetValue (id, out rev))
+				return rev;
+			return -1;
+		}
+
+		/// <summary>
+		/// Content hash recorded for a note when it was uploaded, or null
+		/// if there is none.
+		/// </summary>
+		public string GetNoteHash (string id)
+		{
+			string hash;
+			if (noteHashes.TryGetValue (id, out hash))
+				return hash;
+			return null;
+		}
+
+		/// <summary>
+		/// Revision that the note's stored delta applies to, or -1 if it
+		/// has none.
+		/// </summary>
+		public int GetNoteDeltaBase (string id)
+		{
+			int deltaBase;
+			if (noteDeltaBases.TryGetValue (id, out deltaBase))
+				return deltaBase;
+			return -1;
+		}
+
+		/// <summary>
+		/// Add a note, or update its revision in place if it's already
+		/// in the manifest.  Any recorded content hash or delta is dropped.
+		/// </summary>
+		public void SetNoteRevision (string id, int rev)
+		{
+			SetNoteRevision (id, rev, null, -1);
+		}
+
+		public void SetNoteRevision (string id, int rev, string hash)
+		{
+			SetNoteRevision (id, rev, hash, -1);
+		}
+
+		public void SetNoteRevision (string id, int rev, string hash, int deltaBase)
+		{
+			if (!noteRevisions.ContainsKey (id))
+				noteIds.Add (id);
+			noteRevisions [id] = rev;
+			if (string.IsNullOrEmpty (hash))
+				noteHashes.Remove (id);
+			else
+				noteHashes [id] = hash;
+			if (deltaBase < 0)
+				noteDeltaBases.Remove (id);
+			else
+				noteDeltaBases [id] = deltaBase;
+			sortedByRevision = null;
+		}
+
+		/// <summary>
+		/// All notes changed after the given revision, oldest change first.
+		/// </summary>
+		public IList<KeyValuePair<string, int>> GetNoteRevisionsSince (int sinceRevision)
+		{
+			if (sortedByRevision == null) {
+				sortedByRevision = new KeyValuePair<string, int> [noteIds.Count];
+				for (int i = 0; i < noteIds.Count; i++)
+					sortedByRevision [i] =
+						new KeyValuePair<string, int> (noteIds [i], noteRevisions [noteIds [i]]);
+				Array.Sort (sortedByRevision, CompareByRevision);
+			}
+
+			// Find the first entry with rev > sinceRevision
+			int lo = 0;
+			int hi = sortedByRevision.Length;
+			while (lo < hi) {
+				int mid = lo + (hi - lo) / 2;
+				if (sortedByRevision [mid].Value <= sinceRevision)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+
+			List<KeyValuePair<string, int>> changed =
+				new List<KeyValuePair<string, int>> (sortedByRevision.Length - lo);
+			for (int i = lo; i < sortedByRevision.Length; i++)
+				changed.Add (sortedByRevision [i]);
+			return changed;
+		}
+
+		static int CompareByRevision (KeyValuePair<string, int> a, KeyValuePair<string, int> b)
+		{
+			int result = a.Value.CompareTo (b.Value);
+			if (result == 0)
+				result = string.CompareOrdinal (a.Key, b.Key);
+			return result;
+		}
+	}
+}
@@ -0,0 +1,153 @@
+using System;
+using System.IO;
+using System.Text;
+using System.Collections.Generic;
+
+namespace Tomboy.Sync
+{
+	/// <summary>
+	/// The XML of each note as it was last synchronized, along with the
+	/// server revision it was synchronized at.  Sync servers use it as the
+	/// base for NoteDelta transfers.  It's only a cache: if a base is
+	/// missing or doesn't match, notes are sent whole.
+	///
+	/// Bases are kept as "id.rev.note" files in the sync_base directory
+	/// of the cache directory.
+	/// </summary>
+	public class SyncBaseStore
+	{
+		static SyncBaseStore instance;
+		static readonly object instanceLock = new object ();
+
+		readonly string basePath;
+		readonly object storeLock = new object ();
+
+		// id -> revision of the stored base; loaded on first use
+		Dictionary<string, int> revisions;
+
+		public static SyncBaseStore Instance
+		{
+			get {
+				lock (instanceLock) {
+					if (instance == null)
+						instance = new SyncBaseStore (
+							Path.Combine (Services.NativeApplication.CacheDirectory, "sync_base"));
+					return instance;
+				}
+			}
+		}
+
+		public SyncBaseStore (string basePath)
+		{
+			this.basePath = basePath;
+		}
+
+		Dictionary<string, int> Revisions
+		{
+			get {
+				if (revisions == null) {
+					revisions = new Dictionary<string, int> ();
+					if (Directory.Exists (basePath)) {
+						foreach (string path in Directory.GetFiles (basePath, "*.note")) {
+							// id.rev.note
+							string name = Path.GetFileNameWithoutExtension (path);
+							int dot = name.LastIndexOf ('.');
+							int rev;
+							if (dot > 0 && int.TryParse (name.Substring (dot + 1), out rev))
+								revisions [name.Substring (0, dot)] = rev;
+						}
+					}
+				}
+				return revisions;
+			}
+		}
+
+		string GetPath (string id, int rev)
+		{
+			return Path.Combine (basePath, id + "." + rev.ToString () + ".note");
+		}
+
+		/// <summary>
+		/// Revision of the stored base for a note, or -1 if there is none.
+		/// </summary>
+		public int GetRevision (string id)
+		{
+			lock (storeLock) {
+				int rev;
+				if (Revisions.TryGetValue (id, out rev))
+					return rev;
+				return -1;
+			}
+		}
+
+		/// <summary>
+		/// The stored base for a note, or null if there is none or it
+		/// can't be read.
+		/// </summary>
+		public string Get (string id)
+		{
+			int rev = GetRevision (id);
+			if (rev < 0)
+				return null;
+
+			try {
+				using (StreamReader reader = new StreamReader (GetPath (id, rev), Encoding.UTF8))
+					return reader.ReadToEnd ();
+			} catch (Exception e) {
+				Logger.Debug ("Sync: Could not read base of note {0}: {1}", id, e.Message);
+				return null;
+			}
+		}
+
+		public void Put (string id, int rev, string noteXml)
+		{
+			lock (storeLock) {
+				try {
+					if (!Directory.Exists (basePath))
+						Directory.CreateDirectory (basePath);
+
+					int oldRev;
+					if (Revisions.TryGetValue (id, out oldRev) && oldRev != rev)
+						File.Delete (GetPath (id, oldRev));
+
+					using (StreamWriter writer = new StreamWriter (GetPath (id, rev), false,
+					                                               new UTF8Encoding (false)))
+						writer.Write (noteXml);
+					Revisions [id] = rev;
+				} catch (Exception e) {
+					// Only costs bandwidth next time
+					Logger.Debug ("Sync: Could not store base of note {0}: {1}", id, e.Message);
+					Revisions.Remove (id);
+				}
+			}
+		}
+
+		public void Remove (string id)
+		{
+			lock (storeLock) {
+				int rev;
+				if (!Revisions.TryGetValue (id, out rev))
+					return;
+				Revisions.Remove (id);
+				try {
+					File.Delete (GetPath (id, rev));
+				} catch (Exception e) {
+					Logger.Debug ("Sync: Could not delete base of note {0}: {1}", id, e.Message);
+				}
+			}
+		}
+
+		public void Clear ()
+		{
+			lock (storeLock) {
+				revisions = null;
+				try {
+					if (Directory.Exists (basePath))
+						Directory.Delete (basePath, true);
+				} catch (Exception e) {
+					Logger.Debug ("Sync: Could not clear note bases: {0}", e.Message);
+				}
+			}
+		}
+	}
+}
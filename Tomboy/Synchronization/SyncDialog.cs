@@ -375,9 +375,9 @@ namespace Tomboy.Sync
 					new SyncTitleConflictDialog (localConflictNote, noteUpdateTitles);
 					Gtk.ResponseType reponse = Gtk.ResponseType.Ok;
 
-					bool noteSyncBitsMatch =
-					        SyncManager.SynchronizedNoteXmlMatches (localConflictNote.GetCompleteNoteXml (),
-					                                                remoteNote.XmlContent);
+					string remoteHash = remoteNote.ContentHash;
+					bool noteSyncBitsMatch = remoteHash != null &&
+					        remoteHash == NoteContentHash.Compute (localConflictNote.Data);
 
 					// If the synchronized note content is in conflict
 					// and there is no saved conflict handling behavior, show the dialog
@@ -121,6 +121,7 @@ namespace Tomboy.Sync
 		private static ISyncUI syncUI;
 		private static SyncClient client;
 		private static SyncState state = SyncState.Idle;
+		private static TraceSpan stateSpan;
 		private static Thread syncThread = null;
 		// TODO: Expose the next enum more publicly
 		private static SyncTitleConflictResolution conflictResolution;
@@ -195,15 +196,20 @@ namespace Tomboy.Sync
 			}
 
 			Preferences.SettingChanged += Preferences_SettingChanged;
-			NoteMgr.NoteSaved += (n) => HandleNoteSavedOrDeleted ();
-			NoteMgr.NoteDeleted += (o, n) => HandleNoteSavedOrDeleted ();
+			NoteMgr.NoteSaved += (n) => HandleNoteSavedOrDeleted (1);
+			NoteMgr.NoteDeleted += (o, n) => HandleNoteSavedOrDeleted (1);
+			// Imported notes are written without a NoteSaved
+			NoteMgr.NotesImported += (o, imported) => HandleNoteSavedOrDeleted (imported.Count);
 
 			// Update sync item based on configuration.
 			UpdateSyncAction ();
 		}
 
-		static void HandleNoteSavedOrDeleted ()
+		static void HandleNoteSavedOrDeleted (int count)
 		{
+			// Before the first count, the scan in ClientHasUpdates sees them
+			if (dirtyNoteCount >= 0)
+				Interlocked.Add (ref dirtyNoteCount, count);
 			if (syncThread == null && autosyncTimer != null && autosyncTimeoutPrefMinutes > 0) {
 				TimeSpan timeSinceLastCheck =
 					DateTime.Now - lastBackgroundCheck;
@@ -248,18 +254,100 @@ namespace Tomboy.Sync
 			}
 		}
 
+		static void HandleServerManifestChanged (object sender, EventArgs args)
+		{
+			// Our own commits don't get here; see SynchronizationThread
+			if (syncThread != null || autosyncTimeoutPrefMinutes <= 0)
+				return;
+
+			Logger.Debug ("Sync server manifest changed...checking for updates in a minute");
+			lastBackgroundCheck = DateTime.Now;
+			currentAutosyncTimeoutMinutes = 1;
+			if (autosyncTimer != null)
+				autosyncTimer.Change (currentAutosyncTimeoutMinutes * 60000,
+				                      autosyncTimeoutPrefMinutes * 60000);
+			else
+				autosyncTimer = new Timer ((o) => BackgroundSyncChecker (),
+				                           null,
+				                           currentAutosyncTimeoutMinutes * 60000,
+				                           autosyncTimeoutPrefMinutes * 60000);
+		}
+
 		static void Preferences_SettingChanged (object sender, EventArgs args)
 		{
 			// Update sync item based on configuration.
 			UpdateSyncAction ();
 		}
 
+		/// <summary>
+		/// Watch the configured server's manifest if it is on a local
+		/// file system and autosync is on; stop watching otherwise.
+		/// </summary>
+		static void UpdateServerWatcher ()
+		{
+			string path = null;
+			if (autosyncTimeoutPrefMinutes > 0) {
+				SyncServiceAddin addin = GetConfiguredSyncService ();
+				if (addin != null)
+					path = addin.WatchablePath;
+			}
+
+			if (serverWatcher != null) {
+				if (serverWatcher.ServerPath == path)
+					return;
+				serverWatcher.Dispose ();
+				serverWatcher = null;
+			}
+
+			if (path == null || !Directory.Exists (path))
+				return;
+
+			try {
+				serverWatcher = new SyncServerWatcher (path);
+				serverWatcher.ManifestChanged += HandleServerManifestChanged;
+				Logger.Debug ("Watching {0} for changes by other clients", path);
+			} catch (Exception e) {
+				// Polling still works
+				Logger.Debug ("Could not watch sync server {0}: {1}", path, e.Message);
+				serverWatcher = null;
+			}
+		}
+
+		/// <summary>
+		/// Whether any note was changed or deleted since the last
+		/// sync.  Usually just reads dirtyNoteCount; only the
+		/// first check after startup has to look at every note.
+		/// </summary>
+		static bool ClientHasUpdates ()
+		{
+			if (client.DeletedNoteTitles.Count > 0)
+				return true;
+
+			if (dirtyNoteCount < 0) {
+				int dirty = 0;
+				foreach (Note note in new List<Note> (NoteMgr.Notes)) {
+					if (client.GetRevision (note) == -1 ||
+					    note.MetadataChangeDate > client.LastSyncDate) {
+						dirty = 1;
+						break;
+					}
+				}
+				// Keep any saves that raced with the scan
+				Interlocked.CompareExchange (ref dirtyNoteCount, dirty, -1);
+			}
+			return dirtyNoteCount != 0;
+		}
+
 		private static Timer autosyncTimer;
 		private static int autosyncTimeoutPrefMinutes = -1;
 		// This may differ from the pref, if some logic has determined
 		// that the next background check should occur in, say, 1 minute
 		private static int currentAutosyncTimeoutMinutes = -1;
 		private static DateTime lastBackgroundCheck;
+		private static SyncServerWatcher serverWatcher;
+		// Notes saved, deleted or imported since the last sync; -1 until
+		// the first check after startup has counted them.
+		private static int dirtyNoteCount = -1;
 
 		static void UpdateSyncAction ()
 		{
@@ -287,6 +375,8 @@ namespace Tomboy.Sync
 					NoteMgr.NoteBufferChanged += HandleNoteBufferChanged;
 				}
 			}
+
+			UpdateServerWatcher ();
 		}
 
 		static void BackgroundSyncChecker ()
@@ -295,6 +385,16 @@ namespace Tomboy.Sync
 			currentAutosyncTimeoutMinutes = autosyncTimeoutPrefMinutes;
 			if (syncThread != null)
 				return;
+			bool clientHasUpdates = ClientHasUpdates ();
+
+			// A watched server tells us when it changes, so with nothing
+			// to upload there's no need to even connect.
+			SyncServerWatcher watcher = serverWatcher;
+			if (watcher != null && !watcher.TakeChange () && !clientHasUpdates) {
+				Logger.Debug ("BackgroundSyncChecker: No local or server changes");
+				return;
+			}
+
 			var addin = GetConfiguredSyncService ();
 			if (addin != null) {
 				// TODO: block sync while checking
@@ -310,16 +410,6 @@ namespace Tomboy.Sync
 					// TODO: Figure out a clever way to get the specific error up to the GUI
 				}
 				bool serverHasUpdates = false;
-				bool clientHasUpdates = client.DeletedNoteTitles.Count > 0;
-				if (!clientHasUpdates) {
-					foreach (Note note in new List<Note> (NoteMgr.Notes)) {
-						if (client.GetRevision (note) == -1 ||
-						    note.MetadataChangeDate > client.LastSyncDate) {
-							clientHasUpdates = true;
-							break;
-						}
-					}
-				}
 
 				// NOTE: Important to check, at least to verify
 				//       that server is available
@@ -351,6 +441,18 @@ namespace Tomboy.Sync
 				Logger.Debug ("Error deleting client manifest during reset: {1}",
 				              e.Message);
 			}
+			SyncBaseStore.Instance.Clear ();
+		}
+
+		/// <summary>
+		/// Whether sync servers may send notes as NoteDelta against the
+		/// copies in SyncBaseStore, and so whether those are kept.
+		/// </summary>
+		public static bool DeltaTransferEnabled
+		{
+			get {
+				return (bool) Preferences.Get (Preferences.SYNC_DELTA_TRANSFER);
+			}
 		}
 
 		public static void PerformSynchronization (ISyncUI syncUI)
@@ -379,6 +481,10 @@ namespace Tomboy.Sync
 			SyncServiceAddin addin = null;
 			SyncServer server = null;
 			suspendEvent.Reset();
+			// Don't take our own commit for another client's
+			SyncServerWatcher watcher = serverWatcher;
+			if (watcher != null)
+				watcher.BeginOwnChange ();
 			try {
 
 				addin = GetConfiguredSyncService ();
@@ -459,7 +565,7 @@ namespace Tomboy.Sync
 				{
 					if (FindNoteByUUID (noteUpdate.UUID) == null) {
 						Note existingNote = NoteMgr.Find (noteUpdate.Title);
-						if (existingNote != null && !noteUpdate.BasicallyEqualTo (existingNote)) {
+						if (existingNote != null && !LocalNoteMatches (existingNote, noteUpdate)) {
 //							Logger.Debug ("Sync: Early conflict detection for '{0}'", noteUpdate.Title);
 							if (syncUI != null) {
 								syncUI.NoteConflictDetected (NoteMgr, existingNote, noteUpdate, noteUpdateTitles);
@@ -497,8 +603,13 @@ namespace Tomboy.Sync
 							CreateNoteInMainThread (noteUpdate);
 						}
 					} else if (existingNote.MetadataChangeDate.CompareTo (client.LastSyncDate) <= 0 ||
-					           noteUpdate.BasicallyEqualTo (existingNote)) {
-						// Existing note hasn't been modified since last sync; simply update it from server
+					           ((LocalNoteMatches (existingNote, noteUpdate) ||
+					             LocalContentUnchanged (existingNote)) &&
+					            LocalMetadataMatches (existingNote, noteUpdate))) {
+						// Existing note hasn't been modified since last sync,
+						// or its title, tags and text weren't and its other
+						// metadata is already the server's; simply update it
+						// from server
 						UpdateNoteInMainThread (existingNote, noteUpdate);
 					} else {
 //						Logger.Debug ("Sync: Late conflict detection for '{0}'", noteUpdate.Title);
@@ -541,6 +652,7 @@ namespace Tomboy.Sync
 							if (syncUI != null)
 								syncUI.NoteSynchronized (note.Title, NoteSyncType.DeleteFromClient);
 							NoteMgr.Delete (note);
+							SyncBaseStore.Instance.Remove (note.Id);
 						}
 					}
 				});
@@ -550,24 +662,35 @@ namespace Tomboy.Sync
 				SetState (SyncState.PrepareUpload);
 				// Look through all the notes modified on the client
 				// and upload new or modified ones to the server
+				bool keepBases = DeltaTransferEnabled;
 				List<Note> newOrModifiedNotes = new List<Note> ();
+				List<string> uploadedHashes = new List<string> ();
+				List<string> uploadedXml = new List<string> ();
 				foreach (Note note in new List<Note> (NoteMgr.Notes)) {
 					if (client.GetRevision (note) == -1) {
 						// This is a new note that has never been synchronized to the server
 						// TODO: *OR* this is a note that we lost revision info for!!!
 						// TODO: Do the above NOW!!! (don't commit this dummy)
-						GuiUtils.GtkInvokeAndWait (() => {
-							note.Save ();
-						});
+						string noteXml;
 						newOrModifiedNotes.Add (note);
+						uploadedHashes.Add (GetLocalSyncedHash (note, keepBases, out noteXml));
+						uploadedXml.Add (noteXml);
 						if (syncUI != null)
 							syncUI.NoteSynchronized (note.Title, NoteSyncType.UploadNew);
 					} else if (client.GetRevision (note) <= client.LastSynchronizedRevision &&
 					                note.MetadataChangeDate > client.LastSyncDate) {
-						GuiUtils.GtkInvokeAndWait (() => {
-							note.Save ();
-						});
+						// Skip notes whose title, tags, text and
+						// open-on-startup setting are the same as when
+						// they were last synchronized
+						string noteXml;
+						string hash = GetLocalSyncedHash (note, keepBases, out noteXml);
+						if (hash == client.GetContentHash (note)) {
+							Logger.Debug ("Sync: '{0}' content unchanged, not uploading", note.Title);
+							continue;
+						}
 						newOrModifiedNotes.Add (note);
+						uploadedHashes.Add (hash);
+						uploadedXml.Add (noteXml);
 						if (syncUI != null)
 							syncUI.NoteSynchronized (note.Title, NoteSyncType.UploadModified);
 					}
@@ -598,13 +721,20 @@ namespace Tomboy.Sync
 				}
 
 				SetState (SyncState.CommittingChanges);
+				// Revisions of the notes downloaded above must not be
+				// lost once the server moves on
+				client.Flush ();
 				bool commitResult = server.CommitSyncTransaction ();
 				if (commitResult) {
 					// Apply this revision number to all new/modified notes since last sync
 					// TODO: Is this the best place to do this (after successful server commit)
-					foreach (Note note in newOrModifiedNotes) {
-						client.SetRevision (note, newRevision);
+					for (int i = 0; i < newOrModifiedNotes.Count; i++) {
+						client.SetRevision (newOrModifiedNotes [i], newRevision, uploadedHashes [i]);
+						if (uploadedXml [i] != null)
+							SyncBaseStore.Instance.Put (newOrModifiedNotes [i].Id, newRevision, uploadedXml [i]);
 					}
+					foreach (string uuid in locallyDeletedUUIDs)
+						SyncBaseStore.Instance.Remove (uuid);
 					SetState (SyncState.Succeeded);
 				} else {
 					SetState (SyncState.Failed);
@@ -615,6 +745,8 @@ namespace Tomboy.Sync
 				client.LastSynchronizedRevision = server.LatestRevision;
 
 				client.LastSyncDate = DateTime.Now;
+				// Saves made by the sync itself don't need syncing back
+				Interlocked.Exchange (ref dirtyNoteCount, 0);
 
 				Logger.Debug ("Sync: New revision: {0}", client.LastSynchronizedRevision);
 
@@ -636,6 +768,8 @@ namespace Tomboy.Sync
 						server.CancelSyncTransaction ();
 				} catch {}
 			} finally {
+				if (watcher != null)
+					watcher.EndOwnChange ();
 				syncThread = null;
 				try {
 					addin.PostSyncCleanup ();
@@ -704,13 +838,112 @@ namespace Tomboy.Sync
 			try {
 				localNote.LoadForeignNoteXml (serverNote.XmlContent, ChangeType.OtherDataChanged);
 			} catch {} // TODO: Handle exception in case that serverNote.XmlContent is invalid XML
-			client.SetRevision (localNote, serverNote.LatestRevision);
+			client.SetRevision (localNote, serverNote.LatestRevision,
+			                    GetSyncedHash (serverNote.ContentHash, serverNote.IsOpenOnStartup));
+			if (DeltaTransferEnabled)
+				SyncBaseStore.Instance.Put (localNote.Id, serverNote.LatestRevision, serverNote.XmlContent);
 
 			// Update dialog's sync status
 			if (syncUI != null)
 				syncUI.NoteSynchronized (localNote.Title, syncType);
 		}
 
+		/// <summary>
+		/// NoteContentHash of the note's current content.  Saves the note
+		/// first, so edits still waiting for the save timeout are
+		/// included and the file on disk matches the hash.
+		/// </summary>
+		private static string GetLocalContentHash (Note note)
+		{
+			string hash = null;
+			GuiUtils.GtkInvokeAndWait (() => {
+				note.Save ();
+				hash = note.ContentHash;
+			});
+			return hash;
+		}
+
+		/// <summary>
+		/// The hash the client records for a note as synchronized: its
+		/// NoteContentHash, marked if the note opens on startup.  An
+		/// upload carries that setting too, though the content hash
+		/// leaves it out, so a change to it alone must not look like no
+		/// change.  A note that doesn't open on startup keeps the plain
+		/// content hash, as recorded before the mark.
+		/// </summary>
+		private static string GetSyncedHash (string contentHash, bool isOpenOnStartup)
+		{
+			if (contentHash == null || !isOpenOnStartup)
+				return contentHash;
+			return contentHash + ":open-on-startup";
+		}
+
+		/// <summary>
+		/// GetSyncedHash of the note's current state, saving it first
+		/// like GetLocalContentHash.  Also reads the saved note file if
+		/// readXml is true, before any later save can change it.
+		/// </summary>
+		private static string GetLocalSyncedHash (Note note, bool readXml, out string noteXml)
+		{
+			string hash = null;
+			string xml = null;
+			GuiUtils.GtkInvokeAndWait (() => {
+				note.Save ();
+				hash = GetSyncedHash (note.ContentHash, note.IsOpenOnStartup);
+				if (readXml)
+					xml = note.Manager.Store.ReadXml (note.FilePath);
+			});
+			noteXml = xml;
+			return hash;
+		}
+
+		/// <summary>
+		/// Whether the local note's title, tags and text are the same as
+		/// those of the server's version.
+		/// </summary>
+		private static bool LocalNoteMatches (Note note, NoteUpdate noteUpdate)
+		{
+			string updateHash = noteUpdate.ContentHash;
+			return updateHash != null && updateHash == GetLocalContentHash (note);
+		}
+
+		/// <summary>
+		/// Whether the local note's title, tags, text and open-on-startup
+		/// setting are the same as when it was last synchronized.
+		/// </summary>
+		private static bool LocalContentUnchanged (Note note)
+		{
+			string syncedHash = client.GetContentHash (note);
+			string noteXml;
+			return syncedHash != null && syncedHash == GetLocalSyncedHash (note, false, out noteXml);
+		}
+
+		/// <summary>
+		/// Whether the local note has the same tags (notebook included)
+		/// and open-on-startup setting as the server's version, so
+		/// replacing it with that version loses no local change the
+		/// content hash doesn't see.
+		/// </summary>
+		private static bool LocalMetadataMatches (Note note, NoteUpdate noteUpdate)
+		{
+			if (noteUpdate.Tags == null)
+				return false;
+
+			bool matches = false;
+			GuiUtils.GtkInvokeAndWait (() => {
+				Dictionary<string, Tag> localTags = note.Data.Tags;
+				if (note.IsOpenOnStartup != noteUpdate.IsOpenOnStartup ||
+				    localTags.Count != noteUpdate.Tags.Count)
+					return;
+				foreach (string tag in noteUpdate.Tags) {
+					if (!localTags.ContainsKey (tag))
+						return;
+				}
+				matches = true;
+			});
+			return matches;
+		}
+
 		private static Note FindNoteByUUID (string uuid)
 		{
 			return NoteMgr.FindByUri ("note://tomboy/" + uuid);
@@ -723,63 +956,20 @@ namespace Tomboy.Sync
 			}
 		}
 
+		/// <summary>
+		/// Whether two note documents have the same title, tags and text.
+		/// </summary>
 		public static bool SynchronizedNoteXmlMatches (string noteXml1, string noteXml2)
 		{
 			try {
-				// TODO: I prefer XPath code.  Why doesn't this work? (SelectSingleNode returns null)
-				/*XmlDocument doc1 = new XmlDocument ();
-				XmlDocument doc2 = new XmlDocument ();
-
-				doc1.LoadXml (noteXml1);
-				doc2.LoadXml (noteXml2);
-
-				// Check parts of XML that truly differentiate note content
-				// (enough that we don't need to prompt the user)
-				return (XmlNodesMatch (doc1.SelectSingleNode ("//tags"), doc2.SelectSingleNode ("//tags")) &&
-				        XmlNodesMatch (doc1.SelectSingleNode ("//title"), doc2.SelectSingleNode ("//title")) &&
-				 XmlNodesMatch (doc1.SelectSingleNode ("//text"), doc2.SelectSingleNode ("//text")));
-				*/
-
-				string title1, tags1, content1;
-				string title2, tags2, content2;
-
-				GetSynchronizedXmlBits (noteXml1, out title1, out tags1, out content1);
-				GetSynchronizedXmlBits (noteXml2, out title2, out tags2, out content2);
-
-				return title1 == title2 && tags1 == tags2 && content1 == content2;
+				return NoteContentHash.Compute (noteXml1, string.Empty) ==
+				       NoteContentHash.Compute (noteXml2, string.Empty);
 			} catch (Exception e){
 				Logger.Debug ("SynchronizedNoteXmlMatches threw exception: " + e.ToString ());
 				return false;
 			}
 		}
 
-		private static void GetSynchronizedXmlBits (string noteXml, out string title, out string tags, out string content)
-		{
-			title = null;
-			tags = null;
-			content = null;
-
-			XmlTextReader xml = new XmlTextReader (new StringReader (noteXml));
-			while (xml.Read ()) {
-				switch (xml.NodeType) {
-				case XmlNodeType.Element:
-					switch (xml.Name) {
-					case "title":
-						title = xml.ReadString ();
-						break;
-					case "tags":
-						tags = xml.ReadInnerXml ();
-						Logger.Debug ("In the bits: tags = " + tags); // TODO: Delete
-						break;
-					case "text":
-						content = xml.ReadInnerXml ();
-						break;
-					}
-					break;
-				}
-			}
-		}
-
 //  private static void OnSyncDialogResponse (object sender, Gtk.ResponseArgs args)
 //  {
 //   SyncDialog dialog = sender as SyncDialog;
@@ -802,6 +992,12 @@ namespace Tomboy.Sync
 		#region Private Methods
 		private static void SetState (SyncState newState)
 		{
+			stateSpan.Dispose ();
+			if (Tracer.Enabled && newState != SyncState.Idle)
+				stateSpan = Tracer.Span ("Sync." + newState.ToString (), "sync");
+			else
+				stateSpan = new TraceSpan ();
+
 			state = newState;
 			if (syncUI != null) {
 				// Notify the event handlers
@@ -854,6 +1050,10 @@ namespace Tomboy.Sync
 		public string UUID; //needed?
 		public int LatestRevision;
 
+		private string contentHash;
+		private List<string> tags;
+		private bool isOpenOnStartup;
+
 		public NoteUpdate (string xmlContent, string title, string uuid, int latestRevision)
 		{
 			XmlContent = xmlContent;
@@ -866,66 +1066,72 @@ namespace Tomboy.Sync
 				XmlTextReader xml = new XmlTextReader (new StringReader (XmlContent));
 				xml.Namespaces = false;
 
-				while (xml.Read ()) {
-					switch (xml.NodeType) {
-					case XmlNodeType.Element:
-						switch (xml.Name) {
-						case "title":
-							Title = xml.ReadString ();
+				try {
+					List<string> updateTags = new List<string> ();
+					while (xml.Read ()) {
+						switch (xml.NodeType) {
+						case XmlNodeType.Element:
+							switch (xml.Name) {
+							case "title":
+								Title = xml.ReadString ();
+								break;
+							case "tag":
+								string tag = xml.ReadString ().Trim ();
+								if (tag.Length > 0 && !updateTags.Contains (tag.ToLower ()))
+									updateTags.Add (tag.ToLower ());
+								break;
+							case "open-on-startup":
+								bool.TryParse (xml.ReadString (), out isOpenOnStartup);
+								break;
+							}
 							break;
 						}
-						break;
 					}
+					tags = updateTags;
+				} catch (XmlException e) {
+					Logger.Debug ("Could not parse note update {0}: {1}", uuid, e.Message);
 				}
 			}
 		}
 
-		public bool BasicallyEqualTo (Note existingNote)
+		/// <summary>
+		/// Normalized names of the update's tags, or null if XmlContent
+		/// is missing or can't be parsed.
+		/// </summary>
+		public List<string> Tags
 		{
-//			Logger.Debug ("Comparing NoteData for '{0}'", existingNote.Title);
-			// NOTE: This would be so much easier if NoteUpdate
-			//       was not just a container for a big XML string
-			NoteData updateData = null;
-			using (var xml = new XmlTextReader (new StringReader (XmlContent))) {
-				xml.Namespaces = false;
-				updateData = NoteArchiver.Instance.Read (xml, UUID);
+			get {
+				return tags;
 			}
-
-			// NOTE: Mostly a hack to ignore missing version attributes
-			string existingInnerContent = GetInnerContent (existingNote.Data.Text);
-			string updateInnerContent = GetInnerContent (updateData.Text);
-
-//			Logger.Debug ("existingNote.Data.Title: {0}", existingNote.Data.Title);
-//			Logger.Debug ("updateData.Title: {0}", updateData.Title);
-//
-//			Logger.Debug ("existingInnerContent: {0}", existingInnerContent);
-//			Logger.Debug ("updateInnerContent: {0}", updateInnerContent);
-
-			return existingInnerContent == updateInnerContent &&
-				existingNote.Data.Title == updateData.Title &&
-				CompareTags (existingNote.Data.Tags, updateData.Tags);
-				// TODO: Compare open-on-startup, pinned
 		}
 
-		private string GetInnerContent (string fullContentElement)
+		public bool IsOpenOnStartup
 		{
-			const string noteContentRegex =
-				@"^<note-content([^>]+version=""(?<contentVersion>[^""]*)"")?[^>]*((/>)|(>(?<innerContent>.*)</note-content>))$";
-			Match m = Regex.Match (fullContentElement, noteContentRegex, RegexOptions.Singleline);
-			Group contentGroup = m.Groups ["innerContent"];
-			if (!contentGroup.Success)
-				return null;
-			return contentGroup.Value;
+			get {
+				return isOpenOnStartup;
+			}
 		}
 
-		private bool CompareTags (Dictionary<string, Tag> set1, Dictionary<string, Tag> set2)
+		/// <summary>
+		/// NoteContentHash of XmlContent, or null if it can't be parsed.
+		/// Servers that already know the hash can set it so the note
+		/// doesn't have to be parsed again.
+		/// </summary>
+		public string ContentHash
 		{
-			if (set1.Count != set2.Count)
-				return false;
-			foreach (string key in set1.Keys)
-				if (!set2.ContainsKey (key))
-					return false;
-			return true;
+			get {
+				if (contentHash == null && !string.IsNullOrEmpty (XmlContent)) {
+					try {
+						contentHash = NoteContentHash.Compute (XmlContent, UUID);
+					} catch (Exception e) {
+						Logger.Debug ("Could not hash note update {0}: {1}", UUID, e.Message);
+					}
+				}
+				return contentHash;
+			}
+			set {
+				contentHash = value;
+			}
 		}
 	}
 
@@ -1012,7 +1218,10 @@ namespace Tomboy.Sync
 		DateTime LastSyncDate { get; set; }
 		int GetRevision (Note note);
 		void SetRevision (Note note, int revision);
+		void SetRevision (Note note, int revision, string contentHash);
+		string GetContentHash (Note note);
 		IDictionary<string, string> DeletedNoteTitles { get; }
+		void Flush ();
 		void Reset ();
 		string AssociatedServerId { get; set; }
 	}
@@ -0,0 +1,114 @@
+using System;
+using System.IO;
+using System.Threading;
+
+namespace Tomboy.Sync
+{
+	/// <summary>
+	/// Watches the manifest.xml of a sync server that lives on a local
+	/// file system, so that commits by other clients are noticed when
+	/// they happen instead of by polling.  Every commit rewrites the
+	/// manifest, so watching that one file is enough.
+	///
+	/// On Linux, Mono's FileSystemWatcher is backed by inotify, so an
+	/// idle watcher costs nothing.
+	///
+	/// Our own syncs rewrite the manifest too.  Changes between
+	/// BeginOwnChange and EndOwnChange, and for OwnChangeGrace after
+	/// it, are ignored; the events can arrive a little late.
+	/// </summary>
+	public class SyncServerWatcher : IDisposable
+	{
+		const string manifestName = "manifest.xml";
+
+		/// <summary>
+		/// How long after EndOwnChange changes are still taken to be ours.
+		/// </summary>
+		public static readonly TimeSpan OwnChangeGrace = TimeSpan.FromSeconds (5);
+
+		FileSystemWatcher watcher;
+		// Other clients may have synced before we started watching
+		int changed = 1;
+
+		readonly object ownChangeLock = new object ();
+		int ownChanges;
+		DateTime ownChangeEnd = DateTime.MinValue;
+
+		/// <summary>
+		/// Raised on a thread pool thread whenever the manifest is
+		/// written, created or renamed into place.
+		/// </summary>
+		public event EventHandler ManifestChanged;
+
+		public SyncServerWatcher (string serverPath)
+		{
+			ServerPath = serverPath;
+
+			watcher = new FileSystemWatcher (serverPath, manifestName);
+			watcher.NotifyFilter = NotifyFilters.LastWrite |
+			                       NotifyFilters.FileName |
+			                       NotifyFilters.Size;
+			watcher.Changed += HandleChanged;
+			watcher.Created += HandleChanged;
+			watcher.Renamed += HandleChanged;
+			watcher.EnableRaisingEvents = true;
+		}
+
+		public string ServerPath { get; private set; }
+
+		/// <summary>
+		/// Whether the manifest changed since the last call.
+		/// </summary>
+		public bool TakeChange ()
+		{
+			return Interlocked.Exchange (ref changed, 0) != 0;
+		}
+
+		/// <summary>
+		/// We are about to write the server ourselves, in a sync.
+		/// </summary>
+		public void BeginOwnChange ()
+		{
+			lock (ownChangeLock)
+				ownChanges++;
+		}
+
+		public void EndOwnChange ()
+		{
+			lock (ownChangeLock) {
+				if (ownChanges > 0)
+					ownChanges--;
+				ownChangeEnd = DateTime.UtcNow;
+			}
+		}
+
+		/// <summary>
+		/// Whether a change seen at the given UTC time is one of ours.
+		/// </summary>
+		public bool IsOwnChange (DateTime time)
+		{
+			lock (ownChangeLock)
+				return ownChanges > 0 || time - ownChangeEnd < OwnChangeGrace;
+		}
+
+		void HandleChanged (object sender, FileSystemEventArgs args)
+		{
+			if (IsOwnChange (DateTime.UtcNow))
+				return;
+
+			Interlocked.Exchange (ref changed, 1);
+			EventHandler handler = ManifestChanged;
+			if (handler != null)
+				handler (this, EventArgs.Empty);
+		}
+
+		public void Dispose ()
+		{
+			if (watcher != null) {
+				watcher.EnableRaisingEvents = false;
+				watcher.Dispose ();
+				watcher = null;
+			}
+		}
+	}
+}
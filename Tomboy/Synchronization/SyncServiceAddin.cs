@@ -49,6 +49,17 @@ namespace Tomboy.Sync
 			get;
 		}
 		
+		/// <summary>
+		/// A local directory holding the server's manifest.xml, if changes
+		/// other clients make to it show up in the local file system, so
+		/// that it can be watched instead of polled.  Null otherwise,
+		/// including for FUSE mounts of remote servers.
+		/// </summary>
+		public virtual string WatchablePath
+		{
+			get { return null; }
+		}
+
 		/// <summary>
 		/// Returns true if required settings are valid in the widget
 		/// (Required setings are non-empty)
@@ -1,43 +1,78 @@
 using System;
 using System.IO;
+using System.Text;
 using System.Xml;
 using System.Collections.Generic;
 
 namespace Tomboy.Sync
 {
+	/// <summary>
+	/// Local sync state, kept in manifest.xml in the configuration
+	/// directory.
+	///
+	/// Changes made while syncing are not written to manifest.xml right
+	/// away.  Instead each one is appended as a single line to
+	/// manifest.xml.journal, and the journal is folded into a fresh
+	/// manifest.xml when a sync finishes, at startup, or when it grows
+	/// too large.  Every journal record just sets a value, so replaying
+	/// a journal that was already partly compacted is harmless, and a
+	/// torn last line from a crash is simply ignored.  Records reach
+	/// the disk when Flush is called, which SyncManager does before
+	/// committing to the server.
+	/// </summary>
 	public class TomboySyncClient : SyncClient
 	{
 		private const string localManifestFileName = "manifest.xml";
+		private const string journalFileSuffix = ".journal";
+
+		// Compact even in the middle of a sync once the journal gets this big
+		private const long maxJournalBytes = 1024 * 1024;
 
 		private DateTime lastSyncDate;
 		private int lastSyncRev;
 		private string serverId;
 		private string localManifestFilePath;
 		private Dictionary<string, int> fileRevisions;
+		private Dictionary<string, string> fileHashes;
 		private Dictionary<string, string> deletedNotes;
 
-		public TomboySyncClient ()
+		private string journalFilePath;
+		private StreamWriter journal;
+		private readonly object journalLock = new object ();
+
+		public TomboySyncClient () :
+			this (Path.Combine (Services.NativeApplication.ConfigurationDirectory,
+			                    localManifestFileName),
+			      Tomboy.DefaultNoteManager)
 		{
 			// TODO: Why doesn't OnChanged ever get fired?!
 			FileSystemWatcher w = new FileSystemWatcher ();
 			w.Path = Services.NativeApplication.ConfigurationDirectory;
 			w.Filter = localManifestFileName;
 			w.Changed += OnChanged;
+		}
 
-			localManifestFilePath =
-			        Path.Combine (Services.NativeApplication.ConfigurationDirectory,
-			                      localManifestFileName);
+		/// <summary>
+		/// Keep the sync state in manifestPath, forgetting the notes
+		/// manager deletes.  manager may be null.
+		/// </summary>
+		public TomboySyncClient (string manifestPath, NoteManager manager)
+		{
+			localManifestFilePath = manifestPath;
+			journalFilePath = localManifestFilePath + journalFileSuffix;
 			Parse (localManifestFilePath);
 
-			Tomboy.DefaultNoteManager.NoteDeleted += NoteDeletedHandler;
+			if (manager != null)
+				manager.NoteDeleted += NoteDeletedHandler;
 		}
 
 		private void NoteDeletedHandler (object noteMgr, Note deletedNote)
 		{
 			deletedNotes [deletedNote.Id] = deletedNote.Title;
 			fileRevisions.Remove (deletedNote.Id);
+			fileHashes.Remove (deletedNote.Id);
 
-			Write (localManifestFilePath);
+			AppendJournal ("deleted", deletedNote.Id, deletedNote.Title);
 		}
 
 		private void OnChanged(object source, FileSystemEventArgs e)
@@ -51,8 +86,18 @@ namespace Tomboy.Sync
 			lastSyncDate = DateTime.Today.AddDays (-1);
 			lastSyncRev = -1;
 			fileRevisions = new Dictionary<string,int> ();
+			fileHashes = new Dictionary<string,string> ();
 			deletedNotes = new Dictionary<string,string> ();
 
+			CloseJournal ();
+
+			// A crash while replacing the manifest can leave only the backup
+			string backupPath = manifestPath + "~";
+			if (!File.Exists (manifestPath) && File.Exists (backupPath)) {
+				Logger.Warn ("Restoring {0} from backup", manifestPath);
+				File.Move (backupPath, manifestPath);
+			}
+
 			if (!File.Exists (manifestPath)) {
 				lastSyncDate = DateTime.MinValue;
 				Write (manifestPath);
@@ -87,6 +132,11 @@ namespace Tomboy.Sync
 							} catch { }
 
 							fileRevisions [guid] = revision;
+
+							// Missing in manifests written by older versions
+							XmlAttribute hashAttr = noteNode.Attributes ["content-hash"];
+							if (hashAttr != null && hashAttr.Value.Length > 0)
+								fileHashes [guid] = hashAttr.Value;
 						} catch {
 						// Any errors in XML will be ignored as long as
 						// bad data doesn't end up in fileRevisions.
@@ -133,13 +183,197 @@ namespace Tomboy.Sync
 			} finally {
 				fs.Close ();
 			}
+
+			if (File.Exists (journalFilePath)) {
+				ReplayJournal ();
+				Compact ();
+			}
+		}
+
+		/// <summary>
+		/// Apply the records in the journal on top of the state read from
+		/// manifest.xml.
+		/// </summary>
+		private void ReplayJournal ()
+		{
+			string contents;
+			// Another client in this process may still have it open
+			using (FileStream fs = new FileStream (journalFilePath, FileMode.Open,
+			                                       FileAccess.Read, FileShare.ReadWrite))
+			using (StreamReader reader = new StreamReader (fs, Encoding.UTF8))
+				contents = reader.ReadToEnd ();
+
+			string [] lines = contents.Split ('\n');
+			// Everything after the last newline is a record that was cut
+			// short, or the empty string if the journal is intact
+			if (lines [lines.Length - 1].Length > 0)
+				Logger.Warn ("Ignoring incomplete record at the end of " + journalFilePath);
+
+			int replayed = 0;
+			for (int i = 0; i < lines.Length - 1; i++) {
+				string [] fields = lines [i].Split ('\t');
+				for (int f = 0; f < fields.Length; f++)
+					fields [f] = UnescapeField (fields [f]);
+
+				try {
+					switch (fields [0]) {
+					case "rev":
+						fileRevisions [fields [1]] = int.Parse (fields [2]);
+						if (fields [3].Length > 0)
+							fileHashes [fields [1]] = fields [3];
+						else
+							fileHashes.Remove (fields [1]);
+						break;
+					case "deleted":
+						deletedNotes [fields [1]] = fields [2];
+						fileRevisions.Remove (fields [1]);
+						fileHashes.Remove (fields [1]);
+						break;
+					case "last-sync-rev":
+						lastSyncRev = int.Parse (fields [1]);
+						break;
+					case "server-id":
+						serverId = fields [1];
+						break;
+					default:
+						throw new FormatException ("unknown record type");
+					}
+					replayed++;
+				} catch (Exception e) {
+					Logger.Warn ("Ignoring bad record in {0}: {1}", journalFilePath, e.Message);
+				}
+			}
+
+			Logger.Debug ("Replayed {0} records from {1}", replayed, journalFilePath);
 		}
 
+		/// <summary>
+		/// Append one record to the journal.  The record is handed to the
+		/// operating system right away, so it survives Tomboy crashing,
+		/// but only reaches the disk with the next Flush or Compact.
+		/// </summary>
+		private void AppendJournal (params string [] fields)
+		{
+			lock (journalLock) {
+				if (journal == null) {
+					FileStream fs = new FileStream (journalFilePath, FileMode.Append,
+					                                FileAccess.Write, FileShare.Read);
+					journal = new StreamWriter (fs, new UTF8Encoding (false));
+				}
+
+				StringBuilder record = new StringBuilder ();
+				for (int i = 0; i < fields.Length; i++) {
+					if (i > 0)
+						record.Append ('\t');
+					record.Append (EscapeField (fields [i]));
+				}
+				record.Append ('\n');
+
+				journal.Write (record.ToString ());
+				journal.Flush ();
+
+				if (journal.BaseStream.Length > maxJournalBytes)
+					Compact ();
+			}
+		}
+
+		/// <summary>
+		/// Make every record appended so far durable.  Called once per
+		/// batch of changes rather than per record, since an fsync per
+		/// note would make syncing many notes slow.
+		/// </summary>
+		public virtual void Flush ()
+		{
+			lock (journalLock) {
+				if (journal == null)
+					return;
+				journal.Flush ();
+				((FileStream) journal.BaseStream).Flush (true);
+			}
+		}
+
+		private void CloseJournal ()
+		{
+			lock (journalLock) {
+				if (journal != null) {
+					journal.Close ();
+					journal = null;
+				}
+			}
+		}
+
+		/// <summary>
+		/// Write the current state to manifest.xml and start a new journal.
+		/// </summary>
+		private void Compact ()
+		{
+			lock (journalLock) {
+				CloseJournal ();
+				Write (localManifestFilePath);
+				// If we crash before this, the journal is replayed over
+				// the new manifest at startup, which changes nothing.
+				File.Delete (journalFilePath);
+			}
+		}
+
+		static string EscapeField (string field)
+		{
+			if (field == null)
+				return string.Empty;
+			return field.Replace ("\\", "\\\\").Replace ("\t", "\\t")
+			       .Replace ("\n", "\\n").Replace ("\r", "\\r");
+		}
+
+		static string UnescapeField (string field)
+		{
+			if (field.IndexOf ('\\') < 0)
+				return field;
+
+			StringBuilder result = new StringBuilder (field.Length);
+			for (int i = 0; i < field.Length; i++) {
+				char c = field [i];
+				if (c == '\\' && i + 1 < field.Length) {
+					c = field [++i];
+					switch (c) {
+					case 't': c = '\t'; break;
+					case 'n': c = '\n'; break;
+					case 'r': c = '\r'; break;
+					}
+				}
+				result.Append (c);
+			}
+			return result.ToString ();
+		}
+
+		/// <summary>
+		/// Write a complete manifest.  The file is replaced only once the
+		/// new one is safely on disk, like notes are.
+		/// </summary>
 		private void Write (string manifestPath)
 		{
-			// TODO: Handle file permission errors
-			XmlWriter xml = XmlWriter.Create (manifestPath, XmlEncoder.DocumentSettings);
+			string tmpPath = manifestPath + ".tmp";
+
+			using (FileStream fs = new FileStream (tmpPath, FileMode.Create, FileAccess.Write)) {
+				// TODO: Handle file permission errors
+				using (XmlWriter xml = XmlWriter.Create (fs, XmlEncoder.DocumentSettings))
+					WriteManifest (xml);
+				fs.Flush (true);
+			}
+
+			if (File.Exists (manifestPath)) {
+				string backupPath = manifestPath + "~";
+				if (File.Exists (backupPath))
+					File.Delete (backupPath);
+				File.Move (manifestPath, backupPath);
+				File.Move (tmpPath, manifestPath);
+				File.Delete (backupPath);
+			} else {
+				File.Move (tmpPath, manifestPath);
+			}
+		}
 
+		private void WriteManifest (XmlWriter xml)
+		{
 			try {
 				xml.WriteStartDocument ();
 				xml.WriteStartElement (null, "manifest", "http://beatniksoftware.com/tomboy");
@@ -162,6 +396,9 @@ namespace Tomboy.Sync
 					xml.WriteStartElement (null, "note", null);
 					xml.WriteAttributeString (null, "guid", null, noteGuid);
 					xml.WriteAttributeString (null, "latest-revision", null, fileRevisions [noteGuid].ToString ());
+					string hash;
+					if (fileHashes.TryGetValue (noteGuid, out hash))
+						xml.WriteAttributeString (null, "content-hash", null, hash);
 					xml.WriteEndElement ();
 				}
 
@@ -194,7 +431,8 @@ namespace Tomboy.Sync
 				lastSyncDate = value;
 				// If we just did a sync, we should be able to forget older deleted notes
 				deletedNotes.Clear ();
-				Write (localManifestFilePath);
+				// Set at the end of every sync, so fold the journal in now
+				Compact ();
 			}
 		}
 
@@ -206,7 +444,7 @@ namespace Tomboy.Sync
 			set
 			{
 				lastSyncRev = value;
-				Write (localManifestFilePath);
+				AppendJournal ("last-sync-rev", value.ToString ());
 			}
 		}
 
@@ -220,10 +458,35 @@ namespace Tomboy.Sync
 		}
 
 		public virtual void SetRevision (Note note, int revision)
+		{
+			SetRevision (note, revision, null);
+		}
+
+		/// <summary>
+		/// Record the revision a note was synchronized at, along with the
+		/// hash SyncManager made of what was synchronized (null if
+		/// unknown): its NoteContentHash, marked if it opens on startup.
+		/// </summary>
+		public virtual void SetRevision (Note note, int revision, string contentHash)
 		{
 			fileRevisions [note.Id] = revision;
-			// TODO: Should we write on each of these or no?
-			Write (localManifestFilePath);
+			if (string.IsNullOrEmpty (contentHash))
+				fileHashes.Remove (note.Id);
+			else
+				fileHashes [note.Id] = contentHash;
+			AppendJournal ("rev", note.Id, revision.ToString (), contentHash);
+		}
+
+		/// <summary>
+		/// The hash given to SetRevision when the note was last
+		/// synchronized, or null if it isn't known.
+		/// </summary>
+		public virtual string GetContentHash (Note note)
+		{
+			string hash;
+			if (fileHashes.TryGetValue (note.Id, out hash))
+				return hash;
+			return null;
 		}
 
 		/// <summary>
@@ -243,8 +506,11 @@ namespace Tomboy.Sync
 		/// </summary>
 		public void Reset ()
 		{
+			CloseJournal ();
 			if (File.Exists (localManifestFilePath))
 				File.Delete (localManifestFilePath);
+			if (File.Exists (journalFilePath))
+				File.Delete (journalFilePath);
 			Parse (localManifestFilePath);
 		}
 
@@ -262,7 +528,7 @@ namespace Tomboy.Sync
 			{
 				if (serverId != value) {
 					serverId = value;
-					Write (localManifestFilePath);
+					AppendJournal ("server-id", value);
 				}
 			}
 		}
@@ -71,6 +71,8 @@ namespace Tomboy
 			}
 
 			Logger.LogLevel = debugging ? Level.DEBUG : Level.INFO;
+			if (cmd_line.Trace)
+				Tracer.Enabled = true;
 #if PANEL_APPLET
 			is_panel_applet = cmd_line.UsePanelApplet;
 #else
@@ -81,6 +83,16 @@ namespace Tomboy
 			//       class before this call.
 			Initialize ("tomboy", "Tomboy", "tomboy", args);
 
+			if (cmd_line.Trace) {
+				ExitingEvent += delegate {
+					try {
+						Tracer.WriteChromeTrace (Tracer.DefaultTracePath);
+					} catch (Exception e) {
+						Logger.Error ("Could not write trace: {0}", e.Message);
+					}
+				};
+			}
+
 			// Add private icon dir to search path
 			icon_theme = Gtk.IconTheme.Default;
 			icon_theme.AppendSearchPath (Path.Combine (Path.Combine (Defines.DATADIR, "tomboy"), "icons"));
@@ -123,6 +135,10 @@ namespace Tomboy
 							JumpListManager.CreateJumpList (manager);
 						};
 
+						manager.NotesImported += delegate (object sender, List<Note> imported) {
+							JumpListManager.CreateJumpList (manager);
+						};
+
 						manager.NoteRenamed += delegate (Note sender, string old_title) {
 							JumpListManager.CreateJumpList (manager);
 						};
@@ -513,6 +529,9 @@ namespace Tomboy
 		string search_text;
 		bool open_search;
 		bool addin_args;
+		bool trace;
+		bool write_trace;
+		string write_trace_path;
 
 		List<string> addin_argslist = new List<string> ();
 		public event AddinCommandLineEventHandler AddinCmdLineArgsDetected;
@@ -539,6 +558,15 @@ namespace Tomboy
 			get { return debug; }
 		}
 
+		/// <summary>
+		/// Record tracing spans from startup, and write them to the
+		/// log directory on exit.
+		/// </summary>
+		public bool Trace
+		{
+			get { return trace; }
+		}
+
 		// TODO: Document this option
 		public bool Uninstalled
 		{
@@ -561,6 +589,8 @@ namespace Tomboy
 				open_search ||
 				open_start_here ||
 				open_external_note_path != null ||
+				trace ||
+				write_trace ||
 				addin_args;
 			}
 		}
@@ -608,6 +638,12 @@ namespace Tomboy
 			                "  --start-here\t\t\tDisplay the 'Start Here' note.\n" +
 			                "  --highlight-search [text]\tSearch and highlight text " +
 			                "in the opened note.\n");
+			usage +=
+			        Catalog.GetString (
+			                "  --trace\t\t\tRecord where time is spent, for " +
+			                "diagnosing slowdowns.\n" +
+			                "  --write-trace [path]\t\tWrite what has been recorded " +
+			                "so far as a Chrome trace.\n");
 			usage +=
 			        Catalog.GetString (
 			                "  --addin:html-export-all [path]\tExports all notes to " +
@@ -714,6 +750,23 @@ namespace Tomboy
 
 					break;
 
+				case "--trace":
+					trace = true;
+					break;
+
+				case "--write-trace":
+					// Get optional path; relative to our directory, not
+					// the running instance's
+					if (idx + 1 < args.Length
+					                && args [idx + 1] != null
+					                && args [idx + 1] != String.Empty
+					                && args [idx + 1][0] != '-') {
+						write_trace_path = Path.GetFullPath (args [++idx]);
+					}
+
+					write_trace = true;
+					break;
+
 				case "--search":
 					// Get optional search text...
 					if (idx + 1 < args.Length
@@ -847,6 +900,17 @@ namespace Tomboy
 					remote.DisplaySearch ();
 			}
 
+			if (trace)
+				remote.SetTracingEnabled (true);
+
+			if (write_trace) {
+				string path = remote.WriteTrace (write_trace_path ?? string.Empty);
+				if (path != string.Empty)
+					Console.WriteLine ("Trace written to {0}", path);
+				else
+					Console.WriteLine ("Tomboy could not write the trace; see its log.");
+			}
+
 			if (addin_args) AddinCmdLineArgsDetected (this, new EventArgs ());
 		}
 	}
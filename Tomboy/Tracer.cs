@@ -0,0 +1,296 @@
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Text;
+using System.Threading;
+
+namespace Tomboy
+{
+	/// <summary>
+	/// Named timing spans and counters for finding out where time goes
+	/// on a user's machine, exported as Chrome trace-event JSON that can
+	/// be opened in chrome://tracing or Perfetto.
+	///
+	/// Tracing is off by default.  While it is off, Span returns an empty
+	/// TraceSpan and Count returns immediately, so instrumented code only
+	/// pays for reading a static field.  While it is on, the most recent
+	/// Capacity events are kept in memory; older ones are overwritten.
+	///
+	/// Use spans with using, so they end even if an exception is thrown:
+	///
+	///   using (Tracer.Span ("Search.SearchNotes", "search")) {
+	///       ...
+	///   }
+	/// </summary>
+	public static class Tracer
+	{
+		public const int Capacity = 65536;
+
+		struct TraceEvent
+		{
+			public string Name;
+			public string Category;
+			public char Phase;
+			public long Start;
+			public long Duration;
+			public int ThreadId;
+			public long Value;
+		}
+
+		static volatile bool enabled;
+
+		static readonly object events_lock = new object ();
+		static TraceEvent [] events;
+		static int next_event;
+		static int event_count;
+		static Dictionary<int, string> thread_names = new Dictionary<int, string> ();
+
+		static readonly long origin = Stopwatch.GetTimestamp ();
+
+		public static bool Enabled
+		{
+			get {
+				return enabled;
+			}
+			set {
+				lock (events_lock) {
+					if (value && events == null)
+						events = new TraceEvent [Capacity];
+					enabled = value;
+				}
+				Logger.Info ("Tracing {0}", value ? "enabled" : "disabled");
+			}
+		}
+
+		/// <summary>
+		/// Where WriteChromeTrace writes when no path is given.
+		/// </summary>
+		public static string DefaultTracePath
+		{
+			get {
+				return Path.Combine (Services.NativeApplication.LogDirectory,
+				                     "tomboy-trace.json");
+			}
+		}
+
+		public static TraceSpan Span (string name)
+		{
+			return Span (name, "tomboy");
+		}
+
+		/// <summary>
+		/// Start timing a span.  It ends when the returned TraceSpan is
+		/// disposed.
+		/// </summary>
+		public static TraceSpan Span (string name, string category)
+		{
+			if (!enabled)
+				return new TraceSpan ();
+			return new TraceSpan (name, category, Stopwatch.GetTimestamp ());
+		}
+
+		/// <summary>
+		/// Record the current value of a counter, shown as a graph
+		/// alongside the spans.
+		/// </summary>
+		public static void Count (string name, long value)
+		{
+			if (!enabled)
+				return;
+			Record (name, "counter", 'C', Stopwatch.GetTimestamp (), 0, value);
+		}
+
+		internal static void Record (string name, string category, char phase,
+		                             long start, long duration, long value)
+		{
+			Thread thread = Thread.CurrentThread;
+			int thread_id = thread.ManagedThreadId;
+
+			lock (events_lock) {
+				if (events == null)
+					return;
+
+				if (!thread_names.ContainsKey (thread_id))
+					thread_names [thread_id] = thread.Name;
+
+				events [next_event].Name = name;
+				events [next_event].Category = category;
+				events [next_event].Phase = phase;
+				events [next_event].Start = start;
+				events [next_event].Duration = duration;
+				events [next_event].ThreadId = thread_id;
+				events [next_event].Value = value;
+
+				next_event = (next_event + 1) % events.Length;
+				if (event_count < events.Length)
+					event_count++;
+			}
+		}
+
+		public static void Clear ()
+		{
+			lock (events_lock) {
+				next_event = 0;
+				event_count = 0;
+				if (events != null)
+					Array.Clear (events, 0, events.Length);
+			}
+		}
+
+		/// <summary>
+		/// Write the recorded events to a file, or to DefaultTracePath if
+		/// path is null or empty.  Returns the path written.
+		/// </summary>
+		public static string WriteChromeTrace (string path)
+		{
+			if (string.IsNullOrEmpty (path))
+				path = DefaultTracePath;
+
+			string dir = Path.GetDirectoryName (Path.GetFullPath (path));
+			if (!Directory.Exists (dir))
+				Directory.CreateDirectory (dir);
+
+			using (StreamWriter writer = new StreamWriter (path, false, new UTF8Encoding (false)))
+				WriteChromeTrace (writer);
+
+			Logger.Info ("Wrote trace to {0}", path);
+			return path;
+		}
+
+		public static void WriteChromeTrace (TextWriter writer)
+		{
+			TraceEvent [] snapshot;
+			Dictionary<int, string> names;
+
+			lock (events_lock) {
+				snapshot = new TraceEvent [event_count];
+				int first = (next_event - event_count + Capacity) % Capacity;
+				for (int i = 0; i < event_count; i++)
+					snapshot [i] = events [(first + i) % Capacity];
+				names = new Dictionary<int, string> (thread_names);
+			}
+
+			int pid = Process.GetCurrentProcess ().Id;
+			bool first_event = true;
+
+			writer.Write ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+			foreach (KeyValuePair<int, string> thread in names) {
+				if (thread.Value == null)
+					continue;
+				WriteSeparator (writer, ref first_event);
+				writer.Write ("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+				writer.Write (pid);
+				writer.Write (",\"tid\":");
+				writer.Write (thread.Key);
+				writer.Write (",\"args\":{\"name\":");
+				WriteString (writer, thread.Value);
+				writer.Write ("}}");
+			}
+
+			foreach (TraceEvent ev in snapshot) {
+				WriteSeparator (writer, ref first_event);
+				writer.Write ("{\"name\":");
+				WriteString (writer, ev.Name);
+				writer.Write (",\"cat\":");
+				WriteString (writer, ev.Category);
+				writer.Write (",\"ph\":\"");
+				writer.Write (ev.Phase);
+				writer.Write ("\",\"ts\":");
+				writer.Write (ToMicroseconds (ev.Start - origin));
+				if (ev.Phase == 'X') {
+					writer.Write (",\"dur\":");
+					writer.Write (ToMicroseconds (ev.Duration));
+				}
+				writer.Write (",\"pid\":");
+				writer.Write (pid);
+				writer.Write (",\"tid\":");
+				writer.Write (ev.ThreadId);
+				if (ev.Phase == 'C') {
+					writer.Write (",\"args\":{\"value\":");
+					writer.Write (ev.Value);
+					writer.Write ('}');
+				}
+				writer.Write ('}');
+			}
+
+			writer.Write ("]}");
+		}
+
+		static void WriteSeparator (TextWriter writer, ref bool first)
+		{
+			if (first)
+				first = false;
+			else
+				writer.Write (",\n");
+		}
+
+		static string ToMicroseconds (long ticks)
+		{
+			double us = ticks * 1000000.0 / Stopwatch.Frequency;
+			return us.ToString ("0.###", CultureInfo.InvariantCulture);
+		}
+
+		static void WriteString (TextWriter writer, string s)
+		{
+			writer.Write ('"');
+			if (s != null) {
+				foreach (char c in s) {
+					switch (c) {
+					case '"':
+						writer.Write ("\\\"");
+						break;
+					case '\\':
+						writer.Write ("\\\\");
+						break;
+					case '\n':
+						writer.Write ("\\n");
+						break;
+					case '\r':
+						writer.Write ("\\r");
+						break;
+					case '\t':
+						writer.Write ("\\t");
+						break;
+					default:
+						if (c < ' ')
+							writer.Write ("\\u{0:x4}", (int) c);
+						else
+							writer.Write (c);
+						break;
+					}
+				}
+			}
+			writer.Write ('"');
+		}
+	}
+
+	/// <summary>
+	/// A span started by Tracer.Span.  Disposing it records the span; an
+	/// empty one, returned while tracing is off, records nothing.
+	/// </summary>
+	public struct TraceSpan : IDisposable
+	{
+		readonly string name;
+		readonly string category;
+		readonly long start;
+
+		internal TraceSpan (string name, string category, long start)
+		{
+			this.name = name;
+			this.category = category;
+			this.start = start;
+		}
+
+		public void Dispose ()
+		{
+			if (name == null)
+				return;
+			Tracer.Record (name, category, 'X', start,
+			               Stopwatch.GetTimestamp () - start, 0);
+		}
+	}
+}
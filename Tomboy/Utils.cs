@@ -720,11 +720,14 @@ namespace Tomboy
 
 		public static string Encode (string source)
 		{
-			xml.WriteString (source);
+			// Also called off the GTK thread, by RemoteControl
+			lock (builder) {
+				xml.WriteString (source);
 
-			string val = builder.ToString ();
-			builder.Length = 0;
-			return val;
+				string val = builder.ToString ();
+				builder.Length = 0;
+				return val;
+			}
 		}
 
 		public static XmlWriterSettings DocumentSettings
@@ -741,15 +744,9 @@ namespace Tomboy
 	// Strip xml tags
 	public class XmlDecoder
 	{
-		static StringBuilder builder;
-
-		static XmlDecoder ()
-		{
-			builder = new StringBuilder ();
-		}
-
 		public static string Decode (string source)
 		{
+			StringBuilder builder = new StringBuilder ();
 			StringReader reader = new StringReader (source);
 			XmlTextReader xml = new XmlTextReader (reader);
 			xml.Namespaces = false;
@@ -765,9 +762,7 @@ namespace Tomboy
 
 			xml.Close ();
 
-			string val = builder.ToString ();
-			builder.Length = 0;
-			return val;
+			return builder.ToString ();
 		}
 	}
 
@@ -1119,5 +1114,50 @@ namespace Tomboy
 			foreach (string dir_path in Directory.GetDirectories (old_path))
 				CopyDirectory (dir_path, Path.Combine (new_path, Path.GetFileName (dir_path)));
 		}
+
+		/// <summary>
+		/// Run action on every item using at most max_workers threads.
+		/// Meant for I/O bound work, like reading and writing files on a
+		/// network mount where each file costs a round trip.  Returns
+		/// once every item has been processed.  Actions should handle
+		/// their own per-item errors; if one throws anyway, the remaining
+		/// items are still processed and an exception with the same
+		/// message is thrown, with the first one as its InnerException.
+		/// Wrapping it keeps the stack trace of the worker thread.
+		/// </summary>
+		public static void ForEachParallel<T> (IList<T> items, int max_workers, Action<T> action)
+		{
+			int count = items.Count;
+			int next = -1;
+			Exception first_error = null;
+
+			ThreadStart work = delegate {
+				int index;
+				while ((index = Interlocked.Increment (ref next)) < count) {
+					try {
+						action (items [index]);
+					} catch (Exception e) {
+						Interlocked.CompareExchange (ref first_error, e, null);
+					}
+				}
+			};
+
+			int workers = Math.Min (max_workers, count);
+			if (workers <= 1) {
+				work ();
+			} else {
+				Thread [] threads = new Thread [workers];
+				for (int i = 0; i < workers; i++) {
+					threads [i] = new Thread (work);
+					threads [i].IsBackground = true;
+					threads [i].Start ();
+				}
+				foreach (Thread thread in threads)
+					thread.Join ();
+			}
+
+			if (first_error != null)
+				throw new Exception (first_error.Message, first_error);
+		}
 	}
 }
@@ -566,7 +566,8 @@ namespace Tomboy
 
 		void OnDeleteRange (object sender, Gtk.DeleteRangeArgs args)
 		{
-			ApplyUrlToBlock (args.Start, args.End);
+			using (Tracer.Span ("NoteUrlWatcher.Highlight", "watcher"))
+				ApplyUrlToBlock (args.Start, args.End);
 		}
 
 		void OnInsertText (object sender, Gtk.InsertTextArgs args)
@@ -574,7 +575,8 @@ namespace Tomboy
 			Gtk.TextIter start = args.Pos;
 			start.BackwardChars (args.Length);
 
-			ApplyUrlToBlock (start, args.Pos);
+			using (Tracer.Span ("NoteUrlWatcher.Highlight", "watcher"))
+				ApplyUrlToBlock (start, args.Pos);
 		}
 
 		[GLib.ConnectBefore]
@@ -661,6 +663,7 @@ namespace Tomboy
 		{
 			Manager.NoteDeleted += OnNoteDeleted;
 			Manager.NoteAdded += OnNoteAdded;
+			Manager.NotesImported += OnNotesImported;
 			Manager.NoteRenamed += OnNoteRenamed;
 		}
 
@@ -668,6 +671,7 @@ namespace Tomboy
 		{
 			Manager.NoteDeleted -= OnNoteDeleted;
 			Manager.NoteAdded -= OnNoteAdded;
+			Manager.NotesImported -= OnNotesImported;
 			Manager.NoteRenamed -= OnNoteRenamed;
 		}
 
@@ -709,6 +713,19 @@ namespace Tomboy
 			HighlightInBlock (Buffer.StartIter, Buffer.EndIter);
 		}
 
+		void OnNotesImported (object sender, List<Note> imported)
+		{
+			string body = Note.TextContent.ToLower ();
+
+			// One pass over the buffer finds links to all the new notes
+			foreach (Note added in imported) {
+				if (body.IndexOf (added.Title.ToLower ()) > -1) {
+					HighlightInBlock (Buffer.StartIter, Buffer.EndIter);
+					return;
+				}
+			}
+		}
+
 		void OnNoteDeleted (object sender, Note deleted)
 		{
 			if (deleted == this.Note)
@@ -738,8 +755,10 @@ namespace Tomboy
 				return;
 
 			// Highlight previously unlinked text
-			if (ContainsText (renamed.Title))
-				HighlightNoteInBlock (renamed, Buffer.StartIter, Buffer.EndIter);
+			if (ContainsText (renamed.Title)) {
+				using (Tracer.Span ("NoteLinkWatcher.Highlight", "watcher"))
+					HighlightNoteInBlock (renamed, Buffer.StartIter, Buffer.EndIter);
+			}
 		}
 
 		void DoHighlight (TrieHit hit, Gtk.TextIter start, Gtk.TextIter end)
@@ -813,9 +832,11 @@ namespace Tomboy
 
 		void HighlightInBlock (Gtk.TextIter start, Gtk.TextIter end)
 		{
-			IList<TrieHit> hits = Manager.TitleTrie.FindMatches (start.GetSlice (end));
-			foreach (TrieHit hit in hits) {
-				DoHighlight (hit, start, end);
+			using (Tracer.Span ("NoteLinkWatcher.Highlight", "watcher")) {
+				IList<TrieHit> hits = Manager.TitleTrie.FindMatches (start.GetSlice (end));
+				foreach (TrieHit hit in hits) {
+					DoHighlight (hit, start, end);
+				}
 			}
 		}
 
@@ -974,7 +995,8 @@ namespace Tomboy
 
 		void OnDeleteRange (object sender, Gtk.DeleteRangeArgs args)
 		{
-			ApplyWikiwordToBlock (args.Start, args.End);
+			using (Tracer.Span ("NoteWikiWatcher.Highlight", "watcher"))
+				ApplyWikiwordToBlock (args.Start, args.End);
 			
 		}
 
@@ -983,7 +1005,8 @@ namespace Tomboy
 			Gtk.TextIter start = args.Pos;
 			start.BackwardChars (args.Length);
 
-			ApplyWikiwordToBlock (start, args.Pos);
+			using (Tracer.Span ("NoteWikiWatcher.Highlight", "watcher"))
+				ApplyWikiwordToBlock (start, args.Pos);
 			
 		}
 	}
@@ -1112,6 +1135,9 @@ namespace Tomboy
 		}
 	}
 
+	// Tags can be removed from closed notes (notebooks, sync), so this
+	// has to be attached to every note.
+	[EagerNoteAddin]
 	public class NoteTagsWatcher : NoteAddin
 	{
 		static NoteTagsWatcher ()
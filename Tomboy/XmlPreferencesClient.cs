@@ -1,10 +1,23 @@
 using System;
 using System.IO;
 using System.Collections.Generic;
+using System.Threading;
 using System.Xml;
 
 namespace Tomboy
 {
+	/// <summary>
+	/// Preferences kept in prefs.xml, for platforms without GConf.
+	///
+	/// Values are parsed once and kept in a cache by key, so Get doesn't
+	/// search the document.  Set changes the document in memory and
+	/// notifies straight away, but the file is only written SaveDelay
+	/// milliseconds after the first unsaved change, so a burst of changes
+	/// costs one write.  The new file is synced to disk and then replaces
+	/// the old one, so a crash leaves one or the other.  Unsaved changes
+	/// are also written by SuggestSync and when the process exits, and a
+	/// failed write is tried again after another delay.
+	/// </summary>
 	public class XmlPreferencesClient : IPreferencesClient
 	{
 		#region Private Members
@@ -13,22 +26,64 @@ namespace Tomboy
 		private XmlDocument prefsDoc;
 		private Dictionary<string, NotifyEventHandler> events;
 
+		// key -> parsed value, for keys looked up or set so far
+		private Dictionary<string, object> cache;
+
+		// Guards prefsDoc, cache and dirty; saves happen on a timer thread
+		private readonly object prefsLock = new object ();
+		private bool dirty;
+		private Timer saveTimer;
+		private int saveDelay;
+		private int writeCount;
+
 		#endregion
 
+		/// <summary>
+		/// Milliseconds from the first unsaved change to the write, unless
+		/// a constructor is given another delay.
+		/// </summary>
+		public const int SaveDelay = 1000;
+
 		#region Constructor
 
 		public XmlPreferencesClient ()
+			: this (Path.Combine (Services.NativeApplication.ConfigurationDirectory, "prefs.xml"), SaveDelay, true)
+		{
+		}
+
+		/// <summary>
+		/// Use the given file, without migrating an old one.
+		/// </summary>
+		public XmlPreferencesClient (string fileName)
+			: this (fileName, SaveDelay, false)
 		{
-			string confDir = Services.NativeApplication.ConfigurationDirectory;
-			fileName = Path.Combine (confDir, "prefs.xml");
+		}
+
+		/// <summary>
+		/// Use the given file, without migrating an old one, and write
+		/// it saveDelay milliseconds after the first unsaved change.  With
+		/// Timeout.Infinite, changes are only written by Flush,
+		/// SuggestSync and at exit.
+		/// </summary>
+		public XmlPreferencesClient (string fileName, int saveDelay)
+			: this (fileName, saveDelay, false)
+		{
+		}
+
+		private XmlPreferencesClient (string fileName, int saveDelay, bool migrate)
+		{
+			this.fileName = fileName;
+			this.saveDelay = saveDelay;
 			prefsDoc = new XmlDocument ();
 
 			// Migration from old location
 			// NOTE: Assumes this class is instantiated before
 			//       NoteManager performs its migration
-			if (!Directory.Exists (Services.NativeApplication.DataDirectory) &&
+			if (migrate &&
+			    !Directory.Exists (Services.NativeApplication.DataDirectory) &&
 			    !File.Exists (fileName) &&
 			    File.Exists (Path.Combine (Services.NativeApplication.PreOneDotZeroNoteDirectory, "prefs.xml"))) {
+				string confDir = Path.GetDirectoryName (fileName);
 				if (!Directory.Exists (confDir))
 					Directory.CreateDirectory (confDir);
 				File.Copy (Path.Combine (Services.NativeApplication.PreOneDotZeroNoteDirectory, "prefs.xml"),
@@ -38,18 +93,42 @@ namespace Tomboy
 			if (File.Exists (fileName))
 				prefsDoc.Load (fileName);
 			events = new Dictionary<string, NotifyEventHandler> ();
+			cache = new Dictionary<string, object> ();
+
+			saveTimer = new Timer (OnSaveTimeout);
+			AppDomain.CurrentDomain.ProcessExit += delegate {
+				Flush ();
+			};
 		}
 		
 		#endregion
+
+		/// <summary>
+		/// How many times the file has been written.
+		/// </summary>
+		public int WriteCount
+		{
+			get {
+				return writeCount;
+			}
+		}
 		
 		#region IPreferencesClient implementation
 		
 		public void Set (string key, object value)
 		{
 			try {
-				CreatePath (key);
-				prefsDoc.SelectSingleNode (key).InnerText = System.Convert.ToString(value);
-				prefsDoc.Save(fileName);
+				string text = System.Convert.ToString (value);
+				lock (prefsLock) {
+					CreatePath (key);
+					prefsDoc.SelectSingleNode (key).InnerText = text;
+					// As Get would read it back from the file
+					cache [key] = Parse (text);
+					if (!dirty) {
+						dirty = true;
+						saveTimer.Change (saveDelay, Timeout.Infinite);
+					}
+				}
 				foreach (string nkey in events.Keys) {
 					NotifyEventHandler handler = events [nkey] as NotifyEventHandler;
 					if (handler != null && key.StartsWith (nkey))
@@ -64,31 +143,22 @@ namespace Tomboy
 		
 		public object Get (string key)
 		{
+			object value;
 			try {
-				XmlElement element = prefsDoc.SelectSingleNode(key) as XmlElement;
-				if (element != null) {
-					int intVal;
-					double doubleVal;
-					bool boolVal;
-
-					string innerText = element.InnerText;
-
-					if (bool.TryParse (innerText, out boolVal))
-						return boolVal;
-					else if (int.TryParse (innerText, out intVal))
-						return intVal;
-					else if (double.TryParse (innerText, out doubleVal))
-						return doubleVal;
-					else
-						return innerText;
+				lock (prefsLock) {
+					if (cache.TryGetValue (key, out value))
+						return value;
+
+					XmlElement element = prefsDoc.SelectSingleNode(key) as XmlElement;
+					if (element != null) {
+						value = Parse (element.InnerText);
+						cache [key] = value;
+						return value;
+					}
 				}
-				
-				// TODO: Ugly, fix
-				throw new System.Exception();
 			} catch {
-				throw new NoSuchKeyException (key);
 			}
-
+			throw new NoSuchKeyException (key);
 		}
 		
 		public void AddNotify (string dir, NotifyEventHandler notify)
@@ -111,13 +181,76 @@ namespace Tomboy
 		
 		public void SuggestSync ()
 		{
-			// TODO: Sync with file?
+			Flush ();
 		}
 		
 		#endregion
 
+		/// <summary>
+		/// Write unsaved changes to the file now.
+		/// </summary>
+		public void Flush ()
+		{
+			lock (prefsLock) {
+				if (!dirty)
+					return;
+				saveTimer.Change (Timeout.Infinite, Timeout.Infinite);
+				try {
+					Save ();
+					dirty = false;
+				} catch (Exception e) {
+					// Still unsaved; try again later
+					Logger.Error ("Could not save preferences to {0}: {1}", fileName, e.Message);
+					saveTimer.Change (saveDelay, Timeout.Infinite);
+				}
+			}
+		}
+
 		#region Private Methods
 
+		private void OnSaveTimeout (object state)
+		{
+			Flush ();
+		}
+
+		// Write a temporary file, sync it to disk and put it in place
+		// with a single rename, so that a crash leaves either the old
+		// prefs.xml or the new one, never a half written one
+		private void Save ()
+		{
+			string dir = Path.GetDirectoryName (fileName);
+			if (!string.IsNullOrEmpty (dir) && !Directory.Exists (dir))
+				Directory.CreateDirectory (dir);
+
+			string tmp_file = fileName + ".tmp";
+			using (FileStream stream = new FileStream (tmp_file, FileMode.Create, FileAccess.Write)) {
+				prefsDoc.Save (stream);
+				stream.Flush (true);
+			}
+
+			if (File.Exists (fileName))
+				File.Replace (tmp_file, fileName, null);
+			else
+				File.Move (tmp_file, fileName);
+			writeCount++;
+		}
+
+		private static object Parse (string innerText)
+		{
+			int intVal;
+			double doubleVal;
+			bool boolVal;
+
+			if (bool.TryParse (innerText, out boolVal))
+				return boolVal;
+			else if (int.TryParse (innerText, out intVal))
+				return intVal;
+			else if (double.TryParse (innerText, out doubleVal))
+				return doubleVal;
+			else
+				return innerText;
+		}
+
 		private void CreatePath(string path)
 		{
 			if (path.Length == 0)
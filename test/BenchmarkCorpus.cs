@@ -0,0 +1,286 @@
+namespace TomboyTest
+{
+	using System;
+	using System.Collections.Generic;
+	using System.Globalization;
+	using System.IO;
+	using System.Text;
+	using System.Xml;
+
+	/// <summary>
+	/// Generates a directory of synthetic .note files for benchmarks.
+	/// The same settings and seed always give byte for byte the same
+	/// notes, so results from different runs can be compared.
+	///
+	/// Note lengths follow a log-normal distribution around MedianWords,
+	/// capped at MaxWords.  Words are made up from syllables and picked
+	/// with a skew towards the front of the vocabulary, so some words are
+	/// common and most are rare, like in real text.  Bodies link to other
+	/// notes' titles at LinkDensity links per 100 words.
+	///
+	/// Settings can be overridden with TOMBOY_BENCH_CORPUS, a comma
+	/// separated list such as "median-words=300,link-density=2,tags=10".
+	/// </summary>
+	public class BenchmarkCorpus
+	{
+		public int NoteCount = 1000;
+		public int Seed = 20110101;
+		public int MedianWords = 150;
+		public int MaxWords = 5000;
+		public double LinkDensity = 0.5;
+		public int TagCount = 40;
+		public int MaxTagsPerNote = 3;
+		public int NotebookCount = 8;
+		// Fraction of notes that are in a notebook
+		public double NotebookShare = 0.6;
+		public int VocabularySize = 5000;
+
+		static readonly string [] syllables = {
+			"ka", "lo", "mi", "ne", "tru", "sa", "vel", "dor", "pim", "gra",
+			"shu", "ten", "bo", "ri", "qua", "zel", "an", "os", "fi", "mar"
+		};
+
+		string [] vocabulary;
+		string [] titles;
+
+		public string [] Vocabulary
+		{
+			get {
+				return vocabulary;
+			}
+		}
+
+		public string [] Titles
+		{
+			get {
+				return titles;
+			}
+		}
+
+		/// <summary>
+		/// Total size of the generated note files.
+		/// </summary>
+		public long TotalBytes
+		{
+			get; private set;
+		}
+
+		public static BenchmarkCorpus FromEnvironment (int noteCount)
+		{
+			BenchmarkCorpus corpus = new BenchmarkCorpus ();
+			corpus.NoteCount = noteCount;
+
+			string settings = Environment.GetEnvironmentVariable ("TOMBOY_BENCH_CORPUS");
+			if (string.IsNullOrEmpty (settings))
+				return corpus;
+
+			foreach (string setting in settings.Split (',')) {
+				string [] pair = setting.Split ('=');
+				if (pair.Length != 2)
+					throw new ArgumentException ("Bad TOMBOY_BENCH_CORPUS setting: " + setting);
+				string value = pair [1].Trim ();
+				switch (pair [0].Trim ()) {
+				case "seed":
+					corpus.Seed = int.Parse (value);
+					break;
+				case "median-words":
+					corpus.MedianWords = int.Parse (value);
+					break;
+				case "max-words":
+					corpus.MaxWords = int.Parse (value);
+					break;
+				case "link-density":
+					corpus.LinkDensity = double.Parse (value, CultureInfo.InvariantCulture);
+					break;
+				case "tags":
+					corpus.TagCount = int.Parse (value);
+					break;
+				case "tags-per-note":
+					corpus.MaxTagsPerNote = int.Parse (value);
+					break;
+				case "notebooks":
+					corpus.NotebookCount = int.Parse (value);
+					break;
+				case "notebook-share":
+					corpus.NotebookShare = double.Parse (value, CultureInfo.InvariantCulture);
+					break;
+				default:
+					throw new ArgumentException ("Unknown TOMBOY_BENCH_CORPUS setting: " + pair [0]);
+				}
+			}
+			return corpus;
+		}
+
+		/// <summary>
+		/// A short description of the settings, for reports.
+		/// </summary>
+		public string Describe ()
+		{
+			return string.Format (CultureInfo.InvariantCulture,
+			                      "notes={0},seed={1},median-words={2},max-words={3}," +
+			                      "link-density={4},tags={5},tags-per-note={6}," +
+			                      "notebooks={7},notebook-share={8}",
+			                      NoteCount, Seed, MedianWords, MaxWords, LinkDensity,
+			                      TagCount, MaxTagsPerNote, NotebookCount, NotebookShare);
+		}
+
+		/// <summary>
+		/// Write the notes into directory, which must exist.  Returns the
+		/// paths of the files written.
+		/// </summary>
+		public List<string> Generate (string directory)
+		{
+			Random random = new Random (Seed);
+			vocabulary = MakeVocabulary (random);
+
+			titles = new string [NoteCount];
+			for (int i = 0; i < NoteCount; i++)
+				titles [i] = string.Format ("{0} {1} {2}",
+				                            Capitalize (PickWord (random)),
+				                            PickWord (random), i);
+
+			DateTime baseDate = new DateTime (2010, 1, 1, 0, 0, 0, DateTimeKind.Utc);
+			XmlWriterSettings settings = new XmlWriterSettings ();
+			settings.Encoding = new UTF8Encoding (false);
+			settings.Indent = true;
+
+			List<string> paths = new List<string> (NoteCount);
+			long totalBytes = 0;
+			for (int i = 0; i < NoteCount; i++) {
+				byte [] guid = new byte [16];
+				random.NextBytes (guid);
+				string id = new Guid (guid).ToString ();
+				string path = Path.Combine (directory, id + ".note");
+				DateTime date = baseDate.AddMinutes (i);
+
+				using (XmlWriter xml = XmlWriter.Create (path, settings)) {
+					xml.WriteStartDocument ();
+					xml.WriteStartElement (null, "note", "http://beatniksoftware.com/tomboy");
+					xml.WriteAttributeString ("version", "0.3");
+					xml.WriteAttributeString ("xmlns", "link", null,
+					                          "http://beatniksoftware.com/tomboy/link");
+					xml.WriteAttributeString ("xmlns", "size", null,
+					                          "http://beatniksoftware.com/tomboy/size");
+					xml.WriteElementString ("title", titles [i]);
+					xml.WriteStartElement ("text");
+					xml.WriteAttributeString ("xml", "space", null, "preserve");
+					xml.WriteRaw (MakeContent (random, i));
+					xml.WriteEndElement ();
+					string dateString = XmlConvert.ToString (date, XmlDateTimeSerializationMode.Utc);
+					xml.WriteElementString ("last-change-date", dateString);
+					xml.WriteElementString ("last-metadata-change-date", dateString);
+					xml.WriteElementString ("create-date", dateString);
+
+					List<string> tags = MakeTags (random);
+					if (tags.Count > 0) {
+						xml.WriteStartElement ("tags");
+						foreach (string tag in tags)
+							xml.WriteElementString ("tag", tag);
+						xml.WriteEndElement ();
+					}
+
+					xml.WriteElementString ("open-on-startup", "False");
+					xml.WriteEndElement ();
+					xml.WriteEndDocument ();
+				}
+
+				totalBytes += new FileInfo (path).Length;
+				paths.Add (path);
+			}
+
+			TotalBytes = totalBytes;
+			return paths;
+		}
+
+		string [] MakeVocabulary (Random random)
+		{
+			Dictionary<string, bool> seen = new Dictionary<string, bool> ();
+			string [] words = new string [VocabularySize];
+			int count = 0;
+			while (count < words.Length) {
+				int length = 1 + random.Next (4);
+				StringBuilder word = new StringBuilder ();
+				for (int i = 0; i < length; i++)
+					word.Append (syllables [random.Next (syllables.Length)]);
+				string w = word.ToString ();
+				if (seen.ContainsKey (w))
+					continue;
+				seen [w] = true;
+				words [count++] = w;
+			}
+			return words;
+		}
+
+		// Skewed towards the start of the vocabulary
+		string PickWord (Random random)
+		{
+			double r = random.NextDouble ();
+			return vocabulary [(int) (r * r * r * vocabulary.Length)];
+		}
+
+		static string Capitalize (string word)
+		{
+			return char.ToUpperInvariant (word [0]) + word.Substring (1);
+		}
+
+		int PickLength (Random random)
+		{
+			// Box-Muller, sigma 1
+			double u1 = 1.0 - random.NextDouble ();
+			double u2 = random.NextDouble ();
+			double normal = Math.Sqrt (-2.0 * Math.Log (u1)) * Math.Cos (2.0 * Math.PI * u2);
+			int words = (int) (MedianWords * Math.Exp (normal));
+			return Math.Max (5, Math.Min (MaxWords, words));
+		}
+
+		string MakeContent (Random random, int index)
+		{
+			StringBuilder content = new StringBuilder ();
+			content.Append ("<note-content version=\"0.1\">");
+			content.Append (titles [index]);
+			content.Append ("\n\n");
+
+			int words = PickLength (random);
+			double linkChance = LinkDensity / 100.0;
+			for (int i = 0; i < words; i++) {
+				if (i > 0)
+					content.Append (i % 12 == 0 ? '\n' : ' ');
+
+				if (NoteCount > 1 && random.NextDouble () < linkChance) {
+					int target = random.Next (NoteCount);
+					if (target == index)
+						target = (target + 1) % NoteCount;
+					content.Append ("<link:internal>");
+					content.Append (titles [target]);
+					content.Append ("</link:internal>");
+				} else if (random.Next (50) == 0) {
+					content.Append ("<bold>");
+					content.Append (PickWord (random));
+					content.Append ("</bold>");
+				} else {
+					content.Append (PickWord (random));
+				}
+			}
+
+			content.Append ("</note-content>");
+			return content.ToString ();
+		}
+
+		List<string> MakeTags (Random random)
+		{
+			List<string> tags = new List<string> ();
+			if (NotebookCount > 0 && random.NextDouble () < NotebookShare)
+				tags.Add ("system:notebook:Notebook " + random.Next (NotebookCount));
+
+			if (TagCount > 0) {
+				int count = random.Next (MaxTagsPerNote + 1);
+				for (int i = 0; i < count; i++) {
+					string tag = "tag" + random.Next (TagCount);
+					if (!tags.Contains (tag))
+						tags.Add (tag);
+				}
+			}
+			return tags;
+		}
+	}
+}
@@ -1,7 +1,8 @@
 namespace TomboyTest
 {
 	using System;
-	using System.IO;
+	using System.Collections.Generic;
+	using System.Threading;
 	using NUnit.Framework;
 	using Tomboy;
 
@@ -10,7 +11,7 @@ namespace TomboyTest
 		public string Message = null;
 		public object[] Arguments = null;
 
-		public void Log (string msg, params object[] args)
+		public void Log (Level lvl, string msg, params object[] args)
 		{
 			Message = msg;
 			Arguments = args;
@@ -21,18 +22,27 @@ namespace TomboyTest
 	public class LoggerTest
 	{
 		DebugLogger logger = null;
+		ILogger old_device = null;
 
 		[SetUp]
 		public void Setup ()
 		{
 			logger = new DebugLogger ();
-			Logger.Instance = logger;
+			old_device = Logger.LogDevice;
+			Logger.LogDevice = logger;
+			Logger.LogLevel = Level.DEBUG;
+		}
+
+		[TearDown]
+		public void RestoreDevice ()
+		{
+			Logger.LogDevice = old_device;
 		}
 
 		[Test]
 		public void LogSimple ()
 		{
-			Logger.Log ("Foo");
+			Logger.Debug ("Foo");
 			Assert.AreEqual ("Foo", logger.Message);
 			Assert.AreEqual (0, logger.Arguments.Length);
 		}
@@ -40,8 +50,8 @@ namespace TomboyTest
 		[Test]
 		public void LogOneArgument ()
 		{
-			Logger.Log ("Foo", "arg");
-			Assert.AreEqual ("Foo", logger.Message);
+			Logger.Debug ("Foo {0}", "arg");
+			Assert.AreEqual ("Foo {0}", logger.Message);
 			Assert.AreEqual (1, logger.Arguments.Length);
 			Assert.AreEqual ("arg", logger.Arguments[0]);
 		}
@@ -49,11 +59,161 @@ namespace TomboyTest
 		[Test]
 		public void LogTwoArguments ()
 		{
-			Logger.Log ("Foo", 1, 2);
+			Logger.Info ("Foo", 1, 2);
 			Assert.AreEqual ("Foo", logger.Message);
 			Assert.AreEqual (2, logger.Arguments.Length);
 			Assert.AreEqual (1, logger.Arguments[0]);
 			Assert.AreEqual (2, logger.Arguments[1]);
 		}
+
+		[Test]
+		public void DisabledLevelIsNotLogged ()
+		{
+			Logger.LogLevel = Level.INFO;
+			Logger.Debug ("Foo {0}", 1);
+			Assert.IsNull (logger.Message);
+			Logger.LogLevel = Level.DEBUG;
+		}
+
+		[Test]
+		public void GenericDebugPassesArgumentsUnformatted ()
+		{
+			DateTime date = new DateTime (2010, 3, 4);
+			Logger.Debug ("{0:F2} {1:x} {2:yyyy-MM-dd}", 1.5, 255, date);
+			Assert.AreEqual ("{0:F2} {1:x} {2:yyyy-MM-dd}", logger.Message);
+			Assert.AreEqual (3, logger.Arguments.Length);
+			Assert.AreEqual (1.5, logger.Arguments[0]);
+			Assert.AreEqual (255, logger.Arguments[1]);
+			Assert.AreEqual (date, logger.Arguments[2]);
+		}
+	}
+
+	[TestFixture]
+	public class AsyncLoggerTest
+	{
+		class RecordingWriter : ILogWriter
+		{
+			public List<string> Messages = new List<string> ();
+			public ManualResetEvent Release = new ManualResetEvent (true);
+			public ManualResetEvent Writing = new ManualResetEvent (false);
+
+			public void Write (Level lvl, DateTime time, string msg)
+			{
+				Writing.Set ();
+				Release.WaitOne ();
+				lock (Messages)
+					Messages.Add (msg);
+			}
+
+			public void Flush ()
+			{
+			}
+
+			public string [] Taken ()
+			{
+				lock (Messages)
+					return Messages.ToArray ();
+			}
+		}
+
+		class Mutable
+		{
+			public string Value;
+
+			public override string ToString ()
+			{
+				return Value;
+			}
+		}
+
+		[Test]
+		public void MessagesAreWrittenInOrder ()
+		{
+			RecordingWriter writer = new RecordingWriter ();
+			AsyncLogger logger = new AsyncLogger (writer, 16);
+			for (int i = 0; i < 10; i++)
+				logger.Log (Level.DEBUG, "Message {0}", i);
+			logger.Flush ();
+
+			string [] written = writer.Taken ();
+			Assert.AreEqual (10, written.Length);
+			for (int i = 0; i < 10; i++)
+				Assert.AreEqual ("Message " + i, written [i]);
+		}
+
+		[Test]
+		public void ObjectsAreFormattedWhenLogged ()
+		{
+			RecordingWriter writer = new RecordingWriter ();
+			writer.Release.Reset ();
+			AsyncLogger logger = new AsyncLogger (writer, 16);
+
+			Mutable arg = new Mutable ();
+			arg.Value = "before";
+			logger.Log (Level.DEBUG, "Value {0}", arg);
+			arg.Value = "after";
+			writer.Release.Set ();
+			logger.Flush ();
+
+			Assert.AreEqual ("Value before", writer.Taken () [0]);
+		}
+
+		[Test]
+		public void GenericDebugIsFormattedByTheWriter ()
+		{
+			RecordingWriter writer = new RecordingWriter ();
+			AsyncLogger logger = new AsyncLogger (writer, 16);
+			ILogger old_device = Logger.LogDevice;
+			Logger.LogDevice = logger;
+			Logger.LogLevel = Level.DEBUG;
+			try {
+				DateTime date = new DateTime (2010, 3, 4);
+				Logger.Debug ("[{0,6:F2}] [{1,-4:x}] {2:yyyy-MM-dd}", 1.5, 255, date);
+				Logger.Debug ("{0}-{1}", null as string, "b");
+				Logger.Debug ("Missing {1}", "a");
+				logger.Flush ();
+
+				string [] written = writer.Taken ();
+				Assert.AreEqual (string.Format ("[{0,6:F2}] [{1,-4:x}] {2:yyyy-MM-dd}", 1.5, 255, date),
+				                 written [0]);
+				Assert.AreEqual ("-b", written [1]);
+				// A bad format doesn't throw on either thread
+				Assert.AreEqual ("Missing {1} [a]", written [2]);
+			} finally {
+				Logger.LogDevice = old_device;
+			}
+		}
+
+		[Test]
+		public void FatalIsWrittenImmediately ()
+		{
+			RecordingWriter writer = new RecordingWriter ();
+			AsyncLogger logger = new AsyncLogger (writer, 16);
+			logger.Log (Level.FATAL, "Going down: {0}", "bye");
+			Assert.AreEqual ("Going down: bye", writer.Taken () [0]);
+		}
+
+		[Test]
+		public void FullBufferDropsAndReports ()
+		{
+			RecordingWriter writer = new RecordingWriter ();
+			writer.Release.Reset ();
+			AsyncLogger logger = new AsyncLogger (writer, 4);
+
+			// Hold the writer thread in its first Write; that message's
+			// slot is already free, so four more fit and five are dropped
+			logger.Log (Level.ERROR, "First");
+			Assert.IsTrue (writer.Writing.WaitOne (5000, false));
+			for (int i = 0; i < 9; i++)
+				logger.Log (Level.DEBUG, "Message {0}", i);
+			writer.Release.Set ();
+			logger.Flush ();
+
+			string [] written = writer.Taken ();
+			Assert.AreEqual (6, written.Length);
+			Assert.AreEqual ("First", written [0]);
+			Assert.AreEqual ("Message 3", written [4]);
+			Assert.AreEqual ("Logger: 5 messages dropped, the log buffer was full", written [5]);
+		}
 	}
 }
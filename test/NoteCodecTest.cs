@@ -0,0 +1,364 @@
+namespace TomboyTest
+{
+	using System;
+	using System.Collections.Generic;
+	using System.IO;
+	using System.Text;
+	using NUnit.Framework;
+	using Tomboy;
+
+	/// <summary>
+	/// Checks NoteCodec against NoteArchiver's XmlTextReader and
+	/// XmlWriter code, on notes and note files made up from a fixed
+	/// seed.  Some of the files are damaged on purpose, so that the
+	/// cases the codec leaves to the generic code are covered too.
+	/// </summary>
+	[TestFixture]
+	public class NoteCodecTest
+	{
+		const int Seed = 20111031;
+		const int NoteCount = 300;
+
+		static readonly string [] words = {
+			"plain", "words", "a&b", "x<y", "p>q", "\"quoted\"", "it's",
+			"tab\there", "new\nline", "café", "中文", "😀",
+			"$1", "a.b", "(x)", "[set]", "dollar$", "#hash", "&amp;", "]]>"
+		};
+
+		static readonly string [] markup = {
+			"bold", "italic", "strikethrough", "highlight", "monospace",
+			"size:small", "size:large", "link:internal", "link:url"
+		};
+
+		class PlainNoteArchiver : NoteArchiver
+		{
+		}
+
+		NoteArchiver archiver;
+		string dir;
+
+		[SetUp]
+		public void CreateDirectory ()
+		{
+			archiver = new PlainNoteArchiver ();
+			dir = Path.Combine (Path.GetTempPath (),
+			                    "tomboy-codec-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (dir);
+		}
+
+		[TearDown]
+		public void RemoveDirectory ()
+		{
+			NoteCodec.Enabled = true;
+			Directory.Delete (dir, true);
+		}
+
+		[Test]
+		public void WriteMatchesXmlWriter ()
+		{
+			Random random = new Random (Seed);
+			string path = Path.Combine (dir, "write.note");
+
+			for (int i = 0; i < NoteCount; i++) {
+				NoteData note = MakeNote (random, i);
+
+				string generic = Generic (delegate { return NoteArchiver.WriteString (note); });
+				string codec = Codec (delegate { return NoteArchiver.WriteString (note); });
+				Assert.AreEqual (generic, codec, "WriteString, note " + i);
+
+				generic = Generic (delegate { return WriteFile (path, note); });
+				codec = Codec (delegate { return WriteFile (path, note); });
+				Assert.AreEqual (generic, codec, "WriteFile, note " + i);
+			}
+		}
+
+		[Test]
+		public void ReadMatchesXmlTextReader ()
+		{
+			Random random = new Random (Seed);
+			string path = Path.Combine (dir, "read.note");
+			int fast = 0;
+
+			for (int i = 0; i < NoteCount; i++) {
+				NoteData note = MakeNote (random, i);
+				string xml = Generic (delegate { return NoteArchiver.WriteString (note); });
+				if (xml.StartsWith ("!"))
+					continue;
+
+				xml = xml.Replace ("encoding=\"utf-16\"", "encoding=\"utf-8\"");
+				int mutation = random.Next (mutations);
+				byte [] bytes = Encode (Mutate (random, xml, mutation), random.Next (2) == 0);
+				string uri = "note://tomboy/" + i;
+
+				File.WriteAllBytes (path, bytes);
+				string generic = Generic (delegate {
+					return Describe (archiver.ReadFile (path, uri));
+				});
+				File.WriteAllBytes (path, bytes);
+				string codec = Codec (delegate {
+					return Describe (archiver.ReadFile (path, uri));
+				});
+				Assert.AreEqual (generic, codec, "note " + i + ", mutation " + mutation);
+
+				File.WriteAllBytes (path, bytes);
+				NoteData data;
+				string version;
+				if (NoteCodec.TryReadFile (path, uri, out data, out version))
+					fast++;
+				else if (mutation == 0 && xml.IndexOf ('\r') < 0 && !generic.StartsWith ("!"))
+					Assert.Fail ("unchanged note " + i + " was not read by the codec");
+			}
+
+			Assert.Greater (fast, NoteCount / 2, "notes read by the codec");
+		}
+
+		[Test]
+		public void TitleMatchesXmlTextReader ()
+		{
+			Random random = new Random (Seed);
+
+			for (int i = 0; i < NoteCount; i++) {
+				NoteData note = MakeNote (random, i);
+				string xml = Generic (delegate { return NoteArchiver.WriteString (note); });
+				if (xml.StartsWith ("!"))
+					continue;
+
+				int mutation = random.Next (mutations);
+				string mutated = Mutate (random, xml, mutation);
+				string generic = Generic (delegate { return archiver.GetTitleFromNoteXml (mutated); });
+				string codec = Codec (delegate { return archiver.GetTitleFromNoteXml (mutated); });
+				Assert.AreEqual (generic, codec, "note " + i + ", mutation " + mutation);
+			}
+		}
+
+		[Test]
+		public void RenameMatchesRegex ()
+		{
+			Random random = new Random (Seed);
+
+			for (int i = 0; i < NoteCount; i++) {
+				NoteData note = MakeNote (random, i);
+				string xml = Generic (delegate { return NoteArchiver.WriteString (note); });
+				if (xml.StartsWith ("!"))
+					continue;
+
+				string old_title = random.Next (4) == 0 ? MakePhrase (random, 2) : note.Title;
+				string new_title = MakePhrase (random, 1 + random.Next (3));
+				string generic = Generic (delegate {
+					return archiver.GetRenamedNoteXml (xml, old_title, new_title);
+				});
+				string codec = Codec (delegate {
+					return archiver.GetRenamedNoteXml (xml, old_title, new_title);
+				});
+				Assert.AreEqual (generic, codec, "note " + i);
+			}
+		}
+
+		delegate string Result ();
+
+		// The result, or "!" and the exception type
+		static string Generic (Result result)
+		{
+			NoteCodec.Enabled = false;
+			try {
+				return Run (result);
+			} finally {
+				NoteCodec.Enabled = true;
+			}
+		}
+
+		static string Codec (Result result)
+		{
+			NoteCodec.Enabled = true;
+			return Run (result);
+		}
+
+		static string Run (Result result)
+		{
+			try {
+				string value = result ();
+				return value == null ? "(null)" : value;
+			} catch (Exception e) {
+				return "!" + e.GetType ().Name;
+			}
+		}
+
+		string WriteFile (string path, NoteData note)
+		{
+			archiver.WriteFile (path, note);
+			return Convert.ToBase64String (File.ReadAllBytes (path));
+		}
+
+		static string Describe (NoteData data)
+		{
+			StringBuilder text = new StringBuilder ();
+			text.AppendFormat ("{0}|{1}|{2}|{3}|{4}|", data.Uri, data.Title, data.Text,
+			                   Describe (data.CreateDate), Describe (data.ChangeDate));
+			text.AppendFormat ("{0}|{1}|{2}|{3}|{4}|{5}|{6}|{7}|{8}", Describe (data.MetadataChangeDate),
+			                   data.CursorPosition, data.SelectionBoundPosition,
+			                   data.Width, data.Height, data.X, data.Y,
+			                   data.IsOpenOnStartup, string.Join (",", new List<string> (data.Tags.Keys).ToArray ()));
+			return text.ToString ();
+		}
+
+		static string Describe (DateTime date)
+		{
+			return date.Ticks + "/" + date.Kind;
+		}
+
+		static byte [] Encode (string xml, bool bom)
+		{
+			byte [] bytes = new UTF8Encoding (false).GetBytes (xml);
+			if (!bom)
+				return bytes;
+			byte [] preamble = Encoding.UTF8.GetPreamble ();
+			byte [] with_bom = new byte [preamble.Length + bytes.Length];
+			preamble.CopyTo (with_bom, 0);
+			bytes.CopyTo (with_bom, preamble.Length);
+			return with_bom;
+		}
+
+		NoteData MakeNote (Random random, int index)
+		{
+			NoteData note = new NoteData ("note://tomboy/" + index);
+			note.Title = random.Next (40) == 0 ? string.Empty : MakePhrase (random, 1 + random.Next (4));
+			note.Text = MakeContent (random, note.Title);
+			note.ChangeDate = MakeDate (random);
+			note.MetadataChangeDate = MakeDate (random);
+			note.CreateDate = random.Next (5) == 0 ? DateTime.MinValue : MakeDate (random);
+			note.CursorPosition = random.Next (5000);
+			note.SelectionBoundPosition = random.Next (-1, 5000);
+			note.Width = random.Next (1000);
+			note.Height = random.Next (1000);
+			note.X = random.Next (-1, 2000);
+			note.Y = random.Next (-1, 2000);
+			note.IsOpenOnStartup = random.Next (10) == 0;
+
+			// System tags, which don't need a GTK main loop
+			int tags = random.Next (4);
+			for (int i = 0; i < tags; i++) {
+				Tag tag = TagManager.GetOrCreateTag ("system:notebook:" + MakePhrase (random, 1));
+				note.Tags [tag.NormalizedName] = tag;
+			}
+			return note;
+		}
+
+		static string MakePhrase (Random random, int count)
+		{
+			StringBuilder phrase = new StringBuilder ();
+			for (int i = 0; i < count; i++) {
+				if (i > 0)
+					phrase.Append (' ');
+				phrase.Append (words [random.Next (words.Length)]);
+			}
+			// Now and then something XmlWriter has to deal with
+			if (random.Next (30) == 0)
+				phrase.Append (random.Next (2) == 0 ? "\r\n" : "\u0001");
+			return phrase.ToString ();
+		}
+
+		static string MakeContent (Random random, string title)
+		{
+			StringBuilder content = new StringBuilder ();
+			content.Append ("<note-content version=\"0.1\">");
+			content.Append (Escape (title));
+			content.Append ("\n\n");
+
+			int count = random.Next (60);
+			for (int i = 0; i < count; i++) {
+				string word = Escape (MakePhrase (random, 1));
+				if (random.Next (6) == 0) {
+					string tag = markup [random.Next (markup.Length)];
+					content.AppendFormat ("<{0}>{1}</{0}>", tag, word);
+				} else if (random.Next (20) == 0)
+					content.AppendFormat ("<list><list-item dir=\"ltr\">{0}</list-item></list>", word);
+				else
+					content.Append (word);
+				content.Append (random.Next (8) == 0 ? '\n' : ' ');
+			}
+			content.Append ("</note-content>");
+			return content.ToString ();
+		}
+
+		static string Escape (string text)
+		{
+			return text.Replace ("&", "&amp;").Replace ("<", "&lt;").Replace (">", "&gt;");
+		}
+
+		static DateTime MakeDate (Random random)
+		{
+			long start = new DateTime (2000, 1, 1).Ticks;
+			long span = TimeSpan.FromDays (20 * 365).Ticks;
+			return new DateTime (start + (long) (random.NextDouble () * span), DateTimeKind.Local);
+		}
+
+		const int mutations = 20;
+
+		// Things people, other programs and disks do to note files
+		static string Mutate (Random random, string xml, int mutation)
+		{
+			switch (mutation) {
+			case 1:
+				return Insert (xml, "<note-content version=\"0.1\">", "<bold/>");
+			case 2:
+				return Insert (xml, "</title>", "\n  <!-- comment -->");
+			case 3:
+				return xml.Replace ("version=\"0.3\"", "version='0.3'");
+			case 4:
+				return Insert (xml, "<title>", "&#169;&quot;&#x263A;");
+			case 5:
+				return Insert (xml, "<note-content version=\"0.1\">", "&#x263A;");
+			case 6:
+				return Insert (xml, "<note-content version=\"0.1\">", "<![CDATA[x]]>");
+			case 7:
+				return Insert (xml, "</text>", "\n  <pinned>true</pinned>");
+			case 8:
+				return xml.Replace ("</text>\n  ", "</text>");
+			case 9:
+				return xml.Replace ("version=\"0.3\"", "version=\"0.2\"");
+			case 10:
+				return xml.Substring (0, random.Next (xml.Length));
+			case 11:
+				return xml.Replace ("\n", "\r\n");
+			case 12:
+				return xml.Replace ("<note-content version=\"0.1\">", "<note-content version='0.1'>");
+			case 13:
+				return xml.Replace ("<width>", "<width> ").Replace ("<x>", "<x>+");
+			case 14:
+				return xml.Replace ("<open-on-startup>False", "<open-on-startup>false");
+			case 15:
+				return xml.Substring (xml.IndexOf ("?>") + 2);
+			case 16:
+				return "<?xml version=\"1.0\"?>\n<!DOCTYPE note>" + xml.Substring (xml.IndexOf ("?>") + 2);
+			case 17:
+				return Insert (xml, "<note-content version=\"0.1\">", "<bold >b</bold>");
+			case 18:
+				return MoveTitleLast (xml);
+			case 19:
+				return xml.Replace ("<title>", "<title xml:lang=\"en\">");
+			default:
+				return xml;
+			}
+		}
+
+		static string Insert (string xml, string after, string text)
+		{
+			int index = xml.IndexOf (after);
+			if (index < 0)
+				return xml;
+			return xml.Insert (index + after.Length, text);
+		}
+
+		static string MoveTitleLast (string xml)
+		{
+			int start = xml.IndexOf ("\n  <title>");
+			int end = xml.IndexOf ("</title>");
+			int close = xml.LastIndexOf ("\n</note>");
+			if (start < 0 || end < 0 || close < 0)
+				return xml;
+			end += "</title>".Length;
+			string title = xml.Substring (start, end - start);
+			return xml.Substring (0, start) + xml.Substring (end, close - end) + title + xml.Substring (close);
+		}
+	}
+}
@@ -1,6 +1,7 @@
 namespace TomboyTest
 {
 	using System;
+	using System.Collections.Generic;
 	using System.IO;
 	using NUnit.Framework;
 	using Tomboy;
@@ -74,4 +75,221 @@ public MyNoteManager () :
 			Assert.IsTrue (manager.CreatedStartNote);
 		}
 	}
+
+	/// <summary>
+	/// Adding notes in batches, against a real manager in a temporary
+	/// notes directory.  Skipped where Tomboy cannot be initialized.
+	/// </summary>
+	[TestFixture]
+	public class NoteManagerBatchTest
+	{
+		string root;
+		NoteManager manager;
+		int added_count;
+		List<List<Note>> imported;
+
+		[TestFixtureSetUp]
+		public void InitializeApplication ()
+		{
+			root = Path.Combine (Path.GetTempPath (),
+			                     "tomboy-batch-" + Guid.NewGuid ().ToString ());
+			Environment.SetEnvironmentVariable ("XDG_DATA_HOME", Path.Combine (root, "data"));
+			Environment.SetEnvironmentVariable ("XDG_CONFIG_HOME", Path.Combine (root, "config"));
+			Environment.SetEnvironmentVariable ("XDG_CACHE_HOME", Path.Combine (root, "cache"));
+			if (!PerformanceBenchmark.InitializeApplication ())
+				Assert.Ignore ("No display or D-Bus session");
+		}
+
+		[TestFixtureTearDown]
+		public void RemoveRoot ()
+		{
+			if (root != null && Directory.Exists (root))
+				Directory.Delete (root, true);
+		}
+
+		[SetUp]
+		public void CreateManager ()
+		{
+			string notes_dir = Path.Combine (root, "notes-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (notes_dir);
+			File.WriteAllText (Path.Combine (notes_dir, "existing.note"), NoteXml ("Existing"));
+
+			manager = new NoteManager (notes_dir);
+			manager.Initialize ();
+			Assert.AreEqual (1, manager.Notes.Count);
+
+			added_count = 0;
+			imported = new List<List<Note>> ();
+			manager.NoteAdded += delegate { added_count++; };
+			manager.NotesImported += delegate (object sender, List<Note> notes) {
+				imported.Add (notes);
+			};
+		}
+
+		static string NoteXml (string title)
+		{
+			return "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" +
+			       "<note version=\"0.3\" xmlns=\"http://beatniksoftware.com/tomboy\">" +
+			       "<title>" + title + "</title>" +
+			       "<text xml:space=\"preserve\"><note-content version=\"0.1\">" +
+			       title + "\n\nBody of " + title +
+			       "</note-content></text></note>";
+		}
+
+		static string NewId ()
+		{
+			return Guid.NewGuid ().ToString ();
+		}
+
+		[Test]
+		public void ForeignNotesAreAddedAsOneBatch ()
+		{
+			string [] ids = { NewId (), NewId (), NewId () };
+			Note [] added = manager.AddForeignNotes (
+				ids, new string [] { NoteXml ("One"), NoteXml ("Two"), NoteXml ("Three") });
+
+			Assert.AreEqual (3, added.Length);
+			for (int i = 0; i < ids.Length; i++) {
+				Assert.IsNotNull (added [i]);
+				Assert.AreEqual ("note://tomboy/" + ids [i], added [i].Uri);
+				Assert.AreSame (added [i], manager.FindByUri (added [i].Uri));
+			}
+			Assert.AreEqual ("Two", added [1].Title);
+			Assert.AreEqual (4, manager.Notes.Count);
+
+			Assert.AreEqual (0, added_count);
+			Assert.AreEqual (1, imported.Count);
+			Assert.AreEqual (3, imported [0].Count);
+		}
+
+		[Test]
+		public void ForeignNotesThatCannotBeAddedAreSkipped ()
+		{
+			string id = NewId ();
+			manager.AddForeignNotes (new string [] { id }, new string [] { NoteXml ("First") });
+			imported.Clear ();
+
+			string [] ids = { id, NewId (), NewId (), NewId (), NewId (), NewId () };
+			string [] xmls = {
+				NoteXml ("Same id"),
+				NoteXml ("existing"),       // Title of a note already there
+				NoteXml ("Twice"),
+				NoteXml ("Twice"),          // Title of a note in this batch
+				NoteXml (""),
+				"<note><title>Broken"
+			};
+			Note [] added = manager.AddForeignNotes (ids, xmls);
+
+			Assert.IsNull (added [0]);
+			Assert.AreEqual ("First", manager.FindByUri ("note://tomboy/" + id).Title);
+			Assert.IsNull (added [1]);
+			Assert.IsNotNull (added [2]);
+			Assert.IsNull (added [3]);
+			Assert.IsNull (added [4]);
+			Assert.IsNull (added [5]);
+			Assert.AreEqual (3, manager.Notes.Count);
+
+			Assert.AreEqual (0, added_count);
+			Assert.AreEqual (1, imported.Count);
+			Assert.AreEqual (1, imported [0].Count);
+		}
+
+		[Test]
+		public void ImportedNotesAreAddedAsOneBatch ()
+		{
+			Note [] added = manager.Import (new NoteImport [] {
+				NoteImport.FromText ("One", "Plain <text> & more"),
+				NoteImport.FromXml ("Two", "Some <bold>bold</bold> text")
+			});
+
+			Assert.AreEqual (2, added.Length);
+			Assert.AreEqual ("One", added [0].Title);
+			Assert.AreSame (added [0], manager.Find ("One"));
+			StringAssert.Contains ("Plain &lt;text&gt; &amp; more", added [0].XmlContent);
+			Assert.AreEqual ("Two", added [1].Title);
+			StringAssert.Contains ("<bold>bold</bold>", added [1].XmlContent);
+			Assert.AreEqual (3, manager.Notes.Count);
+
+			Assert.AreEqual (0, added_count);
+			Assert.AreEqual (1, imported.Count);
+			Assert.AreEqual (2, imported [0].Count);
+
+			// Dated like a saved note, so sync sees them as changed
+			foreach (Note note in added) {
+				Assert.AreNotEqual (DateTime.MinValue, note.MetadataChangeDate);
+				Assert.AreEqual (note.CreateDate, note.MetadataChangeDate);
+				NoteData written = NoteArchiver.Instance.ReadBytes (
+					manager.Store.ReadBytes (note.FilePath), note.Uri);
+				Assert.AreEqual (note.MetadataChangeDate, written.MetadataChangeDate);
+			}
+		}
+
+		[Test]
+		public void ImportedTitlesAreMadeUnique ()
+		{
+			Note [] added = manager.Import (new NoteImport [] {
+				NoteImport.FromText ("Existing", "Clashes with a note already there"),
+				NoteImport.FromText ("existing", "And with the one before, ignoring case"),
+				NoteImport.FromText ("Twice", "First"),
+				NoteImport.FromText ("Twice", "Second"),
+				NoteImport.FromText ("  Padded  ", "Trimmed")
+			});
+
+			// GetUniqueName appends " 2", " 3" and so on
+			Assert.AreEqual ("Existing 2", added [0].Title);
+			Assert.AreEqual ("existing 3", added [1].Title);
+			Assert.AreEqual ("Twice", added [2].Title);
+			Assert.AreEqual ("Twice 2", added [3].Title);
+			Assert.AreEqual ("Padded", added [4].Title);
+			Assert.AreEqual (6, manager.Notes.Count);
+
+			Assert.AreEqual (0, added_count);
+			Assert.AreEqual (1, imported.Count);
+			Assert.AreEqual (5, imported [0].Count);
+		}
+
+		[Test]
+		public void ImportsThatCannotBeCreatedAreNull ()
+		{
+			Note [] added = manager.Import (new NoteImport [] {
+				NoteImport.FromText ("", "Empty title"),
+				NoteImport.FromText (null, "No title"),
+				NoteImport.FromText ("   ", "Blank title"),
+				NoteImport.FromXml ("Broken", "<bold>never closed"),
+				NoteImport.FromXml ("Good", "<italic>fine</italic>")
+			});
+
+			Assert.AreEqual (5, added.Length);
+			for (int i = 0; i < 4; i++)
+				Assert.IsNull (added [i], "Import " + i);
+			Assert.AreEqual ("Good", added [4].Title);
+			Assert.IsNull (manager.Find ("Broken"));
+			Assert.AreEqual (2, manager.Notes.Count);
+
+			Assert.AreEqual (0, added_count);
+			Assert.AreEqual (1, imported.Count);
+			Assert.AreEqual (1, imported [0].Count);
+		}
+
+		[Test]
+		public void NothingImportedRaisesNoEvent ()
+		{
+			Note [] added = manager.Import (new NoteImport [] {
+				NoteImport.FromXml ("Broken", "</bold>")
+			});
+			Assert.IsNull (added [0]);
+			Assert.AreEqual (1, manager.Notes.Count);
+			Assert.AreEqual (0, added_count);
+			Assert.AreEqual (0, imported.Count);
+		}
+
+		[Test]
+		public void NothingAddedRaisesNoEvent ()
+		{
+			Note [] added = manager.AddForeignNotes (new string [] { NewId () },
+			                                         new string [] { "not xml" });
+			Assert.IsNull (added [0]);
+			Assert.AreEqual (0, imported.Count);
+		}
+	}
 }
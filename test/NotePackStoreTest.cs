@@ -0,0 +1,188 @@
+namespace TomboyTest
+{
+	using System;
+	using System.IO;
+	using System.Text;
+	using System.Xml;
+	using NUnit.Framework;
+	using Tomboy.Sync;
+
+	[TestFixture]
+	public class NotePackStoreTest
+	{
+		string dir;
+		NotePackStore packs;
+
+		[SetUp]
+		public void CreateServer ()
+		{
+			dir = Path.Combine (Path.GetTempPath (),
+			                    "tomboy-packs-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (dir);
+			packs = new NotePackStore (dir, delegate (string path) {});
+		}
+
+		[TearDown]
+		public void RemoveServer ()
+		{
+			Directory.Delete (dir, true);
+		}
+
+		static string NoteXml (string id, int rev)
+		{
+			return string.Format ("<note><title>{0} at {1}</title></note>", id, rev);
+		}
+
+		void WritePack (int rev, params string [] ids)
+		{
+			using (NotePackStore.PackWriter writer = packs.CreatePack (rev)) {
+				foreach (string id in ids)
+					writer.Add (id, rev, Encoding.UTF8.GetBytes (NoteXml (id, rev)));
+				writer.Commit ();
+			}
+		}
+
+		string [] PackFiles ()
+		{
+			return Directory.GetFiles (Path.Combine (dir, NotePackStore.PackDirectoryName), "*.pack");
+		}
+
+		[Test]
+		public void CommittedNotesCanBeRead ()
+		{
+			Assert.IsFalse (packs.Exists);
+			WritePack (1, "a", "b");
+			WritePack (2, "a");
+
+			packs = new NotePackStore (dir, delegate (string path) {});
+			Assert.IsTrue (packs.Exists);
+			Assert.AreEqual (2, packs.PackCount);
+			Assert.AreEqual (NoteXml ("a", 1), packs.ReadNote ("a", 1));
+			Assert.AreEqual (NoteXml ("b", 1), packs.ReadNote ("b", 1));
+			Assert.AreEqual (NoteXml ("a", 2), packs.ReadNote ("a", 2));
+			Assert.IsNull (packs.ReadNote ("b", 2));
+			Assert.IsNull (packs.ReadNote ("c", 1));
+		}
+
+		[Test]
+		public void UncommittedPackIsInvisible ()
+		{
+			using (NotePackStore.PackWriter writer = packs.CreatePack (1))
+				writer.Add ("a", 1, Encoding.UTF8.GetBytes (NoteXml ("a", 1)));
+
+			packs.LoadIndex ();
+			Assert.AreEqual (0, packs.PackCount);
+			Assert.IsNull (packs.ReadNote ("a", 1));
+			Assert.AreEqual (0, PackFiles ().Length);
+		}
+
+		[Test]
+		public void DiscardPacksAfterRemovesNewerRevisions ()
+		{
+			WritePack (1, "a");
+			WritePack (2, "b");
+			WritePack (3, "c");
+
+			packs.DiscardPacksAfter (1);
+			Assert.AreEqual (1, packs.PackCount);
+			Assert.AreEqual (NoteXml ("a", 1), packs.ReadNote ("a", 1));
+			Assert.IsNull (packs.ReadNote ("b", 2));
+			Assert.IsNull (packs.ReadNote ("c", 3));
+		}
+
+		[Test]
+		public void RepackKeepsOnlyCurrentNotes ()
+		{
+			WritePack (1, "a", "b", "c");
+			WritePack (2, "a");
+			WritePack (3, "b");
+
+			// c was deleted in revision 3, d lives in a revision directory
+			ServerManifest manifest = new ServerManifest ();
+			manifest.Revision = 3;
+			manifest.SetNoteRevision ("a", 2);
+			manifest.SetNoteRevision ("b", 3);
+			manifest.SetNoteRevision ("d", 3);
+
+			packs.Repack (manifest);
+			Assert.AreEqual (1, packs.PackCount);
+			Assert.AreEqual (1, PackFiles ().Length);
+			Assert.AreEqual (NoteXml ("a", 2), packs.ReadNote ("a", 2));
+			Assert.AreEqual (NoteXml ("b", 3), packs.ReadNote ("b", 3));
+			Assert.IsNull (packs.ReadNote ("a", 1));
+			Assert.IsNull (packs.ReadNote ("c", 1));
+			Assert.IsNull (packs.ReadNote ("d", 3));
+
+			// Still readable by a fresh store, and repacking again is harmless
+			packs = new NotePackStore (dir, delegate (string path) {});
+			packs.Repack (manifest);
+			Assert.AreEqual (1, packs.PackCount);
+			Assert.AreEqual (NoteXml ("a", 2), packs.ReadNote ("a", 2));
+		}
+
+		[Test]
+		public void PackManifestRoundTrips ()
+		{
+			string path = Path.Combine (dir, "manifest.xml");
+			ServerManifest manifest = new ServerManifest ();
+			manifest.Revision = 7;
+			manifest.ServerId = "server";
+			manifest.Format = ServerManifest.PackFormat;
+			manifest.SetNoteRevision ("a", 7, "hash-a");
+			manifest.Write (path);
+
+			ServerManifest read = ServerManifest.Read (path);
+			Assert.AreEqual (7, read.Revision);
+			Assert.AreEqual ("server", read.ServerId);
+			Assert.AreEqual (ServerManifest.PackFormat, read.Format);
+			Assert.IsTrue (read.IsFormatSupported);
+			Assert.AreEqual (7, read.GetNoteRevision ("a"));
+			Assert.AreEqual ("hash-a", read.GetNoteHash ("a"));
+		}
+
+		[Test]
+		public void PackManifestStopsOldClients ()
+		{
+			string path = Path.Combine (dir, "manifest.xml");
+			ServerManifest manifest = new ServerManifest ();
+			manifest.Revision = 7;
+			manifest.Format = ServerManifest.PackFormat;
+			manifest.SetNoteRevision ("a", 7);
+			manifest.Write (path);
+
+			// The lookups clients from before packs make: they find a
+			// revision they can't parse, and no notes
+			XmlDocument doc = new XmlDocument ();
+			doc.Load (path);
+			XmlNode syncNode = doc.SelectSingleNode ("//sync");
+			Assert.IsNotNull (syncNode);
+			string latestRevStr = syncNode.Attributes.GetNamedItem ("revision").InnerText;
+			Assert.AreEqual (ServerManifest.LegacyRevision, latestRevStr);
+			int rev;
+			Assert.IsFalse (Int32.TryParse (latestRevStr, out rev));
+			Assert.AreEqual (0, doc.SelectNodes ("//note/@id").Count);
+
+			// Which this client reads past
+			ServerManifest read = ServerManifest.Read (path);
+			Assert.AreEqual (7, read.Revision);
+			Assert.AreEqual (ServerManifest.PackFormat, read.Format);
+			Assert.AreEqual (7, read.GetNoteRevision ("a"));
+
+			// A manifest without a format is still the classic one
+			manifest.Format = null;
+			manifest.Write (path);
+			doc.Load (path);
+			Assert.IsNotNull (doc.SelectSingleNode ("//sync"));
+			Assert.AreEqual (1, doc.SelectNodes ("//note/@id").Count);
+		}
+
+		[Test]
+		public void UnknownFormatIsUnsupported ()
+		{
+			ServerManifest manifest = new ServerManifest ();
+			Assert.IsTrue (manifest.IsFormatSupported);
+			manifest.Format = "pack-2";
+			Assert.IsFalse (manifest.IsFormatSupported);
+		}
+	}
+}
@@ -0,0 +1,145 @@
+namespace TomboyTest
+{
+	using System;
+	using System.Collections.Generic;
+	using NUnit.Framework;
+	using Tomboy;
+
+	[TestFixture]
+	public class NoteSnapshotTest
+	{
+		static NoteSnapshot.Entry MakeEntry (string id, string title)
+		{
+			return MakeEntry (id, title, title + "\n\nBody of " + title);
+		}
+
+		static NoteSnapshot.Entry MakeEntry (string id, string title, string text)
+		{
+			NoteData data = new NoteData ("note://tomboy/" + id);
+			data.Title = title;
+			data.Text = "<note-content version=\"0.1\">" + text + "</note-content>";
+			return new NoteSnapshot.Entry (data, null, null, false);
+		}
+
+		static NoteSnapshot Build (int count)
+		{
+			NoteSnapshot snapshot = NoteSnapshot.Empty;
+			for (int i = 0; i < count; i++)
+				snapshot = snapshot.With (MakeEntry ("n" + i, "Note " + i));
+			return snapshot;
+		}
+
+		[Test]
+		public void WithAddsAndReplaces ()
+		{
+			NoteSnapshot one = NoteSnapshot.Empty.With (MakeEntry ("a", "Apple"));
+			NoteSnapshot two = one.With (MakeEntry ("b", "Banana"));
+			NoteSnapshot renamed = two.With (MakeEntry ("a", "Apricot"));
+
+			Assert.AreEqual (0, NoteSnapshot.Empty.Count);
+			Assert.AreEqual (1, one.Count);
+			Assert.AreEqual (2, two.Count);
+			Assert.AreEqual (2, renamed.Count);
+
+			Assert.AreEqual ("Apple", two.Get ("note://tomboy/a").Title);
+			Assert.AreEqual ("Apricot", renamed.Get ("note://tomboy/a").Title);
+			Assert.IsNotNull (two.Find ("APPLE"));
+			Assert.IsNull (renamed.Find ("apple"));
+			Assert.AreEqual ("note://tomboy/a", renamed.Find ("apricot").Uri);
+			Assert.IsNull (renamed.Get ("note://tomboy/c"));
+		}
+
+		[Test]
+		public void WithoutRemoves ()
+		{
+			NoteSnapshot two = Build (2);
+			NoteSnapshot one = two.Without ("note://tomboy/n0");
+			NoteSnapshot same = one.Without ("note://tomboy/missing");
+
+			Assert.AreEqual (2, two.Count);
+			Assert.AreEqual (1, one.Count);
+			Assert.AreEqual (1, same.Count);
+			Assert.IsNull (one.Get ("note://tomboy/n0"));
+			Assert.IsNull (one.Find ("Note 0"));
+			Assert.IsNotNull (one.Find ("Note 1"));
+			Assert.IsNotNull (two.Find ("Note 0"));
+		}
+
+		[Test]
+		public void OlderSnapshotsDontChange ()
+		{
+			NoteSnapshot before = Build (10);
+			Assert.AreEqual (10, before.Count);
+
+			NoteSnapshot after = before;
+			for (int i = 0; i < 500; i++)
+				after = after.With (MakeEntry ("n" + (i % 10), "Renamed " + i));
+			after = after.With (MakeEntry ("extra", "Extra"));
+
+			// Read the old one only now, after many changes on top of it
+			Assert.AreEqual (10, before.Count);
+			Assert.AreEqual ("Note 3", before.Get ("note://tomboy/n3").Title);
+			Assert.IsNull (before.Get ("note://tomboy/extra"));
+
+			Assert.AreEqual (11, after.Count);
+			Assert.AreEqual ("Renamed 493", after.Get ("note://tomboy/n3").Title);
+			Assert.IsNull (after.Find ("Note 3"));
+		}
+
+		[Test]
+		public void UnreadChainIsEquivalent ()
+		{
+			// Many more changes than notes, none read in between
+			NoteSnapshot snapshot = Build (5);
+			for (int i = 0; i < 1000; i++) {
+				if (i % 7 == 0)
+					snapshot = snapshot.Without ("note://tomboy/n" + (i % 5));
+				else
+					snapshot = snapshot.With (MakeEntry ("n" + (i % 5), "Title " + i));
+			}
+
+			// 995 to 999 were the last to touch n0 to n4; 994 removed n4 and 999 put it back
+			Assert.AreEqual (5, snapshot.Count);
+			for (int i = 995; i < 1000; i++)
+				Assert.AreEqual ("Title " + i, snapshot.Get ("note://tomboy/n" + (i % 5)).Title);
+		}
+
+		[Test]
+		public void SortedUrisFollowChanges ()
+		{
+			NoteSnapshot snapshot = Build (3);
+			Assert.AreEqual (new string [] { "note://tomboy/n0", "note://tomboy/n1", "note://tomboy/n2" },
+			                 snapshot.SortedUris);
+
+			NoteSnapshot saved = snapshot.With (MakeEntry ("n1", "Changed"));
+			Assert.AreSame (snapshot.SortedUris, saved.SortedUris);
+
+			NoteSnapshot added = saved.With (MakeEntry ("a", "First"));
+			Assert.AreEqual (new string [] { "note://tomboy/a", "note://tomboy/n0",
+			                                 "note://tomboy/n1", "note://tomboy/n2" },
+			                 added.SortedUris);
+
+			NoteSnapshot removed = added.Without ("note://tomboy/n0");
+			Assert.AreEqual (new string [] { "note://tomboy/a", "note://tomboy/n1", "note://tomboy/n2" },
+			                 removed.SortedUris);
+		}
+
+		[Test]
+		public void SearchSkipsTemplates ()
+		{
+			NoteData data = new NoteData ("note://tomboy/t");
+			data.Title = "Template";
+			data.Text = "<note-content version=\"0.1\">Template\n\nfruit</note-content>";
+			NoteSnapshot snapshot = NoteSnapshot.Empty
+				.With (MakeEntry ("a", "Apple", "Apple\n\nA fruit, a red fruit"))
+				.With (MakeEntry ("b", "Fruit salad"))
+				.With (MakeEntry ("c", "Carrot"))
+				.With (new NoteSnapshot.Entry (data, null, null, true));
+
+			IDictionary<NoteSnapshot.Entry, int> matches = snapshot.Search ("fruit", false);
+			Assert.AreEqual (2, matches.Count);
+			Assert.AreEqual (2, matches [snapshot.Get ("note://tomboy/a")]);
+			Assert.AreEqual (int.MaxValue, matches [snapshot.Get ("note://tomboy/b")]);
+		}
+	}
+}
@@ -1,5 +1,6 @@
 namespace TomboyTest
 {
+	using System;
 	using NUnit.Framework;
 	using Gtk;
 	using Tomboy;
@@ -84,6 +85,63 @@ namespace TomboyTest
 			note.SetPositionExtent (0, 0, 5, 5);
 			Assert.IsTrue (note.HasExtent ());
 		}
+
+		[Test]
+		public void PackedTextReadsBack ()
+		{
+			string text = "<note-content version=\"0.1\">Caf\u00e9 \ud83d\ude00\n" +
+				new string ('x', 4096) + "</note-content>";
+			note.Text = text;
+			Assert.IsTrue (note.StoredText.Pack ());
+			Assert.IsTrue (note.StoredText.IsPacked);
+			Assert.AreEqual (text, note.Text);
+			Assert.IsFalse (note.StoredText.IsPacked);
+			Assert.AreEqual (0, note.StoredText.PackedSize);
+		}
+
+		[Test]
+		public void PeekLeavesTextPacked ()
+		{
+			string text = new string ('z', 4096);
+			note.Text = text;
+			note.StoredText.Pack ();
+			Assert.AreEqual (text, note.StoredText.Peek ());
+			Assert.IsTrue (note.StoredText.IsPacked);
+		}
+
+		[Test]
+		public void TextThatDeflatesBadlyIsNotPacked ()
+		{
+			// Random printable ASCII deflates to about 85% of its
+			// UTF-8, though to under half of its size in memory
+			Random random = new Random (42);
+			char [] chars = new char [4096];
+			for (int i = 0; i < chars.Length; i++)
+				chars [i] = (char) random.Next (32, 127);
+			note.Text = new string (chars);
+			Assert.IsFalse (note.StoredText.Pack ());
+			Assert.AreEqual (new string (chars), note.Text);
+		}
+
+		[Test]
+		public void CloneSharesPackedText ()
+		{
+			note.Text = new string ('y', 4096);
+			NoteData copy = note.Clone ();
+			note.StoredText.Pack ();
+			Assert.IsTrue (copy.StoredText.IsPacked);
+
+			note.Text = "changed";
+			Assert.AreEqual (new string ('y', 4096), copy.Text);
+		}
+
+		[Test]
+		public void ShortTextIsNotPacked ()
+		{
+			note.Text = "<note-content>Foo</note-content>";
+			Assert.IsFalse (note.StoredText.Pack ());
+			Assert.AreEqual ("<note-content>Foo</note-content>", note.Text);
+		}
 	}
 
 	[TestFixture]
@@ -155,4 +213,56 @@ namespace TomboyTest
 			Note.CreateNewNote ("Note Title", "/tmp/note", null);
 		}
 	}
+
+	[TestFixture]
+	public class NoteContentHashTest
+	{
+		NoteData CreateData (string title, string text)
+		{
+			NoteData data = new NoteData ("note://tomboy/hash-test");
+			data.Title = title;
+			data.Text = text;
+			return data;
+		}
+
+		[Test]
+		public void IgnoresContentVersion ()
+		{
+			Assert.AreEqual (
+				NoteContentHash.Compute (CreateData ("A", "<note-content version=\"0.1\">A\nfoo</note-content>")),
+				NoteContentHash.Compute (CreateData ("A", "<note-content>A\nfoo</note-content>")));
+		}
+
+		[Test]
+		public void DiffersOnTitleOrText ()
+		{
+			string hash = NoteContentHash.Compute (CreateData ("A", "<note-content>A\nfoo</note-content>"));
+			Assert.AreNotEqual (hash,
+				NoteContentHash.Compute (CreateData ("B", "<note-content>A\nfoo</note-content>")));
+			Assert.AreNotEqual (hash,
+				NoteContentHash.Compute (CreateData ("A", "<note-content>A\nbar</note-content>")));
+		}
+	}
+
+	[TestFixture]
+	public class NoteDeltaTest
+	{
+		[Test]
+		public void RoundTrip ()
+		{
+			string baseText = "<note-content>Title\n\n" + new string ('a', 500) + "\u00e9\U0001F600" +
+			                  new string ('b', 500) + "</note-content>";
+			string target = baseText.Replace ("\u00e9", "changed \u00e8");
+			byte [] delta = Tomboy.Sync.NoteDelta.Create (baseText, target);
+			Assert.Less (delta.Length, target.Length / 4);
+			Assert.AreEqual (target, Tomboy.Sync.NoteDelta.Apply (baseText, delta));
+		}
+
+		[Test, ExpectedException (typeof (System.IO.InvalidDataException))]
+		public void RejectsWrongBase ()
+		{
+			byte [] delta = Tomboy.Sync.NoteDelta.Create ("one base text", "a target");
+			Tomboy.Sync.NoteDelta.Apply ("another base text", delta);
+		}
+	}
 }
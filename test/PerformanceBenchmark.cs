@@ -0,0 +1,619 @@
+namespace TomboyTest
+{
+	using System;
+	using System.Collections.Generic;
+	using System.Diagnostics;
+	using System.Globalization;
+	using System.IO;
+	using System.Text;
+	using System.Text.RegularExpressions;
+	using System.Xml.XPath;
+	using System.Xml.Xsl;
+	using NUnit.Framework;
+	using Tomboy;
+	using Tomboy.ExportToHtml;
+	using Tomboy.Sync;
+
+	/// <summary>
+	/// Named measurements from one benchmark run, written as JSON and
+	/// compared against a stored baseline.
+	/// </summary>
+	public class BenchmarkResults
+	{
+		class Metric
+		{
+			public string Name;
+			public double Value;
+			public bool HigherIsBetter;
+		}
+
+		readonly List<Metric> metrics = new List<Metric> ();
+
+		public string Corpus;
+		public long CorpusBytes;
+
+		public void Add (string name, double value, bool higherIsBetter)
+		{
+			Metric metric = new Metric ();
+			metric.Name = name;
+			metric.Value = value;
+			metric.HigherIsBetter = higherIsBetter;
+			metrics.Add (metric);
+			Console.WriteLine ("{0,-28} {1,14:F2}", name, value);
+		}
+
+		/// <summary>
+		/// Add the 50th, 90th and 99th percentile and the maximum of a set
+		/// of samples, as name_p50 and so on.
+		/// </summary>
+		public void AddPercentiles (string name, List<double> samples)
+		{
+			if (samples.Count == 0)
+				return;
+			samples.Sort ();
+			Add (name + "_p50", Percentile (samples, 0.50), false);
+			Add (name + "_p90", Percentile (samples, 0.90), false);
+			Add (name + "_p99", Percentile (samples, 0.99), false);
+			Add (name + "_max", samples [samples.Count - 1], false);
+		}
+
+		static double Percentile (List<double> sorted, double p)
+		{
+			int index = (int) Math.Ceiling (p * sorted.Count) - 1;
+			return sorted [Math.Max (0, Math.Min (sorted.Count - 1, index))];
+		}
+
+		public void Write (string path)
+		{
+			StringBuilder json = new StringBuilder ();
+			json.Append ("{\n");
+			json.AppendFormat ("  \"benchmark\": \"tomboy\",\n");
+			json.AppendFormat ("  \"date\": \"{0}\",\n",
+			                   DateTime.UtcNow.ToString ("yyyy-MM-ddTHH:mm:ssZ", CultureInfo.InvariantCulture));
+			json.AppendFormat ("  \"machine\": \"{0}\",\n", Environment.MachineName);
+			json.AppendFormat ("  \"processors\": {0},\n", Environment.ProcessorCount);
+			json.AppendFormat ("  \"corpus\": \"{0}\",\n", Corpus);
+			json.AppendFormat ("  \"corpus_bytes\": {0},\n", CorpusBytes);
+			json.Append ("  \"metrics\": {");
+			for (int i = 0; i < metrics.Count; i++) {
+				json.Append (i == 0 ? "\n" : ",\n");
+				json.AppendFormat (CultureInfo.InvariantCulture,
+				                   "    \"{0}\": {{ \"value\": {1:0.###}, \"better\": \"{2}\" }}",
+				                   metrics [i].Name, metrics [i].Value,
+				                   metrics [i].HigherIsBetter ? "higher" : "lower");
+			}
+			json.Append ("\n  }\n}\n");
+
+			string dir = Path.GetDirectoryName (Path.GetFullPath (path));
+			if (!Directory.Exists (dir))
+				Directory.CreateDirectory (dir);
+			File.WriteAllText (path, json.ToString ());
+			Console.WriteLine ("Results written to {0}", path);
+		}
+
+		/// <summary>
+		/// Compare with a baseline written by an earlier run.  Returns a
+		/// description of every metric that got worse by more than
+		/// tolerance (0.25 is 25%); empty if none did, or if the baseline
+		/// was made with a different corpus.
+		/// </summary>
+		public List<string> CompareWithBaseline (string baselinePath, double tolerance)
+		{
+			List<string> regressions = new List<string> ();
+			string baseline = File.ReadAllText (baselinePath);
+
+			Match corpus = Regex.Match (baseline, "\"corpus\":\\s*\"([^\"]*)\"");
+			if (!corpus.Success || corpus.Groups [1].Value != Corpus) {
+				Console.WriteLine ("Baseline {0} was made with a different corpus; not comparing",
+				                   baselinePath);
+				return regressions;
+			}
+
+			Dictionary<string, double> baseValues = new Dictionary<string, double> ();
+			foreach (Match m in Regex.Matches (baseline,
+			                                   "\"(\\w+)\":\\s*\\{\\s*\"value\":\\s*([-+0-9.eE]+)"))
+				baseValues [m.Groups [1].Value] =
+					double.Parse (m.Groups [2].Value, CultureInfo.InvariantCulture);
+
+			Console.WriteLine ("{0,-28} {1,14} {2,14} {3,8}", "Compared to baseline", "baseline", "now", "change");
+			foreach (Metric metric in metrics) {
+				double baseValue;
+				if (!baseValues.TryGetValue (metric.Name, out baseValue))
+					continue;
+
+				double change = baseValue == 0 ? 0 : (metric.Value - baseValue) / baseValue;
+				Console.WriteLine ("{0,-28} {1,14:F2} {2,14:F2} {3,7:+0.0;-0.0}%",
+				                   metric.Name, baseValue, metric.Value, change * 100);
+
+				// Sub-unit values are mostly timer noise
+				if (Math.Max (Math.Abs (baseValue), Math.Abs (metric.Value)) < 1.0)
+					continue;
+
+				bool worse = metric.HigherIsBetter ?
+					metric.Value < baseValue / (1 + tolerance) :
+					metric.Value > baseValue * (1 + tolerance);
+				if (worse)
+					regressions.Add (string.Format ("{0}: {1:F2} -> {2:F2}",
+					                                metric.Name, baseValue, metric.Value));
+			}
+			return regressions;
+		}
+	}
+
+	/// <summary>
+	/// End to end benchmark of loading, searching, saving and syncing a
+	/// synthetic note collection.  Not run by default; "make benchmark"
+	/// runs it for several collection sizes, one process per size.
+	///
+	/// Configured through the environment:
+	///
+	///   TOMBOY_BENCH_NOTES      number of notes (1000)
+	///   TOMBOY_BENCH_CORPUS     corpus settings, see BenchmarkCorpus
+	///   TOMBOY_BENCH_OUTPUT     where to write the JSON results
+	///   TOMBOY_BENCH_BASELINE   results to compare against, if present
+	///   TOMBOY_BENCH_TOLERANCE  allowed slowdown before failing (0.25)
+	///
+	/// Archiver, trie, sync and cold storage measurements need no display.  Startup,
+	/// search, save, import and HTML export go through a real NoteManager or
+	/// the preferences and need GTK and a D-Bus session; run under
+	/// xvfb-run and dbus-launch on headless machines.  Without them those
+	/// measurements are skipped.
+	///
+	/// Everything runs against a temporary home directory, so the
+	/// user's own notes and settings are never touched.
+	/// </summary>
+	[TestFixture, Explicit]
+	public class PerformanceBenchmark
+	{
+		const int SAMPLE_SIZE = 200;
+		const int SEARCH_REPEATS = 5;
+		const int IMPORT_COUNT = 10000;
+
+		string root;
+		string notesDir;
+		BenchmarkCorpus corpus;
+		List<string> paths;
+		BenchmarkResults results;
+
+		static int GetEnvironmentInt (string name, int defaultValue)
+		{
+			string value = Environment.GetEnvironmentVariable (name);
+			return string.IsNullOrEmpty (value) ? defaultValue : int.Parse (value);
+		}
+
+		[TestFixtureSetUp]
+		public void CreateCorpus ()
+		{
+			root = Path.Combine (Path.GetTempPath (),
+			                     "tomboy-bench-" + Guid.NewGuid ().ToString ());
+			notesDir = Path.Combine (root, "notes");
+			Directory.CreateDirectory (notesDir);
+
+			// Must happen before anything asks Services for a directory
+			Environment.SetEnvironmentVariable ("XDG_DATA_HOME", Path.Combine (root, "data"));
+			Environment.SetEnvironmentVariable ("XDG_CONFIG_HOME", Path.Combine (root, "config"));
+			Environment.SetEnvironmentVariable ("XDG_CACHE_HOME", Path.Combine (root, "cache"));
+
+			corpus = BenchmarkCorpus.FromEnvironment (GetEnvironmentInt ("TOMBOY_BENCH_NOTES", 1000));
+			Console.WriteLine ("Generating corpus: {0}", corpus.Describe ());
+			Stopwatch watch = Stopwatch.StartNew ();
+			paths = corpus.Generate (notesDir);
+			Console.WriteLine ("Generated {0} notes, {1:F1} MB, in {2:F1} s",
+			                   paths.Count, corpus.TotalBytes / 1048576.0,
+			                   watch.Elapsed.TotalSeconds);
+
+			results = new BenchmarkResults ();
+			results.Corpus = corpus.Describe ();
+			results.CorpusBytes = corpus.TotalBytes;
+		}
+
+		[TestFixtureTearDown]
+		public void RemoveCorpus ()
+		{
+			if (root != null && Directory.Exists (root))
+				Directory.Delete (root, true);
+		}
+
+		[Test]
+		public void Run ()
+		{
+			List<NoteData> notes = MeasureArchiver ();
+			MeasureTrie (notes);
+			MeasureSync (notes);
+			MeasureNoteStore (notes);
+			MeasureColdStorage (notes);
+
+			if (InitializeApplication ()) {
+				NoteManager manager = MeasureStartup ();
+				MeasureSearch (manager);
+				MeasureSave (manager);
+				MeasureImport (manager);
+				MeasureExport (notes);
+			} else {
+				Console.WriteLine ("No display or D-Bus session: skipping startup, search, save, import and export");
+			}
+
+			results.Add ("peak_working_set_mb",
+			             Process.GetCurrentProcess ().PeakWorkingSet64 / 1048576.0, false);
+
+			string output = Environment.GetEnvironmentVariable ("TOMBOY_BENCH_OUTPUT");
+			if (!string.IsNullOrEmpty (output))
+				results.Write (output);
+
+			string baseline = Environment.GetEnvironmentVariable ("TOMBOY_BENCH_BASELINE");
+			if (!string.IsNullOrEmpty (baseline) && File.Exists (baseline)) {
+				string toleranceValue = Environment.GetEnvironmentVariable ("TOMBOY_BENCH_TOLERANCE");
+				double tolerance = string.IsNullOrEmpty (toleranceValue) ? 0.25 :
+					double.Parse (toleranceValue, CultureInfo.InvariantCulture);
+				List<string> regressions = results.CompareWithBaseline (baseline, tolerance);
+				if (regressions.Count > 0)
+					Assert.Fail ("Slower than baseline {0}:\n{1}", baseline,
+					             string.Join ("\n", regressions.ToArray ()));
+			}
+		}
+
+		static string UriFor (string path)
+		{
+			return "note://tomboy/" + Path.GetFileNameWithoutExtension (path);
+		}
+
+		List<NoteData> MeasureArchiver ()
+		{
+			List<NoteData> notes = new List<NoteData> (paths.Count);
+			Stopwatch watch = Stopwatch.StartNew ();
+			foreach (string path in paths)
+				notes.Add (NoteArchiver.Read (path, UriFor (path)));
+			watch.Stop ();
+			results.Add ("archiver_read_notes_per_sec",
+			             paths.Count / watch.Elapsed.TotalSeconds, true);
+
+			// Every write is flushed to disk, so only write a sample
+			string writeDir = Path.Combine (root, "write");
+			Directory.CreateDirectory (writeDir);
+			int count = Math.Min (notes.Count, SAMPLE_SIZE * 5);
+			watch = Stopwatch.StartNew ();
+			for (int i = 0; i < count; i++)
+				NoteArchiver.Write (Path.Combine (writeDir, Path.GetFileName (paths [i])), notes [i]);
+			watch.Stop ();
+			results.Add ("archiver_write_notes_per_sec", count / watch.Elapsed.TotalSeconds, true);
+
+			return notes;
+		}
+
+		void MeasureTrie (List<NoteData> notes)
+		{
+			Stopwatch watch = Stopwatch.StartNew ();
+			TrieTree trie = new TrieTree (false);
+			foreach (NoteData note in notes)
+				trie.AddKeyword (note.Title, note);
+			trie.ComputeFailureGraph ();
+			watch.Stop ();
+			results.Add ("trie_build_ms", watch.Elapsed.TotalMilliseconds, false);
+
+			long chars = 0;
+			int count = Math.Min (notes.Count, SAMPLE_SIZE * 5);
+			watch = Stopwatch.StartNew ();
+			for (int i = 0; i < count; i++) {
+				string text = NoteContentHash.GetInnerContent (notes [i].Text);
+				trie.FindMatches (text);
+				chars += text.Length;
+			}
+			watch.Stop ();
+			results.Add ("trie_scan_mb_per_sec",
+			             chars / 1048576.0 / watch.Elapsed.TotalSeconds, true);
+		}
+
+		void MeasureSync (List<NoteData> data)
+		{
+			List<Note> notes = new List<Note> (data.Count);
+			for (int i = 0; i < data.Count; i++)
+				notes.Add (Note.CreateExistingNote (data [i], paths [i], null));
+
+			string serverPath = Path.Combine (root, "server");
+			Directory.CreateDirectory (serverPath);
+
+			FileSystemSyncServer server = new FileSystemSyncServer (serverPath);
+			Assert.IsTrue (server.BeginSyncTransaction ());
+			Stopwatch watch = Stopwatch.StartNew ();
+			server.UploadNotes (notes);
+			Assert.IsTrue (server.CommitSyncTransaction ());
+			watch.Stop ();
+			results.Add ("sync_upload_ms", watch.Elapsed.TotalMilliseconds, false);
+
+			server = new FileSystemSyncServer (serverPath);
+			watch = Stopwatch.StartNew ();
+			IDictionary<string, NoteUpdate> updates = server.GetNoteUpdatesSince (-1);
+			watch.Stop ();
+			Assert.AreEqual (notes.Count, updates.Count);
+			results.Add ("sync_download_ms", watch.Elapsed.TotalMilliseconds, false);
+		}
+
+		/// <summary>
+		/// The segment store: moving the corpus into it, starting up from
+		/// it, saves one at a time and all at once, and compaction.
+		/// </summary>
+		void MeasureNoteStore (List<NoteData> notes)
+		{
+			string storeDir = Path.Combine (root, "store");
+			Directory.CreateDirectory (storeDir);
+
+			SegmentNoteStore store = new SegmentNoteStore (storeDir, null);
+			store.Open ();
+			Stopwatch watch = Stopwatch.StartNew ();
+			Assert.AreEqual (paths.Count, store.ImportDirectory (notesDir, false));
+			watch.Stop ();
+			results.Add ("store_import_ms", watch.Elapsed.TotalMilliseconds, false);
+			store.Close ();
+
+			// What NoteManager.LoadNotes asks of it
+			watch = Stopwatch.StartNew ();
+			store = new SegmentNoteStore (storeDir, null);
+			store.Open ();
+			results.Add ("store_open_ms", watch.Elapsed.TotalMilliseconds, false);
+			int loaded = 0;
+			foreach (string path in store.GetNotePaths ()) {
+				if (store.Read (path, UriFor (path)) != null)
+					loaded++;
+			}
+			watch.Stop ();
+			Assert.AreEqual (paths.Count, loaded);
+			results.Add ("store_load_ms", watch.Elapsed.TotalMilliseconds, false);
+
+			List<double> samples = new List<double> ();
+			int count = Math.Min (notes.Count, SAMPLE_SIZE);
+			for (int i = 0; i < count; i++) {
+				Stopwatch save = Stopwatch.StartNew ();
+				store.Write (paths [i], notes [i]);
+				save.Stop ();
+				samples.Add (save.Elapsed.TotalMilliseconds * 1000);
+			}
+			results.AddPercentiles ("store_save_us", samples);
+
+			// Saving every note, as on quit
+			watch = Stopwatch.StartNew ();
+			store.BeginBatch ();
+			for (int i = 0; i < notes.Count; i++)
+				store.Write (paths [i], notes [i]);
+			store.EndBatch ();
+			watch.Stop ();
+			results.Add ("store_burst_save_ms", watch.Elapsed.TotalMilliseconds, false);
+
+			// Waits for any compaction the burst started
+			store.Close ();
+			store = new SegmentNoteStore (storeDir, null);
+			store.Open ();
+			watch = Stopwatch.StartNew ();
+			store.Compact ();
+			watch.Stop ();
+			results.Add ("store_compact_ms", watch.Elapsed.TotalMilliseconds, false);
+			store.Close ();
+		}
+
+		/// <summary>
+		/// Memory saved by deflating note text, against the time it takes
+		/// to open a cold note and to search the collection cold and hot.
+		/// </summary>
+		void MeasureColdStorage (List<NoteData> notes)
+		{
+			long hotBytes = 0;
+			long coldBytes = 0;
+			Stopwatch watch = Stopwatch.StartNew ();
+			foreach (NoteData note in notes) {
+				NoteText text = note.StoredText;
+				hotBytes += text.Length * 2L;
+				coldBytes += text.Pack () ? text.PackedSize : text.Length * 2L;
+			}
+			watch.Stop ();
+			results.Add ("cold_pack_ms", watch.Elapsed.TotalMilliseconds, false);
+			results.Add ("hot_text_mb", hotBytes / 1048576.0, false);
+			results.Add ("cold_text_mb", coldBytes / 1048576.0, false);
+			results.Add ("cold_memory_saved_pct",
+			             hotBytes == 0 ? 0 : 100.0 * (hotBytes - coldBytes) / hotBytes, true);
+
+			// What opening a note adds: its first read after packing
+			List<double> samples = new List<double> ();
+			int count = Math.Min (notes.Count, SAMPLE_SIZE);
+			for (int i = 0; i < count; i++) {
+				Stopwatch open = Stopwatch.StartNew ();
+				string text = notes [i].Text;
+				open.Stop ();
+				Assert.IsNotNull (text);
+				samples.Add (open.Elapsed.TotalMilliseconds * 1000);
+			}
+			results.AddPercentiles ("cold_open_us", samples);
+
+			string word = corpus.Vocabulary [corpus.Vocabulary.Length / 10];
+			foreach (NoteData note in notes)
+				note.StoredText.Pack ();
+			watch = Stopwatch.StartNew ();
+			int coldMatches = CountMatches (notes, word);
+			watch.Stop ();
+			results.Add ("cold_search_ms", watch.Elapsed.TotalMilliseconds, false);
+
+			watch = Stopwatch.StartNew ();
+			int hotMatches = CountMatches (notes, word);
+			watch.Stop ();
+			results.Add ("hot_search_ms", watch.Elapsed.TotalMilliseconds, false);
+			Assert.AreEqual (coldMatches, hotMatches);
+		}
+
+		static int CountMatches (List<NoteData> notes, string word)
+		{
+			int matches = 0;
+			foreach (NoteData note in notes) {
+				if (note.Text.IndexOf (word, StringComparison.OrdinalIgnoreCase) >= 0)
+					matches++;
+			}
+			return matches;
+		}
+
+		static bool initialized;
+
+		internal static bool InitializeApplication ()
+		{
+			if (initialized)
+				return true;
+
+			string [] args = new string [0];
+			if (!Gtk.Application.InitCheck ("tomboy-benchmark", ref args))
+				return false;
+
+			try {
+				Application.Initialize ("tomboy", "Tomboy", "tomboy", args);
+			} catch (Exception e) {
+				Console.WriteLine ("Could not initialize Tomboy: {0}", e.Message);
+				return false;
+			}
+
+			initialized = true;
+			return true;
+		}
+
+		NoteManager MeasureStartup ()
+		{
+			Stopwatch watch = Stopwatch.StartNew ();
+			NoteManager manager = new NoteManager (notesDir);
+			manager.Initialize ();
+			watch.Stop ();
+
+			Assert.AreEqual (paths.Count, manager.Notes.Count);
+			results.Add ("startup_ms", watch.Elapsed.TotalMilliseconds, false);
+			results.Add ("managed_heap_mb", GC.GetTotalMemory (true) / 1048576.0, false);
+			return manager;
+		}
+
+		void MeasureSearch (NoteManager manager)
+		{
+			string [] vocabulary = corpus.Vocabulary;
+			string [] queries = {
+				vocabulary [0],                          // In most notes
+				vocabulary [vocabulary.Length / 20],
+				vocabulary [vocabulary.Length - 1],      // Rare
+				"\"" + vocabulary [1] + " " + vocabulary [2] + "\"",
+				vocabulary [3] + " " + vocabulary [vocabulary.Length / 2],
+				corpus.Titles [corpus.Titles.Length / 2],
+				"qqqqqq"                                 // Nowhere
+			};
+
+			Search search = new Search (manager);
+			// Warm up caches, like a user's second search
+			foreach (string query in queries)
+				search.SearchNotes (query, false, null);
+
+			List<double> samples = new List<double> ();
+			for (int i = 0; i < SEARCH_REPEATS; i++) {
+				foreach (string query in queries) {
+					Stopwatch watch = Stopwatch.StartNew ();
+					search.SearchNotes (query, false, null);
+					samples.Add (watch.Elapsed.TotalMilliseconds);
+				}
+			}
+			results.AddPercentiles ("search_ms", samples);
+		}
+
+		void MeasureSave (NoteManager manager)
+		{
+			List<double> openSamples = new List<double> ();
+			int count = Math.Min (manager.Notes.Count, SAMPLE_SIZE);
+			List<Note> notes = manager.Notes.GetRange (0, count);
+
+			foreach (Note note in notes) {
+				Stopwatch watch = Stopwatch.StartNew ();
+				NoteBuffer buffer = note.Buffer;
+				openSamples.Add (watch.Elapsed.TotalMilliseconds);
+
+				Gtk.TextIter end = buffer.EndIter;
+				buffer.Insert (ref end, " benchmark");
+			}
+			results.AddPercentiles ("buffer_open_ms", openSamples);
+
+			// Serializes each buffer and writes the file, like the save
+			// timeout does
+			Stopwatch saveWatch = Stopwatch.StartNew ();
+			foreach (Note note in notes)
+				note.Save ();
+			saveWatch.Stop ();
+			results.Add ("save_notes_per_sec", count / saveWatch.Elapsed.TotalSeconds, true);
+		}
+
+		void MeasureImport (NoteManager manager)
+		{
+			// Reuses the corpus titles, so every import needs a unique name
+			string [] titles = corpus.Titles;
+			string [] vocabulary = corpus.Vocabulary;
+			List<NoteImport> imports = new List<NoteImport> (IMPORT_COUNT);
+			for (int i = 0; i < IMPORT_COUNT; i++) {
+				string body = vocabulary [i % vocabulary.Length] + " " +
+				              vocabulary [(i * 7) % vocabulary.Length];
+				imports.Add (NoteImport.FromText (titles [i % titles.Length], body));
+			}
+
+			int before = manager.Notes.Count;
+			Stopwatch watch = Stopwatch.StartNew ();
+			manager.Import (imports);
+			watch.Stop ();
+
+			Assert.AreEqual (before + IMPORT_COUNT, manager.Notes.Count);
+			results.Add ("import_notes_per_sec", IMPORT_COUNT / watch.Elapsed.TotalSeconds, true);
+		}
+
+		/// <summary>
+		/// Stands in for ExportAllTransformExtension, which needs the
+		/// application's NoteManager.
+		/// </summary>
+		public class ExportExtension
+		{
+			public string ToLower (string s)
+			{
+				return s.ToLower ();
+			}
+
+			public string GetRelativePath (string title_to)
+			{
+				return ExportAllApplicationAddin.SanitizeNoteTitle (title_to) + ".html";
+			}
+		}
+
+		void MeasureExport (List<NoteData> notes)
+		{
+			string exportDir = Path.Combine (root, "export");
+			Directory.CreateDirectory (exportDir);
+
+			List<HtmlExportJob> jobs = new List<HtmlExportJob> (notes.Count);
+			for (int i = 0; i < notes.Count; i++)
+				jobs.Add (new HtmlExportJob (notes [i],
+				                             Path.Combine (exportDir, i.ToString () + ".html"),
+				                             new ExportExtension ()));
+
+			HtmlExporter exporter = new HtmlExporter (true);
+			Stopwatch watch = Stopwatch.StartNew ();
+			exporter.Export (jobs);
+			watch.Stop ();
+			results.Add ("html_export_notes_per_sec", jobs.Count / watch.Elapsed.TotalSeconds, true);
+
+			// The export must not change: compare a sample with what
+			// the old serialize, parse and XslTransform path makes
+			XslTransform legacy = new XslTransform ();
+			using (Stream xsl = typeof (HtmlExporter).Assembly.GetManifestResourceStream ("ExportToHtml.xsl"))
+				legacy.Load (new System.Xml.XmlTextReader (xsl), null, null);
+			int count = Math.Min (notes.Count, SAMPLE_SIZE);
+			for (int i = 0; i < count; i++) {
+				XPathDocument doc = new XPathDocument (
+					new StringReader (NoteArchiver.WriteString (notes [i])));
+				XsltArgumentList args = new XsltArgumentList ();
+				args.AddParam ("exporting-multiple", "", true);
+				args.AddParam ("export-linked", "", false);
+				args.AddParam ("export-linked-all", "", false);
+				args.AddParam ("root-note", "", notes [i].Title);
+				args.AddExtensionObject ("http://beatniksoftware.com/tomboy", new ExportExtension ());
+
+				StringWriter expected = new StringWriter ();
+				legacy.Transform (doc, args, expected);
+				StringWriter actual = new StringWriter ();
+				exporter.WriteHTMLForNote (actual, notes [i], new ExportExtension ());
+				Assert.AreEqual (expected.ToString (), actual.ToString (),
+				                 "HTML export of " + notes [i].Title);
+			}
+		}
+	}
+}
@@ -0,0 +1,148 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Xml;
+using System.Xml.XPath;
+using System.Xml.Xsl;
+
+using NUnit.Framework;
+using Tomboy;
+using Tomboy.ExportToHtml;
+
+namespace TomboyTest
+{
+	[TestFixture]
+	public class HtmlExporterTest
+	{
+		static XslTransform legacy;
+		string dir;
+
+		// Titles, and the content after them, that exercise every part
+		// of the stylesheet
+		static readonly string [,] notes = {
+			{ "Plain", "\n\nJust some text." },
+			{ "Formatting", "\n\n<bold>bold</bold> <italic>italic</italic> " +
+			  "<strikethrough>struck</strikethrough> <highlight>lit</highlight> " +
+			  "<monospace>mono</monospace> <bold><italic>both</italic></bold>" },
+			{ "Sizes", "\n\n<size:small>small</size:small> <size:large>large</size:large> " +
+			  "<size:huge>huge</size:huge>" },
+			{ "Links", "\n\n<link:internal>Plain</link:internal>, " +
+			  "<link:broken>Gone</link:broken> and <link:url>http://example.com/?a=1&amp;b=2</link:url>" },
+			{ "Lists", "\n\n<list><list-item dir=\"ltr\">One\n</list-item>" +
+			  "<list-item dir=\"ltr\">Two\n<list><list-item dir=\"ltr\">Nested\n</list-item></list>" +
+			  "</list-item></list>After" },
+			{ "Test Ä Title", "\n\nArabic characters: ثقۍ." },
+			{ "Quotes \"and\" 'apostrophes' & <angles>", "\n\n&lt;not a tag&gt; &amp;amp;" },
+			{ "Whitespace", "\n\n  leading\t tabs   and  \n\n\n trailing  \n" },
+			{ "Empty", "" }
+		};
+
+		[TestFixtureSetUp]
+		public void LoadLegacyTransform ()
+		{
+			legacy = new XslTransform ();
+			using (Stream xsl = typeof (HtmlExporter).Assembly.GetManifestResourceStream ("ExportToHtml.xsl"))
+				legacy.Load (new XmlTextReader (xsl), null, null);
+		}
+
+		[SetUp]
+		public void CreateDirectory ()
+		{
+			dir = Path.Combine (Path.GetTempPath (),
+			                    "tomboy-html-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (dir);
+		}
+
+		[TearDown]
+		public void RemoveDirectory ()
+		{
+			Directory.Delete (dir, true);
+		}
+
+		static List<NoteData> MakeNotes ()
+		{
+			List<NoteData> list = new List<NoteData> ();
+			for (int i = 0; i < notes.GetLength (0); i++) {
+				NoteData data = new NoteData ("note://tomboy/html-" + i);
+				data.Title = notes [i, 0];
+				data.Text = "<note-content version=\"0.1\">" + XmlEncoder.Encode (notes [i, 0]) +
+				            notes [i, 1] + "</note-content>";
+				list.Add (data);
+			}
+			return list;
+		}
+
+		// What ExportToHtml made before HtmlExporter: the complete note
+		// XML, parsed again and transformed with XslTransform
+		static string LegacyHtml (NoteData data, bool exporting_multiple, string font)
+		{
+			XPathDocument doc = new XPathDocument (new StringReader (NoteArchiver.WriteString (data)));
+			XsltArgumentList args = new XsltArgumentList ();
+			args.AddParam ("exporting-multiple", "", exporting_multiple);
+			args.AddParam ("export-linked", "", false);
+			args.AddParam ("export-linked-all", "", false);
+			args.AddParam ("root-note", "", data.Title);
+			args.AddExtensionObject ("http://beatniksoftware.com/tomboy",
+			                         new PerformanceBenchmark.ExportExtension ());
+			if (font != null)
+				args.AddParam ("font", "", font);
+
+			StringWriter writer = new StringWriter ();
+			legacy.Transform (doc, args, writer);
+			return writer.ToString ();
+		}
+
+		[Test]
+		public void OutputMatchesLegacyTransform ()
+		{
+			foreach (bool exporting_multiple in new bool [] { false, true }) {
+				foreach (string font in new string [] { null, "font-family:'Sans';" }) {
+					HtmlExporter exporter = new HtmlExporter (exporting_multiple, font);
+					foreach (NoteData data in MakeNotes ()) {
+						StringWriter actual = new StringWriter ();
+						exporter.WriteHTMLForNote (actual, data, new PerformanceBenchmark.ExportExtension ());
+						Assert.AreEqual (LegacyHtml (data, exporting_multiple, font), actual.ToString (),
+						                 "HTML export of " + data.Title);
+					}
+				}
+			}
+		}
+
+		[Test]
+		public void ExportWritesEveryFile ()
+		{
+			HtmlExporter exporter = new HtmlExporter (true, null);
+			List<HtmlExportJob> jobs = new List<HtmlExportJob> ();
+			List<NoteData> list = MakeNotes ();
+			for (int i = 0; i < list.Count; i++)
+				jobs.Add (new HtmlExportJob (list [i], Path.Combine (dir, i + ".html"),
+				                             new PerformanceBenchmark.ExportExtension ()));
+			exporter.Export (jobs);
+
+			// Written the same way, so the charset in the output matches
+			string expected_path = Path.Combine (dir, "expected.html");
+			for (int i = 0; i < list.Count; i++) {
+				using (StreamWriter writer = new StreamWriter (expected_path))
+					exporter.WriteHTMLForNote (writer, list [i], new PerformanceBenchmark.ExportExtension ());
+				Assert.AreEqual (File.ReadAllText (expected_path),
+				                 File.ReadAllText (Path.Combine (dir, i + ".html")));
+			}
+		}
+
+		[Test]
+		public void ExportFailureIsThrown ()
+		{
+			HtmlExporter exporter = new HtmlExporter (true, null);
+			List<HtmlExportJob> jobs = new List<HtmlExportJob> ();
+			jobs.Add (new HtmlExportJob (MakeNotes () [0],
+			                             Path.Combine (Path.Combine (dir, "missing"), "a.html"),
+			                             new PerformanceBenchmark.ExportExtension ()));
+			try {
+				exporter.Export (jobs);
+				Assert.Fail ("Exporting into a missing folder succeeded");
+			} catch (System.Reflection.TargetInvocationException e) {
+				Assert.IsInstanceOfType (typeof (DirectoryNotFoundException), e.InnerException);
+			}
+		}
+	}
+}
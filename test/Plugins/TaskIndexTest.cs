@@ -0,0 +1,202 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+using NUnit.Framework;
+using Tomboy.Tasks;
+
+namespace TomboyTest
+{
+	[TestFixture]
+	public class TaskIndexTest
+	{
+		static readonly DateTime today = new DateTime (2012, 5, 10);
+
+		TaskIndex index;
+		int created;
+
+		[SetUp]
+		public void CreateIndex ()
+		{
+			index = new TaskIndex ();
+			created = 0;
+		}
+
+		// Sets the task's data directly, as a loaded task has it, so
+		// that no save is queued
+		Task MakeTask (string summary, DateTime due_date, TaskPriority priority)
+		{
+			string path = Path.Combine ("tasks", Guid.NewGuid ().ToString () + ".task");
+			Task task = Task.CreateNewTask (summary, path, null);
+			task.Data.DueDate = due_date;
+			task.Data.Priority = priority;
+			task.Data.CreateDate = today.AddMinutes (created++);
+			return task;
+		}
+
+		Task AddTask (DateTime due_date)
+		{
+			Task task = MakeTask ("Due " + due_date, due_date, TaskPriority.Normal);
+			index.Update (task);
+			return task;
+		}
+
+		void SetDueDate (Task task, DateTime due_date)
+		{
+			task.Data.DueDate = due_date;
+			index.Update (task);
+		}
+
+		void SetComplete (Task task, bool complete)
+		{
+			task.Data.CompletionDate = complete ? today : DateTime.MinValue;
+			index.Update (task);
+		}
+
+		[Test]
+		public void TopOpenTasksAreSoonestDueFirst ()
+		{
+			Task no_date_old = MakeTask ("No date, old", DateTime.MinValue, TaskPriority.High);
+			Task later = MakeTask ("Later", today.AddDays (2), TaskPriority.High);
+			Task tomorrow_normal = MakeTask ("Tomorrow, normal", today.AddDays (1), TaskPriority.Normal);
+			Task tomorrow_high = MakeTask ("Tomorrow, high", today.AddDays (1), TaskPriority.High);
+			Task no_date_new = MakeTask ("No date, new", DateTime.MinValue, TaskPriority.Low);
+			Task done = MakeTask ("Done", today, TaskPriority.High);
+			done.Data.CompletionDate = today;
+
+			foreach (Task task in new Task [] { no_date_new, done, later, tomorrow_normal,
+			                                    no_date_old, tomorrow_high })
+				index.Update (task);
+
+			Assert.AreEqual (6, index.Count);
+			Assert.AreEqual (5, index.OpenCount);
+			Assert.AreEqual (1, index.CompletedCount);
+			CollectionAssert.AreEqual (new Task [] { tomorrow_high, tomorrow_normal, later,
+			                                         no_date_old, no_date_new },
+			                           index.GetTopOpenTasks (10));
+			CollectionAssert.AreEqual (new Task [] { tomorrow_high, tomorrow_normal },
+			                           index.GetTopOpenTasks (2));
+
+			// Same day and priority: the older task first
+			tomorrow_normal.Data.Priority = TaskPriority.High;
+			index.Update (tomorrow_normal);
+			CollectionAssert.AreEqual (new Task [] { tomorrow_normal, tomorrow_high },
+			                           index.GetTopOpenTasks (2));
+
+			SetComplete (tomorrow_normal, true);
+			Assert.AreEqual (4, index.OpenCount);
+			Assert.AreEqual (tomorrow_high, index.GetTopOpenTasks (1) [0]);
+		}
+
+		[Test]
+		public void ChangedDueDateReplacesTheOldOne ()
+		{
+			Task task = AddTask (today);
+			Assert.AreEqual (today.AddDays (1), index.NextDeadline);
+
+			SetDueDate (task, today.AddDays (3));
+			Assert.AreEqual (today.AddDays (4), index.NextDeadline);
+			Assert.AreEqual (0, index.TakeOverdue (today.AddDays (2)).Count);
+			CollectionAssert.AreEqual (new Task [] { task }, index.TakeOverdue (today.AddDays (4)));
+			Assert.AreEqual (0, index.TakeOverdue (today.AddDays (10)).Count);
+
+			// A new due date comes due again, even one already past
+			SetDueDate (task, today.AddDays (1));
+			CollectionAssert.AreEqual (new Task [] { task }, index.TakeOverdue (today.AddDays (10)));
+
+			// A save that leaves the due date alone doesn't
+			index.Update (task);
+			Assert.AreEqual (0, index.TakeOverdue (today.AddDays (10)).Count);
+			Assert.AreEqual (DateTime.MaxValue, index.NextDeadline);
+		}
+
+		[Test]
+		public void CompletedTaskComesDueWhenReopened ()
+		{
+			Task task = AddTask (today);
+			SetComplete (task, true);
+			Assert.AreEqual (DateTime.MaxValue, index.NextDeadline);
+			Assert.AreEqual (0, index.TakeOverdue (today.AddDays (5)).Count);
+
+			SetComplete (task, false);
+			CollectionAssert.AreEqual (new Task [] { task }, index.TakeOverdue (today.AddDays (5)));
+
+			// Completing and re-opening after it was taken, too
+			SetComplete (task, true);
+			SetComplete (task, false);
+			CollectionAssert.AreEqual (new Task [] { task }, index.TakeOverdue (today.AddDays (5)));
+			Assert.AreEqual (0, index.TakeOverdue (today.AddDays (5)).Count);
+		}
+
+		[Test]
+		public void RemovedTaskDoesNotComeDue ()
+		{
+			Task removed = AddTask (today);
+			Task kept = AddTask (today.AddDays (1));
+
+			index.Remove (removed);
+			Assert.IsFalse (index.Contains (removed));
+			Assert.AreEqual (1, index.Count);
+			Assert.AreEqual (today.AddDays (2), index.NextDeadline);
+			CollectionAssert.AreEqual (new Task [] { kept }, index.TakeOverdue (today.AddDays (5)));
+
+			// Added back, it is a new task
+			index.Update (removed);
+			CollectionAssert.AreEqual (new Task [] { removed }, index.TakeOverdue (today.AddDays (5)));
+		}
+
+		[Test]
+		public void RebuildKeepsCurrentDueDates ()
+		{
+			Task first = AddTask (today.AddDays (1));
+			Task second = AddTask (today.AddDays (2));
+			Task changing = AddTask (today.AddDays (3));
+
+			// Far more stale heap items than tasks, so the heap is
+			// rebuilt several times over
+			for (int i = 0; i < 100; i++)
+				SetDueDate (changing, today.AddDays (10 + i));
+			for (int i = 0; i < 50; i++)
+				index.Remove (AddTask (today));
+
+			Assert.AreEqual (3, index.Count);
+			Assert.AreEqual (today.AddDays (2), index.NextDeadline);
+			CollectionAssert.AreEqual (new Task [] { first, second },
+			                           index.TakeOverdue (today.AddDays (100)));
+			CollectionAssert.AreEqual (new Task [] { changing },
+			                           index.TakeOverdue (today.AddDays (200)));
+			Assert.AreEqual (DateTime.MaxValue, index.NextDeadline);
+		}
+
+		[Test]
+		public void OverdueIsOpenAndPastTheDueDay ()
+		{
+			DateTime now = DateTime.Now;
+			Assert.IsFalse (MakeTask ("No date", DateTime.MinValue, TaskPriority.Normal).IsOverdue);
+			Assert.IsFalse (MakeTask ("Today", now, TaskPriority.Normal).IsOverdue);
+			Task yesterday = MakeTask ("Yesterday", now.AddDays (-1), TaskPriority.Normal);
+			Assert.IsTrue (yesterday.IsOverdue);
+			yesterday.Data.CompletionDate = now;
+			Assert.IsFalse (yesterday.IsOverdue);
+		}
+
+		[Test]
+		public void DueDatesPastAtLoadDoNotComeDue ()
+		{
+			DateTime loaded_at = today.AddDays (5);
+			Task past = MakeTask ("Past", today, TaskPriority.Normal);
+			Task future = MakeTask ("Future", today.AddDays (7), TaskPriority.Normal);
+			index.Update (past, loaded_at);
+			index.Update (future, loaded_at);
+
+			// Still listed as the first open task
+			Assert.AreEqual (past, index.GetTopOpenTasks (1) [0]);
+			Assert.AreEqual (today.AddDays (8), index.NextDeadline);
+			CollectionAssert.AreEqual (new Task [] { future }, index.TakeOverdue (today.AddDays (10)));
+
+			// Given a new due date, it comes due as usual
+			SetDueDate (past, today.AddDays (11));
+			CollectionAssert.AreEqual (new Task [] { past }, index.TakeOverdue (today.AddDays (20)));
+		}
+	}
+}
@@ -0,0 +1,156 @@
+namespace TomboyTest
+{
+	using System;
+	using System.Collections.Generic;
+	using System.IO;
+	using NUnit.Framework;
+	using Tomboy;
+
+	[TestFixture]
+	public class SegmentNoteStoreTest
+	{
+		string dir;
+		string backup_dir;
+		SegmentNoteStore store;
+
+		[SetUp]
+		public void CreateStore ()
+		{
+			dir = Path.Combine (Path.GetTempPath (),
+			                    "tomboy-store-" + Guid.NewGuid ().ToString ());
+			backup_dir = Path.Combine (dir, "Backup");
+			Directory.CreateDirectory (dir);
+			store = new SegmentNoteStore (dir, backup_dir);
+			store.Open ();
+		}
+
+		[TearDown]
+		public void RemoveStore ()
+		{
+			store.Close ();
+			Directory.Delete (dir, true);
+		}
+
+		string PathFor (int i)
+		{
+			return Path.Combine (dir, "note-" + i + ".note");
+		}
+
+		static NoteData MakeNote (int i, string body)
+		{
+			NoteData data = new NoteData ("note://tomboy/note-" + i);
+			data.Title = "Note " + i;
+			data.Text = "<note-content version=\"0.1\">Note " + i + "\n\n" + body + "</note-content>";
+			data.CreateDate = new DateTime (2011, 10, 31, 12, 0, 0);
+			data.ChangeDate = data.CreateDate.AddMinutes (i);
+			data.MetadataChangeDate = data.ChangeDate;
+			return data;
+		}
+
+		void Reopen ()
+		{
+			store.Close ();
+			store = new SegmentNoteStore (dir, backup_dir);
+			store.Open ();
+		}
+
+		[Test]
+		public void NotesSurviveReopen ()
+		{
+			for (int i = 0; i < 20; i++)
+				store.Write (PathFor (i), MakeNote (i, "first"));
+			store.Write (PathFor (3), MakeNote (3, "second"));
+			store.Delete (PathFor (5));
+			Reopen ();
+
+			Assert.AreEqual (19, store.GetNotePaths ().Count);
+			Assert.AreEqual (MakeNote (3, "second").Text,
+			                 store.Read (PathFor (3), "note://tomboy/note-3").Text);
+			Assert.IsTrue (File.Exists (Path.Combine (backup_dir, "note-5.note")));
+		}
+
+		[Test]
+		public void CompactKeepsLatestNotes ()
+		{
+			for (int i = 0; i < 20; i++)
+				store.Write (PathFor (i), MakeNote (i, "first"));
+			store.Compact ();
+			Assert.AreEqual (8, store.LogSize);
+
+			store.Write (PathFor (7), MakeNote (7, "after"));
+			Reopen ();
+
+			Assert.AreEqual (20, store.GetNotePaths ().Count);
+			Assert.AreEqual (MakeNote (7, "after").Text,
+			                 store.Read (PathFor (7), "note://tomboy/note-7").Text);
+			Assert.AreEqual (MakeNote (8, "first").Text,
+			                 store.Read (PathFor (8), "note://tomboy/note-8").Text);
+		}
+
+		[Test]
+		public void CutShortRecordIsDropped ()
+		{
+			store.Write (PathFor (1), MakeNote (1, "kept"));
+			store.Write (PathFor (2), MakeNote (2, "cut short"));
+			store.Close ();
+
+			string log_path = Path.Combine (dir, "notes.wal");
+			using (FileStream log = new FileStream (log_path, FileMode.Open))
+				log.SetLength (log.Length - 10);
+			store = new SegmentNoteStore (dir, backup_dir);
+			store.Open ();
+
+			ICollection<string> paths = store.GetNotePaths ();
+			Assert.AreEqual (1, paths.Count);
+			Assert.IsTrue (paths.Contains (PathFor (1)));
+		}
+
+		[Test]
+		public void GetFileIsRemovedOnClose ()
+		{
+			store.Write (PathFor (1), MakeNote (1, "handed out"));
+			string file = store.GetFile (PathFor (1));
+			Assert.IsFalse (file.StartsWith (dir));
+			CollectionAssert.AreEqual (store.ReadBytes (PathFor (1)), File.ReadAllBytes (file));
+			Assert.IsNull (store.GetFile (PathFor (2)));
+
+			store.Close ();
+			Assert.IsFalse (File.Exists (file));
+		}
+
+		[Test]
+		public void WriteAfterCloseOpensAgain ()
+		{
+			store.Write (PathFor (1), MakeNote (1, "before"));
+			store.Close ();
+			store.Write (PathFor (2), MakeNote (2, "after"));
+			Reopen ();
+
+			Assert.AreEqual (2, store.GetNotePaths ().Count);
+			Assert.AreEqual (MakeNote (2, "after").Text,
+			                 store.Read (PathFor (2), "note://tomboy/note-2").Text);
+		}
+
+		[Test]
+		public void ExportMatchesNoteArchiver ()
+		{
+			string export_dir = Path.Combine (dir, "export");
+			for (int i = 0; i < 5; i++)
+				store.Write (PathFor (i), MakeNote (i, "exported"));
+			Assert.AreEqual (5, store.ExportDirectory (export_dir));
+
+			string archived = Path.Combine (dir, "archived.note");
+			NoteArchiver.Write (archived, MakeNote (2, "exported"));
+			CollectionAssert.AreEqual (File.ReadAllBytes (archived),
+			                           File.ReadAllBytes (Path.Combine (export_dir, "note-2.note")));
+
+			SegmentNoteStore imported = new SegmentNoteStore (export_dir, null);
+			imported.Open ();
+			Assert.AreEqual (5, imported.ImportDirectory (export_dir, true));
+			Assert.AreEqual (0, Directory.GetFiles (export_dir, "*.note").Length);
+			Assert.AreEqual (MakeNote (4, "exported").Text,
+			                 imported.Read (PathFor (4), "note://tomboy/note-4").Text);
+			imported.Close ();
+		}
+	}
+}
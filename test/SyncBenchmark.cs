@@ -0,0 +1,134 @@
+namespace TomboyTest
+{
+	using System;
+	using System.Collections.Generic;
+	using System.Diagnostics;
+	using System.IO;
+	using System.Threading;
+	using NUnit.Framework;
+	using Tomboy;
+	using Tomboy.Sync;
+
+	/// <summary>
+	/// A file system sync server that pretends to live on a slow network
+	/// mount by sleeping before every note transfer.
+	/// </summary>
+	class SlowFileSystemSyncServer : FileSystemSyncServer
+	{
+		public int LatencyMs;
+
+		public SlowFileSystemSyncServer (string path, int latencyMs) :
+			base (path)
+		{
+			LatencyMs = latencyMs;
+		}
+
+		protected override string ReadServerFile (string path)
+		{
+			Thread.Sleep (LatencyMs);
+			return base.ReadServerFile (path);
+		}
+
+		protected override void WriteToServer (string serverPath, byte [] data)
+		{
+			Thread.Sleep (LatencyMs);
+			base.WriteToServer (serverPath, data);
+		}
+	}
+
+	/// <summary>
+	/// Measures file system sync throughput against a server with
+	/// injected per-file latency.  Not run by default; use
+	/// "nunit-console TomboyTest.dll /run:TomboyTest.SyncBenchmark".
+	/// </summary>
+	[TestFixture, Explicit]
+	public class SyncBenchmark
+	{
+		const int NOTE_COUNT = 200;
+		const int LATENCY_MS = 20;
+
+		string root;
+		string localPath;
+		List<Note> notes;
+
+		[SetUp]
+		public void CreateNotes ()
+		{
+			root = Path.Combine (Path.GetTempPath (),
+			                     "tomboy-sync-bench-" + Guid.NewGuid ().ToString ());
+			localPath = Path.Combine (root, "local");
+			Directory.CreateDirectory (localPath);
+
+			notes = new List<Note> ();
+			for (int i = 0; i < NOTE_COUNT; i++) {
+				string path = Path.Combine (localPath, Guid.NewGuid ().ToString () + ".note");
+				NoteData data = new NoteData ("note://tomboy/" + Path.GetFileNameWithoutExtension (path));
+				data.Title = "Benchmark note " + i;
+				data.Text = "<note-content version=\"0.1\">" + data.Title + "\n\n" +
+				            new string ('x', 2048) + "</note-content>";
+				data.CreateDate = DateTime.Now;
+				data.ChangeDate = data.CreateDate;
+				NoteArchiver.Write (path, data);
+				notes.Add (Note.CreateExistingNote (data, path, null));
+			}
+		}
+
+		[TearDown]
+		public void RemoveNotes ()
+		{
+			if (Directory.Exists (root))
+				Directory.Delete (root, true);
+		}
+
+		string CreateServer ()
+		{
+			string serverPath = Path.Combine (root, "server-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (serverPath);
+			return serverPath;
+		}
+
+		double Upload (string serverPath, int workers)
+		{
+			SlowFileSystemSyncServer server = new SlowFileSystemSyncServer (serverPath, LATENCY_MS);
+			server.MaxParallelTransfers = workers;
+			Assert.IsTrue (server.BeginSyncTransaction ());
+
+			Stopwatch watch = Stopwatch.StartNew ();
+			server.UploadNotes (notes);
+			watch.Stop ();
+
+			Assert.IsTrue (server.CommitSyncTransaction ());
+			return watch.Elapsed.TotalSeconds;
+		}
+
+		double Download (string serverPath, int workers)
+		{
+			SlowFileSystemSyncServer server = new SlowFileSystemSyncServer (serverPath, LATENCY_MS);
+			server.MaxParallelTransfers = workers;
+
+			Stopwatch watch = Stopwatch.StartNew ();
+			IDictionary<string, NoteUpdate> updates = server.GetNoteUpdatesSince (-1);
+			watch.Stop ();
+
+			Assert.AreEqual (NOTE_COUNT, updates.Count);
+			return watch.Elapsed.TotalSeconds;
+		}
+
+		void Report (string what, int workers, double seconds)
+		{
+			Console.WriteLine ("{0,-8} workers={1,-2} {2,7:F2}s {3,8:F1} notes/s",
+			                   what, workers, seconds, NOTE_COUNT / seconds);
+		}
+
+		[Test]
+		public void Throughput ()
+		{
+			Console.WriteLine ("{0} notes, {1} ms latency per file", NOTE_COUNT, LATENCY_MS);
+			foreach (int workers in new int [] { 1, FileSystemSyncServer.DEFAULT_MAX_PARALLEL_TRANSFERS }) {
+				string serverPath = CreateServer ();
+				Report ("upload", workers, Upload (serverPath, workers));
+				Report ("download", workers, Download (serverPath, workers));
+			}
+		}
+	}
+}
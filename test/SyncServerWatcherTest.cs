@@ -0,0 +1,102 @@
+namespace TomboyTest
+{
+	using System;
+	using System.IO;
+	using System.Threading;
+	using NUnit.Framework;
+	using Tomboy.Sync;
+
+	[TestFixture]
+	public class SyncServerWatcherTest
+	{
+		string dir;
+		SyncServerWatcher watcher;
+
+		[SetUp]
+		public void CreateWatcher ()
+		{
+			dir = Path.Combine (Path.GetTempPath (),
+			                    "tomboy-watch-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (dir);
+			watcher = new SyncServerWatcher (dir);
+		}
+
+		[TearDown]
+		public void RemoveWatcher ()
+		{
+			watcher.Dispose ();
+			Directory.Delete (dir, true);
+		}
+
+		void WriteManifest ()
+		{
+			File.WriteAllText (Path.Combine (dir, "manifest.xml"),
+			                   "<sync revision=\"" + DateTime.Now.Ticks + "\" />");
+		}
+
+		bool WaitForChange (int timeoutMs)
+		{
+			for (int waited = 0; waited < timeoutMs; waited += 50) {
+				if (watcher.TakeChange ())
+					return true;
+				Thread.Sleep (50);
+			}
+			return false;
+		}
+
+		[Test]
+		public void FirstCheckReportsChange ()
+		{
+			Assert.IsTrue (watcher.TakeChange ());
+			Assert.IsFalse (watcher.TakeChange ());
+		}
+
+		[Test]
+		public void OwnChangeWindow ()
+		{
+			DateTime now = DateTime.UtcNow;
+			Assert.IsFalse (watcher.IsOwnChange (now));
+
+			watcher.BeginOwnChange ();
+			Assert.IsTrue (watcher.IsOwnChange (now));
+			Assert.IsTrue (watcher.IsOwnChange (now.AddHours (1)));
+
+			watcher.EndOwnChange ();
+			now = DateTime.UtcNow;
+			Assert.IsTrue (watcher.IsOwnChange (now));
+			Assert.IsTrue (watcher.IsOwnChange (now + SyncServerWatcher.OwnChangeGrace - TimeSpan.FromSeconds (1)));
+			Assert.IsFalse (watcher.IsOwnChange (now + SyncServerWatcher.OwnChangeGrace + TimeSpan.FromSeconds (1)));
+		}
+
+		[Test]
+		public void OwnChangesNest ()
+		{
+			watcher.BeginOwnChange ();
+			watcher.BeginOwnChange ();
+			watcher.EndOwnChange ();
+			DateTime later = DateTime.UtcNow + SyncServerWatcher.OwnChangeGrace + TimeSpan.FromSeconds (1);
+			Assert.IsTrue (watcher.IsOwnChange (later));
+			watcher.EndOwnChange ();
+			Assert.IsFalse (watcher.IsOwnChange (later.AddSeconds (1)));
+		}
+
+		[Test]
+		public void OtherClientsCommitIsNoticed ()
+		{
+			watcher.TakeChange ();
+			WriteManifest ();
+			Assert.IsTrue (WaitForChange (5000));
+		}
+
+		[Test]
+		public void OwnCommitIsIgnored ()
+		{
+			watcher.TakeChange ();
+			watcher.BeginOwnChange ();
+			WriteManifest ();
+			watcher.EndOwnChange ();
+			// Late events fall inside the grace period too
+			Assert.IsFalse (WaitForChange (2000));
+		}
+	}
+}
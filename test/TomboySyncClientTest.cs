@@ -0,0 +1,119 @@
+namespace TomboyTest
+{
+	using System;
+	using System.IO;
+	using System.Text;
+	using NUnit.Framework;
+	using Tomboy;
+	using Tomboy.Sync;
+
+	[TestFixture]
+	public class TomboySyncClientTest
+	{
+		string dir;
+		string manifest_path;
+		string journal_path;
+
+		[SetUp]
+		public void CreateDirectory ()
+		{
+			dir = Path.Combine (Path.GetTempPath (),
+			                    "tomboy-sync-client-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (dir);
+			manifest_path = Path.Combine (dir, "manifest.xml");
+			journal_path = manifest_path + ".journal";
+		}
+
+		[TearDown]
+		public void RemoveDirectory ()
+		{
+			Directory.Delete (dir, true);
+		}
+
+		static Note MakeNote (string id)
+		{
+			NoteData data = new NoteData ("note://tomboy/" + id);
+			data.Title = id;
+			return Note.CreateExistingNote (data, "/tmp/" + id + ".note", null);
+		}
+
+		void AppendToJournal (string text)
+		{
+			using (FileStream fs = new FileStream (journal_path, FileMode.Append))
+			using (StreamWriter writer = new StreamWriter (fs, new UTF8Encoding (false)))
+				writer.Write (text);
+		}
+
+		[Test]
+		public void JournalIsReplayed ()
+		{
+			TomboySyncClient client = new TomboySyncClient (manifest_path, null);
+			client.AssociatedServerId = "server";
+			client.SetRevision (MakeNote ("a"), 3, "hash-a");
+			client.SetRevision (MakeNote ("b"), 4, null);
+			client.SetRevision (MakeNote ("a"), 5, "hash-a2");
+			client.LastSynchronizedRevision = 5;
+			client.Flush ();
+			Assert.IsTrue (File.Exists (journal_path));
+
+			// Start over as if Tomboy had crashed before compacting
+			client = new TomboySyncClient (manifest_path, null);
+			Assert.AreEqual ("server", client.AssociatedServerId);
+			Assert.AreEqual (5, client.GetRevision (MakeNote ("a")));
+			Assert.AreEqual ("hash-a2", client.GetContentHash (MakeNote ("a")));
+			Assert.AreEqual (4, client.GetRevision (MakeNote ("b")));
+			Assert.IsNull (client.GetContentHash (MakeNote ("b")));
+			Assert.AreEqual (5, client.LastSynchronizedRevision);
+
+			// Replaying compacts the journal into the manifest
+			Assert.IsFalse (File.Exists (journal_path));
+			client = new TomboySyncClient (manifest_path, null);
+			Assert.AreEqual (5, client.GetRevision (MakeNote ("a")));
+		}
+
+		[Test]
+		public void EscapedFieldsSurviveReplay ()
+		{
+			new TomboySyncClient (manifest_path, null);
+			AppendToJournal ("deleted\tc\tTab\\there\\nand \\\\ newline\n");
+
+			TomboySyncClient client = new TomboySyncClient (manifest_path, null);
+			Assert.AreEqual ("Tab\there\nand \\ newline", client.DeletedNoteTitles ["c"]);
+		}
+
+		[Test]
+		public void TornLastRecordIsIgnored ()
+		{
+			new TomboySyncClient (manifest_path, null);
+			AppendToJournal ("rev\ta\t7\thash-a\nrev\tb\t8\thas");
+
+			TomboySyncClient client = new TomboySyncClient (manifest_path, null);
+			Assert.AreEqual (7, client.GetRevision (MakeNote ("a")));
+			Assert.AreEqual ("hash-a", client.GetContentHash (MakeNote ("a")));
+			Assert.AreEqual (-1, client.GetRevision (MakeNote ("b")));
+		}
+
+		[Test]
+		public void BadRecordIsSkipped ()
+		{
+			new TomboySyncClient (manifest_path, null);
+			AppendToJournal ("rev\ta\tnot-a-number\t\nbogus\tx\nrev\tb\t2\t\n");
+
+			TomboySyncClient client = new TomboySyncClient (manifest_path, null);
+			Assert.AreEqual (-1, client.GetRevision (MakeNote ("a")));
+			Assert.AreEqual (2, client.GetRevision (MakeNote ("b")));
+		}
+
+		[Test]
+		public void DeletionForgetsRevision ()
+		{
+			new TomboySyncClient (manifest_path, null);
+			AppendToJournal ("rev\ta\t1\thash-a\ndeleted\ta\tTitle A\n");
+
+			TomboySyncClient client = new TomboySyncClient (manifest_path, null);
+			Assert.AreEqual (-1, client.GetRevision (MakeNote ("a")));
+			Assert.IsNull (client.GetContentHash (MakeNote ("a")));
+			Assert.AreEqual ("Title A", client.DeletedNoteTitles ["a"]);
+		}
+	}
+}
@@ -0,0 +1,117 @@
+namespace TomboyTest
+{
+	using System;
+	using System.IO;
+	using System.Threading;
+	using NUnit.Framework;
+	using Tomboy;
+
+	[TestFixture]
+	public class XmlPreferencesClientTest
+	{
+		const string WindowX = "/apps/tomboy/window_x";
+		const string SyncState = "/apps/tomboy/sync_state";
+
+		string dir;
+		string file;
+
+		[SetUp]
+		public void CreateDirectory ()
+		{
+			dir = Path.Combine (Path.GetTempPath (),
+			                    "tomboy-prefs-" + Guid.NewGuid ().ToString ());
+			Directory.CreateDirectory (dir);
+			file = Path.Combine (dir, "prefs.xml");
+		}
+
+		[TearDown]
+		public void RemoveDirectory ()
+		{
+			Directory.Delete (dir, true);
+		}
+
+		[Test]
+		public void BurstOfSetsIsWrittenOnce ()
+		{
+			// Written only when asked, however long the sets take
+			XmlPreferencesClient client = new XmlPreferencesClient (file, Timeout.Infinite);
+			int notified = 0;
+			client.AddNotify ("/apps/tomboy", delegate { notified++; });
+
+			for (int i = 0; i < 500; i++) {
+				client.Set (WindowX, i);
+				client.Set (SyncState, i % 2 == 0);
+			}
+
+			// Every change is seen straight away...
+			Assert.AreEqual (1000, notified);
+			Assert.AreEqual (499, client.Get (WindowX));
+			Assert.AreEqual (false, client.Get (SyncState));
+			// ...but none is written yet
+			Assert.AreEqual (0, client.WriteCount);
+
+			client.SuggestSync ();
+			Assert.AreEqual (1, client.WriteCount);
+			client.SuggestSync ();
+			Assert.AreEqual (1, client.WriteCount, "Nothing new to write");
+
+			XmlPreferencesClient reloaded = new XmlPreferencesClient (file);
+			Assert.AreEqual (499, reloaded.Get (WindowX));
+			Assert.AreEqual (false, reloaded.Get (SyncState));
+		}
+
+		[Test]
+		public void WritesAfterDelay ()
+		{
+			XmlPreferencesClient client = new XmlPreferencesClient (file, 50);
+			client.Set (WindowX, 10);
+			client.Set (WindowX, 20);
+
+			for (int waited = 0; client.WriteCount == 0 && waited < 5000; waited += 50)
+				Thread.Sleep (50);
+			Assert.AreEqual (1, client.WriteCount);
+			Assert.AreEqual (20, new XmlPreferencesClient (file).Get (WindowX));
+			Assert.IsFalse (File.Exists (file + ".tmp"));
+		}
+
+		[Test]
+		public void ReplacesExistingFile ()
+		{
+			XmlPreferencesClient client = new XmlPreferencesClient (file, Timeout.Infinite);
+			client.Set (WindowX, 1);
+			client.Flush ();
+			client.Set (WindowX, 2);
+			client.Flush ();
+
+			Assert.AreEqual (2, client.WriteCount);
+			Assert.AreEqual (2, new XmlPreferencesClient (file).Get (WindowX));
+			Assert.AreEqual (1, Directory.GetFiles (dir).Length);
+		}
+
+		[Test]
+		public void FailedSaveIsKept ()
+		{
+			// A file where the directory should be makes the save fail
+			string blocker = Path.Combine (dir, "config");
+			File.WriteAllText (blocker, string.Empty);
+			string blocked_file = Path.Combine (blocker, "prefs.xml");
+
+			XmlPreferencesClient client = new XmlPreferencesClient (blocked_file, Timeout.Infinite);
+			client.Set (WindowX, 5);
+			client.Flush ();
+			Assert.AreEqual (0, client.WriteCount);
+
+			File.Delete (blocker);
+			client.Flush ();
+			Assert.AreEqual (1, client.WriteCount);
+			Assert.AreEqual (5, new XmlPreferencesClient (blocked_file).Get (WindowX));
+		}
+
+		[Test]
+		[ExpectedException (typeof (NoSuchKeyException))]
+		public void MissingKey ()
+		{
+			new XmlPreferencesClient (file).Get ("/apps/tomboy/no_such_key");
+		}
+	}
+}
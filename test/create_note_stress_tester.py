@@ -13,6 +13,9 @@ try:
 except:
 	num_notes = 10
 
+# "bulk" creates all the notes with one CreateNotes call
+bulk = len(sys.argv) > 2 and sys.argv[2] == "bulk"
+
 bus = dbus.SessionBus()
 obj = bus.get_object("org.gnome.Tomboy", "/org/gnome/Tomboy/RemoteControl")
 tomboy = dbus.Interface(obj, "org.gnome.Tomboy.RemoteControl")
@@ -36,6 +39,20 @@ def get_random_word():
 			pass
 
 # Create lots of notes
+if bulk:
+	titles = []
+	texts = []
+	for i in range(0,num_notes-1):
+		titles.append(get_random_word())
+		texts.append(get_random_word())
+
+	start = time.time()
+	tomboy.CreateNotes(titles, texts)
+	end = time.time()
+
+	print "%s notes,%f" % (len(titles), end - start)
+	sys.exit(0)
+
 for i in range(0,num_notes-1):
 	title = get_random_word()
 	text = get_random_word()